@@ -35,8 +35,14 @@
 #include <esp32_utilities.h>
 
 //******************** R/W TESTS CONFIGURATION
-#define BLOCKS_TO_WRITE 1000 // Blocks of 512 bytes
-#define BLOCKS_TO_READ 1000  // Blocks of 512 bytes
+#define BLOCKS_TO_WRITE 1000         // Blocks of 512 bytes
+#define BLOCKS_TO_READ 1000          // Blocks of 512 bytes
+#define STREAM_MB_TO_WRITE 16        // Written through EMMC_StreamWriter
+#define STREAM_RECORD_SIZE 48        // Bytes per write() call, like a small binary sensor record
+#define BYTEWISE_READ_BYTES 262144   // Read one byte per call, for comparison
+#define READ_INTO_BYTES 131072       // File read whole with readFileInto
+#define BENCHMARK_FILE_BYTES 4194304 // EMMC_Benchmark test file, for each of BENCHMARK_BLOCK_SIZES
+#define BENCHMARK_BLOCK_SIZES {512, 4096, 32768}
 
 //******************** SETTINGS
 
@@ -47,6 +53,8 @@
 #define EMMC_MODE true   // Set to false to use SPI
 #define _4_BIT_MODE true // Set to use card in 4-bit mode
 
+#define BUS_FREQUENCY_kHZ 20000 // SDMMC up to 40000 (high speed, short traces only). Same for SPI
+
 #define CD_PIN 13 // Card Detect pin
 #define EN_PIN -1 // Enable pin
 
@@ -54,13 +62,17 @@
 SystemOnChip esp;
 Terminal terminal;
 EMMC_Memory emmc;
+EMMC_StreamWriter stream;
+EMMC_Benchmark benchmark;
 
 //******************** INTERRUPTS
 
 //********************  METHODS
 void handleCardDetectPinChange();
 void runWriteTest();
-void runReadTest(); // TODO: Implement read test
+void runStreamTest();
+void runReadTest();
+void runBenchmark();
 
 //********************  SETUP
 void setup()
@@ -79,6 +91,7 @@ void setup()
 
     // 3. Init eMMC
     long initial_time = micros();
+    emmc.setBusFrequency(BUS_FREQUENCY_kHZ);
     ESP_ERROR initialize_emmc = emmc.begin(EN_PIN, CD_PIN, eMMC_MODE, MODE_1_BIT);
 
     if (initialize_emmc.on_error)
@@ -103,7 +116,9 @@ void loop()
     {
         // 2.1 Run a small test that saves 5Mb of data
         runWriteTest();
+        runStreamTest();
         runReadTest();
+        runBenchmark();
     }
 }
 
@@ -121,7 +136,7 @@ void runWriteTest()
     }
 
     // 2. Initial write to create file
-    ESP_ERROR create_file = emmc.writeFile("/write_test.txt", data);
+    ESP_ERROR create_file = emmc.writeFile("/write_test.txt", data, sizeof(data));
     if (create_file.on_error)
     {
         terminal.printMessage(TerminalMessage(create_file.debug_message, "MMC", ERROR, micros()));
@@ -157,8 +172,141 @@ void runWriteTest()
     esp.uart0.println();
 }
 
+void runStreamTest()
+{
+    terminal.printMessage(TerminalMessage("Running stream write test ...", "MMC", INFO, micros()));
+
+    // 1. Open the stream. 2 blocks of 32 KB, the writer task on core 0
+    ESP_ERROR open_stream = stream.begin(emmc, "/stream_test.bin");
+    if (open_stream.on_error)
+    {
+        terminal.printMessage(TerminalMessage(open_stream.debug_message, "MMC", ERROR, micros()));
+        return;
+    }
+
+    // 2. Write small binary records, as a sensor task would
+    uint8_t record[STREAM_RECORD_SIZE];
+    uint32_t max_call_time = 0;
+    long initial_time = micros();
+
+    for (uint32_t i = 0; i < STREAM_MB_TO_WRITE * 1000000UL / STREAM_RECORD_SIZE; i++)
+    {
+        memcpy(record, &i, sizeof(i));
+        record[sizeof(i)] = 0; // NUL bytes are fine
+
+        uint32_t call_time = micros();
+        stream.write(record, sizeof(record));
+        max_call_time = max(max_call_time, (uint32_t)(micros() - call_time));
+    }
+
+    ESP_ERROR close_stream = stream.close();
+    if (close_stream.on_error)
+    {
+        terminal.printMessage(TerminalMessage(close_stream.debug_message, "MMC", ERROR, micros()));
+    }
+
+    // 3. Display stats to user
+    terminal.printMessage(TerminalMessage("Stream test done: ", "MMC", INFO, micros(), micros() - initial_time));
+    esp.uart0.println();
+
+    EMMC_StreamStats stats = stream.getStats();
+    terminal.println("Bytes written: " + String((uint32_t)stats.bytes_written) + " bytes in " + String(stats.blocks_written) + " blocks");
+    terminal.println("Sustained write speed: " + String(stats.sustained_MBps, 2) + " MB/s");
+    terminal.println("Write speed while writing: " + String(stats.write_MBps, 2) + " MB/s");
+    terminal.println("Worst block write latency: " + String(stats.max_write_latency_us / 1000.0, 2) + " mS");
+    terminal.println("Worst write() call: " + String(max_call_time) + " uS, " + String(stats.producer_stalls) + " stalls");
+
+    esp.uart0.println();
+}
+
 void runReadTest()
 {
+    terminal.printMessage(TerminalMessage("Running read speed test ...", "MMC", INFO, micros()));
+
+    // 1. One byte per call, as a String is built one char at a time
+    File file = emmc.getFileSystem()->open("/stream_test.bin");
+    uint32_t checksum = 0;
+    long initial_time = micros();
+
+    for (uint32_t i = 0; i < BYTEWISE_READ_BYTES && file.available(); i++)
+    {
+        checksum += file.read();
+    }
+
+    long bytewise_time = micros() - initial_time;
+    file.close();
+
+    // 2. The whole stream test file, in chunks of EMMC_READ_CHUNK_SIZE
+    size_t total = 0;
+    initial_time = micros();
+
+    ESP_ERROR read_chunks = emmc.readFile("/stream_test.bin", [&](const uint8_t *data, size_t length)
+                                          {
+                                              checksum += data[0];
+                                              total += length;
+                                              return true;
+                                          });
+
+    long chunked_time = micros() - initial_time;
+
+    // 3. A smaller file read whole, with a single call
+    uint8_t *buffer = (uint8_t *)heap_caps_malloc(READ_INTO_BYTES, MALLOC_CAP_DMA);
+    size_t bytes_read = 0;
+    long read_into_time = 0;
+
+    if (buffer != nullptr)
+    {
+        memset(buffer, 0x55, READ_INTO_BYTES);
+        emmc.writeFile("/read_test.bin", buffer, READ_INTO_BYTES);
+
+        initial_time = micros();
+        ESP_ERROR read_into = emmc.readFileInto("/read_test.bin", buffer, READ_INTO_BYTES, bytes_read);
+        read_into_time = micros() - initial_time;
+
+        if (read_into.on_error)
+        {
+            terminal.printMessage(TerminalMessage(read_into.debug_message, "MMC", ERROR, micros()));
+        }
+        heap_caps_free(buffer);
+    }
+
+    if (read_chunks.on_error)
+    {
+        terminal.printMessage(TerminalMessage(read_chunks.debug_message, "MMC", ERROR, micros()));
+    }
+
+    // 4. Display stats to user
+    terminal.printMessage(TerminalMessage("Reading test done: ", "MMC", INFO, micros()));
+    esp.uart0.println();
+
+    terminal.println("Byte per call: " + String((double)BYTEWISE_READ_BYTES / bytewise_time, 2) + " MB/s");
+    terminal.println("Chunks of " + String(EMMC_READ_CHUNK_SIZE) + " bytes: " + String((double)total / chunked_time, 2) + " MB/s");
+    terminal.println("Whole file: " + String((double)bytes_read / read_into_time, 2) + " MB/s");
+    terminal.println("Checksum: " + String(checksum));
+
+    esp.uart0.println();
+}
+
+void runBenchmark()
+{
+    terminal.printMessage(TerminalMessage("Running storage benchmark ...", "MMC", INFO, micros()));
+
+    // Sequential and random, read and write, for each block size. Takes a few seconds per block size
+    const size_t block_sizes[] = BENCHMARK_BLOCK_SIZES;
+    for (size_t block_size : block_sizes)
+    {
+        EMMC_BenchmarkResult result;
+        ESP_ERROR run = benchmark.run(emmc, block_size, result, BENCHMARK_FILE_BYTES);
+
+        if (run.on_error)
+        {
+            terminal.printMessage(TerminalMessage(run.debug_message, "MMC", ERROR, micros()));
+            return;
+        }
+        terminal.println(EMMC_Benchmark::toString(result));
+    }
+
+    esp.uart0.println();
 }
 
 void handleCardDetectPinChange()
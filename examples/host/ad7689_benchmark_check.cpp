@@ -0,0 +1,209 @@
+/*
+ * File Name: ad7689_benchmark_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Runs AD7689Benchmark on an AD7689 talking to an AD7689Model on the SPI stand-in, with the timer backend paced by a simulated tick
+// source instead of a hardware timer (see AD7689TickSource). The rates are PC rates, only the bookkeeping is checked.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/adc/ad7689 examples/host/ad7689_benchmark_check.cpp
+//       src/libraries/adc/ad7689/ad7689.cpp src/libraries/adc/ad7689/ad7689_benchmark.cpp -o ad7689_benchmark_check
+//   ./ad7689_benchmark_check
+//
+// Checks:
+//  - the self-test passes on the model;
+//  - both paced backends hold the requested rate, with every scan in the latency histogram;
+//  - the timer backend sees the wake-up latency of the tick source, and counts the ticks it missed as overruns;
+//  - bus load is the time spent in the frames, the same for both backends, and the timer backend's CPU load adds the
+//    wake-up latency to it;
+//  - the timer backend is unsupported without a tick source, or when it can't start; DMA is always unsupported;
+//  - the JSON report has every backend, and bad parameters are refused.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <ad7689_benchmark.h>
+
+#include "ad7689_model.h"
+
+//******************** SETTINGS
+#define CS_PIN 32
+#define DURATION_mS 200
+#define PACED_RATE 1000
+#define WAKE_UP_uS 3        // Simulated interrupt and context switch
+#define FRAME_uS 10         // Simulated bus time of a frame
+#define RATE_TOLERANCE 0.05 // Relative
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+// -- Ticks on the simulated clock: wait() jumps to the next tick, plus the wake-up latency
+class SimulatedTicks : public AD7689TickSource
+{
+public:
+    bool start_fails = false;
+    uint32_t skip_every = 0; // Every skip_every waits, miss a tick
+
+    bool start(uint32_t period_us) override
+    {
+        period_ns = period_us * 1000ULL;
+        next_ns = hostNanos() + period_ns;
+        waits = 0;
+        running = !start_fails;
+        return running;
+    }
+
+    uint32_t wait(uint32_t timeout_ms, uint32_t *tick_cycles) override
+    {
+        if (!running)
+        {
+            return 0;
+        }
+
+        // -- Busy for two periods: the first tick due meanwhile is missed
+        if (skip_every && ++waits % skip_every == 0)
+        {
+            hostAdvance(2 * period_ns / 1000);
+        }
+
+        uint64_t now = hostNanos();
+        if (next_ns > now + timeout_ms * 1000000ULL)
+        {
+            return 0;
+        }
+
+        // -- Every tick due by now, the last one wakes us up
+        uint32_t pending = 1;
+        if (now > next_ns)
+        {
+            pending += (now - next_ns) / period_ns;
+            next_ns += (pending - 1) * period_ns;
+        }
+        else
+        {
+            hostAdvance((next_ns - now + 999) / 1000);
+        }
+
+        *tick_cycles = (uint32_t)(next_ns * HOST_CPU_MHZ / 1000);
+        hostAdvance(WAKE_UP_uS);
+        next_ns += period_ns;
+        return pending;
+    }
+
+    void stop() override { running = false; }
+
+private:
+    uint64_t period_ns = 0;
+    uint64_t next_ns = 0;
+    uint32_t waits = 0;
+    bool running = false;
+};
+
+class ReportText : public Print
+{
+public:
+    String text;
+    size_t write(uint8_t data) override
+    {
+        text += String((char)data);
+        return 1;
+    }
+};
+
+static bool near(float value, float target)
+{
+    return fabs(value - target) <= target * RATE_TOLERANCE;
+}
+
+static uint32_t histogramTotal(const AD7689_jitter &jitter)
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < BENCHMARK_JITTER_BINS; i++)
+    {
+        total += jitter.histogram[i];
+    }
+    return total;
+}
+
+int main()
+{
+    SPIClass bus(VSPI);
+    AD7689Model model;
+    model.setFrameTime(FRAME_uS);
+    bus.attachDevice(CS_PIN, &model);
+    AD7689 adc;
+    adc.begin(CS_PIN, bus, 20000000);
+
+    AD7689Benchmark benchmark(adc);
+    SimulatedTicks ticks;
+    ESP_ERROR err = benchmark.run(DURATION_mS, PACED_RATE, &ticks);
+    AD7689_benchmark_report report = benchmark.getReport();
+
+    ReportText json;
+    benchmark.writeReport(json);
+    printf("%s", json.text.c_str());
+
+    check(!err.on_error && report.selftest, "self-test passes");
+    check(report.frameTime > 0 && report.singleChannelRate > 0 && report.fullScanRate > 0, "frame time and maximum rates measured");
+    check(bus.transactions == 0, "bus released");
+
+    const AD7689_backend_result &blocking = report.blocking;
+    check(blocking.supported && near(blocking.scanRate, PACED_RATE) && blocking.cpuLoad == 1,
+          "blocking: paced rate held, core never released");
+    check(histogramTotal(blocking.jitter) == blocking.jitter.scans && blocking.jitter.min <= blocking.jitter.max,
+          "blocking: every scan in the histogram");
+
+    const AD7689_backend_result &timer = report.timer;
+    check(timer.supported && near(timer.scanRate, PACED_RATE) && timer.jitter.overruns == 0, "timer: paced rate held");
+    check(timer.jitter.min >= WAKE_UP_uS * 1000 && timer.jitter.mean < (WAKE_UP_uS + 1) * 1000 &&
+              histogramTotal(timer.jitter) == timer.jitter.scans && timer.jitter.histogram[WAKE_UP_uS] > timer.jitter.scans / 2,
+          "timer: wake-up latency measured");
+    check(timer.cpuLoad > 0 && timer.cpuLoad < 1, "timer: core released between scans");
+
+    // A scan is a frame per channel and one for the temperature
+    const float bus_load = PACED_RATE * (TOTAL_CHANNELS + 1) * FRAME_uS / 1e6;
+    const float wake_up_load = PACED_RATE * WAKE_UP_uS / 1e6;
+    printf("bus load %.4f blocking, %.4f timer, %.4f expected\n", blocking.busLoad, timer.busLoad, bus_load);
+    check(near(blocking.busLoad, bus_load) && near(timer.busLoad, bus_load), "bus load: time in the frames");
+    check(timer.cpuLoad - timer.busLoad >= wake_up_load * (1 - RATE_TOLERANCE), "timer: wake-up in the CPU load only");
+    check(!report.dma.supported, "DMA unsupported");
+
+    // -- A tick slept through every 10 scans
+    ticks.skip_every = 10;
+    benchmark.run(DURATION_mS, PACED_RATE, &ticks);
+    const AD7689_jitter &missed = benchmark.getReport().timer.jitter;
+    check(missed.overruns > 0 && (missed.scans + missed.overruns) * 10 >= (DURATION_mS * PACED_RATE / 1000) * 9,
+          "timer: missed ticks counted as overruns");
+
+    ticks.skip_every = 0;
+    ticks.start_fails = true;
+    benchmark.run(DURATION_mS, PACED_RATE, &ticks);
+    check(!benchmark.getReport().timer.supported, "timer unsupported when the source can't start");
+
+    benchmark.run(DURATION_mS, PACED_RATE, NULL);
+    check(!benchmark.getReport().timer.supported && benchmark.getReport().blocking.supported,
+          "timer unsupported without a tick source");
+
+    check(json.text.startsWith("{\"device\":\"AD7689\"") && json.text.indexOf('\n') == (int)json.text.length() - 1 &&
+              strstr(json.text.c_str(), "\"blocking\":{\"supported\":true") &&
+              strstr(json.text.c_str(), "\"timer\":{\"supported\":true") &&
+              strstr(json.text.c_str(), "\"dma\":{\"supported\":false}"),
+          "JSON report on one line, every backend");
+
+    check(benchmark.run(0, PACED_RATE).on_error && benchmark.run(DURATION_mS, 0).on_error &&
+              benchmark.run(DURATION_mS, PACED_RATE, NULL, TOTAL_CHANNELS).on_error,
+          "bad parameters refused");
+    return ok ? 0 : 1;
+}
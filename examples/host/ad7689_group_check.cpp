@@ -0,0 +1,168 @@
+/*
+ * File Name: ad7689_group_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks AD7689Group on three AD7689 attached to models, two on VSPI and one on HSPI. Every model frame takes
+// FRAME_uS of simulated time (AD7689Model::setFrameTime), so the skew the group reports can be compared with the
+// one the interleaving should give: the same channel of the N ADCs read within N - 1 frames of each other, where
+// reading one whole ADC after the other would put a whole scan between them.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/adc/ad7689 examples/host/ad7689_group_check.cpp
+//       src/libraries/adc/ad7689/ad7689.cpp src/libraries/adc/ad7689/ad7689_group.cpp -o ad7689_group_check
+//   ./ad7689_group_check
+//
+// Checks:
+//  - every sample and temperature of every ADC on its own channel, from the first frame;
+//  - sample offsets interleaved: ADC after ADC within a slot, slot after slot;
+//  - frame skew of N - 1 frames, in every frame and in the statistics;
+//  - an ADC read on its own between frames is put back in step;
+//  - each bus locked once per frame and released, throughput statistics;
+//  - full group, empty group and bad channel counts refused.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <ad7689_group.h>
+
+#include "ad7689_model.h"
+
+//******************** SETTINGS
+#define ADCS 3
+#define FRAME_uS 2
+#define FRAMES 200
+#define SKEW_MARGIN_nS 1000 // PC time on top of the simulated frames
+#define PREEMPTED_FRAMES (FRAMES / 50) // Frames the PC may stretch by preempting us
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+static uint16_t code(uint8_t adc, uint8_t channel)
+{
+    return 0x1000 * (channel + 1) + 0x10 * adc + channel;
+}
+
+static uint16_t tempCode(uint8_t adc)
+{
+    return 0x0A00 + adc;
+}
+
+static bool frameMatches(const AD7689_frame &frame, uint8_t channels)
+{
+    bool match = true;
+    for (uint8_t i = 0; i < ADCS; i++)
+    {
+        match &= frame.temperature[i] == tempCode(i);
+        for (uint8_t ch = 0; ch < channels; ch++)
+        {
+            match &= frame.samples[i][ch] == code(i, ch);
+        }
+    }
+    return match;
+}
+
+int main()
+{
+    SPIClass vspi(VSPI), hspi(HSPI);
+    AD7689Model models[ADCS];
+    AD7689 adcs[ADCS];
+    AD7689Group group;
+
+    check(group.begin().on_error, "empty group refused");
+
+    bool added = true;
+    for (uint8_t i = 0; i < ADCS; i++)
+    {
+        for (uint8_t ch = 0; ch < TOTAL_CHANNELS; ch++)
+        {
+            models[i].setInput(ch, code(i, ch));
+        }
+        models[i].setInput(TEMP_CHANNEL, tempCode(i));
+        models[i].setFrameTime(FRAME_uS);
+        (i < 2 ? vspi : hspi).attachDevice(32 + i, &models[i]);
+        adcs[i].begin(32 + i, i < 2 ? vspi : hspi, 20000000);
+        added &= !group.addADC(adcs[i]).on_error;
+    }
+    check(added && group.getADCCount() == ADCS && group.getBusCount() == 2, "3 ADCs on 2 buses");
+
+    check(group.begin(0).on_error && group.begin(TOTAL_CHANNELS + 1).on_error, "bad channel counts refused");
+    check(!group.begin(TOTAL_CHANNELS).on_error && vspi.transactions == 0 && hspi.transactions == 0, "sequencers started");
+
+    // -- Every frame: the right samples, interleaved, N - 1 frames of skew
+    const uint32_t expected_skew = (ADCS - 1) * FRAME_uS * 1000;
+    AD7689_frame frame;
+    bool samples = true;
+    uint32_t shuffled = 0, skewed = 0; // Frames off, the PC may preempt us in the middle of one
+    for (uint16_t f = 0; f < FRAMES; f++)
+    {
+        memset(&frame, 0, sizeof(frame));
+        group.readFrame(frame);
+        samples &= frameMatches(frame, TOTAL_CHANNELS);
+
+        bool interleaved = true;
+        for (uint8_t slot = 0; slot < TOTAL_CHANNELS; slot++)
+        {
+            for (uint8_t i = 0; i < ADCS; i++)
+            {
+                uint32_t expected = (slot * ADCS + i + 1) * FRAME_uS * 1000;
+                interleaved &= frame.sampleOffset[i][slot] >= expected &&
+                               frame.sampleOffset[i][slot] < expected + SKEW_MARGIN_nS * (slot + 1);
+            }
+        }
+        shuffled += !interleaved;
+        skewed += frame.skew < expected_skew || frame.skew >= expected_skew + SKEW_MARGIN_nS;
+    }
+    check(samples, "every sample of every ADC on its channel");
+    check(shuffled <= PREEMPTED_FRAMES, "ADCs interleaved within each slot");
+    check(skewed <= PREEMPTED_FRAMES, "frame skew of N - 1 frames");
+
+    AD7689_group_stats stats = group.getStats();
+    printf("frames %u, %.0f frames/s, %.0f samples/s, skew mean %.0f ns max %u ns\n", stats.frames, stats.frameRate,
+           stats.throughput, stats.meanSkew, stats.maxSkew);
+    check(stats.meanSkew >= expected_skew && stats.meanSkew < expected_skew + SKEW_MARGIN_nS &&
+              stats.maxSkew >= stats.meanSkew && stats.meanSkew < TOTAL_CHANNELS * FRAME_uS * 1000,
+          "statistics: skew well under a scan");
+    check(stats.frames == FRAMES && fabs(stats.throughput - stats.frameRate * ADCS * (TOTAL_CHANNELS + 1)) < 1 &&
+              stats.frameRate < 1e6 / ((TOTAL_CHANNELS + 1) * ADCS * FRAME_uS),
+          "statistics: frames and throughput");
+    check(vspi.transactions == 0 && hspi.transactions == 0, "buses released");
+
+    // -- Used alone between frames: restarted with the group scan
+    uint16_t data[TOTAL_CHANNELS], temp;
+    adcs[1].readChannels(3, UNIPOLAR_MODE, data, &temp);
+    group.readFrame(frame);
+    bool back = frameMatches(frame, TOTAL_CHANNELS);
+    group.readFrame(frame);
+    check(back && frameMatches(frame, TOTAL_CHANNELS), "ADC read alone put back in step");
+
+    // -- Partial scans
+    group.begin(4);
+    memset(&frame, 0, sizeof(frame));
+    group.readFrame(frame);
+    check(frameMatches(frame, 4) && frame.samples[0][4] == 0, "partial scan");
+
+    group.resetStats();
+    check(group.getStats().frames == 0 && group.getStats().maxSkew == 0, "statistics reset");
+
+    AD7689Group full;
+    AD7689 extra[MAX_GROUP_ADCS + 1];
+    bool refused = false;
+    for (uint8_t i = 0; i <= MAX_GROUP_ADCS; i++)
+    {
+        refused = full.addADC(extra[i]).on_error;
+    }
+    check(refused && full.getADCCount() == MAX_GROUP_ADCS, "full group refused");
+    return ok ? 0 : 1;
+}
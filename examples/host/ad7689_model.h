@@ -0,0 +1,164 @@
+/*
+ * File Name: ad7689_model.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Behavioural AD7689, for the AD7689 driver on the SPI stand-in (attach it with spi.attachDevice(cs_pin, &model)).
+// A frame is everything clocked between a falling and a rising edge of CS, and the model reproduces what the driver
+// depends on:
+//  - a configuration written during frame n takes effect for the conversion started at the end of frame n + 1, so
+//    data lags 2 frames behind commands;
+//  - the sequencer scans IN0 to INx (and temperature with SEQ_SCAN_INPUT_TEMP), restarting when reconfigured;
+//  - with RB cleared, the 16 data bits are followed by the 14 bit configuration used for that conversion (readback),
+//    for a 32 clock frame;
+//  - bytes clocked with CS high are ignored, as the chip does.
+//
+// The conversion at the end of a frame is run when the next one starts, the results are the same.
+//
+// Mateo :)
+
+#pragma once
+
+#include <SPI.h>
+
+class AD7689Model : public HostSPIDevice
+{
+public:
+    AD7689Model() { reset(); }
+
+    // Power-on state: default configuration, sequencer off, pipeline empty
+    void reset()
+    {
+        active_cfg = 0x3FFF;
+        pending_cfg = 0;
+        has_pending = false;
+        seq_index = 0;
+        last_data = 0;
+        last_cfg = active_cfg;
+        ramp_value = 0;
+        frames = 0;
+        in_frame = false;
+    }
+
+    // Code converted on a channel, 8 for the temperature sensor
+    void setInput(uint8_t channel, uint16_t code)
+    {
+        if (channel < 9)
+        {
+            inputs[channel] = code;
+        }
+    }
+
+    // Added to every conversion result after each conversion, to catch stale or misattributed samples. 0 disables it
+    void setRamp(uint16_t step) { ramp = step; }
+
+    // Makes every frame take us microseconds of the stand-in clock, like a real bus would. 0, the default, takes none
+    void setFrameTime(uint32_t us) { frame_time = us; }
+
+    uint32_t getFrameCount() const { return frames; }
+
+    // -- CS fell: the previous frame ended with a conversion, this one clocks out its result
+    void spiSelect() override
+    {
+        endFrame();
+        in_frame = true;
+        frame_byte = 0;
+        command = 0;
+        frames++;
+
+        // RB is active low, the configuration is returned left aligned like the command word
+        out = (uint32_t)last_data << 16;
+        if (!(last_cfg & 0x0001))
+        {
+            out |= (uint16_t)(last_cfg << 2);
+        }
+        if (frame_time)
+        {
+            delayMicroseconds(frame_time);
+        }
+    }
+
+    uint8_t spiTransfer(uint8_t data) override
+    {
+        uint8_t response = frame_byte < 4 ? (uint8_t)(out >> (24 - 8 * frame_byte)) : 0;
+        if (frame_byte < 2)
+        {
+            command = command << 8 | data;
+        }
+        frame_byte++;
+        return response;
+    }
+
+private:
+    uint16_t inputs[9] = {}; // IN0..IN7, and the temperature sensor
+    uint16_t ramp = 0;
+    uint16_t ramp_value;
+    uint32_t frame_time = 0;
+    uint16_t active_cfg;  // 14 bit configuration of the next conversion
+    uint16_t pending_cfg; // written in the previous frame
+    bool has_pending;
+    uint8_t seq_index;    // next sequencer slot
+    uint16_t last_data;   // conversion started at the end of the previous frame
+    uint16_t last_cfg;    // and its configuration
+    uint32_t frames;
+
+    bool in_frame;
+    uint8_t frame_byte;
+    uint16_t command;
+    uint32_t out;
+
+    static uint8_t field(uint16_t cfg, uint8_t shift, uint8_t mask) { return (cfg >> shift) & mask; }
+
+    // -- CS rose: convert with the configuration written in the frame before, then latch this frame's one
+    void endFrame()
+    {
+        if (!in_frame)
+        {
+            return;
+        }
+        in_frame = false;
+        convert();
+
+        // CFG bit set: the configuration register is overwritten for the conversion after the next one
+        if (frame_byte >= 2 && (command & 0x8000))
+        {
+            pending_cfg = command >> 2;
+            has_pending = true;
+        }
+    }
+
+    void convert()
+    {
+        if (has_pending)
+        {
+            active_cfg = pending_cfg;
+            has_pending = false;
+            seq_index = 0;
+        }
+
+        uint8_t incc = field(active_cfg, 10, 0b111);
+        uint8_t inx = field(active_cfg, 7, 0b111);
+        uint8_t seq = field(active_cfg, 1, 0b11);
+        uint8_t channel = inx;
+
+        if (seq == 0b10 || seq == 0b11)
+        {
+            // IN0 to INx, followed by temperature when enabled
+            uint8_t slots = inx + 1 + (seq == 0b10 ? 1 : 0);
+            channel = seq_index <= inx ? seq_index : 8;
+            seq_index = seq_index + 1 == slots ? 0 : seq_index + 1;
+        }
+        else if (incc == 0b011)
+        {
+            channel = 8;
+        }
+
+        last_data = inputs[channel] + ramp_value;
+        last_cfg = active_cfg;
+        ramp_value += ramp;
+    }
+};
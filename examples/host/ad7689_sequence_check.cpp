@@ -0,0 +1,196 @@
+/*
+ * File Name: ad7689_sequence_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks the AD7689 sequencing against AD7689Model on the SPI stand-in, which answers 2 frames behind the commands
+// like the chip does. Every input gets its own code, so a sample read on the wrong frame lands on the wrong channel
+// and is caught. With the model ramp on, every conversion is also one count above the previous one, which catches
+// stale samples.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/adc/ad7689 examples/host/ad7689_sequence_check.cpp
+//       src/libraries/adc/ad7689/ad7689.cpp -o ad7689_sequence_check
+//   ./ad7689_sequence_check
+//
+// Checks:
+//  - readChannels: full and partial scans on the on-chip sequencer, fresh and on the right channels from the first
+//    call, temperature included;
+//  - 0 or more than 8 channels refused without a frame shifted;
+//  - the sequencer is only reconfigured when the CFG register was rewritten (self-test), not by planning;
+//  - planSequence on the on-chip sequencer for IN0 to INx, one command per conversion otherwise;
+//  - the 2 frame lag of planned sequences: the last 2 slots of a scan delivered by the next one, oversampled
+//    channels averaged, temperature every temp_decimation scans;
+//  - plans with no channel, or more than MAX_SEQUENCE_SLOTS conversions, refused.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <ad7689.h>
+
+#include "ad7689_model.h"
+
+//******************** SETTINGS
+#define CS_PIN 32
+#define TEMP_CODE 0x0ABC
+#define PLAN_SCANS 8
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+static uint16_t code(uint8_t channel)
+{
+    return 0x1000 * (channel + 1) + channel;
+}
+
+static void setInputs(AD7689Model &model)
+{
+    for (uint8_t ch = 0; ch < TOTAL_CHANNELS; ch++)
+    {
+        model.setInput(ch, code(ch));
+    }
+    model.setInput(TEMP_CHANNEL, TEMP_CODE);
+}
+
+// -- Every channel read has its own code, and the temperature too
+static bool scanMatches(const uint16_t *data, uint8_t channels, uint16_t temp)
+{
+    bool match = temp == TEMP_CODE;
+    for (uint8_t ch = 0; ch < channels; ch++)
+    {
+        match &= data[ch] == code(ch);
+    }
+    return match;
+}
+
+int main()
+{
+    SPIClass bus(VSPI);
+    AD7689Model model;
+    setInputs(model);
+
+    bus.attachDevice(CS_PIN, &model);
+    AD7689 adc;
+    adc.begin(CS_PIN, bus, 20000000);
+
+    uint16_t data[TOTAL_CHANNELS] = {};
+    uint16_t temp = 0;
+
+    // -- On-chip sequencer: right from the first scan, then again once it has wrapped around
+    bool full = !adc.readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp).on_error && scanMatches(data, TOTAL_CHANNELS, temp);
+    full &= !adc.readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp).on_error && scanMatches(data, TOTAL_CHANNELS, temp);
+    check(full, "readChannels: every channel and temperature");
+
+    memset(data, 0, sizeof(data));
+    temp = 0;
+    bool partial = !adc.readChannels(3, UNIPOLAR_MODE, data, &temp).on_error && scanMatches(data, 3, temp) && data[3] == 0;
+    partial &= !adc.readChannels(3, UNIPOLAR_MODE, data, &temp).on_error && scanMatches(data, 3, temp);
+    check(partial, "readChannels: partial scan");
+
+    // -- Out of range: refused before anything is shifted
+    uint32_t frames = model.getFrameCount();
+    ESP_ERROR none = adc.readChannels(0, UNIPOLAR_MODE, data, &temp);
+    ESP_ERROR nine = adc.readChannels(TOTAL_CHANNELS + 1, UNIPOLAR_MODE, data, &temp);
+    check(none.on_error && nine.on_error && model.getFrameCount() == frames, "0 or more than 8 channels refused");
+
+    // -- Planning writes nothing: the sequencer keeps running. The self-test rewrites CFG: it's restarted
+    adc.readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp);
+    adc.planSequence(0b00000110);
+    frames = model.getFrameCount();
+    adc.readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp);
+    check(model.getFrameCount() - frames == TOTAL_CHANNELS + 1 && scanMatches(data, TOTAL_CHANNELS, temp),
+          "planning leaves the sequencer running");
+
+    check(adc.selftest(), "self-test reads its configuration back");
+    frames = model.getFrameCount();
+    memset(data, 0, sizeof(data));
+    adc.readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp);
+    check(model.getFrameCount() - frames == TOTAL_CHANNELS + 3 && scanMatches(data, TOTAL_CHANNELS, temp),
+          "sequencer restarted after the self-test");
+
+    // -- IN0 to INx, temperature on every scan: the on-chip sequencer, nothing to deliver late
+    memset(data, 0, sizeof(data));
+    temp = 0;
+    check(!adc.planSequence(0b00000111).on_error && adc.readSequence(data, &temp) == (0b111 | 1 << TEMP_CHANNEL) &&
+              scanMatches(data, 3, temp),
+          "contiguous plan: on-chip sequencer, complete first scan");
+    frames = model.getFrameCount();
+    adc.readSequence(data, &temp);
+    check(model.getFrameCount() - frames == 4 && scanMatches(data, 3, temp), "contiguous plan: 1 frame per conversion");
+
+    // -- IN0 x4, IN2, IN5 x2, IN7 x3: 10 commands per scan, temperature every 2 scans
+    const uint8_t mask = 0b10100101;
+    uint8_t oversampling[TOTAL_CHANNELS] = {4, 0, 1, 0, 0, 2, 0, 3};
+    check(!adc.planSequence(mask, oversampling, 2).on_error, "oversampled plan accepted");
+
+    memset(data, 0, sizeof(data));
+    temp = 0;
+    uint16_t first = adc.readSequence(data, &temp);
+    check(first == 0b00100101 && data[7] == 0 && temp == 0, "first scan: the last 2 slots still in flight");
+
+    bool averaged = true, lagged = true;
+    uint16_t temperatures = 0;
+    for (uint8_t scan = 1; scan < PLAN_SCANS; scan++)
+    {
+        frames = model.getFrameCount();
+        uint16_t updated = adc.readSequence(data, &temp);
+
+        // -- The temperature slot ends every second scan, and is delivered by the next one
+        bool temp_due = scan % 2 == 0;
+        lagged &= (updated & 0xFF) == mask && ((updated >> TEMP_CHANNEL) & 1) == temp_due;
+        lagged &= model.getFrameCount() - frames == 10u + (scan % 2 == 1);
+        averaged &= data[0] == code(0) && data[2] == code(2) && data[5] == code(5) && data[7] == code(7);
+        temperatures += temp_due && temp == TEMP_CODE;
+    }
+    check(lagged, "later scans: every channel, temperature every 2 scans");
+    check(averaged && temperatures == PLAN_SCANS / 2 - 1, "every sample on its own channel");
+
+    uint8_t too_many[TOTAL_CHANNELS] = {9, 9, 9, 9, 9, 9, 9, 9};
+    check(adc.planSequence(0).on_error && adc.planSequence(0xFF, too_many).on_error && adc.readSequence(data, &temp) == 0,
+          "empty or oversized plan refused");
+
+    // -- Another ADC, on a model with the ramp on: every conversion one count above the previous one
+    AD7689Model ramp_model;
+    setInputs(ramp_model);
+    ramp_model.setRamp(1);
+    SPIClass ramp_bus(HSPI);
+    ramp_bus.attachDevice(CS_PIN, &ramp_model);
+    AD7689 ramp_adc;
+    ramp_adc.begin(CS_PIN, ramp_bus, 20000000);
+
+    uint16_t previous[TOTAL_CHANNELS];
+    ramp_adc.readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, previous, &temp);
+    ramp_adc.readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp);
+    bool fresh = true;
+    for (uint8_t ch = 0; ch < TOTAL_CHANNELS; ch++)
+    {
+        fresh &= data[ch] - previous[ch] == TOTAL_CHANNELS + 1;
+        fresh &= ch == 0 || (data[ch] - code(ch)) == (data[ch - 1] - code(ch - 1)) + 1;
+    }
+    fresh &= temp - TEMP_CODE == data[TOTAL_CHANNELS - 1] - code(TOTAL_CHANNELS - 1) + 1;
+    check(fresh, "readChannels: fresh samples, in conversion order");
+
+    // -- IN0 is the average of 4 conversions, the scans in between take 10 or 11 frames
+    ramp_adc.planSequence(mask, oversampling, 2);
+    ramp_adc.readSequence(data, &temp);
+    bool oversampled = true;
+    for (uint8_t scan = 0; scan < PLAN_SCANS; scan++)
+    {
+        uint16_t before = data[0];
+        ramp_adc.readSequence(data, &temp);
+        oversampled &= data[0] - before == 10 || data[0] - before == 11;
+    }
+    check(oversampled, "oversampled channel fresh on every scan");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+/*
+ * File Name: adc_trigger_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks ADCTrigger on made up frame streams. Every frame carries its own index on the last channel, so a snapshot
+// can be checked frame by frame against the stream it was taken from.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/adc/ad7689 examples/host/adc_trigger_check.cpp
+//       src/libraries/adc/ad7689/adc_trigger.cpp -o adc_trigger_check
+//   ./adc_trigger_check
+//
+// Checks:
+//  - every condition type fires on the first frame that meets it, and not before: level, edge, slope, window;
+//  - edges and slopes wait for the frames they look back on;
+//  - any and all combinations, and the index of the first condition met;
+//  - pre-trigger history, trigger frame and post-trigger frames in the snapshot, oldest first, also when the history
+//    has wrapped around or isn't full yet;
+//  - nothing captured while idle or after a snapshot, until armed again;
+//  - serialization: readSnapshot in chunks of any size and writeSnapshot give the same bytes, header first;
+//  - bad channel counts, channels and slope spans refused;
+//  - begin with fewer channels drops the conditions on the channels left out.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <adc_trigger.h>
+
+#include <vector>
+
+//******************** SETTINGS
+#define CHANNELS 3 // Signal, a second signal, frame index
+#define INDEX_CHANNEL (CHANNELS - 1)
+#define PRE_FRAMES 20
+#define POST_FRAMES 10
+#define FRAME_RATE 1000
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+class Capture : public Print
+{
+public:
+    std::vector<uint8_t> bytes;
+    size_t write(uint8_t data) override
+    {
+        bytes.push_back(data);
+        return 1;
+    }
+};
+
+// -- Stream with channel 0 given by the caller, channel 1 its mirror, and the frame index
+static std::vector<uint16_t> stream(const std::vector<uint16_t> &signal)
+{
+    std::vector<uint16_t> frames(signal.size() * CHANNELS);
+    for (size_t f = 0; f < signal.size(); f++)
+    {
+        frames[f * CHANNELS] = signal[f];
+        frames[f * CHANNELS + 1] = 0xFFFF - signal[f];
+        frames[f * CHANNELS + INDEX_CHANNEL] = (uint16_t)f;
+    }
+    return frames;
+}
+
+// -- Frame index at which the trigger completes a snapshot, -1 if it never does
+static int32_t feed(ADCTrigger &trigger, const std::vector<uint16_t> &frames)
+{
+    for (size_t f = 0; f < frames.size() / CHANNELS; f++)
+    {
+        if (trigger.process(&frames[f * CHANNELS]))
+        {
+            return (int32_t)f;
+        }
+    }
+    return -1;
+}
+
+// -- Index of the trigger frame of a single condition on channel 0, -1 if it never fires
+static int32_t fires(const ADC_trigger_condition &condition, const std::vector<uint16_t> &signal)
+{
+    ADCTrigger trigger;
+    trigger.begin(CHANNELS, PRE_FRAMES, 0, FRAME_RATE);
+    trigger.addCondition(condition);
+    trigger.arm();
+    return feed(trigger, stream(signal));
+}
+
+// -- The snapshot holds consecutive frames of the stream, the trigger frame at triggerIndex
+static bool snapshotMatches(ADCTrigger &trigger, const std::vector<uint16_t> &frames, uint16_t trigger_frame,
+                            uint16_t pre_frames, uint16_t post_frames)
+{
+    const ADC_snapshot_header &header = trigger.getSnapshotHeader();
+    bool match = header.magic == TRIGGER_SNAPSHOT_MAGIC && header.version == TRIGGER_SNAPSHOT_VERSION &&
+                 header.channels == CHANNELS && header.frameRate == FRAME_RATE && header.triggerIndex == pre_frames &&
+                 header.frameCount == pre_frames + 1 + post_frames;
+    const uint16_t *snapshot = trigger.getSnapshotFrames();
+    for (uint16_t i = 0; match && i < header.frameCount; i++)
+    {
+        size_t f = trigger_frame - pre_frames + i;
+        match &= memcmp(&snapshot[i * CHANNELS], &frames[f * CHANNELS], CHANNELS * sizeof(uint16_t)) == 0;
+    }
+    return match;
+}
+
+int main()
+{
+    // -- 0, 100, 200... up to 2000, then back down
+    std::vector<uint16_t> ramp;
+    for (uint16_t v = 0; v <= 2000; v += 100)
+    {
+        ramp.push_back(v);
+    }
+    for (int32_t v = 1900; v >= 0; v -= 100)
+    {
+        ramp.push_back((uint16_t)v);
+    }
+
+    // -- Every type on the ramp: first frame that meets it
+    check(fires({0, TRIGGER_LEVEL_ABOVE, 1000, 0, 0}, ramp) == 11 && fires({0, TRIGGER_LEVEL_ABOVE, 2000, 0, 0}, ramp) == -1,
+          "level above");
+    check(fires({0, TRIGGER_LEVEL_BELOW, 50, 0, 0}, ramp) == 0 && fires({0, TRIGGER_LEVEL_BELOW, 0, 0, 0}, ramp) == -1,
+          "level below");
+    check(fires({0, TRIGGER_RISING_EDGE, 1000, 0, 0}, ramp) == 10 && fires({0, TRIGGER_RISING_EDGE, 0, 0, 0}, ramp) == -1,
+          "rising edge, not on the first frame");
+    check(fires({0, TRIGGER_FALLING_EDGE, 1000, 0, 0}, ramp) == 30 && fires({0, TRIGGER_FALLING_EDGE, 2000, 0, 0}, ramp) == -1,
+          "falling edge");
+    check(fires({0, TRIGGER_SLOPE_RISING, 500, 0, 5}, ramp) == 5 && fires({0, TRIGGER_SLOPE_RISING, 600, 0, 6}, ramp) == 6 &&
+              fires({0, TRIGGER_SLOPE_RISING, 501, 0, 5}, ramp) == -1 &&
+              fires({0, TRIGGER_SLOPE_RISING, 3200, 0, TRIGGER_MAX_SLOPE_SPAN}, ramp) == -1,
+          "rising slope over its span");
+    check(fires({0, TRIGGER_SLOPE_FALLING, 300, 0, 3}, ramp) == 23 && fires({0, TRIGGER_SLOPE_FALLING, 400, 0, 4}, ramp) == 24,
+          "falling slope over its span");
+    check(fires({0, TRIGGER_WINDOW_INSIDE, 450, 650, 0}, ramp) == 5 && fires({0, TRIGGER_WINDOW_INSIDE, 1010, 1090, 0}, ramp) == -1,
+          "inside window");
+    check(fires({0, TRIGGER_WINDOW_OUTSIDE, 0, 1500, 0}, ramp) == 16 &&
+              fires({0, TRIGGER_WINDOW_OUTSIDE, 0, 2000, 0}, ramp) == -1,
+          "outside window");
+
+    // -- Any and all: channel 1 mirrors channel 0, both above 1000 never happens
+    std::vector<uint16_t> frames = stream(ramp);
+    ADCTrigger trigger;
+    trigger.begin(CHANNELS, PRE_FRAMES, 0, FRAME_RATE);
+    trigger.addCondition({1, TRIGGER_LEVEL_BELOW, 0xFFFF - 1500, 0, 0});
+    trigger.addCondition({0, TRIGGER_LEVEL_ABOVE, 1000, 0, 0});
+    trigger.arm();
+    int32_t any = feed(trigger, frames);
+    check(any == 11 && trigger.getSnapshotHeader().condition == 1, "any: first condition met");
+
+    trigger.setCombine(TRIGGER_ALL);
+    trigger.arm();
+    int32_t all = feed(trigger, frames);
+    trigger.addCondition({0, TRIGGER_LEVEL_BELOW, 100, 0, 0});
+    trigger.arm();
+    check(all == 16 && trigger.getSnapshotHeader().condition == 0 && feed(trigger, frames) == -1, "all: every condition met");
+
+    // -- A long stream, the history wrapped around many times: trigger at frame 500
+    std::vector<uint16_t> level(1000, 100);
+    for (size_t f = 500; f < level.size(); f++)
+    {
+        level[f] = 3000;
+    }
+    frames = stream(level);
+    trigger.clearConditions();
+    trigger.setCombine(TRIGGER_ANY);
+    trigger.addCondition({0, TRIGGER_RISING_EDGE, 2000, 0, 0});
+    trigger.begin(CHANNELS, PRE_FRAMES, POST_FRAMES, FRAME_RATE);
+    check(trigger.getState() == TRIGGER_IDLE && feed(trigger, frames) == -1, "idle: nothing captured");
+
+    trigger.arm();
+    size_t f = 0;
+    bool states = trigger.getState() == TRIGGER_ARMED;
+    for (; f < 500; f++)
+    {
+        trigger.process(&frames[f * CHANNELS]);
+        states &= trigger.getState() == TRIGGER_ARMED && !trigger.snapshotReady() && trigger.getSnapshotSize() == 0;
+    }
+    for (; f < 500 + POST_FRAMES + 1; f++)
+    {
+        bool completed = trigger.process(&frames[f * CHANNELS]);
+        states &= completed == (f == 500 + POST_FRAMES) &&
+                  trigger.getState() == (f == 500 + POST_FRAMES ? TRIGGER_DONE : TRIGGER_CAPTURING);
+    }
+    check(states && trigger.snapshotReady(), "armed, capturing, done");
+    check(snapshotMatches(trigger, frames, 500, PRE_FRAMES, POST_FRAMES), "pre-trigger, trigger and post-trigger frames");
+
+    // -- Done: later frames feed the history only
+    Capture written;
+    std::vector<uint16_t> saved(trigger.getSnapshotFrames(), trigger.getSnapshotFrames() + (PRE_FRAMES + 1 + POST_FRAMES) * CHANNELS);
+    for (; f < frames.size() / CHANNELS; f++)
+    {
+        trigger.process(&frames[f * CHANNELS]);
+    }
+    check(trigger.getState() == TRIGGER_DONE &&
+              memcmp(saved.data(), trigger.getSnapshotFrames(), saved.size() * sizeof(uint16_t)) == 0,
+          "snapshot kept until armed again");
+
+    // -- Serialization: header then frames, in chunks of every size up to a BLE MTU
+    size_t size = trigger.getSnapshotSize();
+    size_t wrote = trigger.writeSnapshot(written);
+    bool serialized = size == sizeof(ADC_snapshot_header) + saved.size() * sizeof(uint16_t) && wrote == size &&
+                      written.bytes.size() == size &&
+                      memcmp(written.bytes.data(), &trigger.getSnapshotHeader(), sizeof(ADC_snapshot_header)) == 0 &&
+                      memcmp(written.bytes.data() + sizeof(ADC_snapshot_header), saved.data(), saved.size() * 2) == 0;
+    for (size_t chunk = 1; chunk <= 244; chunk++)
+    {
+        std::vector<uint8_t> read(size + chunk);
+        size_t offset = 0, n;
+        while ((n = trigger.readSnapshot(offset, &read[offset], chunk)) > 0)
+        {
+            serialized &= n <= chunk;
+            offset += n;
+        }
+        serialized &= offset == size && memcmp(read.data(), written.bytes.data(), size) == 0;
+    }
+    check(serialized, "readSnapshot in chunks and writeSnapshot agree");
+
+    // -- Armed again: the history is full, the next edge captures as many frames
+    std::vector<uint16_t> pulses(300, 100);
+    for (size_t p = 150; p < 200; p++)
+    {
+        pulses[p] = 3000;
+    }
+    frames = stream(pulses);
+    trigger.arm();
+    check(trigger.getSnapshotSize() == 0 && feed(trigger, frames) == 150 + POST_FRAMES &&
+              snapshotMatches(trigger, frames, 150, PRE_FRAMES, POST_FRAMES),
+          "armed again: next snapshot");
+
+    // -- Fired before the history is full: shorter pre-trigger part. No post-trigger frames: done on the trigger
+    trigger.begin(CHANNELS, PRE_FRAMES, 0, FRAME_RATE);
+    std::vector<uint16_t> early(PRE_FRAMES, 100);
+    early[7] = 3000;
+    frames = stream(early);
+    trigger.arm();
+    Capture empty;
+    check(feed(trigger, frames) == 7 && snapshotMatches(trigger, frames, 7, 7, 0) && trigger.snapshotReady(),
+          "short history, no post-trigger frames");
+    trigger.disarm();
+    check(trigger.getSnapshotSize() == 0 && trigger.writeSnapshot(empty) == 0 && trigger.readSnapshot(0, NULL, 10) == 0,
+          "nothing to serialize when disarmed");
+
+    // -- Block processing
+    trigger.begin(CHANNELS, PRE_FRAMES, POST_FRAMES, FRAME_RATE);
+    frames = stream(pulses);
+    trigger.arm();
+    check(!trigger.process(frames.data(), 150) && trigger.process(frames.data() + 150 * CHANNELS, 150) &&
+              snapshotMatches(trigger, frames, 150, PRE_FRAMES, POST_FRAMES),
+          "frames fed in blocks");
+
+    // -- Refused
+    ADCTrigger refused;
+    bool bad = refused.begin(0, 10, 10).on_error && refused.begin(TOTAL_CHANNELS + 2, 10, 10).on_error &&
+               refused.begin(CHANNELS, 40000, 30000).on_error;
+    refused.arm();
+    bad &= refused.getState() == TRIGGER_IDLE && !refused.process(frames.data());
+    refused.begin(CHANNELS, 10, 10);
+    bad &= refused.addCondition({CHANNELS, TRIGGER_LEVEL_ABOVE, 0, 0, 0}).on_error &&
+           refused.addCondition({0, TRIGGER_SLOPE_RISING, 10, 0, 0}).on_error &&
+           refused.addCondition({0, TRIGGER_SLOPE_FALLING, 10, 0, TRIGGER_MAX_SLOPE_SPAN + 1}).on_error;
+    for (uint8_t i = 0; i < TRIGGER_MAX_CONDITIONS; i++)
+    {
+        bad &= !refused.addCondition({0, TRIGGER_LEVEL_ABOVE, 0, 0, 0}).on_error;
+    }
+    bad &= refused.addCondition({0, TRIGGER_LEVEL_ABOVE, 0, 0, 0}).on_error;
+    check(bad, "bad channels, spans and conditions refused");
+
+    // -- Fewer channels: the condition on the index channel goes, the one on channel 0 stays, as condition 0
+    ADCTrigger shrunk;
+    shrunk.begin(CHANNELS, 0, 0);
+    shrunk.addCondition({INDEX_CHANNEL, TRIGGER_LEVEL_ABOVE, 0, 0, 0});
+    shrunk.addCondition({0, TRIGGER_LEVEL_ABOVE, 100, 0, 0});
+    shrunk.begin(INDEX_CHANNEL, 0, 0);
+    shrunk.arm();
+    const uint16_t below[INDEX_CHANNEL] = {50, 0}, above[INDEX_CHANNEL] = {150, 0};
+    check(!shrunk.process(below) && shrunk.process(above) && shrunk.getSnapshotHeader().condition == 0,
+          "fewer channels: conditions left out dropped");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,298 @@
+/*
+ * File Name: compression_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks EMMC_CompressedWriter, its codecs and EMMC_CompressedReader on the file system stand-in of
+// examples/host/stand_in.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/memory/emmc
+//       examples/host/compression_check.cpp src/libraries/memory/emmc/emmc_compression.cpp -o compression_check
+//   ./compression_check
+//
+// Logs of a ride are compressed block by block, then read back:
+//  - CAN frames (16 byte records) and CSV text, with LZ4;
+//  - 8 ADC channels of 16 bit samples, with delta + varint, and with LZ4 for comparison;
+//  - random bytes: every block stored as it is, only the frame headers added.
+// For each: ratio, worst block, compression speed on this PC, data read back identical. Then: decompression started
+// at a frame in the middle, a damaged frame reported, and the memory each class takes.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <emmc_compression.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+//******************** SETTINGS
+#define LOG_BYTES (4UL * 1024 * 1024) // Per log
+#define ADC_CHANNELS 8
+#define MIN_CAN_RATIO 1.6f
+#define MIN_CSV_RATIO 2.f
+#define MIN_ADC_RATIO 1.8f
+#define MAX_STORED_OVERHEAD 0.005f // Random data, frame headers only
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+//******************** LOGS
+struct __attribute__((packed)) CanRecord
+{
+    uint32_t time_us;
+    uint16_t id;
+    uint8_t dlc;
+    uint8_t bus;
+    uint8_t data[8];
+};
+
+// -- A few ECUs sending at fixed rates: counters, slow sensors, status bytes
+static std::vector<uint8_t> canLog()
+{
+    static const uint16_t ids[] = {0x0C0, 0x0C4, 0x1A0, 0x210, 0x3E8, 0x401, 0x520, 0x7DF};
+    std::vector<uint8_t> log;
+    std::minstd_rand random(1);
+    uint32_t time_us = 0;
+
+    for (uint32_t i = 0; log.size() + sizeof(CanRecord) <= LOG_BYTES; i++)
+    {
+        CanRecord record = {};
+        uint8_t n = i % 8;
+        time_us += 125 + random() % 8;
+        record.time_us = time_us;
+        record.id = ids[n];
+        record.dlc = 8;
+        uint16_t rpm = 2000 + (uint16_t)(1500 * sin(i / 20000.));
+        uint8_t temperature = 80 + i / 100000;
+        record.data[0] = (uint8_t)(i / 8);                // Rolling counter
+        record.data[1] = n < 4 ? (uint8_t)rpm : temperature;
+        record.data[2] = n < 4 ? (uint8_t)(rpm >> 8) : 0;
+        record.data[3] = n == 2 ? (uint8_t)(random() % 4) : 0x10; // A little noise
+        record.data[7] = 0xA5;
+        log.insert(log.end(), (uint8_t *)&record, (uint8_t *)&record + sizeof(record));
+    }
+    return log;
+}
+
+// -- What a text logger writes with print()
+static std::vector<uint8_t> csvLog()
+{
+    std::vector<uint8_t> log;
+    char line[96];
+    for (uint32_t i = 0; log.size() < LOG_BYTES; i++)
+    {
+        float t = i / 1000.f;
+        int n = snprintf(line, sizeof(line), "%lu,%.3f,%.3f,%.2f,%.1f,%d\n", 1000000UL + i * 1000UL, 0.2f * sinf(t),
+                         1.f + 0.5f * sinf(9 * t), 20.f * sinf(0.9f * t), 25 + t / 120, i % 3 == 0);
+        log.insert(log.end(), line, line + n);
+    }
+    log.resize(LOG_BYTES);
+    return log;
+}
+
+// -- 16 bit ADC codes: slow signals and suspension strokes, a few counts of noise
+static std::vector<uint8_t> adcLog()
+{
+    std::vector<uint8_t> log;
+    std::minstd_rand random(2);
+    int16_t record[ADC_CHANNELS];
+    for (uint32_t i = 0; log.size() + sizeof(record) <= LOG_BYTES; i++)
+    {
+        float t = i / 1000.f;
+        for (uint8_t c = 0; c < ADC_CHANNELS; c++)
+        {
+            float signal = c < 4 ? 12000 * sinf(t * (1 + c)) : 2000 * sinf(t * 0.1f * c);
+            record[c] = (int16_t)(16000 + signal + (int)(random() % 9) - 4);
+        }
+        log.insert(log.end(), (uint8_t *)record, (uint8_t *)record + sizeof(record));
+    }
+    return log;
+}
+
+static std::vector<uint8_t> randomLog()
+{
+    std::vector<uint8_t> log(LOG_BYTES);
+    std::minstd_rand random(3);
+    for (uint8_t &byte : log)
+    {
+        byte = random();
+    }
+    return log;
+}
+
+//******************** CHECKS
+// -- File offset of every frame, from the block callback
+static void recordFrame(const EMMC_CompressionBlock &block, void *arg)
+{
+    std::vector<uint32_t> &offsets = *(std::vector<uint32_t> *)arg;
+    offsets.push_back(offsets.back() + block.stored_length);
+}
+
+static EMMC_CompressedWriter writer; // Static: the buffers are members
+static EMMC_CompressedReader reader;
+static EMMC_LZ4Codec lz4;
+
+static std::vector<uint8_t> readAll(File &file)
+{
+    std::vector<uint8_t> data;
+    uint8_t buffer[1000];
+    reader.begin(file);
+    for (size_t n; (n = reader.read(buffer, sizeof(buffer))) > 0;)
+    {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    return data;
+}
+
+// -- Compress log to path. Returns the ratio
+static float compressLog(fs::FS &file_system,
+                         const char *name,
+                         const char *path,
+                         const std::vector<uint8_t> &log,
+                         EMMC_Codec &codec,
+                         std::vector<uint32_t> &offsets)
+{
+    File file = file_system.open(path, FILE_WRITE);
+    offsets.assign(1, 0);
+    writer.setBlockCallback(recordFrame, &offsets);
+    writer.begin(file, codec);
+
+    // -- In records of a few dozen bytes, like a logger would
+    for (size_t i = 0; i < log.size(); i += 48)
+    {
+        writer.write(log.data() + i, min((size_t)48, log.size() - i));
+    }
+    bool closed = !writer.close().on_error;
+    file.close();
+
+    EMMC_CompressionStats stats = writer.getStats();
+    printf("%-22s ratio %5.2f, worst block %5.2f, %3u of %4u blocks stored, %6.1f MB/s, worst block %u us\n", name,
+           stats.ratio, stats.min_ratio, stats.blocks_stored, stats.blocks, stats.compress_MBps,
+           stats.max_compress_us);
+
+    file = file_system.open(path);
+    bool identical = closed && readAll(file) == log && !reader.getError().on_error;
+    bool reported = offsets.size() == stats.blocks + 1 && offsets.back() == file.size();
+    file.close();
+
+    char what[64];
+    snprintf(what, sizeof(what), "%s: read back identical", name);
+    check(identical, what);
+    snprintf(what, sizeof(what), "%s: every frame reported", name);
+    check(reported, what);
+    return stats.ratio;
+}
+
+static void checkLogs(fs::FS &file_system)
+{
+    std::vector<uint32_t> offsets;
+    EMMC_DeltaVarintCodec delta_varint(sizeof(int16_t), ADC_CHANNELS);
+
+    std::vector<uint8_t> can = canLog();
+    check(compressLog(file_system, "CAN, LZ4", "/can.z", can, lz4, offsets) >= MIN_CAN_RATIO, "CAN frames compressed");
+
+    std::vector<uint8_t> csv = csvLog();
+    check(compressLog(file_system, "CSV, LZ4", "/csv.z", csv, lz4, offsets) >= MIN_CSV_RATIO, "CSV text compressed");
+
+    std::vector<uint8_t> adc = adcLog();
+    float lz4_ratio = compressLog(file_system, "ADC, LZ4", "/adc_lz4.z", adc, lz4, offsets);
+    float delta_ratio = compressLog(file_system, "ADC, delta + varint", "/adc.z", adc, delta_varint, offsets);
+    check(delta_ratio >= MIN_ADC_RATIO && delta_ratio > lz4_ratio, "ADC channels: delta + varint beats LZ4");
+
+    std::vector<uint8_t> noise = randomLog();
+    float random_ratio = compressLog(file_system, "random, LZ4", "/random.z", noise, lz4, offsets);
+    check(writer.getStats().blocks_stored == writer.getStats().blocks && 1 / random_ratio - 1 <= MAX_STORED_OVERHEAD,
+          "random data stored, frame headers only");
+
+    // -- Start at a frame in the middle: no state from earlier blocks is needed
+    compressLog(file_system, "CAN, LZ4", "/can.z", can, lz4, offsets);
+    uint32_t frame = offsets.size() / 2;
+    File file = file_system.open("/can.z");
+    file.seek(offsets[frame]);
+    std::vector<uint8_t> tail = readAll(file);
+    check(tail.size() == can.size() - frame * EMMC_COMPRESSION_BLOCK_SIZE &&
+              std::equal(tail.begin(), tail.end(), can.end() - tail.size()),
+          "decompression started at a frame in the middle");
+    file.close();
+
+    // -- A flipped bit is caught by the frame CRC, the frames before it are still read
+    std::vector<uint8_t> bytes = *file_system.contents("/can.z");
+    bytes[offsets[frame] + sizeof(EMMC_CompressionFrame) + 100] ^= 0x04;
+    file = file_system.open("/damaged.z", FILE_WRITE);
+    file.write(bytes.data(), bytes.size());
+    file.close();
+    file = file_system.open("/damaged.z");
+    std::vector<uint8_t> damaged = readAll(file);
+    check(reader.getError().on_error && damaged.size() == frame * EMMC_COMPRESSION_BLOCK_SIZE,
+          "damaged frame reported");
+    file.close();
+}
+
+// -- Short and odd sized blocks, flushes, partial values
+static void checkEdges(fs::FS &file_system)
+{
+    std::minstd_rand random(4);
+    EMMC_DeltaVarintCodec codecs[] = {EMMC_DeltaVarintCodec(1, 3), EMMC_DeltaVarintCodec(4, 5),
+                                      EMMC_DeltaVarintCodec(2, 64)};
+    bool identical = true;
+
+    for (uint32_t trial = 0; trial < 300; trial++)
+    {
+        EMMC_Codec &codec = trial % 4 == 3 ? (EMMC_Codec &)lz4 : (EMMC_Codec &)codecs[trial % 4];
+        size_t block_size = codec.getAlignment() * (1 + random() % (EMMC_COMPRESSION_BLOCK_SIZE / codec.getAlignment()));
+        std::vector<uint8_t> data(random() % 20000);
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            data[i] = trial % 2 ? (uint8_t)(i / 7) : (uint8_t)random();
+        }
+
+        File file = file_system.open("/edge.z", FILE_WRITE);
+        writer.setBlockCallback(nullptr);
+        writer.begin(file, codec, block_size);
+        for (size_t i = 0; i < data.size();)
+        {
+            size_t n = min((size_t)(random() % 300), data.size() - i);
+            writer.write(data.data() + i, n);
+            i += n;
+            if (random() % 10 == 0)
+            {
+                writer.flush();
+            }
+        }
+        writer.close();
+        file.close();
+
+        file = file_system.open("/edge.z");
+        identical &= readAll(file) == data && !reader.getError().on_error;
+        file.close();
+    }
+    check(identical, "odd block sizes, flushes and partial values");
+
+    File file = file_system.open("/edge.z", FILE_WRITE);
+    check(writer.begin(file, codecs[1], 1010).on_error, "block size not a multiple of the record refused");
+}
+
+int main()
+{
+    fs::FS file_system;
+    checkLogs(file_system);
+    checkEdges(file_system);
+
+    printf("memory: writer %u bytes, LZ4 codec %u bytes, reader %u bytes, nothing allocated\n",
+           (unsigned)sizeof(EMMC_CompressedWriter), (unsigned)sizeof(EMMC_LZ4Codec),
+           (unsigned)sizeof(EMMC_CompressedReader));
+    return ok ? 0 : 1;
+}
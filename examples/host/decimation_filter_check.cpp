@@ -0,0 +1,288 @@
+/*
+ * File Name: decimation_filter_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks DecimationFilter and DecimationStage against references computed directly from the input.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/adc/ad7689 examples/host/decimation_filter_check.cpp
+//       src/libraries/adc/ad7689/decimation_filter.cpp -o decimation_filter_check
+//   ./decimation_filter_check
+//
+// Checks:
+//  - box-car: the rounded average of each block, exactly;
+//  - CIC, every order: exactly the FIR of the same impulse response ((1 + z^-1 + ... + z^-(R-1))^N), on a stream long
+//    enough for the integrators of orders 3 and 4 to wrap around, fed in blocks of random length;
+//  - half-band: unity DC gain, and the measured gain of sines against the response of its Q15 coefficients, with
+//    the passband and stopband it is sold with;
+//  - DecimationStage: interleaved channels give the same samples as one filter per channel;
+//  - ENOB and output rates, and refused configurations.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <decimation_filter.h>
+
+#include <random>
+#include <vector>
+
+//******************** SETTINGS
+#define STREAM_SAMPLES 200000
+#define SINE_SAMPLES 16384
+#define SINE_AMPLITUDE 20000.0
+#define GAIN_TOLERANCE 1e-3       // Measured against computed half-band gain
+#define PASSBAND_EDGE 0.05        // Of the input rate, gain within PASSBAND_RIPPLE of 1 below
+#define PASSBAND_RIPPLE 0.005
+#define STOPBAND_EDGE 0.4         // Of the input rate, attenuation above STOPBAND_dB
+#define STOPBAND_dB 35.0
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+static std::mt19937 generator(1234);
+
+// -- Impulse response of a CIC: the boxcar of length R convolved with itself N times
+static std::vector<uint64_t> cicResponse(uint16_t stage_ratio, uint8_t order)
+{
+    std::vector<uint64_t> h(1, 1);
+    for (uint8_t n = 0; n < order; n++)
+    {
+        std::vector<uint64_t> next(h.size() + stage_ratio - 1, 0);
+        for (size_t i = 0; i < h.size(); i++)
+        {
+            for (uint16_t k = 0; k < stage_ratio; k++)
+            {
+                next[i + k] += h[i];
+            }
+        }
+        h = next;
+    }
+    return h;
+}
+
+// -- Output m of the first stage, from the stream itself: no state, nothing to wrap
+static int32_t reference(const std::vector<uint16_t> &x, const std::vector<uint64_t> &h, uint16_t stage_ratio, size_t m)
+{
+    size_t n = m * stage_ratio + stage_ratio - 1;
+    uint64_t v = 0, gain = 0;
+    for (size_t k = 0; k < h.size(); k++)
+    {
+        gain += h[k];
+        v += k <= n ? h[k] * x[n - k] : 0;
+    }
+    return (int32_t)(((v << DECIMATION_FRACTION_BITS) + gain / 2) / gain);
+}
+
+// -- Feeds the stream in blocks of random length, as an acquisition loop would
+static std::vector<int32_t> run(DecimationFilter &filter, const std::vector<uint16_t> &x)
+{
+    std::vector<int32_t> y(x.size() / filter.getRatio() + 1);
+    size_t written = 0;
+    for (size_t n = 0; n < x.size();)
+    {
+        size_t block = std::min(x.size() - n, (size_t)(generator() % 700 + 1));
+        std::vector<int32_t> out(block / filter.getRatio() + 1);
+        size_t count = filter.process(&x[n], block, out.data());
+        for (size_t i = 0; i < count; i++)
+        {
+            y[written++] = out[i];
+        }
+        n += block;
+    }
+    y.resize(written);
+    return y;
+}
+
+// -- Gain of the half-band alone at f, in cycles per input sample, from its coefficients
+static double halfBandGain(double f)
+{
+    double w = 2 * M_PI * f;
+    return (16278 + 2 * (9453 * cos(w) - 1374 * cos(3 * w) + 166 * cos(5 * w))) / 32768.0;
+}
+
+// -- Amplitude at the output of a sine at f, on the decimated (and maybe aliased) frequency
+static double measuredGain(double f)
+{
+    DecimationFilter filter;
+    filter.begin(BOXCAR_FILTER, 2, 1, true); // the box-car of 1 passes samples through
+
+    std::vector<uint16_t> x(SINE_SAMPLES);
+    for (size_t n = 0; n < x.size(); n++)
+    {
+        x[n] = (uint16_t)lround(32768 + SINE_AMPLITUDE * cos(2 * M_PI * f * n));
+    }
+    std::vector<int32_t> y(x.size() / 2 + 1);
+    size_t count = filter.process(x.data(), x.size(), y.data());
+
+    // -- Output m is the FIR centred on input 2m - 4: project on the sine there, past the start-up
+    double in_phase = 0, quadrature = 0;
+    size_t used = 0;
+    for (size_t m = 8; m < count; m++)
+    {
+        double t = 2.0 * m - 4;
+        double value = y[m] / (double)(1 << DECIMATION_FRACTION_BITS) - 32768;
+        in_phase += value * cos(2 * M_PI * f * t);
+        quadrature += value * sin(2 * M_PI * f * t);
+        used++;
+    }
+    double sign = in_phase < 0 ? -1 : 1;
+    return sign * 2 * sqrt(in_phase * in_phase + quadrature * quadrature) / used / SINE_AMPLITUDE;
+}
+
+int main()
+{
+    // -- Full scale, then noise
+    std::vector<uint16_t> x(STREAM_SAMPLES);
+    for (size_t n = 0; n < x.size(); n++)
+    {
+        x[n] = n < STREAM_SAMPLES / 4 ? 0xFFFF : generator() & 0xFFFF;
+    }
+
+    DecimationFilter filter;
+    bool boxcar = true;
+    const uint16_t boxcar_ratios[] = {2, 3, 16, 100, 256};
+    for (uint16_t ratio : boxcar_ratios)
+    {
+        boxcar &= !filter.begin(BOXCAR_FILTER, ratio).on_error;
+        std::vector<int32_t> y = run(filter, x);
+        boxcar &= y.size() == x.size() / ratio;
+        for (size_t m = 0; m < y.size(); m++)
+        {
+            uint64_t sum = 0;
+            for (uint16_t k = 0; k < ratio; k++)
+            {
+                sum += x[m * ratio + k];
+            }
+            boxcar &= y[m] == (int32_t)(((sum << DECIMATION_FRACTION_BITS) + ratio / 2) / ratio);
+        }
+    }
+    check(boxcar, "box-car: rounded block averages");
+
+    // -- Gains: powers of two (shifts) and not (divisions), up to 256^4
+    struct Cic
+    {
+        uint16_t ratio;
+        uint8_t order;
+    };
+    const Cic cics[] = {{2, 1}, {10, 1}, {4, 2}, {17, 2}, {8, 3}, {25, 3}, {32, 4}, {256, 4}, {255, 4}};
+    bool cic = true, wrapped = true;
+    for (const Cic &c : cics)
+    {
+        cic &= !filter.begin(CIC_FILTER, c.ratio, c.order).on_error;
+        std::vector<uint64_t> h = cicResponse(c.ratio, c.order);
+        std::vector<int32_t> y = run(filter, x);
+        cic &= y.size() == x.size() / c.ratio;
+        for (size_t m = 0; m < y.size(); m++)
+        {
+            cic &= y[m] == reference(x, h, c.ratio, m);
+        }
+
+        // -- What the last integrator would hold without wrapping: above 64 bits
+        if (c.order >= 3)
+        {
+            double integrators[DECIMATION_MAX_CIC_ORDER] = {};
+            for (uint16_t sample : x)
+            {
+                integrators[0] += sample;
+                for (uint8_t i = 1; i < c.order; i++)
+                {
+                    integrators[i] += integrators[i - 1];
+                }
+            }
+            wrapped &= integrators[c.order - 1] > pow(2.0, 64);
+        }
+    }
+    check(cic, "CIC: exactly the FIR of its impulse response");
+    check(wrapped, "CIC: checked across integrator wraparound");
+
+    // -- Half-band: DC in, DC out, also after a CIC
+    bool dc = !filter.begin(CIC_FILTER, 8, 3, true).on_error;
+    std::vector<uint16_t> constant(4000, 51234);
+    std::vector<int32_t> y = run(filter, constant);
+    for (size_t m = HALF_BAND_TAPS; m < y.size(); m++)
+    {
+        dc &= DecimationFilter::toCode(y[m]) == 51234 && abs(y[m] - (51234 << DECIMATION_FRACTION_BITS)) <= 1;
+    }
+    check(dc && y.size() == constant.size() / 8, "half-band: unity DC gain");
+
+    bool response = true, passband = true, stopband = true;
+    printf("%-12s %-12s %-12s\n", "f / fs", "measured", "coefficients");
+    for (uint8_t step = 1; step < 20; step++)
+    {
+        // -- fs / 4 lands on the output Nyquist frequency, where sine and cosine can't be told apart
+        double f = step * 0.025;
+        if (step == 10)
+        {
+            continue;
+        }
+
+        double measured = measuredGain(f), expected = halfBandGain(f);
+        printf("%-12.3f %-12.6f %-12.6f\n", f, measured, expected);
+        response &= fabs(measured - expected) < GAIN_TOLERANCE;
+        passband &= f > PASSBAND_EDGE || fabs(measured - 1) < PASSBAND_RIPPLE;
+        stopband &= f < STOPBAND_EDGE || 20 * log10(fabs(measured)) < -STOPBAND_dB;
+    }
+    check(response, "half-band: gain of sines matches the coefficients");
+    check(passband && stopband, "half-band: passband and stopband");
+
+    // -- Stage: 4 interleaved channels, each with its own filter
+    DecimationStage stage;
+    bool configured = !stage.configureChannel(0, BOXCAR_FILTER, 4, 3, false, 8000).on_error &&
+                      !stage.configureChannel(1, CIC_FILTER, 8, 3, false, 8000).on_error &&
+                      !stage.configureChannel(3, CIC_FILTER, 16, 2, true, 8000).on_error;
+    const uint8_t width = 4;
+    const size_t frames = 2048;
+    std::vector<uint16_t> interleaved(frames * width);
+    for (uint16_t &sample : interleaved)
+    {
+        sample = generator() & 0xFFFF;
+    }
+    std::vector<int32_t> buffers[TOTAL_CHANNELS];
+    int32_t *outputs[TOTAL_CHANNELS] = {};
+    size_t counts[TOTAL_CHANNELS];
+    for (uint8_t ch = 0; ch < width; ch++)
+    {
+        buffers[ch].resize(frames / 4 + 1);
+        outputs[ch] = buffers[ch].data();
+    }
+    stage.process(interleaved.data(), frames, width, outputs, counts);
+
+    bool same = configured && counts[2] == 0;
+    const uint8_t channels[] = {0, 1, 3};
+    for (uint8_t ch : channels)
+    {
+        DecimationFilter alone;
+        alone.begin(ch == 0 ? BOXCAR_FILTER : CIC_FILTER, ch == 0 ? 4 : (ch == 1 ? 8 : 16), ch == 3 ? 2 : 3, ch == 3);
+        std::vector<uint16_t> single(frames);
+        for (size_t f = 0; f < frames; f++)
+        {
+            single[f] = interleaved[f * width + ch];
+        }
+        std::vector<int32_t> expected(frames);
+        size_t count = alone.process(single.data(), frames, expected.data());
+        same &= count == counts[ch] && memcmp(expected.data(), buffers[ch].data(), count * sizeof(int32_t)) == 0;
+    }
+    check(same, "stage: interleaved channels as filtered alone");
+
+    check(stage.getOutputRate(1) == 1000 && stage.getOutputRate(2) == 0 && fabs(stage.getENOB(0) - (AD7689_ENOB + 1)) < 1e-4 &&
+              fabs(stage.getENOB(3) - (AD7689_ENOB + 2)) < 1e-4,
+          "output rates and ENOB");
+
+    check(filter.begin(BOXCAR_FILTER, 1).on_error && filter.begin(BOXCAR_FILTER, 257).on_error &&
+              filter.begin(CIC_FILTER, 9, 3, true).on_error && filter.begin(CIC_FILTER, 8, 5).on_error &&
+              filter.begin(CIC_FILTER, 8, 0).on_error && stage.configureChannel(TOTAL_CHANNELS, BOXCAR_FILTER, 4).on_error,
+          "bad configurations refused");
+    return ok ? 0 : 1;
+}
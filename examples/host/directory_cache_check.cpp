@@ -0,0 +1,251 @@
+/*
+ * File Name: directory_cache_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks the directory listings and the metadata cache of EMMC_Memory on the SD_MMC stand-in of
+// examples/host/stand_in, where every file opened while walking a directory costs what it costs on FAT.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/memory/emmc
+//       examples/host/directory_cache_check.cpp src/libraries/memory/emmc/emmc_memory.cpp
+//       src/libraries/memory/emmc/emmc_directory.cpp -o directory_check
+//   ./directory_check
+//
+// A card with a few thousand ride logs, one directory per day, is written. Then:
+//  - listings and "newer than" queries from the cache are identical to walks of the card, at every depth, and cost
+//    no file system access; both in path order, with the cache or without;
+//  - after writes, overwrites, renames (of a directory too), deletes, new and removed directories, the cache still
+//    matches a walk of the whole card;
+//  - a file written through a File is picked up by refreshMetadata(), lines added with appendFile() at once;
+//  - the text listing of listDirectory(), and errors for missing directories.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <emmc_memory.h>
+
+#include <algorithm>
+
+//******************** SETTINGS
+#define DAYS 12
+#define RIDES_PER_DAY 250
+#define RAW_PER_DAY 10 // In a raw/ subdirectory of each day
+#define APPENDED_LINES 3
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+// -- listed as EMMC_Memory returns it, in path order, against walked in any order
+static bool sameEntries(const std::vector<EMMC_FileInfo> &a, std::vector<EMMC_FileInfo> b)
+{
+    auto byPath = [](const EMMC_FileInfo &x, const EMMC_FileInfo &y) { return strcmp(x.path.c_str(), y.path.c_str()) < 0; };
+    std::sort(b.begin(), b.end(), byPath);
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].path != b[i].path || a[i].size != b[i].size || a[i].last_write != b[i].last_write ||
+            a[i].is_directory != b[i].is_directory || a[i].level != b[i].level)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// -- The reference: a walk of the card, straight through the iterator
+static std::vector<EMMC_FileInfo> walk(const char *dirname, uint8_t levels)
+{
+    std::vector<EMMC_FileInfo> entries;
+    EMMC_DirectoryIterator iterator;
+    EMMC_FileInfo info;
+    iterator.begin(SD_MMC, dirname, levels);
+    while (iterator.next(info))
+    {
+        entries.push_back(info);
+    }
+    return entries;
+}
+
+static time_t day_start[DAYS];
+
+static void writeCard(EMMC_Memory &emmc)
+{
+    char path[64];
+    uint8_t data[600];
+    memset(data, 'x', sizeof(data));
+
+    emmc.makeDirectory("/logs");
+    emmc.makeDirectory("/config");
+    emmc.writeFile("/config/settings.json", (const uint8_t *)"{\"rate\":1000}", 13);
+    for (uint8_t day = 0; day < DAYS; day++)
+    {
+        delay(3600 * 1000UL); // An hour between rides
+        day_start[day] = micros() / 1000000;
+
+        snprintf(path, sizeof(path), "/logs/2021-09-%02u", day + 1);
+        emmc.makeDirectory(path);
+        for (uint16_t ride = 0; ride < RIDES_PER_DAY; ride++)
+        {
+            snprintf(path, sizeof(path), "/logs/2021-09-%02u/ride_%03u.csv", day + 1, ride);
+            emmc.writeFile(path, data, 100 + (ride * 7) % 500);
+        }
+
+        snprintf(path, sizeof(path), "/logs/2021-09-%02u/raw", day + 1);
+        emmc.makeDirectory(path);
+        for (uint16_t raw = 0; raw < RAW_PER_DAY; raw++)
+        {
+            snprintf(path, sizeof(path), "/logs/2021-09-%02u/raw/imu_%02u.bin", day + 1, raw);
+            emmc.writeFile(path, data, sizeof(data));
+        }
+    }
+}
+
+static void checkListings(EMMC_Memory &emmc)
+{
+    std::vector<EMMC_FileInfo> cached;
+
+    // -- A walk, for reference
+    SD_MMC.resetStats();
+    std::vector<EMMC_FileInfo> walked = walk("/logs", 1);
+    fs::FSStats walk_stats = SD_MMC.getStats();
+
+    SD_MMC.resetStats();
+    emmc.listDirectory("/logs", 1, cached);
+    emmc.listDirectory("/logs", 1, cached);
+    fs::FSStats cached_stats = SD_MMC.getStats();
+
+    printf("listing /logs: %u entries, walk %u opens %.2f s, cached %u opens\n", (unsigned)walked.size(),
+           walk_stats.opens, walk_stats.busy_us / 1e6, cached_stats.opens);
+    check(walked.size() == DAYS * (RIDES_PER_DAY + 2) && sameEntries(cached, walked), "listing from the cache");
+    check(cached_stats.opens == 0 && cached_stats.busy_us == 0, "repeated listings without file system access");
+
+    // -- Depth limits
+    bool depths = true;
+    for (uint8_t levels = 0; levels <= 3; levels++)
+    {
+        emmc.listDirectory("/", levels, cached);
+        depths &= sameEntries(cached, walk("/", levels));
+    }
+    emmc.listDirectory("/logs", 0, cached);
+    check(depths && cached.size() == DAYS, "depth limits");
+
+    // -- Files written since the middle of the rides
+    time_t since = day_start[DAYS / 2] - 1;
+    std::vector<EMMC_FileInfo> newer;
+    SD_MMC.resetStats();
+    emmc.findFilesNewerThan("/logs", since, newer);
+    bool only_newer = SD_MMC.getStats().opens == 0;
+
+    std::vector<EMMC_FileInfo> expected;
+    for (EMMC_FileInfo &entry : walk("/logs", EMMC_DIRECTORY_MAX_LEVELS))
+    {
+        if (!entry.is_directory && entry.last_write > since)
+        {
+            expected.push_back(entry);
+        }
+    }
+    printf("newer than: %u files\n", (unsigned)newer.size());
+    check(only_newer && newer.size() == (DAYS - DAYS / 2) * (RIDES_PER_DAY + RAW_PER_DAY) &&
+              sameEntries(newer, expected),
+          "files newer than a time, from RAM");
+}
+
+static void checkUpdates(EMMC_Memory &emmc)
+{
+    uint8_t data[2000] = {};
+    std::vector<EMMC_FileInfo> cached;
+    uint32_t updates = emmc.getMetadataCacheStats().updates;
+
+    delay(5000);
+    emmc.writeFile("/logs/2021-09-01/ride_new.csv", data, 1234);    // New
+    emmc.writeFile("/logs/2021-09-02/ride_000.csv", data, 2000);    // Overwritten
+    emmc.renameFile("/logs/2021-09-03/ride_000.csv", "/logs/2021-09-03/ride_first.csv");
+    emmc.renameFile("/logs/2021-09-04", "/archive");                // A directory and its contents
+    emmc.deleteFile("/logs/2021-09-05/ride_001.csv");
+    emmc.makeDirectory("/logs/2021-09-30");
+    emmc.makeDirectory("/logs/empty");
+    emmc.removeDirectory("/logs/empty");
+
+    emmc.listDirectory("/", EMMC_DIRECTORY_MAX_LEVELS, cached);
+    check(emmc.isMetadataCached() && emmc.getMetadataCacheStats().updates > updates &&
+              sameEntries(cached, walk("/", EMMC_DIRECTORY_MAX_LEVELS)),
+          "cache follows writes, renames and deletes");
+
+    // -- Written around EMMC_Memory, then refreshed
+    File file = SD_MMC.open("/logs/2021-09-06/stream.bin", FILE_WRITE);
+    file.write(data, sizeof(data));
+    file.close();
+    emmc.refreshMetadata("/logs/2021-09-06/stream.bin");
+    emmc.listDirectory("/", EMMC_DIRECTORY_MAX_LEVELS, cached);
+    check(sameEntries(cached, walk("/", EMMC_DIRECTORY_MAX_LEVELS)), "refreshMetadata picks up other writes");
+
+    // -- Lines appended to the file writeFile left open, each one in the cache before any flush
+    bool appended = !emmc.writeFile("/logs/2021-09-07/notes.txt", data, 10).on_error;
+    for (uint8_t line = 0; line < APPENDED_LINES; line++)
+    {
+        delay(2000);
+        appended &= !emmc.appendFile("/logs/2021-09-07/notes.txt", "lap").on_error;
+        emmc.listDirectory("/logs/2021-09-07", 0, cached);
+        appended &= sameEntries(cached, walk("/logs/2021-09-07", 0));
+    }
+    EMMC_FileInfo notes;
+    emmc.listDirectory("/logs/2021-09-07", 0, cached);
+    for (EMMC_FileInfo &entry : cached)
+    {
+        notes = entry.path == "/logs/2021-09-07/notes.txt" ? entry : notes;
+    }
+    check(appended && notes.size == 10 + APPENDED_LINES * 5, "cache follows every append");
+}
+
+static void checkText(EMMC_Memory &emmc)
+{
+    ESP_ERROR err = emmc.listDirectory("/config", 0);
+    check(!err.on_error && strstr(err.debug_message.c_str(), "\tFile: /config/settings.json - Size: 13 bytes\n"),
+          "text listing");
+
+    std::vector<EMMC_FileInfo> entries;
+    check(emmc.listDirectory("/missing", 0, entries).on_error &&
+              emmc.listDirectory("/config/settings.json", 0, entries).on_error,
+          "missing directory reported");
+}
+
+int main()
+{
+    EMMC_Memory emmc;
+    emmc.begin(-1, -1);
+    writeCard(emmc);
+
+    // -- Mount again with the cache: one walk, then lookups
+    EMMC_Memory cached;
+    cached.setMetadataCache(true);
+    SD_MMC.resetStats();
+    check(!cached.begin(-1, -1).on_error && cached.isMetadataCached(), "cache built at mount");
+    printf("cache: %u entries, built with %u opens, %.2f s of file system time\n",
+           cached.getMetadataCacheStats().entries, SD_MMC.getStats().opens, SD_MMC.getStats().busy_us / 1e6);
+
+    checkListings(cached);
+    checkUpdates(cached);
+    checkText(cached);
+
+    // -- Without the cache, the same answers from walks
+    std::vector<EMMC_FileInfo> entries;
+    check(!emmc.listDirectory("/", EMMC_DIRECTORY_MAX_LEVELS, entries).on_error &&
+              sameEntries(entries, walk("/", EMMC_DIRECTORY_MAX_LEVELS)),
+          "listing without the cache walks the card");
+    return ok ? 0 : 1;
+}
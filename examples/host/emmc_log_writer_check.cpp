@@ -0,0 +1,201 @@
+/*
+ * File Name: emmc_log_writer_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks EMMC_LogWriter and EMMC_LogReader on the file system stand-in of examples/host/stand_in, which injects the
+// cluster allocation stalls of FAT (see stand_in/FS.h).
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/memory/emmc
+//       examples/host/emmc_log_writer_check.cpp src/libraries/memory/emmc/emmc_log_writer.cpp -o log_check
+//   ./log_check
+//
+// Checks:
+//  - appending to a growing file, for reference: worst write latency with the FAT stalls;
+//  - the log writer on the same data: no allocation after begin(), worst write() latency;
+//  - the ring: after wrapping, the reader returns the newest data, in order;
+//  - power loss: data up to the last sync() is read back, nothing after it;
+//  - sessions: a new begin() reuses the segments and continues after the previous session.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <emmc_log_writer.h>
+
+#include <vector>
+
+//******************** SETTINGS
+#define RECORD_SIZE 48                         // Bytes per record
+#define DATA_MB 24                             // Written in each check
+#define SEGMENT_COUNT 4                        // Ring of 4 x 4 MB, wraps 1.5 times
+#define SEGMENT_SIZE (4UL * 1024 * 1024)
+#define SYNC_EVERY (1024UL * 1024)             // Bytes between sync() calls
+#define MAX_LOG_LATENCY_US 5000                // Worst write() accepted, stalls of the reference are 30 ms
+#define RECORDS (DATA_MB * 1000000UL / RECORD_SIZE)
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+static void makeRecord(uint32_t counter, uint8_t *record)
+{
+    memcpy(record, &counter, sizeof(counter));
+    for (size_t i = sizeof(counter); i < RECORD_SIZE; i++)
+    {
+        record[i] = (uint8_t)(counter * 7 + i);
+    }
+}
+
+// Writes records [first, first + count) and returns the worst write() time
+template <typename Writer>
+static uint32_t writeRecords(Writer &writer, uint32_t first, uint32_t count, size_t sync_every = 0)
+{
+    uint8_t record[RECORD_SIZE];
+    uint32_t worst = 0;
+    size_t since_sync = 0;
+
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        makeRecord(i, record);
+        uint32_t start = micros();
+        writer.write(record, RECORD_SIZE);
+        worst = max(worst, (uint32_t)(micros() - start));
+
+        since_sync += RECORD_SIZE;
+        if (sync_every && since_sync >= sync_every)
+        {
+            writer.sync();
+            since_sync = 0;
+        }
+    }
+    return worst;
+}
+
+// Reads the whole log, which must hold the end of the record stream [0, last]. Returns the number of records seen
+static uint32_t readBack(fs::FS &file_system, uint32_t last, bool &in_order)
+{
+    EMMC_LogReader reader;
+    in_order = !reader.begin(file_system, "/log").on_error;
+
+    std::vector<uint8_t> data(reader.getSize());
+    in_order &= reader.read(data.data(), data.size()) == data.size();
+    uint8_t extra;
+    in_order &= reader.read(&extra, 1) == 0;
+
+    // The oldest segment may start in the middle of a record
+    uint64_t total = (uint64_t)(last + 1) * RECORD_SIZE;
+    size_t offset = (RECORD_SIZE - (total - data.size()) % RECORD_SIZE) % RECORD_SIZE;
+    uint32_t first = (uint32_t)((total - data.size() + offset) / RECORD_SIZE);
+
+    uint8_t expected[RECORD_SIZE];
+    uint32_t seen = 0;
+    for (size_t i = offset; in_order && i + RECORD_SIZE <= data.size(); i += RECORD_SIZE, seen++)
+    {
+        makeRecord(first + seen, expected);
+        in_order = memcmp(&data[i], expected, RECORD_SIZE) == 0;
+    }
+    in_order &= seen > 0 && first + seen - 1 == last;
+    return seen;
+}
+
+// Appends to a growing file, as EMMC_Memory::appendFile and the stream writer do
+static void checkAppend()
+{
+    fs::FS file_system;
+    File file = file_system.open("/append.log", FILE_APPEND);
+    uint8_t block[EMMC_LOG_BLOCK_SIZE] = {};
+    uint32_t worst = 0;
+
+    for (uint64_t written = 0; written < DATA_MB * 1000000ULL; written += sizeof(block))
+    {
+        uint32_t start = micros();
+        file.write(block, sizeof(block));
+        worst = max(worst, (uint32_t)(micros() - start));
+    }
+    file.close();
+
+    fs::FSStats stats = file_system.getStats();
+    printf("append: %u clusters allocated, %u FAT stalls, worst 32 KB write %.2f ms\n", stats.clusters_allocated,
+           stats.fat_scans, worst / 1000.);
+}
+
+static void checkRing()
+{
+    fs::FS file_system;
+    EMMC_LogWriter writer;
+    ESP_ERROR err = writer.begin(file_system, "/log", SEGMENT_COUNT, SEGMENT_SIZE);
+    check(!err.on_error, "begin");
+
+    fs::FSStats allocation = file_system.getStats();
+    file_system.resetStats();
+    uint32_t worst = writeRecords(writer, 0, RECORDS, SYNC_EVERY);
+    check(!writer.close().on_error, "close");
+
+    EMMC_LogStats stats = writer.getStats();
+    fs::FSStats logging = file_system.getStats();
+    printf("log: begin %u ms (%u clusters), then %u clusters, %u partial sectors, %u rotations\n",
+           stats.preallocation_ms, allocation.clusters_allocated, logging.clusters_allocated,
+           logging.partial_sectors, stats.rotations);
+    printf("log: worst write() %.2f ms, block %.2f ms mean, rotation %.2f ms, sync %.2f ms\n", worst / 1000.,
+           stats.mean_block_latency_us / 1000., stats.max_rotation_us / 1000., stats.max_sync_us / 1000.);
+    check(logging.clusters_allocated == 0, "no allocation while logging");
+    check(logging.partial_sectors == 0, "sector aligned writes");
+    check(worst < MAX_LOG_LATENCY_US, "worst write() latency");
+
+    bool in_order;
+    uint32_t seen = readBack(file_system, RECORDS - 1, in_order);
+    printf("read back %u records of %lu\n", seen, RECORDS);
+    check(in_order, "newest data read back in order after wrapping");
+    check(seen * RECORD_SIZE > (SEGMENT_COUNT - 1) * (SEGMENT_SIZE - EMMC_LOG_HEADER_SIZE), "ring nearly full");
+
+    // Next session: segments reused, written after the previous session
+    file_system.resetStats();
+    err = writer.begin(file_system, "/log", SEGMENT_COUNT, SEGMENT_SIZE);
+    check(!err.on_error && writer.getSession() == 2, "second session");
+    check(file_system.getStats().clusters_allocated == 0, "segments reused");
+    writeRecords(writer, RECORDS, 10000);
+    writer.close();
+
+    readBack(file_system, RECORDS + 10000 - 1, in_order);
+    check(in_order, "second session continues the first");
+}
+
+static void checkPowerLoss()
+{
+    fs::FS file_system;
+    EMMC_LogWriter *writer = new EMMC_LogWriter();
+    writer->begin(file_system, "/log", SEGMENT_COUNT, SEGMENT_SIZE);
+
+    // Synced in the middle of a segment and of a block, then more data in the same segment, never synced. A
+    // rotation would have recorded it as well
+    const uint32_t synced = 5 * SEGMENT_SIZE / RECORD_SIZE + 1234;
+    writeRecords(*writer, 0, synced);
+    writer->sync();
+    uint8_t segment = writer->getSegment();
+    writeRecords(*writer, synced, 1000);
+    check(writer->getSegment() == segment, "power loss: unsynced data in the same segment");
+
+    // Power cut: the writer is never closed, the file system keeps what was written
+    bool in_order;
+    readBack(file_system, synced - 1, in_order);
+    check(in_order, "power loss: everything up to the last sync");
+}
+
+int main()
+{
+    checkAppend();
+    checkRing();
+    checkPowerLoss();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+/*
+ * File Name: mpu9250_legacy_mahony.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Writes mpu9250_legacy_mahony.csv, the fixture of mpu9250_legacy_check.cpp: synthetic motion quantised to register
+// counts, and the orientation the former driver computed from them with MahonyQuaternionUpdate. The former filter is
+// not copied here, it is built from the last commit that has it, as it was, and once more with the integration of
+// q2..q4 taking the q1 of the previous step (ordered_* columns).
+//
+// Build and run from the repository root:
+//
+//   mkdir -p legacy && git show 81f1359:src/libraries/imu/old/quaternionFilters.h > legacy/quaternionFilters.h
+//   git show 81f1359:src/libraries/imu/old/quaternionFilters.cpp > legacy/quaternionFilters.cpp
+//   sed -e 's/^  q1 = q1 + /  float p0 = q1;\n  q1 = q1 + /' -e 's/^\(  q[234] = p[abc] + (\)q1/\1p0/'
+//       -e 's/MahonyQuaternionUpdate/MahonyQuaternionUpdateOrdered/;s/MadgwickQuaternionUpdate/MadgwickOrdered/'
+//       -e 's/getQ /getQOrdered /' legacy/quaternionFilters.cpp > legacy/quaternionFiltersOrdered.cpp
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Ilegacy examples/host/fixtures/mpu9250_legacy_mahony.cpp
+//       legacy/quaternionFilters.cpp legacy/quaternionFiltersOrdered.cpp -o mpu9250_legacy_mahony
+//   ./mpu9250_legacy_mahony > examples/host/fixtures/mpu9250_legacy_mahony.csv
+//
+// The filter is fed what MPU9250_ computes from the counts: scaled, in the aircraft frame, gyro in rad/s, the
+// magnetometer held between its samples, and the data ready time as dt.
+//
+// Mateo :)
+
+#include <Arduino.h>
+
+#include <random>
+
+#include "quaternionFilters.h"
+
+void MahonyQuaternionUpdateOrdered(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my,
+                                   float mz, float deltat);
+const float *getQOrdered();
+
+//******************** SETTINGS
+#define SAMPLES 1000
+#define SAMPLE_PERIOD_uS 5000 // 200 Hz, the magnetometer at 100 Hz
+#define SEED 1
+
+static void multiply(const double *p, const double *q, double *r)
+{
+    r[0] = p[0] * q[0] - p[1] * q[1] - p[2] * q[2] - p[3] * q[3];
+    r[1] = p[0] * q[1] + p[1] * q[0] + p[2] * q[3] - p[3] * q[2];
+    r[2] = p[0] * q[2] - p[1] * q[3] + p[2] * q[0] + p[3] * q[1];
+    r[3] = p[0] * q[3] + p[1] * q[2] - p[2] * q[1] + p[3] * q[0];
+}
+
+// A vector of the NED frame, in the body frame of orientation q
+static void toBody(const double *q, const double *v, double *out)
+{
+    const double conj[4] = {q[0], -q[1], -q[2], -q[3]};
+    const double vq[4] = {0., v[0], v[1], v[2]};
+    double tmp[4], r[4];
+    multiply(conj, vq, tmp);
+    multiply(tmp, q, r);
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        out[i] = r[i + 1];
+    }
+}
+
+static int16_t count(double value)
+{
+    return (int16_t)lround(std::max(-32768., std::min(32767., value)));
+}
+
+int main()
+{
+    // A16G, G2000DPS, M16BITS, no factory adjustment, bias or scale: the driver's scaling
+    const double dt = SAMPLE_PERIOD_uS * 1e-6;
+    const float acc_res = 16.f / 32768.f, gyro_res = 2000.f / 32768.f;
+    const float mag_res = (float)(10. * 4912. / 32760.0);
+    std::mt19937 rng(SEED);
+    std::normal_distribution<double> acc_noise(0., 0.01), gyro_noise(0., 0.3), mag_noise(0., 4.);
+    const double gravity[3] = {0., 0., 1.}, field[3] = {200., 0., 450.};
+    const double gyro_bias[3] = {0.8, -0.5, 0.3}; // dps, sensor axes
+    double q[4] = {1., 0., 0., 0.};
+
+    printf("# MPU9250 at 200 Hz, 16 g, 2000 dps, AK8963 16 bit at 100 Hz: 5 s of register counts, and the orientation\n");
+    printf("# the legacy driver computed from them (src/libraries/imu/old/quaternionFilters.cpp, MahonyQuaternionUpdate,\n");
+    printf("# Kp 10, Ki 0, at 81f1359).\n");
+    printf("#\n");
+    printf("# Not a recording of a chip: the motion is synthetic, three sine rates, with gyro bias and noise, quantised to\n");
+    printf("# counts. The legacy filter was fed what MPU9250_ computes from the counts: scaled, in the aircraft frame\n");
+    printf("# (-ax, ay, az, gx, -gy, -gz, my, -mx, mz), gyro in rad/s, the magnetometer held between its samples, dt 5 ms.\n");
+    printf("# legacy_* is its output, ordered_* the same with q2..q4 integrated from the previous q1, as QuaternionFilter.\n");
+    printf("#\n");
+    printf("acc_x,acc_y,acc_z,gyro_x,gyro_y,gyro_z,mag_x,mag_y,mag_z,mag_ready,legacy_w,legacy_x,legacy_y,legacy_z,"
+           "ordered_w,ordered_x,ordered_y,ordered_z\n");
+
+    int16_t held_mag[3] = {0, 0, 0};
+    for (int n = 0; n < SAMPLES; n++)
+    {
+        // -- The motion: rates in rad/s, NED body frame
+        const double t = n * dt;
+        const double w[3] = {1.5 * sin(1.4 * t), 1.0 * sin(0.9 * t + 1.), 2.0 * sin(0.6 * t + 2.)};
+        double a[3], m[3];
+        toBody(q, gravity, a);
+        toBody(q, field, m);
+
+        // -- NED body to sensor axes, the inverse of the driver's mapping, then counts
+        const double acc_s[3] = {-a[0], a[1], a[2]};
+        const double gyro_s[3] = {w[0] * 180. / M_PI, -w[1] * 180. / M_PI, -w[2] * 180. / M_PI};
+        const double mag_s[3] = {-m[1], m[0], m[2]};
+        int16_t ac[3], gc[3], mc[3];
+        for (uint8_t k = 0; k < 3; k++)
+        {
+            ac[k] = count((acc_s[k] + acc_noise(rng)) / acc_res);
+            gc[k] = count((gyro_s[k] + gyro_bias[k] + gyro_noise(rng)) / gyro_res);
+            mc[k] = count((mag_s[k] + mag_noise(rng)) / mag_res);
+        }
+        const bool ready = n % 2 == 0;
+        if (ready)
+        {
+            memcpy(held_mag, mc, sizeof(held_mag));
+        }
+
+        // -- What MPU9250_ hands to the filter
+        float af[3], gf[3], mf[3];
+        for (uint8_t k = 0; k < 3; k++)
+        {
+            af[k] = (float)ac[k] * acc_res;
+            gf[k] = (float)gc[k] * gyro_res;
+            mf[k] = (float)held_mag[k] * mag_res;
+        }
+        const float an = -af[0], ae = +af[1], ad = +af[2];
+        const float gn = +gf[0] * DEG_TO_RAD, ge = -gf[1] * DEG_TO_RAD, gd = -gf[2] * DEG_TO_RAD;
+        const float mn = +mf[1], me = -mf[0], md = +mf[2];
+        // As the driver: the first dt from the millisecond clock, then from the data ready times
+        const float deltat = n == 0 ? 5.f / 1000.f : SAMPLE_PERIOD_uS * 1e-6f;
+        MahonyQuaternionUpdate(an, ae, ad, gn, ge, gd, mn, me, md, deltat);
+        MahonyQuaternionUpdateOrdered(an, ae, ad, gn, ge, gd, mn, me, md, deltat);
+
+        const float *l = getQ(), *o = getQOrdered();
+        printf("%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n", ac[0], ac[1], ac[2], gc[0],
+               gc[1], gc[2], mc[0], mc[1], mc[2], ready ? 1 : 0, l[0], l[1], l[2], l[3], o[0], o[1], o[2], o[3]);
+
+        // -- Next orientation
+        const double wq[4] = {0., w[0], w[1], w[2]};
+        double dq[4], norm = 0.;
+        multiply(q, wq, dq);
+        for (uint8_t k = 0; k < 4; k++)
+        {
+            q[k] += 0.5 * dq[k] * dt;
+            norm += q[k] * q[k];
+        }
+        norm = sqrt(norm);
+        for (uint8_t k = 0; k < 4; k++)
+        {
+            q[k] /= norm;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * File Name: flash_emulator.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// NOR flash emulator for RecordStore, optionally backed by a file so its contents survive the program:
+//
+//  - write() only clears bits, like the real thing. Programming a 1 over a 0 is counted in overwrites, which is a bug
+//    of whoever wrote there without erasing;
+//  - erase() sets whole 4 KB sectors to 0xFF, and counts the erases of each sector;
+//  - cutPowerAfter(n) loses the power after n more operations, each programmed byte and each erased 256 byte chunk
+//    being one. The byte being programmed gets a random part of its bits, the chunk being erased random contents,
+//    and every access fails until powerOn().
+//
+// Mateo :)
+
+#pragma once
+
+#include <record_store.h>
+
+#include <random>
+#include <vector>
+
+class FlashEmulator : public RecordStoreFlash
+{
+public:
+    static const uint32_t ERASE_CHUNK = 256;
+
+    struct Stats
+    {
+        uint64_t bytes_programmed = 0;
+        uint64_t bytes_read = 0;
+        uint32_t erases = 0;
+        uint32_t overwrites = 0; // Bytes programmed over cleared bits
+    };
+
+    // -- path nullptr: in memory only. An existing file of the right size is loaded
+    FlashEmulator(uint32_t size, const char *path = nullptr) : memory(size, 0xFF), erase_counts(size / RECORD_STORE_SECTOR_SIZE)
+    {
+        if (path == nullptr)
+        {
+            return;
+        }
+
+        file = fopen(path, "r+b");
+        if (file && fread(memory.data(), 1, size, file) != size)
+        {
+            std::fill(memory.begin(), memory.end(), 0xFF);
+        }
+        if (file == nullptr)
+        {
+            file = fopen(path, "w+b");
+        }
+        save(0, size);
+    }
+
+    ~FlashEmulator()
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+    }
+
+    uint32_t size() override { return memory.size(); }
+
+    bool read(uint32_t address, void *data, size_t length) override
+    {
+        if (!powered || address + length > memory.size())
+        {
+            return false;
+        }
+        memcpy(data, &memory[address], length);
+        stats.bytes_read += length;
+        return true;
+    }
+
+    bool write(uint32_t address, const void *data, size_t length) override
+    {
+        if (!powered || address + length > memory.size())
+        {
+            return false;
+        }
+
+        const uint8_t *bytes = (const uint8_t *)data;
+        bool done = true;
+        size_t i = 0;
+        for (; i < length; i++)
+        {
+            if (spend())
+            {
+                memory[address + i] &= bytes[i] | (uint8_t)random();
+                done = false;
+                i++;
+                break;
+            }
+            stats.overwrites += (bytes[i] & ~memory[address + i]) != 0;
+            memory[address + i] &= bytes[i];
+            stats.bytes_programmed++;
+        }
+        save(address, i);
+        return done;
+    }
+
+    bool erase(uint32_t address, size_t length) override
+    {
+        if (!powered || address % RECORD_STORE_SECTOR_SIZE || length % RECORD_STORE_SECTOR_SIZE ||
+            address + length > memory.size())
+        {
+            return false;
+        }
+
+        for (uint32_t sector = address; sector < address + length; sector += RECORD_STORE_SECTOR_SIZE)
+        {
+            erase_counts[sector / RECORD_STORE_SECTOR_SIZE]++;
+            stats.erases++;
+            for (uint32_t chunk = sector; chunk < sector + RECORD_STORE_SECTOR_SIZE; chunk += ERASE_CHUNK)
+            {
+                bool cut = spend();
+                for (uint32_t i = chunk; i < chunk + ERASE_CHUNK; i++)
+                {
+                    memory[i] = cut ? (uint8_t)random() : 0xFF;
+                }
+                save(chunk, ERASE_CHUNK);
+                if (cut)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // -- Power loss injection
+    void cutPowerAfter(uint64_t operations) { budget = operations; }
+    void powerOn()
+    {
+        powered = true;
+        budget = UINT64_MAX;
+    }
+    bool isPowered() const { return powered; }
+
+    const Stats &getStats() const { return stats; }
+    const std::vector<uint32_t> &getEraseCounts() const { return erase_counts; }
+    void seed(uint32_t value) { random.seed(value); }
+
+private:
+    // -- One operation of the budget. True when the power goes
+    bool spend()
+    {
+        if (budget == 0)
+        {
+            powered = false;
+            return true;
+        }
+        budget--;
+        return false;
+    }
+
+    void save(uint32_t address, size_t length)
+    {
+        if (file && length)
+        {
+            fseek(file, address, SEEK_SET);
+            fwrite(&memory[address], 1, length, file);
+            fflush(file);
+        }
+    }
+
+    std::vector<uint8_t> memory;
+    std::vector<uint32_t> erase_counts;
+    FILE *file = nullptr;
+    bool powered = true;
+    uint64_t budget = UINT64_MAX;
+    std::minstd_rand random{1};
+    Stats stats;
+};
@@ -0,0 +1,319 @@
+/*
+ * File Name: io_queue_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks EMMC_IOQueue on the SD_MMC stand-in of examples/host/stand_in, with the card pulled out in the middle of a
+// recording and put back a second later.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/memory/emmc
+//       examples/host/io_queue_check.cpp src/libraries/memory/emmc/emmc_io_queue.cpp
+//       src/libraries/memory/emmc/emmc_memory.cpp src/libraries/memory/emmc/emmc_directory.cpp -o io_queue_check
+//   ./io_queue_check
+//
+// Two sensors send 32 byte records at 1 kHz each, one file per sensor, while the writer runs from the loop
+// (EMMC_IO_NO_TASK). The card loses what wasn't flushed when it's pulled, as FAT does. For each policy:
+//  - IO_BUFFER with room for the outage: every record on the card once, in order, none torn;
+//  - IO_BUFFER with a small ring: producers told to slow down, then the newest records dropped;
+//  - IO_DROP_OLDEST with a small ring: the oldest records dropped, the newest kept;
+//  - IO_DROP: the records sent during the outage dropped, the others written;
+//  - no detect pin: the removal found from a failed write, remount once the card is back.
+// And, with the byte counts of the ring started just short of 2^32 and a ring size that isn't a power of two, every
+// record written whole and in order across the wrap.
+// In every case records on the card + records dropped = records sent, producers never wait, and the card is
+// unmounted while it's out (EMMC_Memory refuses writes instead of using a dangling file).
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <emmc_io_queue.h>
+
+#include <vector>
+
+//******************** SETTINGS
+#define SENSORS 2
+#define RATE_HZ 1000        // Per sensor
+#define ENABLE_PIN 33
+#define DETECT_PIN 34
+#define REMOVE_AT_mS 2000
+#define INSERT_AT_mS 3000
+#define RUN_mS 6000
+#define MAX_WRITE_uS 2000   // Producer write() call, PC time
+#define WRAP_RING 10000     // Not a power of two, begin() takes 8192
+#define WRAP_START 0xFFFFF000 // Byte counts 4 KB short of their wrap
+#define WRAP_RECORDS 2000
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+struct Record
+{
+    uint32_t sequence;
+    uint32_t time_ms;
+    uint32_t sensor;
+    float values[4];
+    uint32_t check;
+};
+
+static uint32_t recordCheck(const Record &record)
+{
+    return record.sequence * 2654435761u ^ record.sensor ^ record.time_ms;
+}
+
+static const char *paths[SENSORS] = {"/imu.bin", "/shock.bin"};
+
+struct Run
+{
+    uint32_t sent;
+    uint32_t on_card;        // Valid records in the files
+    bool in_order;           // Increasing sequences, nothing torn or duplicated
+    bool complete;           // No sequence missing
+    uint32_t last_before_insert; // Newest sequence sent before the card came back, first sensor
+    bool newest_kept;        // That record is on the card
+    uint32_t slow_downs_seen;
+    bool refused_while_out;  // EMMC_Memory refused a write during the outage
+    EMMC_IOStats stats;
+    ESP_ERROR close;
+};
+
+// -- Every file: whole records, valid, increasing sequence
+static void readBack(Run &run)
+{
+    run.on_card = 0;
+    run.in_order = true;
+    run.complete = true;
+    run.newest_kept = false;
+
+    for (uint8_t sensor = 0; sensor < SENSORS; sensor++)
+    {
+        const std::vector<uint8_t> *data = SD_MMC.contents(paths[sensor]);
+        if (data == nullptr || data->size() % sizeof(Record) != 0)
+        {
+            run.in_order = false;
+            continue;
+        }
+
+        int64_t previous = -1;
+        for (size_t offset = 0; offset < data->size(); offset += sizeof(Record))
+        {
+            Record record;
+            memcpy(&record, data->data() + offset, sizeof(record));
+            run.in_order &= record.check == recordCheck(record) && record.sensor == sensor &&
+                            (int64_t)record.sequence > previous;
+            run.complete &= (int64_t)record.sequence == previous + 1;
+            run.newest_kept |= sensor == 0 && record.sequence == run.last_before_insert;
+            previous = record.sequence;
+            run.on_card++;
+        }
+    }
+}
+
+static void pullCard(bool detect_pin)
+{
+    SD_MMC.removeCard();
+    if (detect_pin)
+    {
+        host_pin_levels[DETECT_PIN] = HIGH;
+    }
+}
+
+static void insertCard()
+{
+    SD_MMC.insertCard();
+    host_pin_levels[DETECT_PIN] = LOW;
+}
+
+// -- The ring's byte counts wrap around after 4 GB, too long to run here
+struct EMMC_IOQueueCheck
+{
+    static void startCountsAt(EMMC_IOQueue &queue, uint32_t count)
+    {
+        queue.produced = count;
+        queue.written = count;
+        queue.committed = count;
+    }
+
+    static size_t ringSize(EMMC_IOQueue &queue)
+    {
+        return queue.ring_size;
+    }
+};
+
+static void checkCountWrap()
+{
+    SD_MMC.remove(paths[0]);
+    EMMC_Memory emmc;
+    emmc.begin(ENABLE_PIN, DETECT_PIN);
+    EMMC_IOQueue queue;
+    queue.addFile(paths[0]);
+    queue.begin(emmc, IO_BUFFER, WRAP_RING, EMMC_IO_NO_TASK);
+    EMMC_IOQueueCheck::startCountsAt(queue, WRAP_START);
+    check(EMMC_IOQueueCheck::ringSize(queue) == 8192, "ring rounded down to a power of two");
+
+    bool queued = true;
+    for (uint32_t sequence = 0; sequence < WRAP_RECORDS; sequence++)
+    {
+        Record record = {sequence, sequence, 0, {1.f, -1.f, 9.81f, 0.f}, 0};
+        record.check = recordCheck(record);
+        queued &= queue.write(0, &record, sizeof(record)) != IO_DROPPED;
+        if (sequence % 64 == 63)
+        {
+            queue.service();
+        }
+    }
+    bool closed = !queue.close().on_error;
+    emmc.end();
+
+    const std::vector<uint8_t> *data = SD_MMC.contents(paths[0]);
+    bool intact = data != nullptr && data->size() == WRAP_RECORDS * sizeof(Record);
+    for (size_t offset = 0; intact && offset < data->size(); offset += sizeof(Record))
+    {
+        Record record;
+        memcpy(&record, data->data() + offset, sizeof(record));
+        intact = record.check == recordCheck(record) && record.sequence == offset / sizeof(Record);
+    }
+    check(queued && closed && intact,
+          "byte counts wrapping: every record whole, in order");
+}
+
+static Run record(EMMC_IO_POLICY policy, size_t buffer_size, bool detect_pin = true)
+{
+    Run run = {};
+    for (const char *path : paths)
+    {
+        SD_MMC.remove(path);
+    }
+
+    EMMC_Memory emmc;
+    emmc.begin(ENABLE_PIN, detect_pin ? DETECT_PIN : -1);
+
+    EMMC_IOQueue queue;
+    for (const char *path : paths)
+    {
+        queue.addFile(path);
+    }
+    queue.begin(emmc, policy, buffer_size, EMMC_IO_NO_TASK);
+
+    uint32_t sequence[SENSORS] = {};
+    uint32_t start_ms = millis();
+    uint64_t next_us = micros();
+    bool removed = false, inserted = false;
+
+    for (uint32_t now = 0; now < RUN_mS; now = millis() - start_ms)
+    {
+        if (!removed && now >= REMOVE_AT_mS)
+        {
+            pullCard(detect_pin);
+            removed = true;
+        }
+        if (removed && !inserted && now >= INSERT_AT_mS)
+        {
+            run.last_before_insert = sequence[0] - 1;
+            insertCard();
+            inserted = true;
+        }
+        if (removed && !inserted && queue.getState() == IO_SUSPENDED)
+        {
+            run.refused_while_out |= emmc.appendFile("/other.txt", "x").on_error;
+        }
+
+        // -- The sensors, on time whatever the card does
+        for (; next_us <= micros(); next_us += 1000000 / RATE_HZ)
+        {
+            for (uint8_t sensor = 0; sensor < SENSORS; sensor++)
+            {
+                Record record = {sequence[sensor]++, now, sensor, {0.1f * now, -1.f, 9.81f, (float)sensor}, 0};
+                record.check = recordCheck(record);
+                run.sent++;
+                run.slow_downs_seen += queue.write(sensor, &record, sizeof(record)) == IO_SLOW_DOWN;
+            }
+        }
+
+        queue.service();
+        delay(1);
+    }
+
+    run.close = queue.close();
+    run.stats = queue.getStats();
+    emmc.end();
+    readBack(run);
+    return run;
+}
+
+static void report(const char *name, const Run &run)
+{
+    printf("%-24s sent %5u, on card %5u, dropped %5u, max depth %6u B, retried %3u, remount %4u ms, write %u us\n",
+           name, run.sent, run.on_card, run.stats.records_dropped, run.stats.max_depth, run.stats.records_retried,
+           run.stats.last_remount_ms, run.stats.max_write_us);
+}
+
+static bool accounted(const Run &run)
+{
+    return run.in_order && run.on_card + run.stats.records_dropped == run.sent && !run.close.on_error &&
+           run.stats.removals == 1 && run.stats.remounts == 1 && run.stats.max_write_us <= MAX_WRITE_uS;
+}
+
+int main()
+{
+    // -- Room for the whole outage: 1 s of 64 KB/s
+    Run buffered = record(IO_BUFFER, 128 * 1024);
+    report("buffer, 128 KB", buffered);
+    check(accounted(buffered) && buffered.complete && buffered.stats.records_dropped == 0,
+          "buffer: every record on the card once, in order");
+    check(buffered.stats.records_retried > 0, "records not synced at the removal written again");
+    check(buffered.refused_while_out, "card unmounted while out");
+    check(buffered.stats.last_remount_ms >= INSERT_AT_mS - REMOVE_AT_mS &&
+              buffered.stats.last_remount_ms <= INSERT_AT_mS - REMOVE_AT_mS + EMMC_IO_REMOUNT_INTERVAL_mS + 500,
+          "remounted within a retry interval of the insertion");
+
+    // -- Small ring: backpressure, then the newest dropped
+    Run full = record(IO_BUFFER, 32 * 1024);
+    report("buffer, 32 KB", full);
+    check(accounted(full) && full.stats.records_dropped > 0 && !full.newest_kept, "buffer: ring full, newest dropped");
+    check(full.slow_downs_seen > 0 && full.slow_downs_seen == full.stats.slow_downs, "producers told to slow down");
+
+    Run oldest = record(IO_DROP_OLDEST, 32 * 1024);
+    report("drop oldest, 32 KB", oldest);
+    check(accounted(oldest) && oldest.stats.records_dropped > 0 && oldest.newest_kept,
+          "drop oldest: oldest dropped, newest kept");
+
+    Run dropped = record(IO_DROP, 128 * 1024);
+    report("drop, 128 KB", dropped);
+    // The outage starts and ends on a loop tick, a record per sensor either way
+    check(accounted(dropped) &&
+              dropped.stats.records_dropped >= (INSERT_AT_mS - REMOVE_AT_mS - 1) * SENSORS * RATE_HZ / 1000,
+          "drop: records sent while out dropped");
+
+    Run no_pin = record(IO_BUFFER, 128 * 1024, false);
+    report("no detect pin", no_pin);
+    check(accounted(no_pin) && no_pin.complete, "no detect pin: removal found from a failed write");
+
+    // -- Closed while the card is out: the loss is reported
+    EMMC_Memory emmc;
+    emmc.begin(ENABLE_PIN, DETECT_PIN);
+    EMMC_IOQueue queue;
+    queue.addFile("/last.bin");
+    queue.begin(emmc, IO_BUFFER, 8192, EMMC_IO_NO_TASK);
+    queue.write(0, "record");
+    pullCard(true);
+    queue.service();
+    check(queue.getState() == IO_SUSPENDED && queue.close().on_error, "closing with the card out reports the loss");
+    insertCard();
+
+    check(queue.begin(emmc, IO_BUFFER, 100, EMMC_IO_NO_TASK).on_error, "ring too small refused");
+
+    checkCountWrap();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+/*
+ * File Name: mpu9250_calibration_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks the background calibration of MPU9250_ on the register model of mpu9250_model.h, fed by updateFromFifo,
+// and the calibration file on the in-memory fs::FS of the stand-ins. The model gives accel and gyro biases, and a
+// magnetometer on an ellipsoid with a hard iron offset, swept over every direction when ROTATING.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -DARDUINO -Iexamples/host/stand_in -Isrc -Isrc/libraries/imu
+//       examples/host/mpu9250_calibration_check.cpp -o mpu9250_calibration_check
+//   ./mpu9250_calibration_check
+//
+// Checks:
+//  - accel/gyro: motion keeps restarting the still window, a second still gives the biases of the model, gravity
+//    removed, the gyro offset registers written; then on to the magnetometer;
+//  - magnetometer: nothing while the direction doesn't change, the ellipsoid center and radii once rotated, DONE,
+//    also with a hard iron offset larger than the field, and with 14 bit output, the hard iron removed from the
+//    readings;
+//  - a magnetometer step never completed fails after the timeout and keeps the previous calibration, cancel goes back
+//    to IDLE;
+//  - saveMPU9250Calibration / loadMPU9250Calibration round trip, corrupt and short records refused, a save
+//    interrupted before the rename recovered, a failed save leaving the previous file.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <MPU9250CalibrationFile.h>
+
+#include "mpu9250_model.h"
+
+//******************** SETTINGS
+#define STEP_mS 20     // FIFO read interval
+#define MAG_POINTS 400 // Directions of the magnetometer sweep
+
+static const int16_t ACC_BIAS[3] = {20, -12, 30}; // counts, 2048 per g
+static const int16_t GYRO_BIAS[3] = {33, -16, 8}; // counts, 16.4 per dps
+static const float MAG_RADIUS[3] = {400.f, 350.f, 300.f};
+static const float SMALL_OFFSET[3] = {100.f, -50.f, 40.f};  // The origin inside the ellipsoid
+static const float LARGE_OFFSET[3] = {900.f, -300.f, 200.f}; // Hard iron over the field: the origin outside
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+enum Motion
+{
+    STILL,
+    MOVING,   // shaking: the gyro jumps by 200 counts every sample
+    ROTATING, // the magnetometer sweeps every direction
+};
+
+static Motion motion = STILL;
+static const float *mag_center = SMALL_OFFSET;
+
+static void source(uint32_t n, MPU9250ModelSample &s)
+{
+    int16_t noise = n % 3 - 1;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        s.acc[i] = ACC_BIAS[i] + noise + (i == 2 ? 2048 : 0);
+        s.gyro[i] = GYRO_BIAS[i] - noise;
+    }
+    if (motion == MOVING)
+    {
+        s.gyro[0] += n % 2 ? 100 : 300;
+    }
+    s.temperature = 0;
+
+    // Fibonacci sphere, the magnetometer samples at half the rate
+    float direction[3] = {1.f, 0.f, 0.f};
+    if (motion == ROTATING)
+    {
+        uint32_t k = (n / 2) % MAG_POINTS;
+        float z = 1.f - (2.f * k + 1.f) / MAG_POINTS, r = sqrtf(1.f - z * z);
+        direction[0] = r * cosf(2.39996323f * k);
+        direction[1] = r * sinf(2.39996323f * k);
+        direction[2] = z;
+    }
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        s.mag[i] = (int16_t)lroundf(mag_center[i] + MAG_RADIUS[i] * direction[i]);
+    }
+    s.mag_ready = n % 2 == 0;
+}
+
+// -- Runs the model and the driver, STEP_mS at a time, for ms or until the calibration leaves state
+static uint32_t run(MPU9250 &mpu, MPU9250Model &model, uint32_t ms, bool until_left = false,
+                    MPU9250CalibrationState state = MPU9250CalibrationState::IDLE)
+{
+    uint32_t elapsed = 0;
+    while (elapsed < ms && !(until_left && mpu.getCalibrationStatus().state != state))
+    {
+        model.run(STEP_mS * 1000);
+        while (mpu.updateFromFifo())
+        {
+        }
+        elapsed += STEP_mS;
+    }
+    return elapsed;
+}
+
+static void writeFile(fs::FS &file_system, const char *path, const std::vector<uint8_t> &bytes, size_t length)
+{
+    File file = file_system.open(path, FILE_WRITE);
+    file.write(bytes.data(), length);
+    file.close();
+}
+
+// -- The magnetometer calibration matches the model's ellipsoid, in counts of mag_res
+static bool fitted(const MPU9250 &mpu, const float mag_res = mpu9250_mag_resolution(MAG_OUTPUT_BITS::M16BITS))
+{
+    const float mean_radius = (MAG_RADIUS[0] + MAG_RADIUS[1] + MAG_RADIUS[2]) / 3.f;
+    bool match = true;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        match &= fabsf(mpu.getMagBias(i) - mag_center[i] * mag_res) < 2.f * mag_res;
+        match &= fabsf(mpu.getMagScale(i) - mean_radius / MAG_RADIUS[i]) < 0.01f;
+    }
+    return match;
+}
+
+static bool sameCalibration(const MPU9250 &a, const MPU9250 &b)
+{
+    bool same = true;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        same &= a.getAccBias(i) == b.getAccBias(i) && a.getGyroBias(i) == b.getGyroBias(i) &&
+                a.getMagBias(i) == b.getMagBias(i) && a.getMagScale(i) == b.getMagScale(i);
+    }
+    return same;
+}
+
+int main()
+{
+    MPU9250Model model;
+    model.source = source;
+    Wire.attachDevice(&model);
+
+    MPU9250 mpu;
+    mpu.setup(MPU9250Model::ADDRESS);
+    mpu.beginFifo(true);
+    const float period_ms = mpu.getFifoSamplePeriod() * 1000.f;
+
+    // -- Accel/gyro: restarted while moving
+    float acc_before[3], gyro_before[3];
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        acc_before[i] = mpu.getAccBias(i);
+        gyro_before[i] = mpu.getGyroBias(i);
+    }
+    motion = MOVING;
+    check(mpu.startCalibration() && mpu.isCalibrating() && mpu.getCalibrationStatus().state == MPU9250CalibrationState::ACC_GYRO,
+          "accel/gyro step started");
+    run(mpu, model, 500);
+    MPU9250CalibrationStatus status = mpu.getCalibrationStatus();
+    check(status.state == MPU9250CalibrationState::ACC_GYRO && status.samples < 25 && status.gyro_noise > 1.f,
+          "moving: still window restarted");
+
+    // -- Still: a second of samples, then the magnetometer
+    motion = STILL;
+    uint32_t still_ms = run(mpu, model, 3000, true, MPU9250CalibrationState::ACC_GYRO);
+    const uint32_t target = max(100.f, 1000.f / period_ms);
+    check(mpu.getCalibrationStatus().state == MPU9250CalibrationState::MAG && still_ms >= target * period_ms &&
+              still_ms <= (target + 25) * period_ms + STEP_mS,
+          "still: on to the magnetometer after a second");
+
+    const float acc_res = mpu9250_acc_resolution(ACCEL_FS_SEL::A16G), gyro_res = mpu9250_gyro_resolution(GYRO_FS_SEL::G2000DPS);
+    bool biases = true;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        float acc = acc_before[i] + ACC_BIAS[i] * acc_res * MPU9250::CALIB_ACCEL_SENSITIVITY;
+        float gyro = gyro_before[i] + GYRO_BIAS[i] * gyro_res * MPU9250::CALIB_GYRO_SENSITIVITY;
+        biases &= fabsf(mpu.getAccBias(i) - acc) < 1.f && fabsf(mpu.getGyroBias(i) - gyro) < 1.f;
+    }
+    int16_t gyro_offset = (int16_t)((model.reg(XG_OFFSET_H) << 8) | model.reg(XG_OFFSET_L));
+    check(biases && gyro_offset == -(int16_t)mpu.getGyroBiasX() / 4, "accel/gyro biases, gravity removed, offsets written");
+
+    // -- Magnetometer: one direction isn't enough, the whole sphere is
+    run(mpu, model, 2000);
+    status = mpu.getCalibrationStatus();
+    check(status.state == MPU9250CalibrationState::MAG && status.coverage < 0.25f, "magnetometer: waiting for rotation");
+
+    motion = ROTATING;
+    run(mpu, model, 20000, true, MPU9250CalibrationState::MAG);
+    status = mpu.getCalibrationStatus();
+    printf("magnetometer: %u samples, coverage %.2f, residual %.4f\n", status.samples, status.coverage, status.fit_residual);
+    check(status.state == MPU9250CalibrationState::DONE && !mpu.isCalibrating() && status.progress == 1.f &&
+              status.coverage >= 0.75f && status.fit_residual <= 0.05f,
+          "magnetometer: DONE");
+    check(fitted(mpu), "magnetometer: center and radii of the ellipsoid");
+
+    mag_center = LARGE_OFFSET;
+    mpu.startCalibration(false, true);
+    run(mpu, model, 20000, true, MPU9250CalibrationState::MAG);
+    check(mpu.getCalibrationStatus().state == MPU9250CalibrationState::DONE && fitted(mpu),
+          "magnetometer: hard iron larger than the field");
+
+    // -- Never rotated: FAILED after a minute, the calibration kept
+    MPU9250 calibrated = mpu;
+    motion = STILL;
+    mpu.startCalibration(false, true);
+    run(mpu, model, 59000);
+    bool waiting = mpu.getCalibrationStatus().state == MPU9250CalibrationState::MAG;
+    run(mpu, model, 2000);
+    check(waiting && mpu.getCalibrationStatus().state == MPU9250CalibrationState::FAILED && !mpu.isCalibrating() &&
+              sameCalibration(mpu, calibrated),
+          "timeout: FAILED, previous calibration kept");
+
+    mpu.startCalibration();
+    mpu.cancelCalibration();
+    run(mpu, model, 1000);
+    check(mpu.getCalibrationStatus().state == MPU9250CalibrationState::IDLE && sameCalibration(mpu, calibrated),
+          "cancel: IDLE, previous calibration kept");
+
+    // -- The calibration file
+    fs::FS file_system;
+    const char *path = "/mpu9250.cal";
+    check(saveMPU9250Calibration(mpu, file_system, path) && file_system.contents(path) &&
+              file_system.contents(path)->size() == sizeof(MPU9250CalibrationRecord) && !file_system.contents("/mpu9250.cal.tmp"),
+          "saved");
+    const std::vector<uint8_t> record = *file_system.contents(path);
+
+    MPU9250 loaded;
+    loaded.setup(MPU9250Model::ADDRESS);
+    MPU9250 uncalibrated = loaded;
+    check(loadMPU9250Calibration(loaded, file_system, path) && sameCalibration(loaded, mpu), "loaded: every value");
+
+    std::vector<uint8_t> corrupt = record;
+    corrupt[offsetof(MPU9250CalibrationRecord, mag_bias)] ^= 0x01;
+    writeFile(file_system, path, corrupt, corrupt.size());
+    MPU9250 refused = uncalibrated;
+    bool corrupt_refused = !loadMPU9250Calibration(refused, file_system, path) && sameCalibration(refused, uncalibrated);
+    writeFile(file_system, path, record, record.size() - 4);
+    check(corrupt_refused && !loadMPU9250Calibration(refused, file_system, path) && sameCalibration(refused, uncalibrated),
+          "corrupt and short records refused");
+
+    // -- Reset between the removal of the file and the rename: the copy is used
+    writeFile(file_system, "/mpu9250.cal.tmp", record, record.size());
+    file_system.remove(path);
+    refused = uncalibrated;
+    check(loadMPU9250Calibration(refused, file_system, path) && sameCalibration(refused, mpu), "interrupted save recovered");
+
+    writeFile(file_system, path, record, record.size());
+    file_system.remove("/mpu9250.cal.tmp");
+    file_system.fail_writes = true;
+    bool failed = !saveMPU9250Calibration(uncalibrated, file_system, path);
+    file_system.fail_writes = false;
+    check(failed && *file_system.contents(path) == record, "failed save: previous file kept");
+
+    // -- 14 bit output: the model's counts are 4 times coarser, the bias is still in mG
+    MPU9250Setting setting_14bits;
+    setting_14bits.mag_output_bits = MAG_OUTPUT_BITS::M14BITS;
+    MPU9250 mpu_14bits;
+    mpu_14bits.setup(MPU9250Model::ADDRESS, setting_14bits);
+    mpu_14bits.beginFifo(true);
+    mag_center = SMALL_OFFSET;
+    run(mpu_14bits, model, 200); // the last reading of the AK8963 is still off the large offset ellipsoid
+    motion = ROTATING;
+    mpu_14bits.startCalibration(false, true);
+    run(mpu_14bits, model, 20000, true, MPU9250CalibrationState::MAG);
+    const float res_14bits = mpu9250_mag_resolution(MAG_OUTPUT_BITS::M14BITS);
+    check(mpu_14bits.getCalibrationStatus().state == MPU9250CalibrationState::DONE && fitted(mpu_14bits, res_14bits),
+          "14 bit magnetometer: center and radii of the ellipsoid");
+
+    // Pointing along x: the hard iron removed, the mean radius left
+    motion = STILL;
+    run(mpu_14bits, model, 200);
+    const float mean_radius = (MAG_RADIUS[0] + MAG_RADIUS[1] + MAG_RADIUS[2]) / 3.f;
+    check(fabsf(mpu_14bits.getMagX() - mean_radius * res_14bits) < 2.f * res_14bits &&
+              fabsf(mpu_14bits.getMagY()) < 2.f * res_14bits && fabsf(mpu_14bits.getMagZ()) < 2.f * res_14bits,
+          "14 bit magnetometer: hard iron removed");
+    return ok ? 0 : 1;
+}
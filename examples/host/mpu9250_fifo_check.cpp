@@ -0,0 +1,174 @@
+/*
+ * File Name: mpu9250_fifo_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks the FIFO streaming of MPU9250_ over I2C, on the register model of mpu9250_model.h behind the Wire stand-in.
+// Every sample the model takes carries its own number, the other fields derived from it, so a sample parsed from the
+// wrong bytes, lost or read twice is caught.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -DARDUINO -Iexamples/host/stand_in -Isrc -Isrc/libraries/imu
+//       examples/host/mpu9250_fifo_check.cpp -o mpu9250_fifo_check
+//   ./mpu9250_fifo_check
+//
+// Checks:
+//  - beginFifo selects accel, temperature, gyro and the AK8963 through slave 0, 22 byte packets;
+//  - every sample parsed from its own packet, in order, with the magnetometer flagged fresh when it is;
+//  - reads longer than the Wire buffer split in bursts of whole packets (5 with the magnetometer, 9 without);
+//  - an overflowed FIFO is reset and counted instead of parsed, the sample clock restarts, and the next samples
+//    are aligned again;
+//  - the sample ring drops the oldest samples when full, updateFromFifo drains it and scales what it pops;
+//  - endFifo stops the FIFO.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <MPU9250.h>
+
+#include "mpu9250_model.h"
+
+//******************** SETTINGS
+#define PACKET_WITH_MAG 22
+#define PACKET_WITHOUT_MAG 14
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+// -- Sample n of the model: its number in acc[0], everything else from it
+static MPU9250ModelSample expected(uint32_t n)
+{
+    int16_t k = (int16_t)(n & 0x7FFF);
+    return {{k, (int16_t)-k, (int16_t)(2048 + (k & 0xFF))},
+            (int16_t)(3 * k),
+            {(int16_t)(k + 1), (int16_t)(k + 2), (int16_t)(k + 3)},
+            {(int16_t)(k ^ 0x5555), (int16_t)(k + 100), (int16_t)(-k - 100)},
+            n % 2 == 0};
+}
+
+// -- A fresh magnetometer sample is flagged valid; one left unread before beginFifo comes with the next packet
+static bool matches(const MPU9250FifoSample &sample, bool with_mag)
+{
+    MPU9250ModelSample e = expected((uint16_t)sample.acc[0]);
+    MPU9250ModelSample mag = e.mag_ready ? e : expected((uint16_t)(sample.acc[0] - 1));
+    bool match = sample.temperature == e.temperature && (with_mag ? sample.mag_valid || !e.mag_ready : !sample.mag_valid);
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        match &= sample.acc[i] == e.acc[i] && sample.gyro[i] == e.gyro[i];
+        match &= !sample.mag_valid || sample.mag[i] == mag.mag[i];
+    }
+    return match;
+}
+
+// -- Pops every sample of the ring: each one matches, and follows the previous one
+static size_t drain(MPU9250 &mpu, int32_t &next, bool &aligned, bool with_mag)
+{
+    MPU9250FifoSample sample;
+    size_t count = 0;
+    while (mpu.readFifoSample(sample))
+    {
+        aligned &= matches(sample, with_mag) && (next < 0 || sample.acc[0] == next);
+        next = sample.acc[0] + 1;
+        count++;
+    }
+    return count;
+}
+
+int main()
+{
+    MPU9250Model model;
+    model.source = [](uint32_t n, MPU9250ModelSample &s) { s = expected(n); };
+    Wire.attachDevice(&model);
+
+    MPU9250 mpu;
+    check(mpu.setup(MPU9250Model::ADDRESS), "setup on the model");
+
+    // -- With the magnetometer: slave 0 reads ST1 to ST2 into the FIFO
+    check(mpu.beginFifo(true) && model.reg(FIFO_EN) == 0xF9 && (model.reg(USER_CTRL) & 0x60) == 0x60 &&
+              model.reg(I2C_SLV0_CTRL) == (0x80 | 8) && model.fifoCount() == 0,
+          "beginFifo: accel, temperature, gyro, slave 0");
+
+    model.runSamples(10);
+    bool sized = model.fifoCount() == 10 * PACKET_WITH_MAG;
+    int32_t next = -1;
+    bool aligned = true;
+    check(sized && mpu.readFifo() == 10 && mpu.fifoAvailable() == 10 && drain(mpu, next, aligned, true) == 10 && aligned,
+          "samples parsed from their own packets, in order");
+
+    // -- 23 samples, 506 bytes: close to full without overflowing, read in bursts of 5 packets
+    model.runSamples(23);
+    uint32_t bursts = mpu.getFifoStats().bursts;
+    model.stats.largest_fifo_read = 0;
+    check(mpu.readFifo() == 23 && mpu.getFifoStats().bursts - bursts == 5 && mpu.getFifoStats().overflows == 0 &&
+              model.stats.largest_fifo_read == 5 * PACKET_WITH_MAG && Wire.largest_request <= I2C_BUFFER_LENGTH,
+          "bursts of whole packets, within the Wire buffer");
+    check(drain(mpu, next, aligned, true) == 23 && aligned, "every burst aligned");
+
+    // -- 30 samples: the FIFO wrapped around, its content can't be parsed
+    uint32_t resets = model.stats.fifo_resets;
+    uint32_t resyncs = mpu.getTimingStats().resyncs;
+    model.runSamples(30);
+    bool overflowed = model.stats.fifo_overflows > 0 && model.fifoCount() == MPU9250Model::FIFO_SIZE;
+    check(overflowed && mpu.readFifo() == 0 && mpu.fifoAvailable() == 0 && mpu.getFifoStats().overflows == 1 &&
+              model.stats.fifo_resets == resets + 1 && model.fifoCount() == 0 && (model.reg(USER_CTRL) & 0x60) == 0x60,
+          "overflow: FIFO reset and counted, streaming kept");
+
+    model.runSamples(10);
+    next = model.stats.samples - 10;
+    check(mpu.readFifo() == 10 && mpu.getTimingStats().resyncs == resyncs + 1 && drain(mpu, next, aligned, true) == 10 &&
+              aligned,
+          "after the overflow: aligned, sample clock restarted");
+
+    // -- Three reads without popping: 69 samples in a 64 sample ring
+    uint32_t first = model.stats.samples;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        model.runSamples(23);
+        mpu.readFifo();
+    }
+    MPU9250FifoSample oldest;
+    bool dropped = mpu.fifoAvailable() == 64 && mpu.getFifoStats().ring_drops == 5;
+    mpu.readFifoSample(oldest);
+    check(dropped && oldest.acc[0] == (int16_t)(first + 5), "full ring: oldest samples dropped");
+
+    // -- updateFromFifo pops the rest, then reads the FIFO, then stops
+    model.runSamples(4);
+    size_t updates = 0;
+    while (mpu.updateFromFifo())
+    {
+        updates++;
+    }
+    MPU9250ModelSample last = expected(model.stats.samples - 1);
+    const float acc_res = mpu9250_acc_resolution(ACCEL_FS_SEL::A16G), gyro_res = mpu9250_gyro_resolution(GYRO_FS_SEL::G2000DPS);
+    check(updates == 63 + 4 && mpu.fifoAvailable() == 0 && fabs(mpu.getAccX() - last.acc[0] * acc_res) < 1e-6 &&
+              fabs(mpu.getAccZ() - last.acc[2] * acc_res) < 1e-6 && fabs(mpu.getGyroY() - last.gyro[1] * gyro_res) < 1e-6,
+          "updateFromFifo: every sample, scaled");
+
+    // -- Without the magnetometer: 14 byte packets, 9 per burst
+    mpu.endFifo();
+    check(mpu.beginFifo(false) && model.reg(FIFO_EN) == 0xF8, "beginFifo without the magnetometer");
+    model.runSamples(20);
+    bursts = mpu.getFifoStats().bursts;
+    model.stats.largest_fifo_read = 0;
+    next = -1;
+    check(mpu.readFifo() == 20 && mpu.getFifoStats().bursts - bursts == 3 &&
+              model.stats.largest_fifo_read == 9 * PACKET_WITHOUT_MAG && drain(mpu, next, aligned, false) == 20 && aligned,
+          "without the magnetometer: aligned, bursts of 9");
+
+    mpu.endFifo();
+    model.runSamples(5);
+    check(!mpu.isFifoStreaming() && mpu.readFifo() == 0 && model.reg(FIFO_EN) == 0 && model.fifoCount() == 0,
+          "endFifo stops the FIFO");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+/*
+ * File Name: mpu9250_legacy_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Replays fixtures/mpu9250_legacy_mahony.csv through MPU9250_ on the register model of mpu9250_model.h, one sample
+// per update() with the INT pin wired to notifyDataReady, and compares QuatFilterSel::MAHONY_MAG, with the gains of
+// the former driver, against the orientation that driver computed from the same counts, sample by sample. The
+// fixture is written by fixtures/mpu9250_legacy_mahony.cpp, from the former driver's own code.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -DARDUINO -Iexamples/host/stand_in -Isrc -Isrc/libraries/imu
+//       examples/host/mpu9250_legacy_check.cpp -o mpu9250_legacy_check
+//   ./mpu9250_legacy_check [examples/host/fixtures/mpu9250_legacy_mahony.csv]
+//
+// Checks:
+//  - MPU9250DynamicConfig and MPU9250StaticConfig: every sample read once, every update() on the data ready time;
+//  - both within rounding of the former driver with its integration order fixed (ordered_*), and within
+//    LEGACY_MATCH_DEG of its output as it was (legacy_*, q2..q4 integrated from the new q1);
+//  - both configs give the same orientation.
+//
+// The PC clock is left out of micros() (host_pc_clock), so a busy PC can't slip an extra sample into a replay.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <MPU9250.h>
+
+#include "mpu9250_model.h"
+
+//******************** SETTINGS
+#define FIXTURE "examples/host/fixtures/mpu9250_legacy_mahony.csv"
+#define LEGACY_KP 10.f
+#define LEGACY_KI 0.f
+#define ORDERED_MATCH_DEG 1e-3  // float rounding only
+#define LEGACY_MATCH_DEG 0.2    // the integration order of the former driver: 0.09 deg on the fixture
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+struct Row
+{
+    MPU9250ModelSample sample;
+    float legacy[4];
+    float ordered[4];
+};
+
+static std::vector<Row> rows;
+static bool replaying = false;
+static size_t next_row = 0;
+
+static bool load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    char line[512];
+    while (fgets(line, sizeof(line), file))
+    {
+        Row r = {};
+        int c[10];
+        if (sscanf(line, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%f,%f,%f,%f,%f,%f,%f,%f", &c[0], &c[1], &c[2], &c[3], &c[4], &c[5],
+                   &c[6], &c[7], &c[8], &c[9], &r.legacy[0], &r.legacy[1], &r.legacy[2], &r.legacy[3], &r.ordered[0],
+                   &r.ordered[1], &r.ordered[2], &r.ordered[3]) != 18)
+            continue; // comments and the column names
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            r.sample.acc[i] = c[i];
+            r.sample.gyro[i] = c[3 + i];
+            r.sample.mag[i] = c[6 + i];
+        }
+        r.sample.mag_ready = c[9] != 0;
+        rows.push_back(r);
+    }
+    fclose(file);
+    return !rows.empty();
+}
+
+// -- The model's samples: the first row until the replay, then one row each
+static void source(uint32_t, MPU9250ModelSample &s)
+{
+    s = rows[replaying ? min(next_row, rows.size() - 1) : 0].sample;
+    if (replaying)
+    {
+        next_row++;
+    }
+}
+
+// Rotation angle between two orientations, in degrees
+static double angleBetween(const float *p, const float *q)
+{
+    // vector part of conj(p) * q, well conditioned for small angles unlike acos of the dot product
+    const double w = (double)p[0] * q[0] + (double)p[1] * q[1] + (double)p[2] * q[2] + (double)p[3] * q[3];
+    const double x = (double)p[0] * q[1] - (double)p[1] * q[0] - (double)p[2] * q[3] + (double)p[3] * q[2];
+    const double y = (double)p[0] * q[2] + (double)p[1] * q[3] - (double)p[2] * q[0] - (double)p[3] * q[1];
+    const double z = (double)p[0] * q[3] - (double)p[1] * q[2] + (double)p[2] * q[1] - (double)p[3] * q[0];
+    return 2. * atan2(sqrt(x * x + y * y + z * z), fabs(w)) * 180. / M_PI;
+}
+
+struct Replay
+{
+    bool in_step = true;      // one new sample and a data ready time at every update()
+    double ordered_deg = 0.;  // worst sample
+    double legacy_deg = 0.;
+    std::vector<float> q;
+};
+
+// -- Sets up the driver on the model, then one model sample and one update() per row
+template <typename MPU>
+static Replay replay(MPU9250Model &model)
+{
+    model.interrupt = nullptr;
+    replaying = false;
+    next_row = 0;
+
+    MPU mpu;
+    mpu.setup(MPU9250Model::ADDRESS);
+    mpu.selectFilter(QuatFilterSel::MAHONY_MAG); // no effect with the static config, which fixes it
+    mpu.setMahonyGains(LEGACY_KP, LEGACY_KI);
+    mpu.setDataReadyPulse(true);                 // bypass kept: update() reads the AK8963 itself
+    model.interrupt = [&mpu](uint32_t t) { mpu.notifyDataReady(t); };
+
+    Replay r;
+    const uint32_t data_ready = mpu.getTimingStats().data_ready;
+    replaying = true;
+    for (size_t n = 0; n < rows.size(); ++n)
+    {
+        model.runSamples(1);
+        r.in_step &= mpu.update() && next_row == n + 1;
+        const float q[4] = {mpu.getQuaternionW(), mpu.getQuaternionX(), mpu.getQuaternionY(), mpu.getQuaternionZ()};
+        r.ordered_deg = max(r.ordered_deg, angleBetween(q, rows[n].ordered));
+        r.legacy_deg = max(r.legacy_deg, angleBetween(q, rows[n].legacy));
+        r.q.insert(r.q.end(), q, q + 4);
+    }
+    r.in_step &= mpu.getTimingStats().data_ready - data_ready == rows.size();
+    replaying = false;
+    model.interrupt = nullptr;
+    return r;
+}
+
+using MPU9250Static = MPU9250_<TwoWire, MPU9250I2CBus<TwoWire>,
+                               MPU9250StaticConfig<ACCEL_FS_SEL::A16G, GYRO_FS_SEL::G2000DPS, MAG_OUTPUT_BITS::M16BITS,
+                                                   QuatFilterSel::MAHONY_MAG>>;
+
+int main(int argc, char **argv)
+{
+    host_pc_clock = false;
+    const char *path = argc > 1 ? argv[1] : FIXTURE;
+    if (!load(path))
+    {
+        fprintf(stderr, "Could not read %s\n", path);
+        return 1;
+    }
+
+    MPU9250Model model;
+    model.source = source;
+    Wire.attachDevice(&model);
+
+    const Replay dynamic = replay<MPU9250>(model);
+    const Replay fixed = replay<MPU9250Static>(model);
+    printf("%zu samples\n", rows.size());
+    printf("dynamic: %.2e deg from the ordered former driver, %.2e deg from the former driver\n", dynamic.ordered_deg,
+           dynamic.legacy_deg);
+    printf("static:  %.2e deg from the ordered former driver, %.2e deg from the former driver\n", fixed.ordered_deg,
+           fixed.legacy_deg);
+
+    check(dynamic.in_step, "dynamic: one sample per update(), on data ready time");
+    check(dynamic.ordered_deg < ORDERED_MATCH_DEG, "dynamic: former driver, integration order fixed");
+    check(dynamic.legacy_deg < LEGACY_MATCH_DEG, "dynamic: former driver");
+    check(fixed.in_step, "static: one sample per update(), on data ready time");
+    check(fixed.ordered_deg < ORDERED_MATCH_DEG, "static: former driver, integration order fixed");
+    check(fixed.legacy_deg < LEGACY_MATCH_DEG, "static: former driver");
+    check(dynamic.q == fixed.q, "static and dynamic: same orientation");
+    return ok ? 0 : 1;
+}
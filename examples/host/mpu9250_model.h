@@ -0,0 +1,474 @@
+/*
+ * File Name: mpu9250_model.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Register level MPU9250 and AK8963, for the MPU9250_ driver on the Wire and SPI stand-ins (attach it with
+// Wire.attachDevice(&model), or spi.attachDevice(cs_pin, &model)):
+//
+//  - the sensors are sampled at the rate of SMPLRT_DIV and the DLPF settings, on the clock of Arduino.h, each
+//    sample given by source: the data registers, the data ready bit of INT_STATUS, the AK8963 registers and, with
+//    the FIFO enabled, the FIFO_EN selection in register order. Samples due are taken at every transaction, or by
+//    update(); run() and runSamples() advance the clock;
+//  - the FIFO holds 512 bytes. Past that the oldest bytes are overwritten, which misaligns the samples, and
+//    FIFO_OFLOW_INT is set in INT_STATUS. INT_STATUS is cleared when read;
+//  - the internal I2C master runs with I2C_MST_EN only: slave 0 reads the AK8963 into EXT_SENS_DATA at each sample
+//    (reading ST2 clears its data ready, as on the chip), slave 4 runs single byte transfers. The AK8963 is on the
+//    I2C bus itself only in bypass mode, with the master off;
+//  - every USER_CTRL write is counted, and over SPI the ones that drop I2C_IF_DIS: the I2C slave interface comes
+//    back and the chip can't be trusted to stay on SPI;
+//  - with RAW_RDY_EN in INT_ENABLE, interrupt is called at every sample, as the INT pin would;
+//  - transactions, update() and the accessors hold a lock, so a check can run the clock while a task of its own
+//    talks to the model.
+//
+// Mateo :)
+
+#pragma once
+
+#include <SPI.h>
+#include <Wire.h>
+
+#include <MPU9250RegisterMap.h>
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// One sample of the sensors, as the registers hold it
+struct MPU9250ModelSample
+{
+    int16_t acc[3];
+    int16_t temperature;
+    int16_t gyro[3];
+    int16_t mag[3];
+    bool mag_ready; // the AK8963 has a new measurement
+};
+
+class MPU9250Model : public HostI2CDevice, public HostSPIDevice
+{
+public:
+    static const uint8_t ADDRESS = 0x68;
+    static const uint8_t AK8963 = 0x0C;
+    static const uint16_t FIFO_SIZE = 512;
+
+    struct Stats
+    {
+        uint32_t samples = 0;
+        uint32_t fifo_overflows = 0;    // samples pushed into a full FIFO
+        uint32_t fifo_resets = 0;       // FIFO_RST written
+        uint32_t fifo_reads = 0;        // transactions reading FIFO_R_W
+        uint32_t largest_fifo_read = 0; // bytes
+        uint32_t user_ctrl_writes = 0;
+        uint32_t if_dis_dropped = 0;    // USER_CTRL written over SPI without I2C_IF_DIS
+        uint32_t slave4_transfers = 0;
+        uint32_t slave4_stalled = 0;    // started with the I2C master off, never done
+    };
+
+    // Sample number in, sample out. Still and flat by default, the magnetometer at half the rate
+    std::function<void(uint32_t, MPU9250ModelSample &)> source = [](uint32_t n, MPU9250ModelSample &s) {
+        s = {{0, 0, 2048}, 0, {0, 0, 0}, {100, 200, 300}, n % 2 == 0};
+    };
+    std::function<void(uint32_t)> interrupt; // INT pin rising edge with the sample time, when data ready is enabled
+    float rate_error = 0.f;           // relative error of the sample period, the MPU9250 oscillator is within a few %
+    uint8_t asa[3] = {128, 128, 128}; // AK8963 fuse ROM sensitivity adjustments, 128 for none
+
+    MPU9250Model() { reset(); }
+
+    // Takes the samples due by now
+    void update()
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        for (double now = hostNanos() / 1000.; next_sample <= now; next_sample += period())
+        {
+            takeSample();
+        }
+    }
+
+    void run(uint64_t us)
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        hostAdvance(us);
+        update();
+    }
+
+    // Runs until count more samples are taken, the next one is then a period away
+    void runSamples(uint32_t count)
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        double target = next_sample + (count - 1) * period();
+        double now = hostNanos() / 1000.;
+        if (count > 0 && target > now)
+        {
+            hostAdvance((uint64_t)ceil(target - now));
+        }
+        update();
+    }
+
+    // Sample period in us, from the configuration and rate_error
+    double period() const
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        double nominal;
+        if (regs[GYRO_CONFIG] & 0x03)
+        {
+            nominal = 1000000. / 32000.; // Fchoice bypass
+        }
+        else if ((regs[MPU_CONFIG] & 0x07) == 0 || (regs[MPU_CONFIG] & 0x07) == 7)
+        {
+            nominal = 1000000. / 8000.;
+        }
+        else
+        {
+            nominal = 1000. * (1 + regs[SMPLRT_DIV]);
+        }
+        return nominal * (1. + rate_error);
+    }
+
+    uint8_t reg(uint8_t address) const
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        return regs[address];
+    }
+
+    size_t fifoCount() const
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        return fifo.size();
+    }
+
+    uint32_t lastSampleTime() const
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        return sample_times.empty() ? 0 : sample_times.back();
+    }
+
+    std::vector<uint32_t> sample_times; // micros() time of every sample
+    std::vector<uint8_t> user_ctrl;     // every value written to USER_CTRL
+    Stats stats;
+
+    //******************** I2C
+    bool i2cAcknowledge(uint8_t address) override
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        update();
+        return address == ADDRESS || (address == AK8963 && (regs[INT_PIN_CFG] & 0x02) && !(regs[USER_CTRL] & 0x20));
+    }
+
+    void i2cWrite(uint8_t address, const uint8_t *data, size_t length) override
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        if (length == 0)
+        {
+            return;
+        }
+        uint8_t &pointer = address == ADDRESS ? mpu_pointer : ak_pointer;
+        pointer = data[0];
+        for (size_t i = 1; i < length; i++)
+        {
+            if (address == ADDRESS)
+            {
+                writeRegister(pointer++, data[i], false);
+            }
+            else
+            {
+                akWrite(pointer++, data[i]);
+            }
+        }
+    }
+
+    void i2cRead(uint8_t address, uint8_t *data, size_t length) override
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        uint8_t &pointer = address == ADDRESS ? mpu_pointer : ak_pointer;
+        if (address == ADDRESS && pointer == FIFO_R_W)
+        {
+            countFifoRead(length);
+        }
+        for (size_t i = 0; i < length; i++)
+        {
+            data[i] = address == ADDRESS ? readRegister(pointer) : akRead(pointer);
+            pointer += pointer != FIFO_R_W || address != ADDRESS;
+        }
+    }
+
+    //******************** SPI
+    void spiSelect() override
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        update();
+        spi_byte = 0;
+    }
+
+    uint8_t spiTransfer(uint8_t data) override
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        if (spi_byte++ == 0)
+        {
+            spi_read = data & 0x80;
+            spi_register = data & 0x7F;
+            if (spi_read && spi_register == FIFO_R_W)
+            {
+                stats.fifo_reads++;
+                fifo_read_bytes = 0;
+            }
+            return 0;
+        }
+
+        if (!spi_read)
+        {
+            writeRegister(spi_register++, data, true);
+            return 0;
+        }
+        if (spi_register == FIFO_R_W)
+        {
+            stats.largest_fifo_read = max(stats.largest_fifo_read, ++fifo_read_bytes);
+            return readRegister(FIFO_R_W);
+        }
+        return readRegister(spi_register++);
+    }
+
+private:
+    mutable std::recursive_mutex lock;
+    uint8_t regs[128];
+    uint8_t ak_regs[0x13];
+    std::deque<uint8_t> fifo;
+    uint32_t sample_count = 0;
+    double next_sample = 0.; // us
+
+    uint8_t mpu_pointer = 0;
+    uint8_t ak_pointer = 0;
+    uint32_t spi_byte = 0;
+    bool spi_read = false;
+    uint8_t spi_register = 0;
+    uint32_t fifo_read_bytes = 0;
+
+    void reset()
+    {
+        memset(regs, 0, sizeof(regs));
+        regs[WHO_AM_I_MPU9250] = 0x71;
+        regs[PWR_MGMT_1] = 0x01;
+        memset(ak_regs, 0, sizeof(ak_regs));
+        ak_regs[AK8963_WHO_AM_I] = 0x48;
+        fifo.clear();
+        next_sample = hostNanos() / 1000. + period();
+    }
+
+    static void bigEndian(uint8_t *data, int16_t value)
+    {
+        data[0] = (uint16_t)value >> 8;
+        data[1] = value & 0xFF;
+    }
+
+    void takeSample()
+    {
+        MPU9250ModelSample s;
+        source(sample_count++, s);
+        stats.samples++;
+        sample_times.push_back((uint32_t)(uint64_t)next_sample);
+
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            bigEndian(&regs[ACCEL_XOUT_H + 2 * i], s.acc[i]);
+            bigEndian(&regs[GYRO_XOUT_H + 2 * i], s.gyro[i]);
+        }
+        bigEndian(&regs[TEMP_OUT_H], s.temperature);
+        regs[INT_STATUS] |= 0x01;
+
+        if (s.mag_ready)
+        {
+            for (uint8_t i = 0; i < 3; i++)
+            {
+                ak_regs[AK8963_XOUT_L + 2 * i] = s.mag[i] & 0xFF; // little endian
+                ak_regs[AK8963_XOUT_H + 2 * i] = (uint16_t)s.mag[i] >> 8;
+            }
+            ak_regs[AK8963_ST1] |= 0x01;
+            ak_regs[AK8963_ST2] = ak_regs[AK8963_CNTL] & 0x10; // BITM, no overflow
+        }
+
+        // -- Slave 0, before the data reaches the FIFO (WAIT_FOR_ES)
+        uint8_t slave0 = regs[I2C_SLV0_CTRL] & 0x0F;
+        if ((regs[USER_CTRL] & 0x20) && (regs[I2C_SLV0_CTRL] & 0x80) && (regs[I2C_SLV0_ADDR] & 0x7F) == AK8963)
+        {
+            for (uint8_t i = 0; i < slave0; i++)
+            {
+                regs[EXT_SENS_DATA_00 + i] = akRead(regs[I2C_SLV0_REG] + i);
+            }
+        }
+
+        if (regs[USER_CTRL] & 0x40)
+        {
+            uint8_t enabled = regs[FIFO_EN];
+            if (enabled & 0x08)
+            {
+                pushFifo(&regs[ACCEL_XOUT_H], 6);
+            }
+            if (enabled & 0x80)
+            {
+                pushFifo(&regs[TEMP_OUT_H], 2);
+            }
+            for (uint8_t i = 0; i < 3; i++)
+            {
+                if (enabled & (0x40 >> i))
+                {
+                    pushFifo(&regs[GYRO_XOUT_H + 2 * i], 2);
+                }
+            }
+            if (enabled & 0x01)
+            {
+                pushFifo(&regs[EXT_SENS_DATA_00], slave0);
+            }
+        }
+
+        if ((regs[INT_ENABLE] & 0x01) && interrupt)
+        {
+            interrupt(sample_times.back());
+        }
+    }
+
+    void pushFifo(const uint8_t *data, uint8_t length)
+    {
+        bool full = false;
+        for (uint8_t i = 0; i < length; i++)
+        {
+            if (fifo.size() == FIFO_SIZE)
+            {
+                fifo.pop_front();
+                full = true;
+            }
+            fifo.push_back(data[i]);
+        }
+        if (full)
+        {
+            regs[INT_STATUS] |= 0x10;
+            stats.fifo_overflows++;
+        }
+    }
+
+    void countFifoRead(size_t length)
+    {
+        stats.fifo_reads++;
+        stats.largest_fifo_read = max(stats.largest_fifo_read, (uint32_t)length);
+    }
+
+    uint8_t readRegister(uint8_t address)
+    {
+        uint8_t value = regs[address & 0x7F];
+        switch (address)
+        {
+        case INT_STATUS:
+            regs[INT_STATUS] = 0;
+            break;
+        case I2C_MST_STATUS:
+            regs[I2C_MST_STATUS] &= ~0x40;
+            break;
+        case FIFO_COUNTH:
+            value = fifo.size() >> 8;
+            break;
+        case FIFO_COUNTL:
+            value = fifo.size() & 0xFF;
+            break;
+        case FIFO_R_W:
+            value = fifo.empty() ? 0xFF : fifo.front();
+            if (!fifo.empty())
+            {
+                fifo.pop_front();
+            }
+            break;
+        }
+        return value;
+    }
+
+    void writeRegister(uint8_t address, uint8_t value, bool spi)
+    {
+        switch (address)
+        {
+        case PWR_MGMT_1:
+            if (value & 0x80)
+            {
+                reset();
+                return;
+            }
+            break;
+        case USER_CTRL:
+            user_ctrl.push_back(value);
+            stats.user_ctrl_writes++;
+            stats.if_dis_dropped += spi && !(value & 0x10);
+            if (value & 0x04)
+            {
+                fifo.clear();
+                stats.fifo_resets++;
+            }
+            value &= ~0x07; // FIFO, I2C master and signal path resets clear themselves
+            break;
+        case I2C_SLV4_CTRL:
+            if (value & 0x80)
+            {
+                slave4();
+                value &= ~0x80;
+            }
+            break;
+        case WHO_AM_I_MPU9250:
+        case INT_STATUS:
+        case FIFO_COUNTH:
+        case FIFO_COUNTL:
+        case FIFO_R_W:
+            return;
+        }
+        regs[address & 0x7F] = value;
+    }
+
+    void slave4()
+    {
+        if (!(regs[USER_CTRL] & 0x20))
+        {
+            stats.slave4_stalled++;
+            return;
+        }
+        stats.slave4_transfers++;
+        if ((regs[I2C_SLV4_ADDR] & 0x7F) != AK8963)
+        {
+            regs[I2C_MST_STATUS] |= 0x50; // SLV4_DONE, SLV4_NACK
+            return;
+        }
+        if (regs[I2C_SLV4_ADDR] & 0x80)
+        {
+            regs[I2C_SLV4_DI] = akRead(regs[I2C_SLV4_REG]);
+        }
+        else
+        {
+            akWrite(regs[I2C_SLV4_REG], regs[I2C_SLV4_DO]);
+        }
+        regs[I2C_MST_STATUS] |= 0x40;
+    }
+
+    uint8_t akRead(uint8_t address)
+    {
+        if (address >= AK8963_ASAX && address <= AK8963_ASAZ)
+        {
+            return asa[address - AK8963_ASAX];
+        }
+        if (address >= sizeof(ak_regs))
+        {
+            return 0;
+        }
+        uint8_t value = ak_regs[address];
+        if (address == AK8963_ST2)
+        {
+            ak_regs[AK8963_ST1] &= ~0x01; // end of the data read
+        }
+        return value;
+    }
+
+    void akWrite(uint8_t address, uint8_t value)
+    {
+        if (address == AK8963_CNTL)
+        {
+            ak_regs[AK8963_CNTL] = value;
+        }
+    }
+};
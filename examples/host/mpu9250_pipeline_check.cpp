@@ -0,0 +1,280 @@
+/*
+ * File Name: mpu9250_pipeline_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks MPU9250Pipeline on the register model of mpu9250_model.h, with the FreeRTOS task of the stand-in running on
+// a thread of its own. The model's INT pin drives the GPIO interrupt of the stand-in, so the ISR runs on the thread
+// advancing the model, as it would on the other core.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -DARDUINO -Iexamples/host/stand_in -Isrc -Isrc/libraries/imu
+//       examples/host/mpu9250_pipeline_check.cpp -o mpu9250_pipeline_check -pthread
+//   ./mpu9250_pipeline_check
+//
+// Checks:
+//  - MPU9250SeqLock: readers racing a writer never see a torn or older value, count() is the number of writes;
+//  - with the FIFO: one interrupt per sample, the task woken once per batch, every sample read fused and published,
+//    the state read by another thread consistent and in order;
+//  - without the FIFO: one read per interrupt, the rest counted as missed;
+//  - INT pin not wired: the task polls on timeout and still publishes;
+//  - stop(): the interrupt detached, the task gone, the FIFO or the pulses stopped;
+//  - a task stuck in a bus transaction: stop() gives up after its timeout without touching the bus.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <MPU9250.h>
+#include <MPU9250Pipeline.h>
+
+#include "mpu9250_model.h"
+
+//******************** SETTINGS
+#define INT_PIN 4
+#define BATCH 4
+#define RUN_mS 1000
+#define SEQLOCK_WRITES 200000
+#define SEQLOCK_READERS 3
+#define SEQLOCK_READS 10000
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+// -- Between the driver and the model: blocks the task's transactions while stalled, counts everyone else's
+class StallingBus : public HostI2CDevice
+{
+public:
+    explicit StallingBus(MPU9250Model &m) : model(m) {}
+
+    std::atomic<bool> stall{false};
+    std::atomic<bool> stalled{false}; // the task is blocked in a transaction
+    std::atomic<uint32_t> other_accesses{0};
+
+    bool i2cAcknowledge(uint8_t address) override
+    {
+        if (host_current_task == nullptr)
+        {
+            other_accesses++;
+        }
+        else if (stall)
+        {
+            // Never released: the deleted task stays blocked here until the program exits
+            stalled = true;
+            std::unique_lock<std::mutex> guard(*lock);
+            released->wait(guard, []() { return false; });
+        }
+        return model.i2cAcknowledge(address);
+    }
+
+    void i2cWrite(uint8_t address, const uint8_t *data, size_t length) override { model.i2cWrite(address, data, length); }
+    void i2cRead(uint8_t address, uint8_t *data, size_t length) override { model.i2cRead(address, data, length); }
+
+private:
+    MPU9250Model &model;
+    std::mutex *lock = new std::mutex();                          // Not destroyed under the blocked task
+    std::condition_variable *released = new std::condition_variable();
+};
+
+// -- Runs the model's clock on this thread for ms, the interrupts with it
+static void run(MPU9250Model &model, uint32_t ms)
+{
+    const uint32_t start = millis();
+    while (millis() - start < ms)
+    {
+        model.update();
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+}
+
+static void pulse(uint32_t)
+{
+    hostSetPin(INT_PIN, HIGH);
+    hostSetPin(INT_PIN, LOW);
+}
+
+// -- Reads the state from another thread while the pipeline runs: consistent, and never going back
+struct StateReader
+{
+    std::atomic<bool> done{false};
+    uint32_t reads = 0;
+    bool ordered = true;
+    std::thread thread;
+
+    template <typename Pipeline>
+    void start(const Pipeline &pipeline)
+    {
+        thread = std::thread([this, &pipeline]() {
+            MPU9250State previous = {};
+            while (!done)
+            {
+                MPU9250State s;
+                if (pipeline.read(s))
+                {
+                    reads++;
+                    ordered &= s.sequence >= previous.sequence && (int32_t)(s.sample_time - previous.sample_time) >= 0;
+                    previous = s;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+    }
+
+    void finish()
+    {
+        done = true;
+        thread.join();
+    }
+};
+
+struct Value
+{
+    uint32_t words[16];
+};
+
+static void seqLock()
+{
+    MPU9250SeqLock<Value> lock;
+    std::atomic<bool> writing{true};
+    std::atomic<uint32_t> torn{0}, backwards{0}, reads{0};
+    std::vector<std::thread> readers;
+    for (uint8_t r = 0; r < SEQLOCK_READERS; r++)
+    {
+        readers.emplace_back([&]() {
+            uint32_t last = 0;
+            while (writing)
+            {
+                Value v;
+                if (!lock.read(v))
+                {
+                    continue;
+                }
+                reads++;
+                for (uint8_t i = 1; i < 16; i++)
+                {
+                    torn += v.words[i] != v.words[0];
+                }
+                backwards += v.words[0] < last;
+                last = v.words[0];
+            }
+        });
+    }
+    // Until every reader got through a few times
+    uint32_t writes = 0;
+    while (writes < SEQLOCK_WRITES || reads < SEQLOCK_READS)
+    {
+        Value v;
+        writes++;
+        for (uint8_t k = 0; k < 16; k++)
+        {
+            v.words[k] = writes;
+        }
+        lock.write(v);
+    }
+    writing = false;
+    for (std::thread &reader : readers)
+    {
+        reader.join();
+    }
+    printf("seqlock: %u writes, %u consistent reads\n", writes, reads.load());
+    check(reads > 0 && torn == 0 && backwards == 0 && lock.count() == writes, "seqlock: no torn or older value");
+}
+
+int main()
+{
+    host_tasks = true;
+    seqLock();
+
+    MPU9250Model model;
+    StallingBus bus(model);
+    Wire.attachDevice(&bus);
+
+    MPU9250 mpu;
+    mpu.setup(MPU9250Model::ADDRESS);
+    model.interrupt = pulse;
+
+    // -- FIFO, drained every BATCH samples
+    MPU9250Pipeline<MPU9250> pipeline(mpu);
+    StateReader reader;
+    check(pipeline.start(INT_PIN, true, true, BATCH) && pipeline.isRunning() && model.reg(FIFO_EN) == 0xF9,
+          "FIFO: started");
+    reader.start(pipeline);
+    run(model, RUN_mS);
+    uint32_t stop_start = millis();
+    pipeline.stop();
+    uint32_t stop_ms = millis() - stop_start;
+    reader.finish();
+
+    MPU9250PipelineStats stats = pipeline.getStats();
+    MPU9250State state;
+    bool published = pipeline.read(state);
+    printf("FIFO: %u interrupts, %u wakeups, %u timeouts, %u samples, wake mean %.0f us, latency mean %.0f us\n",
+           stats.interrupts, stats.wakeups, stats.timeouts, stats.samples, stats.wake_mean_us, stats.latency_mean_us);
+    check(stats.interrupts >= RUN_mS / 10 && stats.wakeups - stats.timeouts <= stats.interrupts / BATCH &&
+              stats.wakeups - stats.timeouts >= stats.interrupts / (2 * BATCH),
+          "FIFO: woken once per batch");
+    check(published && state.sequence == stats.samples && stats.samples <= stats.interrupts &&
+              stats.samples + MPU9250Model::FIFO_SIZE / 22 >= stats.interrupts && fabsf(state.acc[2] - 1.f) < 0.01f,
+          "FIFO: every sample read published");
+    check(reader.reads > 0 && reader.ordered && stats.latency_mean_us < 2 * mpu.getFifoSamplePeriod() * 1e6f,
+          "FIFO: state read by another thread in order");
+    check(!pipeline.isRunning() && stop_ms < 100 && model.reg(FIFO_EN) == 0 && stats.task_stack_free == 4096,
+          "FIFO: stopped, FIFO disabled");
+
+    uint32_t interrupts = pipeline.getStats().interrupts;
+    pulse(0);
+    check(pipeline.getStats().interrupts == interrupts, "stop: interrupt detached");
+
+    // -- One update() per interrupt
+    check(pipeline.start(INT_PIN) && model.reg(INT_PIN_CFG) == 0x02, "no FIFO: started, INT pulses");
+    run(model, RUN_mS);
+    pipeline.stop();
+    stats = pipeline.getStats();
+    uint32_t seen = stats.missed + stats.wakeups - stats.timeouts;
+    printf("no FIFO: %u interrupts, %u wakeups, %u samples, %u missed\n", stats.interrupts, stats.wakeups,
+           stats.samples, stats.missed);
+    check(stats.interrupts >= RUN_mS / 10 && seen <= stats.interrupts && seen + 2 >= stats.interrupts &&
+              stats.samples <= stats.wakeups && stats.samples + stats.missed + 2 >= stats.interrupts &&
+              stats.missed <= stats.interrupts / 4,
+          "no FIFO: one read per interrupt");
+    check(model.reg(INT_PIN_CFG) == 0x22, "no FIFO: stopped, INT latched again");
+
+    // -- INT pin not wired
+    model.interrupt = nullptr;
+    pipeline.start(INT_PIN);
+    run(model, 350);
+    bool polled = pipeline.read(state);
+    pipeline.stop();
+    stats = pipeline.getStats();
+    check(polled && stats.interrupts == 0 && stats.timeouts >= 3 && stats.wakeups == stats.timeouts,
+          "no interrupt: polled on timeout");
+
+    // -- The task blocked in a transaction: stop() gives up, the bus left alone
+    model.interrupt = pulse;
+    pipeline.start(INT_PIN, true);
+    run(model, 50);
+    bus.stall = true;
+    while (!bus.stalled)
+    {
+        run(model, 5);
+    }
+    uint32_t accesses = bus.other_accesses;
+    stop_start = millis();
+    pipeline.stop();
+    stop_ms = millis() - stop_start;
+    run(model, 50);
+    printf("stuck task: stop() took %u ms, %u bus accesses after\n", stop_ms, bus.other_accesses - accesses);
+    check(!pipeline.isRunning() && stop_ms >= 500 && stop_ms < 700 && bus.other_accesses == accesses,
+          "stuck task: stop() times out, bus left alone");
+    return ok ? 0 : 1;
+}
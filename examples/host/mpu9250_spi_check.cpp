@@ -0,0 +1,121 @@
+/*
+ * File Name: mpu9250_spi_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks MPU9250_SPI on the register model of mpu9250_model.h, attached to the SPI stand-in. Over SPI every
+// USER_CTRL write has to keep I2C_IF_DIS, and the AK8963 is only reachable through the internal I2C master: slave 0
+// while streaming, slave 4 otherwise.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -DARDUINO -Iexamples/host/stand_in -Isrc -Isrc/libraries/imu
+//       examples/host/mpu9250_spi_check.cpp -o mpu9250_spi_check
+//   ./mpu9250_spi_check
+//
+// Checks:
+//  - setup reaches the AK8963 through slave 4;
+//  - I2C_IF_DIS kept by beginFifo, the FIFO reset after an overflow, endFifo and the accel/gyro calibration;
+//  - FIFO samples aligned, in bursts of 11 packets;
+//  - after endFifo, the I2C master still on and slave 0 stopped: update() gets every new magnetometer sample.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <MPU9250.h>
+
+#include "mpu9250_model.h"
+
+//******************** SETTINGS
+#define CS_PIN 5
+#define PACKET_WITH_MAG 22
+#define UPDATES 10
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+// -- Sample n of the model: its number in acc[0], everything else from it
+static MPU9250ModelSample expected(uint32_t n)
+{
+    int16_t k = (int16_t)(n & 0x7FFF);
+    return {{k, (int16_t)-k, (int16_t)(2048 + (k & 0xFF))},
+            (int16_t)(3 * k),
+            {(int16_t)(k + 1), (int16_t)(k + 2), (int16_t)(k + 3)},
+            {(int16_t)(k ^ 0x5555), (int16_t)(k + 100), (int16_t)(-k - 100)},
+            n % 2 == 0};
+}
+
+int main()
+{
+    MPU9250Model model;
+    model.source = [](uint32_t n, MPU9250ModelSample &s) { s = expected(n); };
+    SPIClass spi(VSPI);
+    spi.attachDevice(CS_PIN, &model);
+
+    MPU9250_SPI mpu;
+    check(mpu.setup(CS_PIN, spi) && model.stats.slave4_transfers > 0 && model.stats.slave4_stalled == 0,
+          "setup, AK8963 through slave 4");
+
+    check(mpu.beginFifo(true) && model.reg(USER_CTRL) == 0x70 && model.reg(FIFO_EN) == 0xF9,
+          "beginFifo: FIFO, I2C master, I2C_IF_DIS");
+
+    // -- 23 samples, 506 bytes: 11 packets per 255 byte burst
+    model.runSamples(23);
+    uint32_t bursts = mpu.getFifoStats().bursts;
+    bool aligned = mpu.readFifo() == 23 && mpu.getFifoStats().bursts - bursts == 3 &&
+                   model.stats.largest_fifo_read == 11 * PACKET_WITH_MAG;
+    MPU9250FifoSample sample;
+    int32_t next = -1;
+    while (mpu.readFifoSample(sample))
+    {
+        MPU9250ModelSample e = expected((uint16_t)sample.acc[0]);
+        aligned &= sample.gyro[2] == e.gyro[2] && sample.temperature == e.temperature && (next < 0 || sample.acc[0] == next);
+        next = sample.acc[0] + 1;
+    }
+    check(aligned, "samples aligned, bursts of 11");
+
+    model.runSamples(30);
+    check(mpu.readFifo() == 0 && mpu.getFifoStats().overflows == 1 && model.reg(USER_CTRL) == 0x70,
+          "overflow: FIFO reset, I2C_IF_DIS kept");
+
+    mpu.endFifo();
+    check(model.reg(USER_CTRL) == 0x30 && model.reg(I2C_SLV0_CTRL) == 0x00, "endFifo: I2C master kept, slave 0 stopped");
+
+    // -- Every magnetometer sample taken since read by update(), through slave 4
+    const float mag_res = mpu9250_mag_resolution(MAG_OUTPUT_BITS::M16BITS);
+    const uint32_t ended = model.stats.samples;
+    uint32_t fresh = 0, expected_fresh = 0, stalled = model.stats.slave4_stalled;
+    for (uint8_t i = 0; i < UPDATES; i++)
+    {
+        model.runSamples(1);
+        uint32_t first = model.stats.samples - 1;
+        mpu.update();
+        // The newest magnetometer sample, the PC may have let the model take one more during update()
+        bool matched = false, taken = false;
+        for (uint32_t last = first; last < model.stats.samples; last++)
+        {
+            uint32_t ready = last % 2 == 0 ? last : last - 1;
+            MPU9250ModelSample e = expected(ready);
+            taken |= ready >= ended;
+            matched |= fabs(mpu.getMagX() - e.mag[0] * mag_res) < 1e-3 && fabs(mpu.getMagZ() - e.mag[2] * mag_res) < 1e-3;
+        }
+        expected_fresh += taken;
+        fresh += taken && matched;
+    }
+    check(expected_fresh >= UPDATES - 1 && fresh == expected_fresh && model.stats.slave4_stalled == stalled,
+          "after endFifo: every new magnetometer sample");
+
+    mpu.calibrateAccelGyro();
+    check(model.stats.user_ctrl_writes > 0 && model.stats.if_dis_dropped == 0, "I2C_IF_DIS in every USER_CTRL write");
+    return ok ? 0 : 1;
+}
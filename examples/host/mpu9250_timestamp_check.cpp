@@ -0,0 +1,156 @@
+/*
+ * File Name: mpu9250_timestamp_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks the timestamps MPU9250_ gives FIFO samples against the time the register model of mpu9250_model.h took
+// them. The model's oscillator runs RATE_ERROR slow, as a real MPU9250 may, and the FIFO is read at irregular
+// intervals, as a loop busy with other things would.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -DARDUINO -Iexamples/host/stand_in -Isrc -Isrc/libraries/imu
+//       examples/host/mpu9250_timestamp_check.cpp -o mpu9250_timestamp_check
+//   ./mpu9250_timestamp_check
+//
+// Checks:
+//  - anchored on the read time: the sample period measured, timestamps within a fraction of a period of the sample
+//    times, spaced by the period, whatever the read interval;
+//  - after a FIFO overflow: the sample clock restarted on the next read, timestamps right again, none going back;
+//  - anchored on notifyDataReady: timestamps within a few us, a hundredth of a period at most.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <MPU9250.h>
+
+#include "mpu9250_model.h"
+
+//******************** SETTINGS
+#define RATE_ERROR 0.02f   // The model's sample period is 2% long
+#define READS 300
+#define SETTLE_READS 50    // Left out of the statistics, while the period is measured
+#define MIN_READ_uS 15000
+#define MAX_READ_uS 35000  // Under the 23 samples the FIFO holds
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+static uint32_t lcg = 12345;
+
+static uint32_t readInterval()
+{
+    lcg = lcg * 1664525u + 1013904223u;
+    return MIN_READ_uS + (lcg >> 8) % (MAX_READ_uS - MIN_READ_uS);
+}
+
+struct Errors
+{
+    uint32_t samples = 0;
+    double sum = 0.;
+    float max = 0.f;
+    float spacing_max = 0.f; // largest difference between a timestamp step and the period
+    bool increasing = true;
+    uint32_t index_gaps = 0;
+
+    float mean() const { return samples ? sum / samples : 0.f; }
+};
+
+// -- Reads the FIFO after interval us, compares every sample's timestamp with the model's sample time
+static size_t readAndCompare(MPU9250 &mpu, MPU9250Model &model, uint32_t interval, Errors *errors,
+                             MPU9250FifoSample &previous)
+{
+    model.run(interval);
+    size_t n = mpu.readFifo();
+    MPU9250FifoSample sample;
+    while (mpu.readFifoSample(sample))
+    {
+        float error = fabsf((float)(int32_t)(sample.timestamp - model.sample_times[(uint16_t)sample.acc[0]]));
+        if (errors)
+        {
+            errors->samples++;
+            errors->sum += error;
+            errors->max = max(errors->max, error);
+            errors->increasing &= (int32_t)(sample.timestamp - previous.timestamp) > 0;
+            errors->index_gaps += sample.index != previous.index + 1;
+            if (sample.acc[0] == previous.acc[0] + 1)
+            {
+                float step = (float)(int32_t)(sample.timestamp - previous.timestamp);
+                errors->spacing_max = max(errors->spacing_max, fabsf(step - (float)model.period()));
+            }
+        }
+        previous = sample;
+    }
+    return n;
+}
+
+int main()
+{
+    MPU9250Model model;
+    model.source = [](uint32_t n, MPU9250ModelSample &s) {
+        s = {{(int16_t)n, 0, 2048}, 0, {0, 0, 0}, {100, 200, 300}, n % 2 == 0};
+    };
+    model.rate_error = RATE_ERROR;
+    Wire.attachDevice(&model);
+
+    MPU9250 mpu;
+    mpu.setup(MPU9250Model::ADDRESS);
+    mpu.beginFifo(true);
+    const float period = model.period();
+
+    // -- Anchored on the read time
+    MPU9250FifoSample previous = {};
+    Errors read_time;
+    for (uint16_t r = 0; r < READS; r++)
+    {
+        readAndCompare(mpu, model, readInterval(), r < SETTLE_READS ? nullptr : &read_time, previous);
+    }
+    MPU9250TimingStats stats = mpu.getTimingStats();
+    printf("read time: period %.1f us (model %.1f), error mean %.0f us max %.0f us, spacing %.1f us, resyncs %u\n",
+           stats.period_us, period, read_time.mean(), read_time.max, read_time.spacing_max, stats.resyncs);
+    check(fabsf(stats.period_us - period) < 0.002f * period && stats.resyncs == 1, "sample period measured");
+    check(read_time.mean() < 0.25f * period && read_time.max < 0.5f * period, "timestamps within half a period");
+    // Within a read exactly, across reads with a tenth of the residual corrected
+    check(read_time.increasing && read_time.index_gaps == 0 && read_time.spacing_max < 0.1f * period,
+          "timestamps spaced by the period");
+
+    // -- Overflow: the FIFO reset, the sample clock restarted on the next read
+    uint32_t resyncs = stats.resyncs;
+    bool overflowed = readAndCompare(mpu, model, 30 * period, nullptr, previous) == 0 &&
+                      mpu.getFifoStats().overflows == 1;
+    Errors after;
+    for (uint16_t r = 0; r < SETTLE_READS; r++)
+    {
+        readAndCompare(mpu, model, readInterval(), &after, previous);
+    }
+    stats = mpu.getTimingStats();
+    printf("after overflow: error mean %.0f us max %.0f us, resyncs %u\n", after.mean(), after.max, stats.resyncs);
+    check(overflowed && stats.resyncs == resyncs + 1, "overflow: sample clock restarted");
+    check(after.increasing && after.index_gaps == 0 && after.max < 0.5f * period, "after the overflow: timestamps right");
+
+    // -- Anchored on the data ready interrupt, the model's INT pin wired to notifyDataReady
+    model.interrupt = [&mpu](uint32_t time) { mpu.notifyDataReady(time); };
+    Errors data_ready;
+    uint32_t anchored = stats.data_ready;
+    for (uint16_t r = 0; r < READS; r++)
+    {
+        readAndCompare(mpu, model, readInterval(), r < SETTLE_READS ? nullptr : &data_ready, previous);
+    }
+    stats = mpu.getTimingStats();
+    printf("data ready: period %.1f us, error mean %.1f us max %.1f us\n", stats.period_us, data_ready.mean(),
+           data_ready.max);
+    check(stats.data_ready - anchored == READS && data_ready.mean() < 5.f && data_ready.max < 0.01f * period &&
+              data_ready.increasing,
+          "data ready: timestamps within a few us");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+/*
+ * File Name: multi_quaternion_filter_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks MultiQuaternionFilter against one QuaternionFilter per sensor, fed the same samples. The sensors see the
+// same synthetic motion as quaternion_filter_benchmark.cpp, each with its own noise and gyro bias.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Isrc/libraries/imu examples/host/multi_quaternion_filter_check.cpp -o multi_quat_check
+//   ./multi_quat_check
+//
+// Checks:
+//  - MADGWICK_FAST, MAHONY_FAST with integral feedback, and NONE: every lane follows its own QuaternionFilter,
+//    the integral terms kept per sensor. NONE within rounding only, see GYRO_MATCH_DEG;
+//  - a sensor without a new sample is left as it is, like a QuaternionFilter not updated;
+//  - AVERAGE of identical sensors is their estimate, a disabled sensor is neither updated nor combined;
+//  - VOTE leaves out a sensor with a large gyro bias and averages the others.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <MultiQuaternionFilter.h>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+//******************** SETTINGS
+#define SENSORS 4
+#define SAMPLES 20000       // 20 s
+#define DT 0.001f           // 1 kHz
+#define MATCH_DEG 1e-3      // Lane against its own QuaternionFilter
+#define GYRO_MATCH_DEG 1e-2 // NONE: the lanes normalise with the fast inverse square root, QuaternionFilter doesn't
+#define VOTE_THRESHOLD_DEG 5.f
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+struct Sample
+{
+    float a[3], g[3], m[3];
+};
+
+//******************** QUATERNION HELPERS
+static void multiply(const double *p, const double *q, double *r)
+{
+    r[0] = p[0] * q[0] - p[1] * q[1] - p[2] * q[2] - p[3] * q[3];
+    r[1] = p[0] * q[1] + p[1] * q[0] + p[2] * q[3] - p[3] * q[2];
+    r[2] = p[0] * q[2] - p[1] * q[3] + p[2] * q[0] + p[3] * q[1];
+    r[3] = p[0] * q[3] + p[1] * q[2] - p[2] * q[1] + p[3] * q[0];
+}
+
+// Earth frame vector v expressed in the body frame of orientation q
+static void toBody(const double *q, const double *v, float *out)
+{
+    double conj[4] = {q[0], -q[1], -q[2], -q[3]};
+    double vq[4] = {0., v[0], v[1], v[2]};
+    double tmp[4], r[4];
+    multiply(conj, vq, tmp);
+    multiply(tmp, q, r);
+    for (int i = 0; i < 3; ++i)
+        out[i] = (float)r[i + 1];
+}
+
+// Rotation angle between two orientations, in degrees
+static double angleBetween(const float *p, const float *q)
+{
+    double conj[4] = {p[0], -p[1], -p[2], -p[3]};
+    double other[4] = {q[0], q[1], q[2], q[3]};
+    double r[4];
+    multiply(conj, other, r);
+    return 2. * atan2(sqrt(r[1] * r[1] + r[2] * r[2] + r[3] * r[3]), fabs(r[0])) * 180. / M_PI;
+}
+
+//******************** RECORDINGS
+// -- The same motion for every sensor, seen with its own noise and gyro bias: samples[step][sensor]
+static std::vector<std::vector<Sample>> synthesize(const int extra_bias_sensor = -1, const float extra_bias = 0.f)
+{
+    std::vector<std::vector<Sample>> samples(SAMPLES, std::vector<Sample>(SENSORS));
+    std::vector<std::mt19937> rng;
+    for (uint8_t i = 0; i < SENSORS; i++)
+    {
+        rng.emplace_back(i + 1);
+    }
+    std::normal_distribution<float> acc_noise(0.f, 0.01f), gyro_noise(0.f, 0.005f), mag_noise(0.f, 0.01f);
+    const double gravity[3] = {0., 0., 1.};
+    const double field[3] = {0.4, 0., 0.9};
+
+    double q[4] = {1., 0., 0., 0.};
+    for (size_t n = 0; n < SAMPLES; ++n)
+    {
+        double t = n * DT;
+        double w[3] = {1.5 * sin(0.7 * t), 1.0 * sin(0.3 * t + 1.), 2.0 * sin(0.5 * t + 2.)};
+        for (uint8_t i = 0; i < SENSORS; i++)
+        {
+            Sample &s = samples[n][i];
+            toBody(q, gravity, s.a);
+            toBody(q, field, s.m);
+            for (int k = 0; k < 3; ++k)
+            {
+                s.a[k] += acc_noise(rng[i]);
+                s.m[k] += mag_noise(rng[i]);
+                s.g[k] = (float)w[k] + 0.002f * (i + 1) * (k == 0 ? 1.f : -0.5f) + gyro_noise(rng[i]);
+            }
+            if (i == extra_bias_sensor)
+            {
+                s.g[2] += extra_bias;
+            }
+        }
+
+        double wq[4] = {0., w[0], w[1], w[2]};
+        double dq[4];
+        multiply(q, wq, dq);
+        double norm = 0.;
+        for (int k = 0; k < 4; ++k)
+        {
+            q[k] += 0.5 * dq[k] * DT;
+            norm += q[k] * q[k];
+        }
+        norm = sqrt(norm);
+        for (int k = 0; k < 4; ++k)
+            q[k] /= norm;
+    }
+    return samples;
+}
+
+//******************** CHECKS
+// -- Runs the N lanes and N QuaternionFilter on the recording, sensor i skipping the steps where skip(i, n).
+// Returns the largest angle between a lane and its own filter, in degrees.
+template <typename Skip>
+static double compare(QuatFilterSel sel, const std::vector<std::vector<Sample>> &samples, Skip skip)
+{
+    MultiQuaternionFilter<SENSORS> multi;
+    multi.select_filter(sel);
+    multi.set_mahony_gains(10.f, 0.5f);
+    multi.set_combine(MultiImuCombine::NONE);
+
+    QuaternionFilter single[SENSORS];
+    float q[SENSORS][4];
+    for (uint8_t i = 0; i < SENSORS; i++)
+    {
+        single[i].select_filter(sel);
+        single[i].set_mahony_gains(10.f, 0.5f);
+        q[i][0] = 1.f;
+        q[i][1] = q[i][2] = q[i][3] = 0.f;
+    }
+
+    double worst = 0.;
+    for (size_t n = 0; n < samples.size(); ++n)
+    {
+        for (uint8_t i = 0; i < SENSORS; i++)
+        {
+            if (skip(i, n))
+            {
+                continue;
+            }
+            const Sample &s = samples[n][i];
+            multi.set_sample(i, s.a[0], s.a[1], s.a[2], s.g[0], s.g[1], s.g[2], s.m[0], s.m[1], s.m[2]);
+            single[i].update(s.a[0], s.a[1], s.a[2], s.g[0], s.g[1], s.g[2], s.m[0], s.m[1], s.m[2], q[i], DT);
+        }
+        multi.update(DT);
+        for (uint8_t i = 0; i < SENSORS; i++)
+        {
+            float lane[4];
+            multi.get_quaternion(i, lane);
+            worst = std::max(worst, angleBetween(lane, q[i]));
+        }
+    }
+    return worst;
+}
+
+int main()
+{
+    const std::vector<std::vector<Sample>> samples = synthesize();
+    auto every = [](uint8_t, size_t) { return false; };
+
+    const double madgwick = compare(QuatFilterSel::MADGWICK_FAST, samples, every);
+    const double mahony = compare(QuatFilterSel::MAHONY_FAST, samples, every);
+    const double gyro = compare(QuatFilterSel::NONE, samples, every);
+    printf("lane against QuaternionFilter: MADGWICK_FAST %.2e deg, MAHONY_FAST %.2e deg, NONE %.2e deg\n", madgwick,
+           mahony, gyro);
+    check(madgwick < MATCH_DEG, "MADGWICK_FAST: every lane, its own filter");
+    check(mahony < MATCH_DEG, "MAHONY_FAST: every lane, its own integral terms");
+    check(gyro < GYRO_MATCH_DEG, "NONE: every lane, its own filter");
+
+    // Sensor 1 every other step, sensor 3 only for the first half
+    const double skipped = compare(QuatFilterSel::MAHONY_FAST, samples, [](uint8_t i, size_t n) {
+        return (i == 1 && n % 2) || (i == 3 && n >= SAMPLES / 2);
+    });
+    check(skipped < MATCH_DEG, "no new sample: lane left as it is");
+
+    // -- Identical sensors: the average is their estimate. A disabled one changes nothing.
+    MultiQuaternionFilter<SENSORS> multi;
+    multi.set_combine(MultiImuCombine::AVERAGE);
+    multi.enable(2, false);
+    QuaternionFilter single;
+    single.select_filter(QuatFilterSel::MADGWICK_FAST);
+    float q[4] = {1.f, 0.f, 0.f, 0.f};
+    double average = 0.;
+    for (size_t n = 0; n < SAMPLES; ++n)
+    {
+        const Sample &s = samples[n][0];
+        for (uint8_t i = 0; i < SENSORS; i++)
+        {
+            // The disabled sensor gets another sensor's samples, nothing of it may show
+            const Sample &own = i == 2 ? samples[n][1] : s;
+            multi.set_sample(i, own.a[0], own.a[1], own.a[2], own.g[0], own.g[1], own.g[2], own.m[0], own.m[1], own.m[2]);
+        }
+        multi.update(DT);
+        single.update(s.a[0], s.a[1], s.a[2], s.g[0], s.g[1], s.g[2], s.m[0], s.m[1], s.m[2], q, DT);
+        average = std::max(average, angleBetween(multi.get_fused_quaternion(), q));
+    }
+    float disabled[4];
+    multi.get_quaternion(2, disabled);
+    printf("average of identical sensors against QuaternionFilter: %.2e deg\n", average);
+    check(average < MATCH_DEG && multi.get_enabled() == 0x0B, "AVERAGE: identical sensors, their estimate");
+    check(disabled[0] == 1.f && disabled[1] == 0.f && disabled[2] == 0.f && disabled[3] == 0.f,
+          "disabled sensor: neither updated nor combined");
+
+    // -- Sensor 2 with a gyro bias of 20 dps on the down axis, more than the filter corrects: its yaw drifts away
+    const std::vector<std::vector<Sample>> biased = synthesize(2, 20.f * (float)PI / 180.f);
+    MultiQuaternionFilter<SENSORS> voted;
+    voted.set_combine(MultiImuCombine::VOTE, VOTE_THRESHOLD_DEG);
+    voted.select_filter(QuatFilterSel::MADGWICK_FAST);
+    MultiQuaternionFilter<SENSORS> others;
+    others.set_combine(MultiImuCombine::AVERAGE);
+    others.select_filter(QuatFilterSel::MADGWICK_FAST);
+    others.enable(2, false);
+    uint32_t outliers = 0;
+    double vote_error = 0.;
+    for (size_t n = 0; n < SAMPLES; ++n)
+    {
+        for (uint8_t i = 0; i < SENSORS; i++)
+        {
+            const Sample &s = biased[n][i];
+            voted.set_sample(i, s.a[0], s.a[1], s.a[2], s.g[0], s.g[1], s.g[2], s.m[0], s.m[1], s.m[2]);
+            others.set_sample(i, s.a[0], s.a[1], s.a[2], s.g[0], s.g[1], s.g[2], s.m[0], s.m[1], s.m[2]);
+        }
+        voted.update(DT);
+        others.update(DT);
+        outliers = voted.get_outliers();
+        if (outliers)
+        {
+            vote_error = std::max(vote_error, angleBetween(voted.get_fused_quaternion(), others.get_fused_quaternion()));
+        }
+    }
+    printf("vote: outliers 0x%X, fused against the average of the others %.2e deg\n", outliers, vote_error);
+    check(outliers == 0x04 && vote_error < MATCH_DEG, "VOTE: biased sensor left out, the others averaged");
+    return ok ? 0 : 1;
+}
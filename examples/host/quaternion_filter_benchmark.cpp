@@ -0,0 +1,203 @@
+/*
+ * File Name: quaternion_filter_benchmark.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Compares the fast and fixed point QuaternionFilter kernels with the reference ones, and times all of them.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Isrc/libraries/imu examples/host/quaternion_filter_benchmark.cpp -o quat_bench
+//   ./quat_bench [recording.csv]
+//
+// Without argument, a synthetic recording is generated: slow rotations about all axes, with sensor noise and gyro
+// bias. A recording is a CSV file with one sample per line, "dt,ax,ay,az,gx,gy,gz,mx,my,mz", dt in seconds and the
+// gyro in rad/s, already in the frame the filter expects (see MPU9250_::update_quaternion).
+//
+// For each variant, the angle between its quaternion and the reference one is reported (max and RMS, in degrees),
+// along with the time of a single update in ns.
+//
+// Mateo :)
+
+#include <QuaternionFilter.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+//******************** SETTINGS
+#define SYNTHETIC_SAMPLES 60000 // one minute
+#define SYNTHETIC_DT 0.001f     // 1 kHz
+#define TIMING_PASSES 20        // passes over the recording when timing
+
+struct Sample
+{
+    float dt;
+    float a[3], g[3], m[3];
+};
+
+//******************** QUATERNION HELPERS
+static void multiply(const double *p, const double *q, double *r)
+{
+    r[0] = p[0] * q[0] - p[1] * q[1] - p[2] * q[2] - p[3] * q[3];
+    r[1] = p[0] * q[1] + p[1] * q[0] + p[2] * q[3] - p[3] * q[2];
+    r[2] = p[0] * q[2] - p[1] * q[3] + p[2] * q[0] + p[3] * q[1];
+    r[3] = p[0] * q[3] + p[1] * q[2] - p[2] * q[1] + p[3] * q[0];
+}
+
+// Earth frame vector v expressed in the body frame of orientation q
+static void toBody(const double *q, const double *v, float *out)
+{
+    double conj[4] = {q[0], -q[1], -q[2], -q[3]};
+    double vq[4] = {0., v[0], v[1], v[2]};
+    double tmp[4], r[4];
+    multiply(conj, vq, tmp);
+    multiply(tmp, q, r);
+    for (int i = 0; i < 3; ++i)
+        out[i] = (float)r[i + 1];
+}
+
+// Rotation angle between two orientations, in degrees. atan2 stays accurate for small angles, unlike acos.
+static double angleBetween(const float *p, const float *q)
+{
+    double conj[4] = {p[0], -p[1], -p[2], -p[3]};
+    double other[4] = {q[0], q[1], q[2], q[3]};
+    double r[4];
+    multiply(conj, other, r);
+    return 2. * atan2(sqrt(r[1] * r[1] + r[2] * r[2] + r[3] * r[3]), fabs(r[0])) * 180. / M_PI;
+}
+
+//******************** RECORDINGS
+static std::vector<Sample> synthesize()
+{
+    std::vector<Sample> samples(SYNTHETIC_SAMPLES);
+    std::mt19937 rng(1);
+    std::normal_distribution<float> acc_noise(0.f, 0.01f), gyro_noise(0.f, 0.005f), mag_noise(0.f, 0.01f);
+    const float gyro_bias[3] = {0.01f, -0.02f, 0.005f};
+    const double gravity[3] = {0., 0., 1.};
+    const double field[3] = {0.4, 0., 0.9}; // northward and downward components
+
+    double q[4] = {1., 0., 0., 0.};
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        Sample &s = samples[i];
+        double t = i * SYNTHETIC_DT;
+        double w[3] = {1.5 * sin(0.7 * t), 1.0 * sin(0.3 * t + 1.), 2.0 * sin(0.5 * t + 2.)};
+
+        s.dt = SYNTHETIC_DT;
+        toBody(q, gravity, s.a);
+        toBody(q, field, s.m);
+        for (int k = 0; k < 3; ++k)
+        {
+            s.a[k] += acc_noise(rng);
+            s.m[k] += mag_noise(rng);
+            s.g[k] = (float)w[k] + gyro_bias[k] + gyro_noise(rng);
+        }
+
+        // integrate the true orientation
+        double wq[4] = {0., w[0], w[1], w[2]};
+        double dq[4];
+        multiply(q, wq, dq);
+        double norm = 0.;
+        for (int k = 0; k < 4; ++k)
+        {
+            q[k] += 0.5 * dq[k] * SYNTHETIC_DT;
+            norm += q[k] * q[k];
+        }
+        norm = sqrt(norm);
+        for (int k = 0; k < 4; ++k)
+            q[k] /= norm;
+    }
+    return samples;
+}
+
+static bool load(const char *path, std::vector<Sample> &samples)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    Sample s;
+    while (fscanf(file, "%f,%f,%f,%f,%f,%f,%f,%f,%f,%f", &s.dt, &s.a[0], &s.a[1], &s.a[2], &s.g[0], &s.g[1], &s.g[2],
+                  &s.m[0], &s.m[1], &s.m[2]) == 10)
+        samples.push_back(s);
+    fclose(file);
+    return !samples.empty();
+}
+
+//******************** BENCHMARK
+static void run(QuatFilterSel sel, const std::vector<Sample> &samples, std::vector<float> &out)
+{
+    QuaternionFilter filter;
+    filter.select_filter(sel);
+    float q[4] = {1.f, 0.f, 0.f, 0.f};
+    out.resize(samples.size() * 4);
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        const Sample &s = samples[i];
+        filter.update(s.a[0], s.a[1], s.a[2], s.g[0], s.g[1], s.g[2], s.m[0], s.m[1], s.m[2], q, s.dt);
+        memcpy(&out[i * 4], q, sizeof(q));
+    }
+}
+
+static double time(QuatFilterSel sel, const std::vector<Sample> &samples)
+{
+    QuaternionFilter filter;
+    filter.select_filter(sel);
+    float q[4] = {1.f, 0.f, 0.f, 0.f};
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < TIMING_PASSES; ++pass)
+        for (const Sample &s : samples)
+            filter.update(s.a[0], s.a[1], s.a[2], s.g[0], s.g[1], s.g[2], s.m[0], s.m[1], s.m[2], q, s.dt);
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    volatile float sink = q[0]; // keep the loop
+    (void)sink;
+    return elapsed / ((double)TIMING_PASSES * samples.size());
+}
+
+static void compare(const char *name, QuatFilterSel reference, QuatFilterSel candidate, const std::vector<Sample> &samples)
+{
+    std::vector<float> expected, actual;
+    run(reference, samples, expected);
+    run(candidate, samples, actual);
+
+    double max = 0., square_sum = 0.;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        double angle = angleBetween(&expected[i * 4], &actual[i * 4]);
+        max = angle > max ? angle : max;
+        square_sum += angle * angle;
+    }
+    printf("%-14s max %9.6f deg  rms %9.6f deg  %8.1f ns/update\n", name, max, sqrt(square_sum / samples.size()),
+           time(candidate, samples));
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<Sample> samples;
+    if (argc > 1)
+    {
+        if (!load(argv[1], samples))
+        {
+            fprintf(stderr, "Could not read %s\n", argv[1]);
+            return 1;
+        }
+    }
+    else
+    {
+        samples = synthesize();
+    }
+    printf("%zu samples\n", samples.size());
+
+    compare("MADGWICK", QuatFilterSel::MADGWICK, QuatFilterSel::MADGWICK, samples);
+    compare("MADGWICK_FAST", QuatFilterSel::MADGWICK, QuatFilterSel::MADGWICK_FAST, samples);
+    compare("MAHONY", QuatFilterSel::MAHONY, QuatFilterSel::MAHONY, samples);
+    compare("MAHONY_FAST", QuatFilterSel::MAHONY, QuatFilterSel::MAHONY_FAST, samples);
+    compare("MAHONY_FIXED", QuatFilterSel::MAHONY, QuatFilterSel::MAHONY_FIXED, samples);
+    return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * File Name: quaternion_filter_tuning.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Tunes the Madgwick beta and the Mahony Kp/Ki on a recording, with the batch API of QuaternionFilterBatch.h.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc/libraries/imu examples/host/quaternion_filter_tuning.cpp -o quat_tuning
+//   ./quat_tuning [recording.csv]
+//
+// A recording is a CSV file with one sample per line, "t_us,ax,ay,az,gx,gy,gz,mx,my,mz,qw,qx,qy,qz": the sensor
+// values as returned by MPU9250_::getAcc/getGyro/getMag and a reference orientation (e.g. from motion capture) in
+// the filter frame. Without argument, a synthetic recording of a million samples is generated.
+//
+// Every parameter set is scored by the RMS angle between its output and the reference, after 5 s of settling.
+//
+// Mateo :)
+
+#include <QuaternionFilterBatch.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+//******************** SETTINGS
+#define SYNTHETIC_SAMPLES 1000000 // 1000 s at 1 kHz
+#define SETTLE_TIME_US 5000000
+
+struct Recording
+{
+    std::vector<uint64_t> t;
+    std::vector<float> acc, gyro, mag, reference;
+};
+
+static bool load(const char *path, Recording &rec)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    unsigned long long t;
+    float v[13];
+    while (fscanf(file, "%llu,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f", &t, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+                  &v[7], &v[8], &v[9], &v[10], &v[11], &v[12]) == 14)
+    {
+        rec.t.push_back(t);
+        rec.acc.insert(rec.acc.end(), &v[0], &v[3]);
+        rec.gyro.insert(rec.gyro.end(), &v[3], &v[6]);
+        rec.mag.insert(rec.mag.end(), &v[6], &v[9]);
+        rec.reference.insert(rec.reference.end(), &v[9], &v[13]);
+    }
+    fclose(file);
+    return !rec.t.empty();
+}
+
+// Slow rotations about all axes, with noise and gyro bias, expressed in the MPU9250 axes
+static void synthesize(Recording &rec)
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(0.f, 0.01f);
+    double q[4] = {1., 0., 0., 0.};
+
+    for (size_t i = 0; i < SYNTHETIC_SAMPLES; ++i)
+    {
+        const double t = i * 0.001;
+        const double w[3] = {1.5 * sin(0.7 * t), 1.0 * sin(0.3 * t + 1.), 2.0 * sin(0.5 * t + 2.)};
+
+        // gravity (0, 0, 1) and field (0.4, 0, 0.9) in the body frame: third row and first/third columns of R
+        const double gn[3] = {2. * (q[1] * q[3] - q[0] * q[2]), 2. * (q[0] * q[1] + q[2] * q[3]),
+                              q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]};
+        const double xn[3] = {q[0] * q[0] + q[1] * q[1] - q[2] * q[2] - q[3] * q[3], 2. * (q[1] * q[2] - q[0] * q[3]),
+                              2. * (q[1] * q[3] + q[0] * q[2])};
+        const double mn[3] = {0.4 * xn[0] + 0.9 * gn[0], 0.4 * xn[1] + 0.9 * gn[1], 0.4 * xn[2] + 0.9 * gn[2]};
+        const float rad_to_deg = 180.f / (float)PI;
+
+        rec.t.push_back(i * 1000);
+        // inverse of the mapping in MPU9250_::update_quaternion
+        rec.acc.insert(rec.acc.end(), {-(float)gn[0] + noise(rng), (float)gn[1] + noise(rng), (float)gn[2] + noise(rng)});
+        rec.gyro.insert(rec.gyro.end(), {((float)w[0] + 0.01f + noise(rng)) * rad_to_deg,
+                                         -((float)w[1] - 0.02f + noise(rng)) * rad_to_deg,
+                                         -((float)w[2] + noise(rng)) * rad_to_deg});
+        rec.mag.insert(rec.mag.end(), {-(float)mn[1] + noise(rng), (float)mn[0] + noise(rng), (float)mn[2] + noise(rng)});
+        rec.reference.insert(rec.reference.end(), {(float)q[0], (float)q[1], (float)q[2], (float)q[3]});
+
+        // integrate the true orientation, q' = q + 0.5 * q * (0, w) * dt
+        const double dq[4] = {-q[1] * w[0] - q[2] * w[1] - q[3] * w[2], q[0] * w[0] + q[2] * w[2] - q[3] * w[1],
+                              q[0] * w[1] - q[1] * w[2] + q[3] * w[0], q[0] * w[2] + q[1] * w[1] - q[2] * w[0]};
+        double norm = 0.;
+        for (int k = 0; k < 4; ++k)
+        {
+            q[k] += 0.5 * dq[k] * 0.001;
+            norm += q[k] * q[k];
+        }
+        for (int k = 0; k < 4; ++k)
+            q[k] /= sqrt(norm);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Recording rec;
+    if (argc > 1)
+    {
+        if (!load(argv[1], rec))
+        {
+            fprintf(stderr, "Could not read %s\n", argv[1]);
+            return 1;
+        }
+    }
+    else
+    {
+        synthesize(rec);
+    }
+
+    QuatBatchLog log{rec.t.size(), rec.t.data(), rec.acc.data(), rec.gyro.data(), rec.mag.data(),
+                     QuatBatchFrame::MPU9250_AXES};
+
+    size_t settle = 0;
+    while (settle < rec.t.size() && rec.t[settle] - rec.t[0] < SETTLE_TIME_US)
+        settle++;
+
+    std::vector<QuatFilterParams> sets;
+    for (float beta = 0.02f; beta < 1.5f; beta *= 1.5f)
+    {
+        QuatFilterParams params;
+        params.filter = QuatFilterSel::MADGWICK_FAST;
+        params.beta = beta;
+        sets.push_back(params);
+    }
+    for (float kp = 0.5f; kp < 60.f; kp *= 2.f)
+        for (float ki : {0.f, 0.01f, 0.1f})
+        {
+            QuatFilterParams params;
+            params.filter = QuatFilterSel::MAHONY_FAST;
+            params.Kp = kp;
+            params.Ki = ki;
+            sets.push_back(params);
+        }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> scores = quat_filter_sweep(log, sets, quat_rms_angle_to(rec.reference.data(), settle));
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t best = 0;
+    for (size_t i = 0; i < sets.size(); ++i)
+    {
+        const QuatFilterParams &p = sets[i];
+        if (p.filter == QuatFilterSel::MADGWICK_FAST)
+            printf("madgwick beta %6.3f           rms %8.3f deg\n", p.beta, scores[i]);
+        else
+            printf("mahony   Kp %6.2f  Ki %5.2f  rms %8.3f deg\n", p.Kp, p.Ki, scores[i]);
+        if (scores[i] < scores[best])
+            best = i;
+    }
+    printf("best: set %zu, %.3f deg\n", best, scores[best]);
+    printf("%zu sets x %zu samples in %.2f s (%.1f ns/update)\n", sets.size(), rec.t.size(), elapsed,
+           elapsed * 1e9 / ((double)sets.size() * rec.t.size()));
+    return 0;
+}
@@ -0,0 +1,291 @@
+/*
+ * File Name: record_store_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks RecordStore on the NOR flash emulator of flash_emulator.h, with power cuts injected at random points.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/memory/record_store
+//       examples/host/record_store_check.cpp src/libraries/memory/record_store/record_store.cpp -o record_check
+//   ./record_check
+//
+// Checks:
+//  - records read back, identical writes skipped, bad keys and lengths refused;
+//  - a file backed flash keeps the records across program runs;
+//  - endurance: a frequently updated counter and a few state records, compaction, even wear, no bit programmed
+//    over a cleared one;
+//  - power loss: cut at random points of writes, compactions and recoveries, every key must recover the value of its
+//    last acknowledged write, or the one being written when the power went.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include "flash_emulator.h"
+
+#include <map>
+#include <random>
+
+//******************** SETTINGS
+#define FLASH_SIZE (16 * RECORD_STORE_SECTOR_SIZE) // 64 KB partition
+#define SMALL_FLASH_SIZE (4 * RECORD_STORE_SECTOR_SIZE) // Compacts often, for the power loss trials
+#define FLASH_FILE "record_store_check.bin"
+#define ENDURANCE_UPDATES 200000
+#define POWER_LOSS_TRIALS 3000
+#define TRIAL_KEYS 8
+#define TRIAL_MAX_LENGTH 100
+
+enum KEYS : uint16_t
+{
+    ODOMETER,
+    CALIBRATION,
+    STATE,
+};
+
+struct Calibration
+{
+    float offset[3];
+    float scale[3];
+    uint32_t date;
+};
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+static void checkBasic()
+{
+    FlashEmulator flash(FLASH_SIZE);
+    RecordStore store;
+    check(!store.begin(flash).on_error, "begin formats an empty partition");
+
+    uint32_t odometer = 123456;
+    Calibration calibration = {{0.1f, 0.2f, 0.3f}, {1.f, 1.01f, 0.99f}, 20210908};
+    const char state[] = "riding";
+    check(!store.write(ODOMETER, odometer).on_error, "write");
+    check(!store.write(CALIBRATION, calibration).on_error, "write a struct");
+    check(!store.write(STATE, state, sizeof(state)).on_error, "write bytes");
+
+    uint32_t odometer_read = 0;
+    Calibration calibration_read = {};
+    char state_read[16] = {};
+    uint16_t bytes_read;
+    check(!store.read(ODOMETER, odometer_read).on_error && odometer_read == odometer, "read back");
+    check(!store.read(CALIBRATION, calibration_read).on_error &&
+              memcmp(&calibration, &calibration_read, sizeof(calibration)) == 0,
+          "read back a struct");
+    check(!store.read(STATE, state_read, sizeof(state_read), bytes_read).on_error && bytes_read == sizeof(state) &&
+              strcmp(state, state_read) == 0,
+          "read back bytes");
+
+    uint64_t programmed = flash.getStats().bytes_programmed;
+    store.write(ODOMETER, odometer);
+    check(flash.getStats().bytes_programmed == programmed && store.getStats().writes_skipped == 1,
+          "identical write skipped");
+
+    uint8_t too_long[RECORD_STORE_MAX_LENGTH + 1] = {};
+    check(store.write(RECORD_STORE_MAX_KEYS, odometer).on_error, "key out of range refused");
+    check(store.write(STATE, too_long, sizeof(too_long)).on_error, "record too long refused");
+    check(store.read(ODOMETER, calibration_read).on_error, "read of the wrong size refused");
+    check(store.read(STATE + 1, odometer_read).on_error, "missing record reported");
+
+    check(!store.format().on_error && !store.contains(ODOMETER), "format");
+}
+
+static void checkFile()
+{
+    remove(FLASH_FILE);
+    {
+        FlashEmulator flash(FLASH_SIZE, FLASH_FILE);
+        RecordStore store;
+        store.begin(flash);
+        for (uint32_t odometer = 0; odometer <= 5000; odometer++)
+        {
+            store.write(ODOMETER, odometer);
+        }
+    }
+
+    FlashEmulator flash(FLASH_SIZE, FLASH_FILE);
+    RecordStore store;
+    uint32_t odometer = 0;
+    check(!store.begin(flash).on_error && !store.read(ODOMETER, odometer).on_error && odometer == 5000,
+          "file backed flash keeps the records");
+    remove(FLASH_FILE);
+}
+
+static void checkEndurance()
+{
+    FlashEmulator flash(FLASH_SIZE);
+    RecordStore store;
+    store.begin(flash);
+
+    Calibration calibration = {};
+    uint8_t state[64] = {};
+    bool written = true;
+    for (uint32_t update = 0; update < ENDURANCE_UPDATES && written; update++)
+    {
+        written &= !store.write(ODOMETER, update).on_error;
+        if (update % 100 == 0)
+        {
+            calibration.date = update;
+            written &= !store.write(CALIBRATION, calibration).on_error;
+        }
+        if (update % 10 == 0)
+        {
+            state[update / 10 % sizeof(state)]++;
+            written &= !store.write(STATE, state, sizeof(state)).on_error;
+        }
+    }
+    check(written, "endurance: every write accepted");
+
+    RecordStoreStats stats = store.getStats();
+    const FlashEmulator::Stats &flash_stats = flash.getStats();
+    const std::vector<uint32_t> &erases = flash.getEraseCounts();
+    uint32_t least = *std::min_element(erases.begin(), erases.end());
+    uint32_t most = *std::max_element(erases.begin(), erases.end());
+    printf("endurance: %u records, %.1f bytes programmed per record, %u compactions\n", stats.records_written,
+           (double)flash_stats.bytes_programmed / stats.records_written, stats.compactions);
+    printf("endurance: erases per sector %u to %u\n", least, most);
+    check(stats.compactions > 0, "endurance: compaction ran");
+    check(most - least <= 1, "endurance: even wear");
+    check(flash_stats.overwrites == 0, "endurance: nothing programmed without an erase");
+
+    RecordStore reopened;
+    uint64_t bytes_read = flash_stats.bytes_read;
+    uint32_t odometer = 0;
+    Calibration calibration_read = {};
+    check(!reopened.begin(flash).on_error && !reopened.read(ODOMETER, odometer).on_error &&
+              odometer == ENDURANCE_UPDATES - 1 && !reopened.read(CALIBRATION, calibration_read).on_error &&
+              calibration_read.date == calibration.date,
+          "endurance: latest values recovered");
+    printf("endurance: recovery read %u records, %.1f KB\n", reopened.getStats().records_recovered,
+           (flash.getStats().bytes_read - bytes_read) / 1024.);
+}
+
+// -- Random writes, with a model of what the store must hold
+class Trial
+{
+public:
+    Trial(uint32_t seed) : random(seed) { flash.seed(seed); }
+
+    FlashEmulator flash{SMALL_FLASH_SIZE};
+    std::map<uint16_t, std::vector<uint8_t>> acknowledged;
+    uint16_t in_flight_key = 0;
+    std::vector<uint8_t> in_flight;
+    bool pending = false;
+
+    // -- Writes until count writes are done or one fails
+    bool writes(RecordStore &store, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint16_t key = random() % TRIAL_KEYS;
+            std::vector<uint8_t> value(random() % (TRIAL_MAX_LENGTH + 1));
+            for (uint8_t &byte : value)
+            {
+                byte = random();
+            }
+
+            if (store.write(key, value.data(), value.size()).on_error)
+            {
+                in_flight_key = key;
+                in_flight = value;
+                pending = true;
+                return false;
+            }
+            acknowledged[key] = value;
+        }
+        return true;
+    }
+
+    // -- Every key holds its acknowledged value, or the one in flight
+    bool matches(RecordStore &store)
+    {
+        for (uint16_t key = 0; key < TRIAL_KEYS; key++)
+        {
+            std::vector<uint8_t> value(store.getLength(key));
+            uint16_t bytes_read = 0;
+            bool found = store.contains(key) && !store.read(key, value.data(), value.size(), bytes_read).on_error;
+
+            auto expected = acknowledged.find(key);
+            bool is_acknowledged = expected == acknowledged.end() ? !found : found && value == expected->second;
+            if (pending && key == in_flight_key && found && value == in_flight)
+            {
+                acknowledged[key] = value;
+            }
+            else if (!is_acknowledged)
+            {
+                return false;
+            }
+        }
+        pending = false;
+        return true;
+    }
+
+    std::minstd_rand random;
+};
+
+static void checkPowerLoss()
+{
+    uint32_t failures = 0, overwrites = 0, recovery_cuts = 0, torn = 0, compactions = 0;
+
+    for (uint32_t seed = 1; seed <= POWER_LOSS_TRIALS; seed++)
+    {
+        Trial trial(seed);
+        RecordStore store;
+        store.begin(trial.flash);
+
+        // -- Enough history for compactions, then the power goes somewhere in the next writes
+        trial.writes(store, trial.random() % 400);
+        trial.flash.cutPowerAfter(trial.random() % 4000);
+        trial.writes(store, 1000);
+        compactions += store.getStats().compactions;
+
+        // -- Sometimes once more while recovering, which erases torn sectors and interrupted compactions
+        RecordStore recovered;
+        trial.flash.powerOn();
+        if (seed % 3 == 0)
+        {
+            trial.flash.cutPowerAfter(trial.random() % (RECORD_STORE_SECTOR_SIZE / FlashEmulator::ERASE_CHUNK));
+            recovered.begin(trial.flash);
+            recovery_cuts += !trial.flash.isPowered();
+            trial.flash.powerOn();
+        }
+
+        bool passed = !recovered.begin(trial.flash).on_error && trial.matches(recovered);
+        torn += recovered.getStats().torn_records + recovered.getStats().torn_sectors;
+
+        // -- The recovered store keeps working, and recovers again
+        passed &= trial.writes(recovered, 200) && trial.matches(recovered);
+        RecordStore again;
+        passed &= !again.begin(trial.flash).on_error && trial.matches(again);
+
+        failures += !passed;
+        overwrites += trial.flash.getStats().overwrites;
+    }
+
+    printf("power loss: %u trials, %u cuts during recovery, %u torn records or sectors, %u compactions\n",
+           POWER_LOSS_TRIALS, recovery_cuts, torn, compactions);
+    check(failures == 0, "power loss: acknowledged writes recovered");
+    check(overwrites == 0, "power loss: nothing programmed without an erase");
+    check(recovery_cuts > 0 && torn > 0, "power loss: cuts hit recoveries and records");
+}
+
+int main()
+{
+    checkBasic();
+    checkFile();
+    checkEndurance();
+    checkPowerLoss();
+    return ok ? 0 : 1;
+}
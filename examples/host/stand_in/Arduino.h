@@ -0,0 +1,446 @@
+/*
+ * File Name: Arduino.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// The part of the Arduino core the libraries use, so they can be built and exercised on a PC. Put this directory
+// first on the include path, then "src" for utils.h:
+//
+//   g++ -std=c++17 -Iexamples/host/stand_in -Isrc ...
+//
+// micros() runs on the PC clock plus the simulated time of the stand-ins (see hostAdvance), so delays injected by
+// the stand-ins and the device models show up in the measurements without the program actually sleeping.
+//
+// Mateo :)
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define ESP_ARDUINO_VERSION_MAJOR 2
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+#define sq(x) ((x) * (x))
+
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 2)
+
+using std::max;
+using std::min;
+template <typename T, typename L, typename H>
+T constrain(T value, L low, H high)
+{
+    return value < low ? (T)low : (value > high ? (T)high : value);
+}
+
+//******************** TIME
+inline std::atomic<uint64_t> host_simulated_us{0};
+
+// false: the PC clock is left out and time only moves with hostAdvance, so a check replaying samples through the
+// register model doesn't get one more whenever the PC is busy. Set it before anything reads the clock
+inline std::atomic<bool> host_pc_clock{true};
+
+// Advances the simulated clock, as if the calling code had been busy for us microseconds
+inline void hostAdvance(uint64_t us)
+{
+    host_simulated_us += us;
+}
+
+// Nanoseconds since start, simulated time included
+inline uint64_t hostNanos()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    if (!host_pc_clock)
+    {
+        return host_simulated_us * 1000;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() + host_simulated_us * 1000;
+}
+
+inline unsigned long micros()
+{
+    return (unsigned long)(hostNanos() / 1000);
+}
+
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+inline void delay(unsigned long ms)
+{
+    hostAdvance(ms * 1000ULL);
+}
+
+inline void delayMicroseconds(uint32_t us)
+{
+    hostAdvance(us);
+}
+
+// Cycle counter of a 240 MHz core, on the same clock as micros()
+#define HOST_CPU_MHZ 240
+
+class EspClass
+{
+public:
+    uint32_t getCpuFreqMHz() { return HOST_CPU_MHZ; }
+    uint32_t getCycleCount() { return (uint32_t)(hostNanos() * HOST_CPU_MHZ / 1000); }
+};
+
+inline EspClass ESP;
+
+//******************** FREERTOS
+// No tasks on the PC by default: code that can run without one (see EMMC_IO_NO_TASK) is driven by the checks
+// themselves. With host_tasks set, xTaskCreatePinnedToCore runs the task on a thread of its own, with task
+// notifications, and vTaskDelay sleeps for real. A task deleted by another one can't be stopped on the PC: it stays
+// blocked where it is, or stops at its next ulTaskNotifyTake.
+inline bool host_tasks = false;
+
+struct HostTask
+{
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+    std::atomic<bool> deleted{false};
+    uint32_t stack_words = 0;
+};
+
+inline thread_local HostTask *host_current_task = nullptr;
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+typedef HostTask *TaskHandle_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define portYIELD_FROM_ISR() ((void)0)
+#define IRAM_ATTR
+
+struct portMUX_TYPE
+{
+};
+#define portMUX_INITIALIZER_UNLOCKED portMUX_TYPE()
+inline void portENTER_CRITICAL(portMUX_TYPE *) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE *) {}
+
+inline void vTaskDelay(uint32_t ticks)
+{
+    if (host_tasks)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+    }
+    else
+    {
+        delay(ticks * portTICK_PERIOD_MS);
+    }
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*code)(void *), const char *, uint32_t stack, void *arg, UBaseType_t,
+                                          TaskHandle_t *handle, BaseType_t)
+{
+    if (!host_tasks)
+    {
+        return pdFAIL;
+    }
+    HostTask *task = new HostTask(); // Never freed, a deleted task may still be blocked on it
+    task->stack_words = stack / sizeof(StackType_t);
+    if (handle)
+    {
+        *handle = task;
+    }
+    std::thread([code, arg, task]() {
+        host_current_task = task;
+        code(arg);
+    }).detach();
+    return pdPASS;
+}
+
+inline void vTaskDelete(TaskHandle_t task)
+{
+    if (!task)
+    {
+        task = host_current_task;
+    }
+    if (task)
+    {
+        task->deleted = true;
+    }
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task)
+{
+    if (task)
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notifications++;
+        task->notified.notify_one();
+    }
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken)
+    {
+        *woken = pdTRUE;
+    }
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    HostTask *task = host_current_task;
+    if (!task)
+    {
+        return 0;
+    }
+    std::unique_lock<std::mutex> guard(task->lock);
+    auto ready = [task]() { return task->notifications > 0 && !task->deleted; };
+    if (ticks == portMAX_DELAY || task->deleted)
+    {
+        task->notified.wait(guard, ready);
+    }
+    else if (!task->notified.wait_for(guard, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready))
+    {
+        return 0;
+    }
+    uint32_t count = task->notifications;
+    task->notifications = clear ? 0 : count - 1;
+    return count;
+}
+
+// The PC doesn't measure stack use: all of it
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    task = task ? task : host_current_task;
+    return task ? task->stack_words : 0;
+}
+
+//******************** GPIO & MEMORY
+// Pin levels, written by digitalWrite and by the checks (see hostSetPin, a card detect switch for instance). Every
+// level change written is counted, so the SPI stand-in can tell one chip select pulse from the next
+inline uint8_t host_pin_levels[256] = {};
+inline uint32_t host_pin_edges[256] = {};
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t pin, uint8_t level)
+{
+    host_pin_edges[pin] += host_pin_levels[pin] != level;
+    host_pin_levels[pin] = level;
+}
+inline int digitalRead(uint8_t pin) { return host_pin_levels[pin]; }
+
+// Interrupts: hostSetPin drives an input as a signal would, and runs the handler attached to the edge right away, on
+// the calling thread, as the ISR. detachInterrupt waits for a running handler.
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+struct HostInterrupt
+{
+    void (*handler)(void *);
+    void *arg;
+    int mode;
+};
+
+inline HostInterrupt host_interrupts[256] = {};
+inline std::mutex host_interrupt_lock;
+
+inline uint8_t digitalPinToInterrupt(uint8_t pin) { return pin; }
+
+inline void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode)
+{
+    std::lock_guard<std::mutex> guard(host_interrupt_lock);
+    host_interrupts[pin] = {handler, arg, mode};
+}
+
+inline void detachInterrupt(uint8_t pin)
+{
+    std::lock_guard<std::mutex> guard(host_interrupt_lock);
+    host_interrupts[pin] = {};
+}
+
+inline void hostSetPin(uint8_t pin, uint8_t level)
+{
+    std::lock_guard<std::mutex> guard(host_interrupt_lock);
+    uint8_t previous = host_pin_levels[pin];
+    host_pin_levels[pin] = level;
+    const HostInterrupt &attached = host_interrupts[pin];
+    int edge = level > previous ? RISING : (level < previous ? FALLING : 0);
+    if (attached.handler && (attached.mode & edge))
+    {
+        attached.handler(attached.arg);
+    }
+}
+
+inline void *heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+inline void heap_caps_free(void *ptr) { free(ptr); }
+
+//******************** STRING
+class String
+{
+public:
+    String() {}
+    String(const char *text) : s(text ? text : "") {}
+    String(const std::string &text) : s(text) {}
+    String(char c) : s(1, c) {}
+    String(int value) : s(std::to_string(value)) {}
+    String(unsigned int value) : s(std::to_string(value)) {}
+    String(long value) : s(std::to_string(value)) {}
+    String(unsigned long value) : s(std::to_string(value)) {}
+    String(long long value) : s(std::to_string(value)) {}
+    String(unsigned long long value) : s(std::to_string(value)) {}
+    String(double value, unsigned int decimals = 2)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "%.*f", decimals, value);
+        s = text;
+    }
+
+    String &operator+=(const String &other)
+    {
+        s += other.s;
+        return *this;
+    }
+
+    friend String operator+(String a, const String &b) { return a += b; }
+    bool operator==(const String &other) const { return s == other.s; }
+    bool operator!=(const String &other) const { return s != other.s; }
+    char operator[](unsigned int i) const { return s[i]; }
+
+    const char *c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.size(); }
+    bool startsWith(const String &prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        size_t i = s.find(c, from);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    int lastIndexOf(char c) const
+    {
+        size_t i = s.rfind(c);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    String substring(unsigned int from, unsigned int to = ~0u) const
+    {
+        return String(s.substr(from, to == ~0u ? std::string::npos : to - from));
+    }
+
+private:
+    std::string s;
+};
+
+//******************** PRINT & STREAM
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t *data, size_t length)
+    {
+        size_t n = 0;
+        while (n < length && write(data[n]))
+        {
+            n++;
+        }
+        return n;
+    }
+    size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+    virtual void flush() {}
+
+    size_t print(const char *text) { return write(text); }
+    size_t print(const String &text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long value, int base = DEC) { return base == HEX ? printHex(value) : print(String(value)); }
+    size_t print(unsigned long value, int base = DEC) { return base == HEX ? printHex(value) : print(String(value)); }
+    size_t print(int value, int base = DEC) { return base == HEX ? printHex(value) : print(String(value)); }
+    size_t print(unsigned int value, int base = DEC) { return base == HEX ? printHex(value) : print(String(value)); }
+    size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(const T &value, int format)
+    {
+        size_t n = print(value, format);
+        return n + println();
+    }
+
+private:
+    size_t printHex(unsigned long value)
+    {
+        char text[20];
+        snprintf(text, sizeof(text), "%lX", value);
+        return write(text);
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+// The serial monitor is the standard output
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long /*baud*/) {}
+    size_t write(uint8_t data) override { return fputc(data, stdout) == EOF ? 0 : 1; }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+inline HardwareSerial Serial;
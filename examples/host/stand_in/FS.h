@@ -0,0 +1,462 @@
+/*
+ * File Name: FS.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// In-memory stand-in for the Arduino file system API (fs::FS, fs::File), with the write costs of a FAT formatted
+// card injected on the simulated clock of Arduino.h:
+//
+//  - every write costs write_us plus the transfer time at write_MBps;
+//  - a write that starts or ends in the middle of a sector reads it first (rmw_us per partial sector);
+//  - growing a file allocates clusters (cluster_us each), and every fat_scan_clusters clusters the FAT layer stalls
+//    for fat_scan_us looking for free clusters and updating the FAT copies;
+//  - opening a file costs open_us, flushing a modified file updates its directory entry (flush_us).
+//
+// Writing inside the existing size of a file doesn't allocate. FS::getStats counts what happened, FS::fail_writes
+// makes writes fail. FS::removeCard makes every access fail and, as FAT does, cuts files back to the size their
+// directory entry had at their last flush; FS::insertCard puts the card back.
+//
+// Mateo :)
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+struct FSTiming
+{
+    uint32_t sector_size = 512;
+    uint32_t cluster_size = 32768;
+    float write_MBps = 20.f;
+    uint32_t write_us = 100;
+    uint32_t rmw_us = 400;
+    uint32_t cluster_us = 200;
+    uint32_t fat_scan_clusters = 64;
+    uint32_t fat_scan_us = 30000;
+    uint32_t open_us = 500;
+    uint32_t flush_us = 1000;
+    float read_MBps = 40.f;
+    uint32_t read_us = 100;
+};
+
+struct FSStats
+{
+    uint64_t bytes_written;
+    uint64_t bytes_read;
+    uint32_t writes;
+    uint32_t reads;
+    uint32_t partial_sectors;
+    uint32_t clusters_allocated;
+    uint32_t fat_scans;
+    uint32_t opens;
+    uint64_t busy_us; // simulated time spent in the file system
+};
+
+struct Node
+{
+    bool directory = false;
+    std::vector<uint8_t> data;
+    size_t allocated = 0; // bytes, whole clusters
+    size_t flushed_size = 0; // size in the directory entry
+    time_t last_write = 0;
+};
+
+class FS;
+
+class File : public Stream
+{
+public:
+    File() {}
+
+    operator bool() const { return node != nullptr; }
+
+    size_t write(uint8_t data) override { return write(&data, 1); }
+    size_t write(const uint8_t *data, size_t length) override;
+    using Print::write;
+
+    size_t read(uint8_t *buffer, size_t length);
+    int read() override
+    {
+        uint8_t data;
+        return read(&data, 1) == 1 ? data : -1;
+    }
+    int peek() override { return node && !node->directory && pos < node->data.size() ? node->data[pos] : -1; }
+    int available() override { return node && !node->directory ? (int)(node->data.size() - pos) : 0; }
+
+    bool seek(uint32_t position, SeekMode mode = SeekSet);
+    size_t position() const { return pos; }
+    size_t size() const { return node && !node->directory ? node->data.size() : 0; }
+    void flush() override;
+    void close()
+    {
+        flush();
+        node.reset();
+    }
+
+    time_t getLastWrite() { return node ? node->last_write : 0; }
+    const char *path() const { return full_path.c_str(); }
+    const char *name() const;
+    bool isDirectory() const { return node && node->directory; }
+    File openNextFile(const char *mode = FILE_READ);
+    void rewindDirectory() { next_child = 0; }
+
+private:
+    friend class FS;
+
+    FS *file_system = nullptr;
+    std::shared_ptr<Node> node;
+    std::string full_path;
+    size_t pos = 0;
+    bool writable = false;
+    bool append = false;
+    bool modified = false;
+    size_t next_child = 0;
+};
+
+class FS
+{
+public:
+    FSTiming timing;
+    bool fail_writes = false;
+    bool card_present = true;
+
+    void removeCard()
+    {
+        card_present = false;
+        for (auto &entry : nodes)
+        {
+            if (!entry.second->directory)
+            {
+                entry.second->data.resize(min(entry.second->data.size(), entry.second->flushed_size));
+            }
+        }
+    }
+
+    void insertCard() { card_present = true; }
+
+    File open(const char *path, const char *mode = FILE_READ, const bool create = false)
+    {
+        File file;
+        std::string p = normalize(path);
+        auto it = nodes.find(p);
+        bool reading = mode[0] == 'r';
+        bool update = mode[1] == '+';
+
+        charge(timing.open_us);
+        stats.opens++;
+
+        if (!card_present)
+        {
+            return file;
+        }
+        if (it == nodes.end())
+        {
+            if ((reading && !create) || !parentExists(p))
+            {
+                return file;
+            }
+            it = nodes.emplace(p, std::make_shared<Node>()).first;
+        }
+        else if (mode[0] == 'w' && !it->second->directory)
+        {
+            it->second->data.clear();
+            it->second->allocated = 0;
+        }
+
+        file.file_system = this;
+        file.node = it->second;
+        file.full_path = p;
+        file.writable = !reading || update;
+        file.append = mode[0] == 'a';
+        return file;
+    }
+
+    File open(const String &path, const char *mode = FILE_READ) { return open(path.c_str(), mode); }
+
+    bool exists(const char *path) { return card_present && nodes.count(normalize(path)) > 0; }
+    bool exists(const String &path) { return exists(path.c_str()); }
+
+    bool remove(const char *path)
+    {
+        auto it = nodes.find(normalize(path));
+        if (it == nodes.end() || it->second->directory)
+        {
+            return false;
+        }
+        nodes.erase(it);
+        return true;
+    }
+
+    bool rename(const char *from, const char *to)
+    {
+        auto it = nodes.find(normalize(from));
+        std::string p = normalize(to);
+        if (it == nodes.end() || !parentExists(p))
+        {
+            return false;
+        }
+        // A directory takes its contents along
+        std::string from_path = it->first;
+        std::vector<std::pair<std::string, std::shared_ptr<Node>>> moved;
+        for (auto &entry : nodes)
+        {
+            if (entry.first == from_path || entry.first.compare(0, from_path.size() + 1, from_path + "/") == 0)
+            {
+                moved.emplace_back(p + entry.first.substr(from_path.size()), entry.second);
+            }
+        }
+        for (auto &entry : moved)
+        {
+            nodes.erase(from_path + entry.first.substr(p.size()));
+        }
+        for (auto &entry : moved)
+        {
+            nodes[entry.first] = entry.second;
+        }
+        return true;
+    }
+
+    bool mkdir(const char *path)
+    {
+        std::string p = normalize(path);
+        if (nodes.count(p) || !parentExists(p))
+        {
+            return nodes.count(p) && nodes[p]->directory;
+        }
+        nodes[p] = std::make_shared<Node>();
+        nodes[p]->directory = true;
+        return true;
+    }
+
+    bool rmdir(const char *path)
+    {
+        std::string p = normalize(path);
+        auto it = nodes.find(p);
+        if (it == nodes.end() || !it->second->directory || !children(p).empty())
+        {
+            return false;
+        }
+        nodes.erase(it);
+        return true;
+    }
+
+    FSStats getStats() const { return stats; }
+    void resetStats() { stats = {}; }
+
+    // Bytes of a file, for checks
+    const std::vector<uint8_t> *contents(const char *path)
+    {
+        auto it = nodes.find(normalize(path));
+        return it == nodes.end() ? nullptr : &it->second->data;
+    }
+
+private:
+    friend class File;
+
+    std::map<std::string, std::shared_ptr<Node>> nodes{{"/", root()}};
+    FSStats stats{};
+
+    static std::shared_ptr<Node> root()
+    {
+        std::shared_ptr<Node> node = std::make_shared<Node>();
+        node->directory = true;
+        return node;
+    }
+
+    void charge(uint64_t us)
+    {
+        stats.busy_us += us;
+        hostAdvance(us);
+    }
+
+    static std::string normalize(const char *path)
+    {
+        std::string p = path[0] == '/' ? path : std::string("/") + path;
+        while (p.size() > 1 && p.back() == '/')
+        {
+            p.pop_back();
+        }
+        return p;
+    }
+
+    static std::string parent(const std::string &p)
+    {
+        size_t slash = p.rfind('/');
+        return slash == 0 ? "/" : p.substr(0, slash);
+    }
+
+    bool parentExists(const std::string &p)
+    {
+        auto it = nodes.find(parent(p));
+        return it != nodes.end() && it->second->directory;
+    }
+
+    std::vector<std::string> children(const std::string &p)
+    {
+        std::vector<std::string> result;
+        for (auto &entry : nodes)
+        {
+            if (entry.first != p && entry.first != "/" && parent(entry.first) == p)
+            {
+                result.push_back(entry.first);
+            }
+        }
+        return result;
+    }
+
+    // Costs of a write of length bytes at offset, and the allocation of the clusters it grows the file by
+    void chargeWrite(Node &node, size_t offset, size_t length)
+    {
+        uint64_t us = timing.write_us + (uint64_t)(length / timing.write_MBps);
+        uint32_t partial = (offset % timing.sector_size != 0) + ((offset + length) % timing.sector_size != 0);
+        if (partial == 2 && offset / timing.sector_size == (offset + length) / timing.sector_size)
+        {
+            partial = 1;
+        }
+        us += partial * timing.rmw_us;
+        stats.partial_sectors += partial;
+
+        stats.writes++;
+        stats.bytes_written += length;
+        charge(us + allocate(node, offset + length));
+    }
+
+    // Grows the cluster chain of a file to cover end bytes, returns the cost
+    uint64_t allocate(Node &node, size_t end)
+    {
+        uint64_t us = 0;
+        while (node.allocated < end)
+        {
+            node.allocated += timing.cluster_size;
+            stats.clusters_allocated++;
+            us += timing.cluster_us;
+            if (timing.fat_scan_clusters && stats.clusters_allocated % timing.fat_scan_clusters == 0)
+            {
+                stats.fat_scans++;
+                us += timing.fat_scan_us;
+            }
+        }
+        return us;
+    }
+};
+
+inline size_t File::write(const uint8_t *data, size_t length)
+{
+    if (!node || node->directory || !writable || file_system->fail_writes || !file_system->card_present)
+    {
+        return 0;
+    }
+
+    if (append)
+    {
+        pos = node->data.size();
+    }
+
+    file_system->chargeWrite(*node, pos, length);
+    if (node->data.size() < pos + length)
+    {
+        node->data.resize(pos + length);
+    }
+    memcpy(node->data.data() + pos, data, length);
+    pos += length;
+    modified = true;
+    node->last_write = (time_t)(micros() / 1000000);
+    return length;
+}
+
+inline size_t File::read(uint8_t *buffer, size_t length)
+{
+    if (!node || node->directory || pos >= node->data.size())
+    {
+        return 0;
+    }
+
+    size_t n = min(length, node->data.size() - pos);
+    memcpy(buffer, node->data.data() + pos, n);
+    pos += n;
+
+    file_system->stats.reads++;
+    file_system->stats.bytes_read += n;
+    file_system->charge(file_system->timing.read_us + (uint64_t)(n / file_system->timing.read_MBps));
+    return n;
+}
+
+inline bool File::seek(uint32_t position, SeekMode mode)
+{
+    if (!node || node->directory)
+    {
+        return false;
+    }
+
+    size_t target = mode == SeekSet ? position : (mode == SeekCur ? pos + position : node->data.size() + position);
+    if (target > node->data.size())
+    {
+        // As on FAT, seeking past the end of a writable file grows it, allocating the clusters
+        if (!writable || file_system->fail_writes)
+        {
+            return false;
+        }
+        file_system->charge(file_system->allocate(*node, target));
+        node->data.resize(target);
+        modified = true;
+    }
+    pos = target;
+    return true;
+}
+
+inline void File::flush()
+{
+    if (node && modified && file_system->card_present)
+    {
+        modified = false;
+        node->flushed_size = node->data.size();
+        file_system->charge(file_system->timing.flush_us);
+    }
+}
+
+inline const char *File::name() const
+{
+    size_t slash = full_path.rfind('/');
+    return full_path.c_str() + slash + 1;
+}
+
+inline File File::openNextFile(const char *mode)
+{
+    if (!node || !node->directory)
+    {
+        return File();
+    }
+
+    std::vector<std::string> entries = file_system->children(full_path);
+    if (next_child >= entries.size())
+    {
+        return File();
+    }
+    return file_system->open(entries[next_child++].c_str(), mode);
+}
+
+} // namespace fs
+
+using fs::File;
@@ -0,0 +1,47 @@
+/*
+ * File Name: SD.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+// Stand-in for the Arduino SD (SPI mode) library: the FS.h stand-in, mounted on begin(). See Arduino.h.
+//
+// begin() sets the transfer rates of FSTiming from the 1 bit bus, and the command costs of a driver moving every
+// block through the CPU.
+
+#pragma once
+
+#include "FS.h"
+#include "SPI.h"
+
+class SDFS : public fs::FS
+{
+public:
+    uint64_t card_size = 4ULL * 1024 * 1024 * 1024;
+    uint32_t mount_us = 250000;
+    uint32_t frequency_hz = 0; // Of the last begin()
+
+    bool begin(uint8_t /*ssPin*/ = 5,
+               SPIClass &/*spi*/ = SPI,
+               uint32_t frequency = 4000000,
+               const char * /*mountpoint*/ = "/sd",
+               uint8_t /*max_files*/ = 5)
+    {
+        frequency_hz = frequency;
+        float bus_MBps = frequency / 8e6f;
+        timing.read_MBps = 0.6f * bus_MBps;
+        timing.write_MBps = 0.5f * bus_MBps;
+        timing.read_us = 300;
+        timing.write_us = 300;
+
+        hostAdvance(mount_us);
+        return card_present;
+    }
+    void end() {}
+    uint64_t cardSize() { return card_size; }
+    uint64_t totalBytes() { return card_size; }
+    uint64_t usedBytes() { return getStats().bytes_written; }
+};
+
+inline SDFS SD;
@@ -0,0 +1,47 @@
+/*
+ * File Name: SD_MMC.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+// Stand-in for the Arduino SD_MMC library: the FS.h stand-in, mounted on begin(). See Arduino.h.
+//
+// begin() sets the transfer rates of FSTiming from the bus: frequency x width, of which reads get 80 % and writes
+// 60 % (the card programs the flash between blocks).
+
+#pragma once
+
+#include "FS.h"
+
+class SDMMCFS : public fs::FS
+{
+public:
+    uint64_t card_size = 4ULL * 1024 * 1024 * 1024;
+    uint32_t mount_us = 150000; // Card initialization and reading the FAT
+
+    uint32_t frequency_khz = 0; // Of the last begin()
+    bool mode_1_bit = false;
+
+    bool begin(const char * /*mountpoint*/ = "/sdcard",
+               bool mode1bit = false,
+               bool /*format_if_mount_failed*/ = false,
+               int sdmmc_frequency = 20000,
+               uint8_t /*maxOpenFiles*/ = 5)
+    {
+        frequency_khz = sdmmc_frequency;
+        mode_1_bit = mode1bit;
+        float bus_MBps = sdmmc_frequency * (mode1bit ? 1 : 4) / 8000.f;
+        timing.read_MBps = 0.8f * bus_MBps;
+        timing.write_MBps = 0.6f * bus_MBps;
+
+        hostAdvance(mount_us);
+        return card_present;
+    }
+    void end() {}
+    uint64_t cardSize() { return card_size; }
+    uint64_t totalBytes() { return card_size; }
+    uint64_t usedBytes() { return getStats().bytes_written; }
+};
+
+inline SDMMCFS SD_MMC;
@@ -0,0 +1,137 @@
+/*
+ * File Name: SPI.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+// Stand-in for the Arduino SPI library, see Arduino.h. Bytes go to the HostSPIDevice whose chip select pin is low
+// (see attachDevice), otherwise nothing is transferred: reads return 0, as MISO would with nothing on the bus.
+// Transactions are counted, so a check can see the bus was locked and released in pairs.
+
+#pragma once
+
+#include <Arduino.h>
+
+#define HSPI 2
+#define VSPI 3
+
+#define HOST_SPI_DEVICES 4
+
+#define SPI_MODE0 0
+#define SPI_MODE1 1
+#define SPI_MODE2 2
+#define SPI_MODE3 3
+
+#define SPI_LSBFIRST 0
+#define SPI_MSBFIRST 1
+#define LSBFIRST SPI_LSBFIRST
+#define MSBFIRST SPI_MSBFIRST
+
+class SPISettings
+{
+public:
+    SPISettings() : _clock(1000000), _bitOrder(SPI_MSBFIRST), _dataMode(SPI_MODE0) {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) : _clock(clock), _bitOrder(bitOrder), _dataMode(dataMode)
+    {
+    }
+
+    uint32_t _clock;
+    uint8_t _bitOrder;
+    uint8_t _dataMode;
+};
+
+// A device on the bus: spiSelect starts a frame, at the first byte after its chip select went low, or after the end
+// of a transaction
+class HostSPIDevice
+{
+public:
+    virtual ~HostSPIDevice() {}
+    virtual void spiSelect() = 0;
+    virtual uint8_t spiTransfer(uint8_t data) = 0;
+};
+
+class SPIClass
+{
+public:
+    SPIClass(uint8_t bus = HSPI) : spi_bus(bus) {}
+    void begin(int8_t /*sck*/ = -1, int8_t /*miso*/ = -1, int8_t /*mosi*/ = -1, int8_t /*ss*/ = -1) {}
+    void end() {}
+
+    // Up to HOST_SPI_DEVICES per bus, each selected by its cs_pin
+    void attachDevice(uint8_t cs_pin, HostSPIDevice *d)
+    {
+        if (device_count < HOST_SPI_DEVICES)
+        {
+            devices[device_count] = d;
+            devices_cs[device_count++] = cs_pin;
+        }
+    }
+
+    // A frame ends with its transaction
+    void beginTransaction(SPISettings settings)
+    {
+        this->settings = settings;
+        transactions++;
+        selected = false;
+    }
+    void endTransaction()
+    {
+        transactions--;
+        selected = false;
+    }
+
+    uint8_t transfer(uint8_t data)
+    {
+        uint8_t i = 0;
+        while (i < device_count && digitalRead(devices_cs[i]) != LOW)
+        {
+            i++;
+        }
+        if (i == device_count)
+        {
+            return 0;
+        }
+        // A new frame if the chip select moved since the last one began
+        if (!selected || i != selected_device || host_pin_edges[devices_cs[i]] != selected_edges)
+        {
+            devices[i]->spiSelect();
+            selected = true;
+            selected_device = i;
+            selected_edges = host_pin_edges[devices_cs[i]];
+        }
+        return devices[i]->spiTransfer(data);
+    }
+    void transfer(void *data, uint32_t size)
+    {
+        uint8_t *bytes = (uint8_t *)data;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            bytes[i] = transfer(bytes[i]);
+        }
+    }
+    uint16_t transfer16(uint16_t data)
+    {
+        uint16_t high = transfer((uint8_t)(data >> 8));
+        return high << 8 | transfer((uint8_t)data);
+    }
+    uint32_t transfer32(uint32_t data)
+    {
+        uint32_t high = transfer16((uint16_t)(data >> 16));
+        return high << 16 | transfer16((uint16_t)data);
+    }
+
+    SPISettings settings; // Of the last beginTransaction
+    int transactions = 0; // Open transactions
+
+private:
+    uint8_t spi_bus;
+    HostSPIDevice *devices[HOST_SPI_DEVICES] = {};
+    uint8_t devices_cs[HOST_SPI_DEVICES] = {};
+    uint8_t device_count = 0;
+    bool selected = false;
+    uint8_t selected_device = 0;
+    uint32_t selected_edges = 0;
+};
+
+inline SPIClass SPI(VSPI);
@@ -0,0 +1,98 @@
+/*
+ * File Name: Wire.h
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+// Stand-in for the Arduino Wire library, see Arduino.h. Transfers go to the HostI2CDevice attached to the bus, if
+// it acknowledges the address; nothing else answers. Like the ESP32 core, at most I2C_BUFFER_LENGTH bytes go out
+// per transmission and come back per requestFrom, the rest is dropped.
+
+#pragma once
+
+#include <Arduino.h>
+
+#define I2C_BUFFER_LENGTH 128
+
+// A device on the bus: gets the bytes of every write transmission, fills the bytes of every read
+class HostI2CDevice
+{
+public:
+    virtual ~HostI2CDevice() {}
+    virtual bool i2cAcknowledge(uint8_t address) = 0;
+    virtual void i2cWrite(uint8_t address, const uint8_t *data, size_t length) = 0;
+    virtual void i2cRead(uint8_t address, uint8_t *data, size_t length) = 0;
+};
+
+class TwoWire : public Stream
+{
+public:
+    TwoWire(uint8_t bus = 0) : i2c_bus(bus) {}
+    bool begin(int /*sda*/ = -1, int /*scl*/ = -1, uint32_t /*frequency*/ = 0) { return true; }
+    void setClock(uint32_t /*frequency*/) {}
+
+    void attachDevice(HostI2CDevice *d) { device = d; }
+
+    void beginTransmission(uint8_t address)
+    {
+        tx_address = address;
+        tx_length = 0;
+    }
+
+    size_t write(uint8_t data) override
+    {
+        if (tx_length == I2C_BUFFER_LENGTH)
+        {
+            return 0;
+        }
+        tx_buffer[tx_length++] = data;
+        return 1;
+    }
+    using Print::write;
+
+    // 0 on success, 2 if nobody acknowledged the address
+    uint8_t endTransmission(bool /*sendStop*/ = true)
+    {
+        if (!device || !device->i2cAcknowledge(tx_address))
+        {
+            return 2;
+        }
+        device->i2cWrite(tx_address, tx_buffer, tx_length);
+        transmissions++;
+        return 0;
+    }
+
+    uint8_t requestFrom(uint8_t address, uint8_t quantity)
+    {
+        rx_position = 0;
+        rx_length = 0;
+        if (!device || !device->i2cAcknowledge(address))
+        {
+            return 0;
+        }
+        rx_length = quantity > I2C_BUFFER_LENGTH ? I2C_BUFFER_LENGTH : quantity;
+        device->i2cRead(address, rx_buffer, rx_length);
+        largest_request = max(largest_request, (size_t)quantity);
+        return rx_length;
+    }
+
+    int available() override { return rx_length - rx_position; }
+    int read() override { return rx_position < rx_length ? rx_buffer[rx_position++] : -1; }
+    int peek() override { return rx_position < rx_length ? rx_buffer[rx_position] : -1; }
+
+    uint32_t transmissions = 0; // Acknowledged write transmissions
+    size_t largest_request = 0; // Bytes, before the buffer limit
+
+private:
+    uint8_t i2c_bus;
+    HostI2CDevice *device = nullptr;
+    uint8_t tx_address = 0;
+    uint8_t tx_buffer[I2C_BUFFER_LENGTH];
+    size_t tx_length = 0;
+    uint8_t rx_buffer[I2C_BUFFER_LENGTH];
+    size_t rx_length = 0;
+    size_t rx_position = 0;
+};
+
+inline TwoWire Wire(0);
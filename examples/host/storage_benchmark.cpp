@@ -0,0 +1,135 @@
+/*
+ * File Name: storage_benchmark.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Runs EMMC_Benchmark on the card stand-ins of examples/host/stand_in, in every bus mode EMMC_Memory mounts, for a
+// few block sizes. The stand-ins derive their transfer rates from the bus (see SD_MMC.h and SD.h), so the numbers
+// show how the modes and block sizes compare, not what a given card does: run the same benchmark on the board for
+// that (examples/04_emmc_example.cpp).
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/memory/emmc
+//       examples/host/storage_benchmark.cpp src/libraries/memory/emmc/emmc_benchmark.cpp
+//       src/libraries/memory/emmc/emmc_memory.cpp src/libraries/memory/emmc/emmc_directory.cpp -o storage_benchmark
+//   ./storage_benchmark
+//
+// Checks:
+//  - every mode mounts on the right driver with the bus asked for: SPI on SD, SDMMC 1 and 4 bit at 20 and 40 MHz;
+//  - every run reads back what it wrote;
+//  - faster buses and larger blocks give faster sequential transfers, smaller blocks more random IOPS;
+//  - an SDMMC clock above 40 MHz is refused.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <emmc_benchmark.h>
+
+//******************** SETTINGS
+#define FILE_SIZE (4UL * 1024 * 1024)
+#define RANDOM_OPS 500
+
+struct Mode
+{
+    eMMC_CONNECTION_MODE mode;
+    eMMC_BUS_WIDTH bus_width;
+    uint32_t frequency_khz;
+};
+
+// -- Slowest first
+static const Mode modes[] = {
+    {SPI_MODE, MODE_1_BIT, 20000},
+    {eMMC_MODE, MODE_1_BIT, 20000},
+    {eMMC_MODE, MODE_4_BIT, 20000},
+    {eMMC_MODE, MODE_4_BIT, EMMC_SDMMC_HIGH_SPEED_kHZ},
+};
+static const size_t block_sizes[] = {512, 4096, 32768};
+
+#define MODES (sizeof(modes) / sizeof(modes[0]))
+#define BLOCK_SIZES (sizeof(block_sizes) / sizeof(block_sizes[0]))
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+int main()
+{
+    EMMC_Benchmark benchmark;
+    EMMC_BenchmarkResult results[MODES][BLOCK_SIZES];
+    bool mounted = true, identical = true;
+
+    printf("%-20s %6s  %10s %10s %10s %10s %9s\n", "mode", "block", "seq W", "seq R", "rand W", "rand R", "worst W");
+    for (size_t m = 0; m < MODES; m++)
+    {
+        EMMC_Memory emmc;
+        emmc.setBusFrequency(modes[m].frequency_khz);
+        mounted &= !emmc.begin(-1, -1, modes[m].mode, modes[m].bus_width).on_error;
+
+        // -- On the driver of the mode, with the bus asked for
+        if (modes[m].mode == SPI_MODE)
+        {
+            mounted &= emmc.getFileSystem() == &SD && SD.frequency_hz == modes[m].frequency_khz * 1000;
+        }
+        else
+        {
+            mounted &= emmc.getFileSystem() == &SD_MMC && SD_MMC.frequency_khz == modes[m].frequency_khz &&
+                       SD_MMC.mode_1_bit == (modes[m].bus_width == MODE_1_BIT);
+        }
+
+        for (size_t b = 0; b < BLOCK_SIZES; b++)
+        {
+            EMMC_BenchmarkResult &r = results[m][b];
+            identical &= !benchmark.run(emmc, block_sizes[b], r, FILE_SIZE, RANDOM_OPS).on_error && r.errors == 0;
+
+            String name = String(modes[m].mode == SPI_MODE ? "SPI" : (modes[m].bus_width == MODE_4_BIT ? "4 bit" : "1 bit")) +
+                          " " + String(modes[m].frequency_khz / 1000.0, 0) + " MHz";
+            printf("%-20s %6u  %5.2f MB/s %5.2f MB/s %5.0f IOPS %5.0f IOPS %6u us\n", name.c_str(), (unsigned)r.block_size,
+                   r.sequential_write_MBps, r.sequential_read_MBps, r.random_write_iops, r.random_read_iops,
+                   r.max_write_latency_us);
+        }
+        emmc.end();
+    }
+    printf("%s\n", EMMC_Benchmark::toString(results[MODES - 1][1]).c_str());
+
+    check(mounted, "every mode mounted on its driver and bus");
+    check(identical, "every run read back what it wrote");
+
+    // -- Faster buses: sequential transfers in the order of the modes, at every block size
+    bool bus_order = true;
+    for (size_t m = 1; m < MODES; m++)
+    {
+        for (size_t b = 0; b < BLOCK_SIZES; b++)
+        {
+            bus_order &= results[m][b].sequential_write_MBps > results[m - 1][b].sequential_write_MBps &&
+                         results[m][b].sequential_read_MBps > results[m - 1][b].sequential_read_MBps;
+        }
+    }
+    check(bus_order, "faster bus, faster sequential transfers");
+
+    // -- Larger blocks: fewer commands per byte. Smaller blocks: more operations per second
+    bool block_order = true;
+    for (size_t m = 0; m < MODES; m++)
+    {
+        for (size_t b = 1; b < BLOCK_SIZES; b++)
+        {
+            block_order &= results[m][b].sequential_write_MBps > results[m][b - 1].sequential_write_MBps &&
+                           results[m][b].random_read_iops < results[m][b - 1].random_read_iops;
+        }
+    }
+    check(block_order, "larger blocks faster, smaller blocks more IOPS");
+
+    EMMC_Memory emmc;
+    emmc.setBusFrequency(EMMC_SDMMC_HIGH_SPEED_kHZ + 1000);
+    check(emmc.begin(-1, -1, eMMC_MODE, MODE_4_BIT).on_error && !emmc.isInitialized(), "SDMMC above 40 MHz refused");
+    return ok ? 0 : 1;
+}
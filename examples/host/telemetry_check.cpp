@@ -0,0 +1,279 @@
+/*
+ * File Name: telemetry_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Checks EMMC_TelemetryWriter and EMMC_TelemetryReader on the file system stand-in of examples/host/stand_in.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/memory/emmc
+//       examples/host/telemetry_check.cpp src/libraries/memory/emmc/emmc_telemetry.cpp -o telemetry_check
+//   ./telemetry_check
+//
+// Ten minutes of a 10 channel, 1 kHz log (IMU, ADC, temperature, fork travel) are written, then:
+//  - size against the same samples as CSV text, as appendFile loggers write them;
+//  - every sample read back, equal to the quantized value;
+//  - a 10 second window exported from the middle: reads needed and rows;
+//  - block footers agree with the samples;
+//  - a file never closed, with a torn last block: recovered by scanning, up to the last whole block.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <emmc_telemetry.h>
+
+#include <cmath>
+
+//******************** SETTINGS
+#define SAMPLE_RATE_HZ 1000
+#define DURATION_S 600
+#define WINDOW_S 10
+#define SAMPLES (SAMPLE_RATE_HZ * DURATION_S)
+#define CHANNELS 10
+#define MIN_SIZE_RATIO 5.f // Against CSV
+
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-56s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+static const EMMC_TelemetryChannel channels[CHANNELS] = {
+    EMMC_TelemetryWriter::channel("accel_x", "g", TELEMETRY_INT32, 0.001f),
+    EMMC_TelemetryWriter::channel("accel_y", "g", TELEMETRY_INT32, 0.001f),
+    EMMC_TelemetryWriter::channel("accel_z", "g", TELEMETRY_INT32, 0.001f),
+    EMMC_TelemetryWriter::channel("gyro_x", "dps", TELEMETRY_INT32, 0.01f),
+    EMMC_TelemetryWriter::channel("gyro_y", "dps", TELEMETRY_INT32, 0.01f),
+    EMMC_TelemetryWriter::channel("gyro_z", "dps", TELEMETRY_INT32, 0.01f),
+    EMMC_TelemetryWriter::channel("shock_pressure", "V", TELEMETRY_INT32, 0.0001f),
+    EMMC_TelemetryWriter::channel("fork_pressure", "V", TELEMETRY_INT32, 0.0001f),
+    EMMC_TelemetryWriter::channel("temperature", "C"),
+    EMMC_TelemetryWriter::channel("fork_travel", "mm", TELEMETRY_INT32, 0.01f),
+};
+
+// -- A ride: slow motion, suspension strokes, a little sensor noise
+static uint64_t sampleTime(uint32_t i)
+{
+    return 1000000ULL + (uint64_t)i * 1000000 / SAMPLE_RATE_HZ;
+}
+
+static void makeSample(uint32_t i, float *values)
+{
+    uint32_t noise = i * 2654435761u;
+    float t = (float)i / SAMPLE_RATE_HZ;
+    auto random = [&]() {
+        noise = noise * 1664525 + 1013904223;
+        return (float)(noise >> 8) / (1 << 24) - 0.5f;
+    };
+
+    values[0] = 0.2f * sinf(t * 1.3f) + 0.004f * random();
+    values[1] = 0.1f * sinf(t * 0.7f) + 0.004f * random();
+    values[2] = 1.f + 0.5f * sinf(t * 9.f) + 0.004f * random();
+    values[3] = 20.f * sinf(t * 0.9f) + 0.05f * random();
+    values[4] = 15.f * sinf(t * 1.1f) + 0.05f * random();
+    values[5] = 5.f * sinf(t * 0.3f) + 0.05f * random();
+    values[6] = 1.65f + 0.8f * sinf(t * 9.f) + 0.0003f * random();
+    values[7] = 1.65f + 0.6f * sinf(t * 9.f + 1.f) + 0.0003f * random();
+    values[8] = 25.f + t / 120.f;
+    values[9] = 80.f + 60.f * sinf(t * 9.f);
+}
+
+// -- Value as stored: quantized for TELEMETRY_INT32 channels
+static float stored(uint16_t channel, float value)
+{
+    const EMMC_TelemetryChannel &schema = channels[channel];
+    return schema.type == TELEMETRY_INT32 ? (float)round(value / schema.scale) * schema.scale : value;
+}
+
+// -- Counts what it is given
+class CountingPrint : public Print
+{
+public:
+    size_t write(uint8_t) override
+    {
+        bytes++;
+        return 1;
+    }
+    size_t write(const uint8_t *, size_t length) override
+    {
+        bytes += length;
+        return length;
+    }
+
+    size_t bytes = 0;
+};
+
+// -- A file's bytes, possibly truncated
+class MemorySource : public EMMC_TelemetrySource
+{
+public:
+    MemorySource(const std::vector<uint8_t> &data, size_t length) : bytes(data), length(length) {}
+
+    uint64_t size() override { return length; }
+    bool read(uint64_t offset, void *data, size_t count) override
+    {
+        if (offset + count > length)
+        {
+            return false;
+        }
+        memcpy(data, bytes.data() + offset, count);
+        return true;
+    }
+
+private:
+    const std::vector<uint8_t> &bytes;
+    size_t length;
+};
+
+static void writeLog(fs::FS &file_system, const char *path, uint32_t samples, bool close_it)
+{
+    EMMC_TelemetryWriter *writer = new EMMC_TelemetryWriter();
+    float values[CHANNELS];
+    check(!writer->begin(file_system, path, channels, CHANNELS).on_error, "begin");
+
+    bool written = true;
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        makeSample(i, values);
+        written &= writer->addSample(sampleTime(i), values);
+    }
+    check(written, "every sample accepted");
+
+    if (close_it)
+    {
+        EMMC_TelemetryStats stats = writer->getStats();
+        check(!writer->close().on_error, "close");
+        delete writer;
+        printf("writer: %u blocks, %.2f bytes per sample, %.1f%% of the raw samples\n", stats.blocks,
+               (double)stats.bytes_written / stats.samples, 100. * stats.bytes_written / stats.raw_bytes);
+    }
+    // Otherwise the power goes: never closed, never freed
+}
+
+static void checkSize(fs::FS &file_system)
+{
+    // Same samples, as a logger writing text through appendFile would
+    CountingPrint csv;
+    float values[CHANNELS];
+    char text[32];
+    for (uint32_t i = 0; i < SAMPLES; i++)
+    {
+        makeSample(i, values);
+        csv.bytes += snprintf(text, sizeof(text), "%llu", (unsigned long long)sampleTime(i));
+        for (uint16_t c = 0; c < CHANNELS; c++)
+        {
+            csv.bytes += snprintf(text, sizeof(text), ",%.4f", values[c]);
+        }
+        csv.bytes += 1;
+    }
+
+    size_t size = file_system.contents("/ride.tlm")->size();
+    printf("size: %.2f MB against %.2f MB of CSV, %.1f times smaller\n", size / 1e6, csv.bytes / 1e6,
+           (double)csv.bytes / size);
+    check((float)csv.bytes / size >= MIN_SIZE_RATIO, "at least 5 times smaller than CSV");
+    check(!file_system.exists("/ride.tlm" EMMC_TELEMETRY_INDEX_SUFFIX), "index side file removed");
+}
+
+static void checkReadBack(EMMC_TelemetryReader &reader)
+{
+    std::vector<uint64_t> times(reader.getBlockSamples());
+    std::vector<float> values(CHANNELS * reader.getBlockSamples());
+    float expected[CHANNELS];
+    uint32_t sample = 0;
+    bool equal = true;
+
+    for (uint32_t block = 0; block < reader.getBlockCount() && equal; block++)
+    {
+        uint16_t count;
+        equal = reader.readBlock(block, times.data(), values.data(), count);
+        for (uint16_t i = 0; i < count && equal; i++, sample++)
+        {
+            makeSample(sample, expected);
+            equal = times[i] == sampleTime(sample);
+            for (uint16_t c = 0; c < CHANNELS && equal; c++)
+            {
+                float tolerance = channels[c].type == TELEMETRY_INT32 ? channels[c].scale * 0.01f : 0.f;
+                equal = fabsf(values[c * reader.getBlockSamples() + i] - stored(c, expected[c])) <= tolerance;
+            }
+        }
+    }
+    check(equal && sample == SAMPLES, "every sample read back");
+}
+
+static void checkWindow(EMMC_TelemetryReader &reader)
+{
+    uint64_t from = sampleTime(SAMPLES / 2);
+    uint64_t to = from + WINDOW_S * 1000000ULL;
+    uint32_t reads = reader.getReads();
+
+    CountingPrint csv;
+    uint32_t rows = reader.exportCSV(csv, from, to);
+    reads = reader.getReads() - reads;
+
+    // Binary search, then 3 reads per block: index entry, block header, block. 1 for the block after the window
+    uint32_t window_blocks = WINDOW_S * SAMPLE_RATE_HZ / reader.getBlockSamples() + 2;
+    uint32_t search_reads = (uint32_t)ceil(log2(reader.getBlockCount() + 1.));
+    printf("window: %u rows from %u blocks with %u reads, %u KB of CSV\n", rows, reader.getBlockCount(), reads,
+           (uint32_t)(csv.bytes / 1024));
+    check(rows == WINDOW_S * SAMPLE_RATE_HZ + 1, "10 s window exported");
+    check(reads <= search_reads + 3 * window_blocks + 1, "window found by binary search");
+
+    // Footers: min and max of a block, without decoding it
+    std::vector<uint64_t> times(reader.getBlockSamples());
+    std::vector<float> values(CHANNELS * reader.getBlockSamples());
+    float min[CHANNELS], max[CHANNELS];
+    uint16_t count;
+    uint32_t block = reader.findBlock(from);
+    bool agree =
+        reader.getBlockSummary(block, min, max) && reader.readBlock(block, times.data(), values.data(), count);
+    for (uint16_t c = 0; c < CHANNELS && agree; c++)
+    {
+        float *column = values.data() + c * reader.getBlockSamples();
+        agree = *std::min_element(column, column + count) == min[c] &&
+                *std::max_element(column, column + count) == max[c];
+    }
+    check(agree, "block footers agree with the samples");
+}
+
+static void checkPowerLoss()
+{
+    fs::FS file_system;
+    uint32_t samples = 100 * EMMC_TELEMETRY_BLOCK_SAMPLES + 100;
+    writeLog(file_system, "/cut.tlm", samples, false);
+
+    // Cut in the middle of the last block written
+    const std::vector<uint8_t> &bytes = *file_system.contents("/cut.tlm");
+    MemorySource source(bytes, bytes.size() - 100);
+    EMMC_TelemetryReader reader;
+    check(!reader.begin(source).on_error && !reader.isIndexed(), "power loss: file without index opened");
+    check(reader.getBlockCount() == 99, "power loss: blocks up to the torn one");
+
+    CountingPrint csv;
+    check(reader.exportCSV(csv) == 99 * EMMC_TELEMETRY_BLOCK_SAMPLES, "power loss: their samples exported");
+}
+
+int main()
+{
+    fs::FS file_system;
+    writeLog(file_system, "/ride.tlm", SAMPLES, true);
+    checkSize(file_system);
+
+    File file = file_system.open("/ride.tlm");
+    EMMC_TelemetryFileSource source(file);
+    EMMC_TelemetryReader reader;
+    check(!reader.begin(source).on_error && reader.isIndexed(), "reader: schemas and index");
+    check(reader.getChannelCount() == CHANNELS && strcmp(reader.getChannel(9).name, "fork_travel") == 0,
+          "reader: channels described by the file");
+    checkReadBack(reader);
+    checkWindow(reader);
+    checkPowerLoss();
+    return ok ? 0 : 1;
+}
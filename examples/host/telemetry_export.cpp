@@ -0,0 +1,212 @@
+/*
+ * File Name: telemetry_export.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Exports a telemetry file written by EMMC_TelemetryWriter, copied off the card, for analysis on a PC.
+//
+// Build from the repository root:
+//
+//   g++ -O2 -std=c++17 -Iexamples/host/stand_in -Isrc -Isrc/libraries/memory/emmc
+//       examples/host/telemetry_export.cpp src/libraries/memory/emmc/emmc_telemetry.cpp -o telemetry_export
+//
+// Run:
+//
+//   ./telemetry_export ride.tlm [--from us] [--to us]                 CSV on stdout
+//   ./telemetry_export ride.tlm [--from us] [--to us] --arrays dir    One binary array per column
+//
+// --arrays writes dir/time_us.i64 (int64), dir/<channel>.f32 (float32) for every channel, little endian, one value
+// per sample, and dir/schema.txt with the channel names, units and sample count. numpy.fromfile() or MATLAB fread()
+// load them as they are.
+//
+// Only the blocks of the time range are read, found through the index of the file. Files that were never closed are
+// scanned instead, up to their last whole block.
+//
+// Mateo :)
+
+#include <emmc_telemetry.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// -- A file on the PC, files over 4 GB included
+class HostFileSource : public EMMC_TelemetrySource
+{
+public:
+    HostFileSource(FILE *file) : file(file) {}
+
+    uint64_t size() override
+    {
+        fseeko(file, 0, SEEK_END);
+        return ftello(file);
+    }
+
+    bool read(uint64_t offset, void *data, size_t length) override
+    {
+        return fseeko(file, offset, SEEK_SET) == 0 && fread(data, 1, length, file) == length;
+    }
+
+private:
+    FILE *file;
+};
+
+// -- Print to a FILE
+class FilePrint : public Print
+{
+public:
+    FilePrint(FILE *file) : file(file) {}
+
+    size_t write(uint8_t data) override
+    {
+        return fputc(data, file) == EOF ? 0 : 1;
+    }
+
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        return fwrite(data, 1, length, file);
+    }
+
+private:
+    FILE *file;
+};
+
+static bool exportArrays(EMMC_TelemetryReader &reader, const char *directory, uint64_t from_us, uint64_t to_us)
+{
+    uint16_t channel_count = reader.getChannelCount();
+    uint16_t block_samples = reader.getBlockSamples();
+    std::vector<FILE *> files(channel_count + 1);
+
+    std::string path = std::string(directory) + "/time_us.i64";
+    files[0] = fopen(path.c_str(), "wb");
+    for (uint16_t c = 0; c < channel_count; c++)
+    {
+        path = std::string(directory) + "/" + reader.getChannel(c).name + ".f32";
+        files[c + 1] = fopen(path.c_str(), "wb");
+    }
+    for (FILE *file : files)
+    {
+        if (file == nullptr)
+        {
+            fprintf(stderr, "Could not create the arrays in %s\n", directory);
+            return false;
+        }
+    }
+
+    std::vector<uint64_t> times(block_samples);
+    std::vector<float> values((size_t)channel_count * block_samples);
+    uint64_t rows = 0;
+    uint16_t count;
+    for (uint32_t block = reader.findBlock(from_us); block < reader.getBlockCount(); block++)
+    {
+        if (!reader.readBlock(block, times.data(), values.data(), count) || times[0] > to_us)
+        {
+            break;
+        }
+
+        // -- Samples of the block inside the range
+        uint16_t first = 0, last = count;
+        while (first < count && times[first] < from_us)
+        {
+            first++;
+        }
+        while (last > first && times[last - 1] > to_us)
+        {
+            last--;
+        }
+
+        fwrite(times.data() + first, sizeof(uint64_t), last - first, files[0]);
+        for (uint16_t c = 0; c < channel_count; c++)
+        {
+            fwrite(values.data() + (size_t)c * block_samples + first, sizeof(float), last - first, files[c + 1]);
+        }
+        rows += last - first;
+    }
+
+    for (FILE *file : files)
+    {
+        fclose(file);
+    }
+
+    path = std::string(directory) + "/schema.txt";
+    FILE *schema = fopen(path.c_str(), "w");
+    if (schema == nullptr)
+    {
+        return false;
+    }
+    fprintf(schema, "samples %llu\ntime_us.i64 us\n", (unsigned long long)rows);
+    for (uint16_t c = 0; c < channel_count; c++)
+    {
+        fprintf(schema, "%s.f32 %s\n", reader.getChannel(c).name, reader.getChannel(c).unit);
+    }
+    fclose(schema);
+
+    fprintf(stderr, "%llu samples of %u channels written to %s\n", (unsigned long long)rows, channel_count, directory);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s file [--from us] [--to us] [--arrays dir]\n", argv[0]);
+        return 1;
+    }
+
+    uint64_t from_us = 0, to_us = UINT64_MAX;
+    const char *arrays = nullptr;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--from") == 0)
+        {
+            from_us = strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--to") == 0)
+        {
+            to_us = strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--arrays") == 0)
+        {
+            arrays = argv[i + 1];
+        }
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Could not read %s\n", argv[1]);
+        return 1;
+    }
+
+    HostFileSource source(file);
+    EMMC_TelemetryReader reader;
+    ESP_ERROR err = reader.begin(source);
+    if (err.on_error)
+    {
+        fprintf(stderr, "%s: %s\n", argv[1], err.debug_message.c_str());
+        fclose(file);
+        return 1;
+    }
+    if (!reader.isIndexed())
+    {
+        fprintf(stderr, "%s was not closed, %u blocks recovered by scanning\n", argv[1], reader.getBlockCount());
+    }
+
+    bool exported = true;
+    if (arrays)
+    {
+        exported = exportArrays(reader, arrays, from_us, to_us);
+    }
+    else
+    {
+        FilePrint output(stdout);
+        reader.exportCSV(output, from_us, to_us);
+    }
+
+    fclose(file);
+    return exported ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/*
+ * File Name: vibration_spectrum_check.cpp
+ * Hardware needed: None, this one runs on a PC
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//******************** READ ME
+//
+// Validates VibrationSpectrum.h against a reference and times it.
+//
+// Build and run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Isrc/libraries/imu examples/host/vibration_spectrum_check.cpp -o vibration_check
+//   ./vibration_check
+//
+// Checks:
+//  - the real FFT against a double precision DFT, on random input;
+//  - Parseval: the RMS of the PSD against the RMS of the signal;
+//  - peaks and band levels of known sines in noise;
+//  - the packed summary size, and the time to process one segment per channel.
+//
+// Returns 1 if a check fails.
+//
+// Mateo :)
+
+#include <VibrationSpectrum.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+//******************** SETTINGS
+#define FFT_SIZE 512
+#define SAMPLE_RATE 1000.f
+#define SEGMENTS 8
+#define FFT_TOLERANCE 1e-5    // of the largest bin
+#define RMS_TOLERANCE 0.01    // relative
+#define FREQUENCY_TOLERANCE 0.1 // in bins
+
+typedef VibrationSpectrum<FFT_SIZE, 3> Spectrum;
+
+static Spectrum spectrum; // large, keep it off the stack
+static bool ok = true;
+
+static void check(bool condition, const char *what)
+{
+    printf("%-48s %s\n", what, condition ? "ok" : "FAILED");
+    ok &= condition;
+}
+
+static void checkFft()
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> u(-1.f, 1.f);
+    std::vector<float> x(FFT_SIZE);
+    for (float &v : x)
+        v = u(rng);
+
+    static float out[FFT_SIZE / 2 + 1][2];
+    spectrum.begin(SAMPLE_RATE);
+    spectrum.fft(x.data(), out);
+
+    double max_error = 0., max_bin = 0.;
+    for (size_t k = 0; k <= FFT_SIZE / 2; ++k)
+    {
+        double re = 0., im = 0.;
+        for (size_t n = 0; n < FFT_SIZE; ++n)
+        {
+            re += x[n] * cos(2. * M_PI * k * n / FFT_SIZE);
+            im -= x[n] * sin(2. * M_PI * k * n / FFT_SIZE);
+        }
+        max_error = fmax(max_error, hypot(out[k][0] - re, out[k][1] - im));
+        max_bin = fmax(max_bin, hypot(re, im));
+    }
+    printf("FFT max error %.2e of the largest bin\n", max_error / max_bin);
+    check(max_error / max_bin < FFT_TOLERANCE, "real FFT matches the DFT");
+}
+
+static void checkSines()
+{
+    // two sines on bin centers and off them, in noise, with gravity on z
+    const float f1 = 12.3f, a1 = 0.5f, f2 = 87.f, a2 = 0.05f, noise = 0.01f;
+    std::mt19937 rng(2);
+    std::normal_distribution<float> n(0.f, noise);
+
+    const float edges[] = {5.f, 20.f, 50.f, 100.f, 500.f};
+    spectrum.setBands(edges, 5);
+    spectrum.setPeakCount(3);
+    spectrum.begin(SAMPLE_RATE, FFT_SIZE / 2, SEGMENTS);
+
+    double square_sum = 0.;
+    size_t count = 0, pushed = 0;
+    const size_t needed = FFT_SIZE + (SEGMENTS - 1) * FFT_SIZE / 2;
+    for (size_t i = 0; !spectrum.available(); ++i)
+    {
+        const float t = i / SAMPLE_RATE;
+        const float x = a1 * sinf(2.f * M_PI * f1 * t) + a2 * sinf(2.f * M_PI * f2 * t) + n(rng);
+        spectrum.push(x, n(rng), 1.f + n(rng));
+        square_sum += x * x;
+        count++;
+        pushed++;
+    }
+    check(pushed == needed, "summary after the expected number of samples");
+
+    const Spectrum::Summary &s = spectrum.getSummary();
+    const float signal_rms = sqrt(square_sum / count);
+    printf("x rms %.4f g (signal %.4f g), z rms %.4f g (noise %.4f g)\n", s.rms[0], signal_rms, s.rms[2], noise);
+    check(fabs(s.rms[0] / signal_rms - 1.f) < RMS_TOLERANCE, "Parseval, x");
+    check(fabs(s.rms[2] / noise - 1.f) < 0.1f, "Parseval, z noise only, gravity removed");
+
+    const float df = spectrum.binWidth();
+    printf("peaks %.3f Hz %.4f g, %.3f Hz %.4f g\n", s.peaks[0][0].frequency, s.peaks[0][0].rms, s.peaks[0][1].frequency,
+           s.peaks[0][1].rms);
+    check(fabs(s.peaks[0][0].frequency - f1) < FREQUENCY_TOLERANCE * df, "first peak frequency");
+    check(fabs(s.peaks[0][1].frequency - f2) < FREQUENCY_TOLERANCE * df, "second peak frequency");
+    check(fabs(s.peaks[0][0].rms / (a1 / sqrtf(2.f)) - 1.f) < 0.02f, "first peak RMS");
+    check(fabs(s.peaks[0][1].rms / (a2 / sqrtf(2.f)) - 1.f) < 0.05f, "second peak RMS");
+
+    printf("band rms x:");
+    double band_square_sum = 0.;
+    for (uint8_t b = 0; b < spectrum.bandCount(); ++b)
+    {
+        printf(" %.4f", s.band_rms[0][b]);
+        band_square_sum += s.band_rms[0][b] * s.band_rms[0][b];
+    }
+    printf(" g\n");
+    check(s.band_rms[0][0] > 0.35f && s.band_rms[0][2] > 0.035f && s.band_rms[0][1] < 0.01f, "sines in their bands");
+
+    uint8_t packet[256];
+    const size_t size = spectrum.pack(s, packet, sizeof(packet));
+    printf("packed summary %zu bytes, every %.2f s: %.0f B/s instead of %.0f B/s of raw int16 samples\n", size,
+           needed / SAMPLE_RATE, size * SAMPLE_RATE / (SEGMENTS * FFT_SIZE / 2), 6 * SAMPLE_RATE);
+    check(size == spectrum.packedSize(), "packed size");
+    const uint16_t first_peak = packet[16 + 2 + 2 * 4 + 2] | (packet[16 + 2 + 2 * 4 + 3] << 8);
+    check(fabs(Spectrum::decodeRms(first_peak) / s.peaks[0][0].rms - 1.f) < 0.001f, "packed RMS decodes");
+}
+
+static void timeSegments()
+{
+    spectrum.begin(SAMPLE_RATE, FFT_SIZE / 2, 1000);
+    std::mt19937 rng(3);
+    std::normal_distribution<float> n(0.f, 1.f);
+    for (size_t i = 0; i < FFT_SIZE; ++i)
+        spectrum.push(n(rng), n(rng), n(rng));
+
+    const size_t segments = 2000;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < segments * FFT_SIZE / 2; ++i)
+        spectrum.push(n(rng), n(rng), n(rng));
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printf("%.1f us per segment of %d samples on 3 channels, random generation included\n", us / segments, FFT_SIZE);
+}
+
+int main()
+{
+    checkFft();
+    checkSines();
+    timeSegments();
+    return ok ? 0 : 1;
+}
@@ -40,6 +40,11 @@
 
 // * Analog to Digital Converters
 #include "libraries/adc/ad7689/ad7689.h"
+#include "libraries/adc/ad7689/decimation_filter.h"
+#include "libraries/adc/ad7689/ad7689_group.h"
+#include "libraries/adc/ad7689/adc_trigger.h"
+#include "libraries/adc/ad7689/ad7689_benchmark.h"
+#include "libraries/adc/ad7689/ad7689_timer_ticks.h"
 
 // TODO: Clean up & convert library to new format
 
@@ -48,7 +53,10 @@
 
 // * IMU
 #include "libraries/imu/MPU9250.h"
-// #include "libraries/imu/quaternionFilters.h"
+#include "libraries/imu/MPU9250CalibrationFile.h"
+#include "libraries/imu/MPU9250Pipeline.h"
+#include "libraries/imu/MultiQuaternionFilter.h"
+#include "libraries/imu/VibrationSpectrum.h"
 //#include "libraries/imu/mpu9250/SparkFunMPU9250-DMP.h"
 
 // * Bluetooth Low Energy
@@ -65,10 +73,18 @@
 // TODO: Creat SPIFFS if not initialized
 
 #include "libraries/memory/emmc/emmc_memory.h"
+#include "libraries/memory/emmc/emmc_stream_writer.h"
+#include "libraries/memory/emmc/emmc_log_writer.h"
+#include "libraries/memory/emmc/emmc_telemetry.h"
+#include "libraries/memory/emmc/emmc_compression.h"
+#include "libraries/memory/emmc/emmc_io_queue.h"
+#include "libraries/memory/emmc/emmc_benchmark.h"
 // TODO: Implement SD Card library example
 // TODO: Add library documentation: https://learn.adafruit.com/the-well-automated-arduino-library/doxygen-tips
 // TODO: Implement list directory functionality
 
+#include "libraries/memory/record_store/record_store.h"
+
 // * I/O Expansion
 #include "libraries/io_expansion/SX1509.h"
 
@@ -33,7 +33,7 @@ uint16_t AD7689::shiftTransaction(uint16_t command, bool readback, uint16_t *rb_
     if (readback)
     {
         // Send 32 clock cycles command to get data back, and then get that data into a 16-bit integer
-        uint32_t readback_command = adc_spi_bus.transfer32(command << 16);
+        uint32_t readback_command = adc_spi_bus->transfer32(command << 16);
         uint16_t response = readback_command;
 
         if (rb_cmd_ptr)
@@ -45,7 +45,7 @@ uint16_t AD7689::shiftTransaction(uint16_t command, bool readback, uint16_t *rb_
     {
 
         // uint16_t data = (adc_spi_bus->transfer(command >> 8) << 8) | adc_spi_bus->transfer(command & 0xFF);
-        data = adc_spi_bus.transfer16(command);
+        data = adc_spi_bus->transfer16(command);
     }
 
     // delay to allow data acquisition for the next cycle
@@ -116,9 +116,6 @@ AD7689_conf AD7689::getADCConfig(bool default_config, bool read_back)
         def.REF_conf = refConfig;
     }
 
-    // sequencer disabled, remember to restart it when taking measurements
-    sequencerActive = false;
-
     return def;
 }
 
@@ -162,18 +159,30 @@ float AD7689::readTemperature()
 }
 
 /**
- * [AD7689::configureSequencer Enables the automatic channel sequencer of the ADC and turn on temperature measurements.]
+ * [AD7689::configureSequencer Enables the automatic channel sequencer of the ADC and turn on temperature measurements.
+ * Temperature is only added to the scan when the selected reference keeps the temperature sensor powered.]
+ * @param  scans Number of inputs to scan, starting at IN0, between 1 and 8.
+ * @return       Error if scans is out of range, the ADC is left untouched.
  */
-void AD7689::configureSequencer()
+ESP_ERROR AD7689::configureSequencer(uint8_t scans)
 {
+    ESP_ERROR err;
+
+    // INx holds the last input scanned: 0 would wrap to 255, above 8 the upper bits would be dropped
+    if (scans == 0 || scans > TOTAL_CHANNELS)
+    {
+        err.on_error = true;
+        err.debug_message = "Invalid number of sequencer scans " + String(scans);
+        return err;
+    }
+
     // load a new configuration with the setting specified by the user
     AD7689_conf sequence = getADCConfig();
 
-    // turn on sequencer if it hasn't been turned on yet, and set it to read temperature too
-    // sequence.REF_conf = EXT_REF_TEMP_ON;
-    sequence.REF_conf = INT_REF_4096;
-    // sequence.REF_conf = INTERNAL_25;
-    sequence.SEQ_conf = SEQ_SCAN_INPUT_TEMP;
+    // scan only the requested inputs, using the reference selected by the user
+    sequence.INx_conf = scans - 1;
+    sequence.REF_conf = refConfig;
+    sequence.SEQ_conf = temperatureAvailable() ? SEQ_SCAN_INPUT_TEMP : SEQ_SCAN_INPUT;
 
     // disable readback
     sequence.RB_conf = false;
@@ -192,24 +201,43 @@ void AD7689::configureSequencer()
 
     // remember that the sequencer is active to prevent unnecessary intializations
     sequencerActive = true;
+    sequencerScans = scans;
+
+    // a planned sequence has to be reloaded after this
+    seqPlan.primed = false;
+
+    return err;
+}
+
+/**
+ * [AD7689::temperatureAvailable Checks if the selected voltage reference keeps the temperature sensor powered.]
+ * @return True if temperature can be converted, False otherwise.
+ */
+bool AD7689::temperatureAvailable()
+{
+    return (refConfig != EXT_REF_TEMP_OFF) && (refConfig != EXT_REF_TEMP_OFF_BUF);
 }
 
 /**
  * [AD7689::readChannels Reads voltages as raw 16 bit ADC samples from selected channels. Temperature also read.]
- * @param channels Last channel to read, starting at 0 to max. 7, in differential mode always read even number of channels.
+ * @param channels Number of channels to read, starting at 0 to max. 8, in differential mode always read even number of channels.
  * @param mode     Input signal configuration mode: UNIPOLAR_MODE, BIPOLAR_MODE or DIFFERENTIAL_MODE.
  * @param data     Pointer to a vector holding the data, length depending on channels and mode.
- * @param temp     Pointer to a variable holding the temperature.
+ * @param temp     Pointer to a variable holding the temperature. Left untouched if the reference disables the sensor.
+ * @return         Error if channels is out of range, nothing is read.
  */
 
 // 2017 08 14 update to try to fix micros() overflow bug
-void AD7689::readChannels(uint8_t channels, uint8_t mode, uint16_t data[], uint16_t *temp)
+ESP_ERROR AD7689::readChannels(uint8_t channels, uint8_t mode, uint16_t data[], uint16_t *temp)
 {
+    ESP_ERROR err;
 
-    // if the sequencer insn't active yet, enable it
-    // occurs after self testing or at start-up
-    if (!sequencerActive)
-        configureSequencer();
+    if (channels == 0 || channels > TOTAL_CHANNELS)
+    {
+        err.on_error = true;
+        err.debug_message = "Invalid number of channels " + String(channels);
+        return err;
+    }
 
     uint8_t scans = channels; // unipolar mode default
     if (mode == DIFFERENTIAL_MODE)
@@ -219,36 +247,33 @@ void AD7689::readChannels(uint8_t channels, uint8_t mode, uint16_t data[], uint1
             scans++;
     }
 
-    uint32_t now = micros(),
-             nowPlus2Frames = now + +framePeriod * 2;
+    // if the sequencer insn't active yet, or scans a different number of inputs, (re)enable it
+    // occurs after self testing, at start-up or when switching to a partial scan
+    if (!sequencerActive || sequencerScans != scans)
+    {
+        err = configureSequencer(scans);
+        if (err.on_error)
+            return err;
+    }
+
+    uint32_t now = micros();
 
     // read as many values as there are ADC channels active
     // when reading differential, only half the number of channels will be read
     for (uint8_t ch = 0; ch < scans; ch++)
     {
         data[ch] = shiftTransaction(0, false, NULL);
-        // if (now < lastSeqEndTime)
-        // { // micros() overflow
-        //     lastSeqEndTime = nowPlus2Frames;
-        // }
-        // if ((timeStamps[ch] < lastSeqEndTime) || timeStamps[ch] < now)
-        // { // micros overflow
-        //     timeStamps[ch] = nowPlus2Frames;
-        // }
-        // if (ch < 2)
-        // { // calculate time stamp based on ending of previous sequence for first 2 frames
-        //     timeStamps[ch] = (lastSeqEndTime < nowPlus2Frames) ? nowPlus2Frames : lastSeqEndTime - (1 - ch) * framePeriod;
-        // }
-        // else
-        // {
-        //     timeStamps[ch] = now; // - framePeriod * 2; // sequenceTime in µs, 2 frames lag
-        // }
     }
 
     // capture temperature too
-    *temp = shiftTransaction(0, false, NULL);
-    tempTime = now;       // micros() - framePeriod * 2;
+    if (temperatureAvailable())
+    {
+        *temp = shiftTransaction(0, false, NULL);
+        tempTime = now; // micros() - framePeriod * 2;
+    }
     lastSeqEndTime = now; // micros();
+
+    return err;
 }
 
 /**
@@ -317,6 +342,9 @@ void AD7689::cycleTimingBenchmark()
     }
     framePeriod = (micros() - startTime) / 10;
     lastSeqEndTime = startTime;
+
+    // the default configuration turned the sequencer off
+    sequencerActive = false;
 }
 
 /** AD7689::getInputConfig returns an inputConfig value according to the following truth table
@@ -408,6 +436,8 @@ float AD7689::getPosRef(uint8_t refS, float posR)
 
 ESP_ERROR AD7689::begin(uint8_t cs_pin, SPIClass &spi_bus, uint64_t spi_bus_clk_frequency)
 {
+    ESP_ERROR err;
+
     inputCount = 8;
     inputConfig = getInputConfig(UNIPOLAR_MODE, false);
 
@@ -426,7 +456,7 @@ ESP_ERROR AD7689::begin(uint8_t cs_pin, SPIClass &spi_bus, uint64_t spi_bus_clk_
     filterConfig = true; // full bandwidth
 
     adc_cs_pin = cs_pin;
-    adc_spi_bus = spi_bus;
+    adc_spi_bus = &spi_bus; // keep a reference, so several ADCs can share and coordinate the bus
     adc_spi_settings = SPISettings(spi_bus_clk_frequency, MSBFIRST, SPI_MODE0);
 
     // adc_spi_bus.beginTransaction(adc_spi_settings);
@@ -451,6 +481,11 @@ ESP_ERROR AD7689::begin(uint8_t cs_pin, SPIClass &spi_bus, uint64_t spi_bus_clk_
 
     // sequencer disabled by default
     sequencerActive = false;
+    sequencerScans = 0;
+
+    // no partial scan planned yet
+    seqPlan.valid = false;
+    seqPlan.primed = false;
 
     // //* 1. 2 dummy reads
     // // digitalWrite(adc_cs_pin, LOW);
@@ -504,6 +539,8 @@ ESP_ERROR AD7689::begin(uint8_t cs_pin, SPIClass &spi_bus, uint64_t spi_bus_clk_
 
     // sequencer disabled by default
     sequencerActive = false;
+
+    return err;
 }
 
 /**
@@ -604,8 +641,9 @@ bool AD7689::selftest()
     AD7689_conf rb_conf = getADCConfig(true);
     rb_conf.RB_conf = true; // enable readback
 
-    // send readback command
+    // send readback command, this turns the sequencer off
     shiftTransaction(toCommand(rb_conf), false, NULL);
+    sequencerActive = false;
 
     // skip second frame
     shiftTransaction(toCommand(getADCConfig(false)), false, NULL);
@@ -622,3 +660,282 @@ bool AD7689::selftest()
     }
     return res;
 }
+
+/**
+ * [AD7689::planSequence Computes a conversion schedule for an arbitrary set of channels.
+ * Each channel can be oversampled, in which case consecutive conversions are averaged into one output sample.
+ * Oversampled conversions are grouped per channel so the input multiplexer only switches once per channel.
+ * If the channels are contiguous from IN0, are not oversampled and temperature is read on every scan (or never),
+ * the on-chip sequencer runs the scan and no configuration words are sent. Otherwise every frame carries the
+ * configuration (CFG update) for the conversion it starts, which costs no extra SPI clocks.]
+ * @param  channel_mask    Bit mask of the channels to scan, bit 0 is IN0.
+ * @param  oversampling    Conversions averaged per output sample for each channel, NULL for no oversampling.
+ * @param  temp_decimation Convert temperature once every temp_decimation scans, 0 to disable temperature.
+ * @return                 Error if the plan can't be executed with the current configuration: no channels, too
+ *                         many conversions, temperature without the sensor, or differential inputs.
+ */
+ESP_ERROR AD7689::planSequence(uint8_t channel_mask, const uint8_t *oversampling, uint16_t temp_decimation)
+{
+    ESP_ERROR err;
+    err.on_error = false;
+
+    if (channel_mask == 0)
+    {
+        err.on_error = true;
+        err.debug_message = "No channels selected for sequence";
+        return err;
+    }
+
+    if (temp_decimation > 0 && !temperatureAvailable())
+    {
+        err.on_error = true;
+        err.debug_message = "Selected voltage reference disables the temperature sensor";
+        return err;
+    }
+
+    // slots are planned per input: in differential mode INx selects a pair, and the sequencer scans pairs
+    if (inputConfig == INCC_BIPOLAR_DIFF || inputConfig == INCC_UNIPOLAR_DIFF)
+    {
+        err.on_error = true;
+        err.debug_message = "Sequences of differential inputs are not supported";
+        seqPlan.valid = false;
+        return err;
+    }
+
+    uint16_t total_slots = 0;
+    uint8_t scans = 0;
+    bool contiguous = true;
+    bool uniform = true;
+
+    for (uint8_t ch = 0; ch < TOTAL_CHANNELS; ch++)
+    {
+        uint8_t ratio = 0;
+        if (channel_mask & (1 << ch))
+        {
+            ratio = (oversampling && oversampling[ch] > 0) ? oversampling[ch] : 1;
+
+            contiguous &= (ch == scans);
+            uniform &= (ratio == 1);
+            total_slots += ratio;
+            scans++;
+        }
+        seqPlan.oversampling[ch] = ratio;
+    }
+
+    if (total_slots > MAX_SEQUENCE_SLOTS)
+    {
+        err.on_error = true;
+        err.debug_message = "Sequence needs more than " + String(MAX_SEQUENCE_SLOTS) + " conversions per scan";
+        seqPlan.valid = false;
+        return err;
+    }
+
+    seqPlan.tempDecimation = temp_decimation;
+    seqPlan.hardwareSequencer = contiguous && uniform && (temp_decimation <= 1);
+
+    // configuration for each conversion when the sequencer is not used
+    AD7689_conf slot_conf = getADCConfig();
+    slot_conf.REF_conf = refConfig;
+    slot_conf.SEQ_conf = SEQ_OFF;
+    slot_conf.RB_conf = false;
+    slot_conf.CFG_conf = true;
+
+    seqPlan.slotCount = 0;
+    for (uint8_t ch = 0; ch < TOTAL_CHANNELS; ch++)
+    {
+        slot_conf.INx_conf = ch;
+        for (uint8_t i = 0; i < seqPlan.oversampling[ch]; i++)
+        {
+            AD7689_slot &slot = seqPlan.slots[seqPlan.slotCount++];
+            slot.command = seqPlan.hardwareSequencer ? 0 : toCommand(slot_conf);
+            slot.channel = ch;
+        }
+    }
+
+    slot_conf.INCC_conf = INCC_TEMP;
+    seqPlan.tempCommand = toCommand(slot_conf);
+
+    seqPlan.valid = true;
+    seqPlan.primed = false;
+
+    return err;
+}
+
+/**
+ * [AD7689::primeSequence Loads the planned sequence into the ADC and resets the conversion pipeline.]
+ */
+void AD7689::primeSequence()
+{
+    if (seqPlan.hardwareSequencer)
+    {
+        AD7689_conf sequence = getADCConfig();
+        sequence.INx_conf = seqPlan.slotCount - 1;
+        sequence.REF_conf = refConfig;
+        sequence.SEQ_conf = seqPlan.tempDecimation ? SEQ_SCAN_INPUT_TEMP : SEQ_SCAN_INPUT;
+        sequence.RB_conf = false;
+        sequence.CFG_conf = true;
+
+        // send command to configure ADC and enable sequencer, then skip a frame
+        shiftTransaction(toCommand(sequence), false, NULL);
+        shiftTransaction(0, false, NULL);
+    }
+
+    // the two conversions in flight don't belong to this plan
+    seqPlan.pipeline[0] = NO_CHANNEL;
+    seqPlan.pipeline[1] = NO_CHANNEL;
+
+    for (uint8_t ch = 0; ch < TOTAL_CHANNELS; ch++)
+    {
+        seqPlan.accumulator[ch] = 0;
+        seqPlan.accumulated[ch] = 0;
+    }
+
+    seqPlan.scanCount = 0;
+    seqPlan.primed = true;
+
+    // readChannels has to reconfigure the ADC after this
+    sequencerActive = false;
+}
+
+/**
+ * [AD7689::shiftSlot Starts the conversion of a slot, and stores the result of the conversion started 2 frames ago.]
+ * @param  slot The slot to start.
+ * @param  data Vector of samples indexed by channel.
+ * @param  temp Pointer to a variable holding the temperature.
+ * @return      Bit mask of the outputs that received a new sample, bit TEMP_CHANNEL for temperature.
+ */
+uint16_t AD7689::shiftSlot(const AD7689_slot &slot, uint16_t *data, uint16_t *temp)
+{
+    uint16_t result = shiftTransaction(slot.command, false, NULL);
+
+    // responses lag 2 frames behind on commands
+    uint8_t channel = seqPlan.pipeline[0];
+    seqPlan.pipeline[0] = seqPlan.pipeline[1];
+    seqPlan.pipeline[1] = slot.channel;
+
+    if (channel == TEMP_CHANNEL)
+    {
+        *temp = result;
+        tempTime = micros();
+        return 1 << TEMP_CHANNEL;
+    }
+
+    if (channel < TOTAL_CHANNELS)
+    {
+        uint8_t ratio = seqPlan.oversampling[channel];
+        seqPlan.accumulator[channel] += result;
+
+        if (++seqPlan.accumulated[channel] >= ratio)
+        {
+            data[channel] = (seqPlan.accumulator[channel] + ratio / 2) / ratio;
+            seqPlan.accumulator[channel] = 0;
+            seqPlan.accumulated[channel] = 0;
+            return 1 << channel;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * [AD7689::readSequence Runs one scan of the planned sequence.
+ * When the sequencer can't be used, the last 2 conversions of a scan are delivered by the next call, so the first
+ * call after planning may not update every channel.]
+ * @param  data Vector of TOTAL_CHANNELS samples, indexed by channel. Only planned channels are written.
+ * @param  temp Pointer to a variable holding the temperature. Only written on scans that convert temperature.
+ * @return      Bit mask of the outputs that received a new sample, bit TEMP_CHANNEL for temperature.
+ */
+uint16_t AD7689::readSequence(uint16_t *data, uint16_t *temp)
+{
+    uint16_t updated = 0;
+
+    if (!seqPlan.valid)
+        return updated;
+
+    if (!seqPlan.primed)
+        primeSequence();
+
+    if (seqPlan.hardwareSequencer)
+    {
+        // the sequencer scans IN0 to INx, followed by temperature if enabled
+        for (uint8_t i = 0; i < seqPlan.slotCount; i++)
+        {
+            data[i] = shiftTransaction(0, false, NULL);
+            updated |= 1 << i;
+        }
+
+        if (seqPlan.tempDecimation)
+        {
+            *temp = shiftTransaction(0, false, NULL);
+            tempTime = micros();
+            updated |= 1 << TEMP_CHANNEL;
+        }
+    }
+    else
+    {
+        for (uint8_t i = 0; i < seqPlan.slotCount; i++)
+            updated |= shiftSlot(seqPlan.slots[i], data, temp);
+
+        // convert temperature only once every tempDecimation scans
+        if (seqPlan.tempDecimation && ++seqPlan.scanCount >= seqPlan.tempDecimation)
+        {
+            AD7689_slot temp_slot = {seqPlan.tempCommand, TEMP_CHANNEL};
+            updated |= shiftSlot(temp_slot, data, temp);
+            seqPlan.scanCount = 0;
+        }
+    }
+
+    lastSeqEndTime = micros();
+    return updated;
+}
+
+/**
+ * [AD7689::conversionPeriod Time taken by a single conversion, limited by either the SPI frame or the ADC throughput.]
+ * @return Conversion period in microseconds.
+ */
+float AD7689::conversionPeriod()
+{
+    float min_period = 1000000.0 / MAX_SAMPLE_RATE;
+    return (framePeriod > min_period) ? framePeriod : min_period;
+}
+
+/**
+ * [AD7689::getScanRate Estimates how many scans of the planned sequence can be run per second.]
+ * @return Scans per second, 0 if no sequence is planned.
+ */
+float AD7689::getScanRate()
+{
+    if (!seqPlan.valid)
+        return 0;
+
+    float frames = seqPlan.slotCount;
+    if (seqPlan.tempDecimation)
+        frames += 1.0 / seqPlan.tempDecimation;
+
+    return 1000000.0 / (conversionPeriod() * frames);
+}
+
+/**
+ * [AD7689::getChannelSampleRate Effective output rate of a channel in the planned sequence, after oversampling.]
+ * @param  channel The channel, between 0 and 7.
+ * @return         Samples per second, 0 if the channel is not part of the sequence.
+ */
+float AD7689::getChannelSampleRate(uint8_t channel)
+{
+    if (!seqPlan.valid || channel >= TOTAL_CHANNELS || seqPlan.oversampling[channel] == 0)
+        return 0;
+
+    return getScanRate();
+}
+
+/**
+ * [AD7689::getTemperatureSampleRate Effective temperature rate of the planned sequence.]
+ * @return Samples per second, 0 if temperature is not part of the sequence.
+ */
+float AD7689::getTemperatureSampleRate()
+{
+    if (!seqPlan.valid || seqPlan.tempDecimation == 0)
+        return 0;
+
+    return getScanRate() / seqPlan.tempDecimation;
+}
@@ -58,6 +58,10 @@
 #define TCONV (4)
 #define TACQ (2)
 #define STARTUP_DELAY (100)
+#define MAX_SAMPLE_RATE (250000)      // maximum throughput of the ADC, in samples per second
+#define TEMP_CHANNEL (TOTAL_CHANNELS) // channel tag used for the temperature sensor in a sequence plan
+#define MAX_SEQUENCE_SLOTS (64)       // maximum number of conversions in a single planned scan
+#define NO_CHANNEL (0xFF)             // channel tag for conversions that don't belong to a plan
 
 /** Configuration settings of the ADC.
  *  This should *not* be modified directly by the user.
@@ -75,11 +79,40 @@ struct AD7689_conf
     bool RB_conf;      /*!< True if readback should be enabled */
 };
 
+/** A single conversion of a planned sequence. */
+struct AD7689_slot
+{
+    uint16_t command; /*!< Command word shifted out to start this conversion. */
+    uint8_t channel;  /*!< Input channel being converted, or TEMP_CHANNEL. */
+};
+
+/** Conversion schedule built by AD7689::planSequence.
+ *  This should *not* be modified directly by the user.
+ */
+struct AD7689_sequence
+{
+    AD7689_slot slots[MAX_SEQUENCE_SLOTS]; /*!< Conversions of a single scan, temperature excluded. */
+    uint8_t slotCount;                     /*!< Number of used slots. */
+    uint8_t oversampling[TOTAL_CHANNELS];  /*!< Conversions averaged per output sample, 0 if the channel is not scanned. */
+    uint16_t tempDecimation;               /*!< Temperature is converted once every tempDecimation scans, 0 to disable. */
+    uint16_t tempCommand;                  /*!< Command word for the temperature conversion. */
+    uint16_t scanCount;                    /*!< Scans since the last temperature conversion. */
+    bool hardwareSequencer;                /*!< True if the on-chip sequencer runs the scan. */
+    bool valid;                            /*!< True once a plan has been computed. */
+    bool primed;                           /*!< True while the ADC holds the configuration of this plan. */
+    uint8_t pipeline[2];                   /*!< Channels of the two conversions still in flight. */
+    uint32_t accumulator[TOTAL_CHANNELS];  /*!< Running sum of oversampled conversions. */
+    uint8_t accumulated[TOTAL_CHANNELS];   /*!< Number of conversions in each accumulator. */
+};
+
 /**
  * Represents the Analog Devices AD7689, an ADC with 8 channels and 16 bit resolution.
  */
 class AD7689
 {
+    friend class AD7689Group;
+    friend class AD7689Benchmark;
+
 private:
     AD7689_conf conf; /*!< Configuration settings for the ADC. */
 
@@ -89,7 +122,7 @@ private:
     uint8_t inputConfig; /*!< Input channel configuration. */
     uint8_t refConfig;   /*!< Voltage reference configuration. */
 
-    SPIClass adc_spi_bus;
+    SPIClass *adc_spi_bus;
     SPISettings adc_spi_settings;
     uint8_t adc_cs_pin;
 
@@ -101,14 +134,20 @@ private:
     uint32_t lastSeqEndTime;             /*!< Time stamp of the end of the last data acquisition sequence. */
     uint8_t inputCount;                  /*!< Number of input channels. Even for differential mode. */
 
-    bool sequencerActive; /*!< True when the sequencer is initialized, false at start-up or during self tests */
-    bool filterConfig;    /*!< Input filter configuration. */
+    bool sequencerActive;     /*!< True when the sequencer is initialized, false at start-up or during self tests */
+    uint8_t sequencerScans;   /*!< Number of inputs scanned by the sequencer. */
+    bool filterConfig;        /*!< Input filter configuration. */
+    AD7689_sequence seqPlan;  /*!< Planned partial scan, see planSequence. */
 
     uint16_t shiftTransaction(uint16_t command, bool readback, uint16_t *rb_cmd_ptr);
     uint16_t toCommand(AD7689_conf cfg);
     AD7689_conf getADCConfig(bool default_config = false, bool read_back = false);
     float readTemperature(void);
-    void configureSequencer();
+    ESP_ERROR configureSequencer(uint8_t scans = TOTAL_CHANNELS);
+    bool temperatureAvailable(void);
+    void primeSequence(void);
+    uint16_t shiftSlot(const AD7689_slot &slot, uint16_t *data, uint16_t *temp);
+    float conversionPeriod(void);
 
     // float calculateVoltage(uint16_t sample);
     float calculateTemp(uint16_t temp);
@@ -124,11 +163,18 @@ private:
 public:
     ESP_ERROR begin(uint8_t cs_pin, SPIClass &spi_bus, uint64_t spi_bus_clk_frequency);
     void enableFiltering(bool onOff);
-    void readChannels(uint8_t channels, uint8_t mode, uint16_t *data, uint16_t *temp);
+    ESP_ERROR readChannels(uint8_t channels, uint8_t mode, uint16_t *data, uint16_t *temp);
     float acquireChannel(uint8_t channel, uint32_t *timeStamp);
     float acquireChannel(uint8_t channel);
     float acquireTemperature();
     bool selftest(void);
     float calculateVoltage(uint16_t sample);
+
+    // partial scan sequencing
+    ESP_ERROR planSequence(uint8_t channel_mask, const uint8_t *oversampling = NULL, uint16_t temp_decimation = 1);
+    uint16_t readSequence(uint16_t *data, uint16_t *temp);
+    float getScanRate(void);
+    float getChannelSampleRate(uint8_t channel);
+    float getTemperatureSampleRate(void);
 };
 #endif
@@ -0,0 +1,372 @@
+// Throughput benchmark and self-test for the AD7689 driver.
+// Timing is measured with the CPU cycle counter; the paced backends record the latency between the instant a scan is
+// due (busy-wait deadline or timer interrupt) and the start of its first frame, in 1 µs bins.
+
+#include "ad7689_benchmark.h"
+
+AD7689Benchmark::AD7689Benchmark(AD7689 &adc_under_test)
+{
+    adc = &adc_under_test;
+    cpuMHz = 1;
+    memset(&report, 0, sizeof(report));
+}
+
+/**
+ * [AD7689Benchmark::run Runs the self-test and every measurement.]
+ * @param  duration   Length of each rate and backend measurement, in ms.
+ * @param  paced_rate Scans per second requested from the paced backends.
+ * @param  ticks      Tick source pacing the timer backend, NULL to skip it.
+ * @param  channel    Input used for the single channel rate.
+ * @return            Error if the parameters are invalid or the self-test failed. The report is complete either way.
+ */
+ESP_ERROR AD7689Benchmark::run(uint32_t duration, uint32_t paced_rate, AD7689TickSource *ticks, uint8_t channel)
+{
+    ESP_ERROR err;
+
+    if (duration == 0 || paced_rate == 0 || channel >= TOTAL_CHANNELS)
+    {
+        err.on_error = true;
+        err.debug_message = "Invalid benchmark parameters";
+        return err;
+    }
+
+    memset(&report, 0, sizeof(report));
+    cpuMHz = ESP.getCpuFreqMHz();
+    report.pacedRate = paced_rate;
+
+    beginBus();
+
+    report.selftest = adc->selftest();
+
+    measureFrameTime();
+    measureSingleChannel(channel, duration);
+    measureFullScan(duration);
+    measureBlocking(duration);
+
+    endBus();
+
+    resetBackend(report.timer);
+    if (ticks)
+        measureTimer(*ticks, duration);
+
+    // the driver only shifts frames from the CPU
+    resetBackend(report.dma);
+
+    if (!report.selftest)
+    {
+        err.on_error = true;
+        err.debug_message = "AD7689 self-test failed";
+    }
+
+    return err;
+}
+
+/**
+ * [AD7689Benchmark::beginBus Locks the SPI bus for the ADC.]
+ */
+void AD7689Benchmark::beginBus()
+{
+    adc->adc_spi_bus->beginTransaction(adc->adc_spi_settings);
+}
+
+/**
+ * [AD7689Benchmark::endBus Releases the SPI bus.]
+ */
+void AD7689Benchmark::endBus()
+{
+    adc->adc_spi_bus->endTransaction();
+}
+
+/**
+ * [AD7689Benchmark::measureFrameTime Measures a complete frame, and the bare 16 bit transfer without the CS edges.
+ * CS stays high during the bare transfers, so the ADC ignores them.]
+ */
+void AD7689Benchmark::measureFrameTime()
+{
+    uint32_t start = ESP.getCycleCount();
+    for (uint16_t i = 0; i < BENCHMARK_TIMING_FRAMES; i++)
+        adc->shiftTransaction(0, false, NULL);
+    uint32_t frame_cycles = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (uint16_t i = 0; i < BENCHMARK_TIMING_FRAMES; i++)
+        adc->adc_spi_bus->transfer16(0);
+    uint32_t transfer_cycles = ESP.getCycleCount() - start;
+
+    report.frameTime = (float)toNanoseconds(frame_cycles) / BENCHMARK_TIMING_FRAMES;
+    report.transferTime = (float)toNanoseconds(transfer_cycles) / BENCHMARK_TIMING_FRAMES;
+    report.csOverhead = report.frameTime - report.transferTime;
+}
+
+/**
+ * [AD7689Benchmark::measureSingleChannel Maximum sample rate of a single channel, through planSequence.]
+ * @param channel  Input to convert.
+ * @param duration Length of the measurement, in ms.
+ */
+void AD7689Benchmark::measureSingleChannel(uint8_t channel, uint32_t duration)
+{
+    uint16_t data[TOTAL_CHANNELS];
+    uint16_t temp;
+    uint32_t samples = 0;
+
+    if (adc->planSequence(1 << channel, NULL, 0).on_error)
+        return;
+
+    uint32_t start = micros();
+    uint32_t elapsed;
+    do
+    {
+        if (adc->readSequence(data, &temp) & (1 << channel))
+            samples++;
+        elapsed = micros() - start;
+    } while (elapsed < duration * 1000);
+
+    report.singleChannelRate = samples * 1000000.0 / elapsed;
+}
+
+/**
+ * [AD7689Benchmark::measureFullScan Maximum scan rate of readChannels on every channel.]
+ * @param duration Length of the measurement, in ms.
+ */
+void AD7689Benchmark::measureFullScan(uint32_t duration)
+{
+    uint16_t data[TOTAL_CHANNELS];
+    uint16_t temp;
+    uint32_t scans = 0;
+
+    uint32_t start = micros();
+    uint32_t elapsed;
+    do
+    {
+        adc->readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp);
+        scans++;
+        elapsed = micros() - start;
+    } while (elapsed < duration * 1000);
+
+    report.fullScanRate = scans * 1000000.0 / elapsed;
+    report.fullScanSampleRate = report.fullScanRate * (TOTAL_CHANNELS + (adc->temperatureAvailable() ? 1 : 0));
+}
+
+/**
+ * [AD7689Benchmark::measureBlocking Full scans at the paced rate, waiting for each deadline in a busy loop.
+ * The core is never released, so its CPU load is always 1.]
+ * @param duration Length of the measurement, in ms.
+ */
+void AD7689Benchmark::measureBlocking(uint32_t duration)
+{
+    AD7689_backend_result &result = report.blocking;
+    resetBackend(result);
+    result.supported = true;
+
+    uint16_t data[TOTAL_CHANNELS];
+    uint16_t temp;
+    double sum = 0, square_sum = 0;
+    uint64_t busy_cycles = 0;
+
+    uint32_t period = (uint64_t)cpuMHz * 1000000 / report.pacedRate;
+    uint32_t start_us = micros();
+    uint32_t deadline = ESP.getCycleCount() + period;
+
+    while (micros() - start_us < duration * 1000)
+    {
+        while ((int32_t)(ESP.getCycleCount() - deadline) < 0)
+            ;
+
+        uint32_t begin = ESP.getCycleCount();
+        adc->readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp);
+        uint32_t end = ESP.getCycleCount();
+
+        addLatency(result.jitter, toNanoseconds(begin - deadline), sum, square_sum);
+        busy_cycles += end - begin;
+
+        deadline += period;
+
+        // late: skip the scans that were missed instead of bursting to catch up
+        while ((int32_t)(end - deadline) >= 0)
+        {
+            result.jitter.overruns++;
+            deadline += period;
+        }
+    }
+
+    float elapsed = (micros() - start_us) / 1000000.0;
+    result.scanRate = result.jitter.scans / elapsed;
+    result.cpuLoad = 1;
+    result.busLoad = (busy_cycles / (cpuMHz * 1000000.0)) / elapsed;
+    finishJitter(result.jitter, sum, square_sum);
+}
+
+/**
+ * [AD7689Benchmark::measureTimer Full scans at the paced rate, each started by a tick waking the calling task.
+ * With a timer interrupt, the latency includes the interrupt and the context switch.]
+ * @param ticks    Tick source, see AD7689TickSource.
+ * @param duration Length of the measurement, in ms.
+ */
+void AD7689Benchmark::measureTimer(AD7689TickSource &ticks, uint32_t duration)
+{
+    AD7689_backend_result &result = report.timer;
+
+    uint16_t data[TOTAL_CHANNELS];
+    uint16_t temp;
+    double sum = 0, square_sum = 0;
+    uint64_t busy_cycles = 0;
+    uint64_t bus_cycles = 0;
+
+    // left unsupported if the source can't tick
+    if (!ticks.start(1000000 / report.pacedRate))
+        return;
+
+    result.supported = true;
+    beginBus();
+
+    uint32_t start_us = micros();
+    while (micros() - start_us < duration * 1000)
+    {
+        uint32_t due;
+        uint32_t pending = ticks.wait(100, &due);
+        if (pending == 0)
+            break;
+
+        uint32_t begin = ESP.getCycleCount();
+        adc->readChannels(TOTAL_CHANNELS, UNIPOLAR_MODE, data, &temp);
+        uint32_t end = ESP.getCycleCount();
+
+        addLatency(result.jitter, toNanoseconds(begin - due), sum, square_sum);
+        result.jitter.overruns += pending - 1;
+
+        // time spent in the interrupt and waking up is part of the CPU load, not of the bus load
+        busy_cycles += end - due;
+        bus_cycles += end - begin;
+    }
+
+    endBus();
+    ticks.stop();
+
+    float elapsed = (micros() - start_us) / 1000000.0;
+    result.scanRate = result.jitter.scans / elapsed;
+    result.cpuLoad = (busy_cycles / (cpuMHz * 1000000.0)) / elapsed;
+    result.busLoad = (bus_cycles / (cpuMHz * 1000000.0)) / elapsed;
+    finishJitter(result.jitter, sum, square_sum);
+}
+
+/**
+ * [AD7689Benchmark::resetBackend Clears the result of a backend and marks it unsupported.]
+ * @param result Backend result.
+ */
+void AD7689Benchmark::resetBackend(AD7689_backend_result &result)
+{
+    memset(&result, 0, sizeof(result));
+    result.jitter.min = UINT32_MAX;
+}
+
+/**
+ * [AD7689Benchmark::addLatency Adds a scheduling latency to the jitter statistics.]
+ * @param jitter     Statistics to update.
+ * @param latency    Latency, in ns.
+ * @param sum        Running sum of latencies.
+ * @param square_sum Running sum of squared latencies.
+ */
+void AD7689Benchmark::addLatency(AD7689_jitter &jitter, uint32_t latency, double &sum, double &square_sum)
+{
+    uint32_t bin = latency / 1000;
+    if (bin >= BENCHMARK_JITTER_BINS)
+        bin = BENCHMARK_JITTER_BINS - 1;
+
+    jitter.histogram[bin]++;
+    jitter.scans++;
+
+    if (latency < jitter.min)
+        jitter.min = latency;
+    if (latency > jitter.max)
+        jitter.max = latency;
+
+    sum += latency;
+    square_sum += (double)latency * latency;
+}
+
+/**
+ * [AD7689Benchmark::finishJitter Computes mean and standard deviation once every latency has been added.]
+ * @param jitter     Statistics to update.
+ * @param sum        Sum of latencies.
+ * @param square_sum Sum of squared latencies.
+ */
+void AD7689Benchmark::finishJitter(AD7689_jitter &jitter, double sum, double square_sum)
+{
+    if (jitter.scans == 0)
+    {
+        jitter.min = 0;
+        return;
+    }
+
+    double mean = sum / jitter.scans;
+    double variance = square_sum / jitter.scans - mean * mean;
+
+    jitter.mean = mean;
+    jitter.stddev = (variance > 0) ? sqrt(variance) : 0;
+}
+
+/**
+ * [AD7689Benchmark::writeBackend Appends a backend result to the JSON report.]
+ * @param  output Destination.
+ * @param  name   Backend name.
+ * @param  result Backend result.
+ * @return        Bytes written.
+ */
+size_t AD7689Benchmark::writeBackend(Print &output, const char *name, const AD7689_backend_result &result)
+{
+    String json = "\"" + String(name) + "\":{\"supported\":" + String(result.supported ? "true" : "false");
+
+    if (result.supported)
+    {
+        const AD7689_jitter &jitter = result.jitter;
+
+        json += ",\"scan_rate\":" + String(result.scanRate, 1);
+        json += ",\"cpu_load\":" + String(result.cpuLoad, 4);
+        json += ",\"bus_load\":" + String(result.busLoad, 4);
+        json += ",\"latency_ns\":{\"mean\":" + String(jitter.mean, 1) + ",\"stddev\":" + String(jitter.stddev, 1);
+        json += ",\"min\":" + String(jitter.min) + ",\"max\":" + String(jitter.max) + "}";
+        json += ",\"scans\":" + String(jitter.scans) + ",\"overruns\":" + String(jitter.overruns);
+        json += ",\"histogram_us\":[";
+        for (uint8_t i = 0; i < BENCHMARK_JITTER_BINS; i++)
+        {
+            json += String(jitter.histogram[i]);
+            if (i < BENCHMARK_JITTER_BINS - 1)
+                json += ",";
+        }
+        json += "]";
+    }
+
+    json += "}";
+    return output.write((const uint8_t *)json.c_str(), json.length());
+}
+
+/**
+ * [AD7689Benchmark::writeReport Prints the last report as a single line of JSON.]
+ * @param  output Destination, e.g. Serial.
+ * @return        Bytes written.
+ */
+size_t AD7689Benchmark::writeReport(Print &output)
+{
+    String json = "{\"device\":\"AD7689\"";
+    json += ",\"cpu_mhz\":" + String(cpuMHz);
+    json += ",\"selftest\":" + String(report.selftest ? "true" : "false");
+    json += ",\"frame_ns\":" + String(report.frameTime, 1);
+    json += ",\"transfer_ns\":" + String(report.transferTime, 1);
+    json += ",\"cs_overhead_ns\":" + String(report.csOverhead, 1);
+    json += ",\"single_channel_sps\":" + String(report.singleChannelRate, 1);
+    json += ",\"full_scan_rate\":" + String(report.fullScanRate, 1);
+    json += ",\"full_scan_sps\":" + String(report.fullScanSampleRate, 1);
+    json += ",\"paced_rate\":" + String(report.pacedRate);
+    json += ",\"backends\":{";
+
+    size_t written = output.write((const uint8_t *)json.c_str(), json.length());
+
+    written += writeBackend(output, "blocking", report.blocking);
+    written += output.write(',');
+    written += writeBackend(output, "timer", report.timer);
+    written += output.write(',');
+    written += writeBackend(output, "dma", report.dma);
+    written += output.write((const uint8_t *)"}}\n", 3);
+
+    return written;
+}
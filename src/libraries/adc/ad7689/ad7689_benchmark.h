@@ -0,0 +1,112 @@
+#ifndef AD7689_BENCHMARK_H
+#define AD7689_BENCHMARK_H
+
+#include <Arduino.h>
+#include <utils.h>
+#include "ad7689.h"
+
+// Throughput benchmark and self-test for an AD7689, on hardware or on a simulated AD7689 behind the SPI bus.
+// Measures the frame time and CS overhead, the maximum single channel and full scan rates, and the scheduling jitter
+// and CPU load of each acquisition backend at a fixed scan rate:
+//  - blocking: the caller spins until each scan is due;
+//  - timer: a tick source wakes the caller once per scan (a hardware timer interrupt, see AD7689TimerTicks);
+//  - DMA: not implemented by the driver, always reported as unsupported.
+// Results are printed as JSON by writeReport so they can be collected and compared between builds.
+
+#define BENCHMARK_JITTER_BINS (16)     // 1 µs bins, the last one also collects everything above
+#define BENCHMARK_TIMING_FRAMES (1000) // frames shifted to measure the frame time
+
+/**
+ * Periodic tick source pacing the timer backend, e.g. a hardware timer interrupt (AD7689TimerTicks) or a simulated
+ * clock on a PC.
+ */
+class AD7689TickSource
+{
+public:
+    virtual ~AD7689TickSource() {}
+
+    /** Starts ticking every period_us. Returns false if the source can't be started. */
+    virtual bool start(uint32_t period_us) = 0;
+
+    /**
+     * Blocks until the next tick, at most timeout_ms.
+     * @param  tick_cycles Set to ESP.getCycleCount() at the last tick.
+     * @return             Ticks since the previous wait, more than 1 if some were missed, 0 on timeout.
+     */
+    virtual uint32_t wait(uint32_t timeout_ms, uint32_t *tick_cycles) = 0;
+
+    virtual void stop(void) = 0;
+};
+
+/** Scheduling latency of a paced backend: time from the instant a scan is due to the start of its first frame. */
+struct AD7689_jitter
+{
+    uint32_t scans;                            /*!< Number of paced scans. */
+    uint32_t overruns;                         /*!< Scans that started after the next one was already due. */
+    float mean;                                /*!< Mean latency, in ns. */
+    float stddev;                              /*!< Standard deviation of the latency, in ns. */
+    uint32_t min;                              /*!< Shortest latency, in ns. */
+    uint32_t max;                              /*!< Longest latency, in ns. */
+    uint32_t histogram[BENCHMARK_JITTER_BINS]; /*!< Latency distribution, 1 µs per bin. */
+};
+
+/** Results of a single acquisition backend. */
+struct AD7689_backend_result
+{
+    bool supported;       /*!< False if the backend could not be measured. */
+    float scanRate;       /*!< Scans per second actually achieved. */
+    float cpuLoad;        /*!< Fraction of the core taken by the backend, waiting included for the blocking one. */
+    float busLoad;        /*!< Fraction of the time spent shifting frames. */
+    AD7689_jitter jitter; /*!< Scheduling latency. */
+};
+
+/** Complete benchmark report. */
+struct AD7689_benchmark_report
+{
+    bool selftest;                  /*!< Result of AD7689::selftest (configuration readback). */
+    float frameTime;                /*!< Time of a complete 16 bit frame, CS included, in ns. */
+    float transferTime;             /*!< Time of the 16 bit transfer alone, in ns. */
+    float csOverhead;               /*!< frameTime - transferTime, in ns. */
+    float singleChannelRate;        /*!< Samples per second of a single planned channel. */
+    float fullScanRate;             /*!< Scans per second of readChannels on all channels. */
+    float fullScanSampleRate;       /*!< Samples per second of those scans, temperature included. */
+    uint32_t pacedRate;             /*!< Scan rate requested from the paced backends. */
+    AD7689_backend_result blocking; /*!< Busy-wait paced acquisition. */
+    AD7689_backend_result timer;    /*!< Timer interrupt paced acquisition. */
+    AD7689_backend_result dma;      /*!< DMA acquisition. */
+};
+
+/**
+ * Benchmark and self-test harness. Running it reconfigures the ADC.
+ */
+class AD7689Benchmark
+{
+private:
+    AD7689 *adc;                    /*!< ADC under test. */
+    AD7689_benchmark_report report; /*!< Results of the last run. */
+    uint32_t cpuMHz;                /*!< CPU frequency, to convert cycles to ns. */
+
+    uint32_t toNanoseconds(uint32_t cycles) { return (uint64_t)cycles * 1000 / cpuMHz; }
+    void beginBus(void);
+    void endBus(void);
+
+    void measureFrameTime(void);
+    void measureSingleChannel(uint8_t channel, uint32_t duration);
+    void measureFullScan(uint32_t duration);
+    void measureBlocking(uint32_t duration);
+    void measureTimer(AD7689TickSource &ticks, uint32_t duration);
+
+    void resetBackend(AD7689_backend_result &result);
+    void addLatency(AD7689_jitter &jitter, uint32_t latency, double &sum, double &square_sum);
+    void finishJitter(AD7689_jitter &jitter, double sum, double square_sum);
+    size_t writeBackend(Print &output, const char *name, const AD7689_backend_result &result);
+
+public:
+    AD7689Benchmark(AD7689 &adc_under_test);
+
+    ESP_ERROR run(uint32_t duration = 1000, uint32_t paced_rate = 1000, AD7689TickSource *ticks = NULL, uint8_t channel = 0);
+    const AD7689_benchmark_report &getReport(void) { return report; }
+    size_t writeReport(Print &output);
+};
+
+#endif
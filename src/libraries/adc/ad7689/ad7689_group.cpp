@@ -0,0 +1,177 @@
+// Coordinated acquisition from several AD7689 ADCs.
+// Every ADC runs its own sequencer with the same scan length. A frame is read slot by slot, and within a slot every
+// ADC is clocked once, so the CS edges of the ADCs are interleaved and each ADC converts while the others are read.
+// Samples of the same channel are therefore taken within one slot of each other, which is reported as skew.
+
+#include "ad7689_group.h"
+
+AD7689Group::AD7689Group()
+{
+    adcCount = 0;
+    busCount = 0;
+    scans = TOTAL_CHANNELS;
+    temperature = false;
+    resetStats();
+}
+
+/**
+ * [AD7689Group::addADC Adds an ADC to the group. ADCs are read in the order they are added.]
+ * @param  adc An ADC started with AD7689::begin.
+ * @return     Error if the group is full.
+ */
+ESP_ERROR AD7689Group::addADC(AD7689 &adc)
+{
+    ESP_ERROR err;
+
+    if (adcCount >= MAX_GROUP_ADCS)
+    {
+        err.on_error = true;
+        err.debug_message = "ADC group is full, maximum is " + String(MAX_GROUP_ADCS);
+        return err;
+    }
+
+    adcs[adcCount++] = &adc;
+
+    // keep track of the distinct buses to lock them once per frame
+    for (uint8_t i = 0; i < busCount; i++)
+    {
+        if (buses[i] == adc.adc_spi_bus)
+            return err;
+    }
+
+    buses[busCount] = adc.adc_spi_bus;
+    busSettings[busCount] = adc.adc_spi_settings;
+    busCount++;
+
+    return err;
+}
+
+/**
+ * [AD7689Group::begin Starts the sequencer of every ADC in the group.]
+ * @param  channels Number of channels scanned by every ADC, starting at IN0.
+ * @return          Error if the group is empty, or if the ADCs don't agree on temperature conversion.
+ */
+ESP_ERROR AD7689Group::begin(uint8_t channels)
+{
+    ESP_ERROR err;
+
+    if (adcCount == 0)
+    {
+        err.on_error = true;
+        err.debug_message = "ADC group is empty";
+        return err;
+    }
+
+    if (channels == 0 || channels > TOTAL_CHANNELS)
+    {
+        err.on_error = true;
+        err.debug_message = "Invalid number of channels " + String(channels);
+        return err;
+    }
+
+    // all sequencers must have the same length to stay in lock step
+    temperature = adcs[0]->temperatureAvailable();
+    for (uint8_t i = 1; i < adcCount; i++)
+    {
+        if (adcs[i]->temperatureAvailable() != temperature)
+        {
+            err.on_error = true;
+            err.debug_message = "All ADCs in a group must use a reference with the same temperature sensor setting";
+            return err;
+        }
+    }
+
+    scans = channels;
+
+    for (uint8_t b = 0; b < busCount; b++)
+        buses[b]->beginTransaction(busSettings[b]);
+
+    for (uint8_t i = 0; i < adcCount; i++)
+        adcs[i]->configureSequencer(scans);
+
+    for (uint8_t b = 0; b < busCount; b++)
+        buses[b]->endTransaction();
+
+    resetStats();
+    return err;
+}
+
+/**
+ * [AD7689Group::readFrame Reads one scan of every ADC into a merged frame.]
+ * @param frame Frame to fill. Samples beyond the scanned channels are left untouched.
+ */
+void AD7689Group::readFrame(AD7689_frame &frame)
+{
+    for (uint8_t b = 0; b < busCount; b++)
+        buses[b]->beginTransaction(busSettings[b]);
+
+    // an ADC may have been used on its own since begin, restart its sequencer
+    for (uint8_t i = 0; i < adcCount; i++)
+    {
+        if (!adcs[i]->sequencerActive || adcs[i]->sequencerScans != scans)
+            adcs[i]->configureSequencer(scans);
+    }
+
+    uint32_t cpu_mhz = ESP.getCpuFreqMHz();
+    frame.timeStamp = micros();
+    uint32_t start = ESP.getCycleCount();
+    uint32_t skew = 0;
+
+    for (uint8_t slot = 0; slot < scans; slot++)
+    {
+        for (uint8_t i = 0; i < adcCount; i++)
+        {
+            frame.samples[i][slot] = adcs[i]->shiftTransaction(0, false, NULL);
+            frame.sampleOffset[i][slot] = (ESP.getCycleCount() - start) * 1000 / cpu_mhz;
+        }
+
+        uint32_t spread = frame.sampleOffset[adcCount - 1][slot] - frame.sampleOffset[0][slot];
+        if (spread > skew)
+            skew = spread;
+    }
+
+    if (temperature)
+    {
+        for (uint8_t i = 0; i < adcCount; i++)
+            frame.temperature[i] = adcs[i]->shiftTransaction(0, false, NULL);
+    }
+
+    for (uint8_t b = 0; b < busCount; b++)
+        buses[b]->endTransaction();
+
+    frame.skew = skew;
+
+    frames++;
+    skewSum += skew;
+    if (skew > maxSkew)
+        maxSkew = skew;
+}
+
+/**
+ * [AD7689Group::getStats Aggregate throughput and skew since the last resetStats.]
+ * @return Group statistics.
+ */
+AD7689_group_stats AD7689Group::getStats()
+{
+    AD7689_group_stats stats;
+    float elapsed = (micros() - statsStart) / 1000000.0;
+
+    stats.frames = frames;
+    stats.frameRate = (elapsed > 0) ? frames / elapsed : 0;
+    stats.throughput = stats.frameRate * adcCount * (scans + (temperature ? 1 : 0));
+    stats.maxSkew = maxSkew;
+    stats.meanSkew = frames ? (float)skewSum / frames : 0;
+
+    return stats;
+}
+
+/**
+ * [AD7689Group::resetStats Restarts throughput and skew measurements.]
+ */
+void AD7689Group::resetStats()
+{
+    statsStart = micros();
+    frames = 0;
+    maxSkew = 0;
+    skewSum = 0;
+}
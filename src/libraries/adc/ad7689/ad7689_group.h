@@ -0,0 +1,67 @@
+#ifndef AD7689_GROUP_H
+#define AD7689_GROUP_H
+
+#include <Arduino.h>
+#include <utils.h>
+#include <SPI.h>
+#include "ad7689.h"
+
+// Coordinated acquisition from several AD7689 on one or two SPI buses (e.g. VSPI & HSPI from SystemOnChip).
+// The ADCs run their sequencers in lock step and are read round-robin: while one ADC converts, the next one is
+// clocked out, so conversions overlap and the CS of every ADC is interleaved within a sequencer slot.
+
+#define MAX_GROUP_ADCS (4)
+
+/** One merged sample frame of every ADC in the group. */
+struct AD7689_frame
+{
+    uint16_t samples[MAX_GROUP_ADCS][TOTAL_CHANNELS];      /*!< Raw samples, indexed by ADC and channel. */
+    uint16_t temperature[MAX_GROUP_ADCS];                  /*!< Raw temperature of each ADC, if the reference enables it. */
+    uint32_t sampleOffset[MAX_GROUP_ADCS][TOTAL_CHANNELS]; /*!< Time each sample was read, in ns after timeStamp. */
+    uint32_t timeStamp;                                    /*!< micros() at the start of the frame. */
+    uint32_t skew;                                         /*!< Largest spread of the same channel across ADCs, in ns. */
+};
+
+/** Throughput and alignment metrics of the group, since the last resetStats. */
+struct AD7689_group_stats
+{
+    uint32_t frames;  /*!< Number of frames acquired. */
+    float frameRate;  /*!< Frames per second. */
+    float throughput; /*!< Samples per second, all ADCs and channels together. */
+    uint32_t maxSkew; /*!< Largest frame skew, in ns. */
+    float meanSkew;   /*!< Average frame skew, in ns. */
+};
+
+/**
+ * Multi-ADC acquisition group. The ADCs must be started with AD7689::begin before being added.
+ */
+class AD7689Group
+{
+private:
+    AD7689 *adcs[MAX_GROUP_ADCS];            /*!< ADCs in read order. */
+    uint8_t adcCount;                        /*!< Number of ADCs in the group. */
+    SPIClass *buses[MAX_GROUP_ADCS];         /*!< Distinct buses used by the group. */
+    SPISettings busSettings[MAX_GROUP_ADCS]; /*!< Settings of the first ADC added on each bus. */
+    uint8_t busCount;                        /*!< Number of distinct buses. */
+    uint8_t scans;                           /*!< Channels scanned per ADC, starting at IN0. */
+    bool temperature;                        /*!< True if the sequencers also convert temperature. */
+
+    uint32_t statsStart; /*!< micros() at the last resetStats. */
+    uint32_t frames;     /*!< Frames since the last resetStats. */
+    uint32_t maxSkew;    /*!< Largest skew since the last resetStats, in ns. */
+    uint64_t skewSum;    /*!< Sum of frame skews since the last resetStats, in ns. */
+
+public:
+    AD7689Group();
+
+    ESP_ERROR addADC(AD7689 &adc);
+    ESP_ERROR begin(uint8_t channels = TOTAL_CHANNELS);
+    void readFrame(AD7689_frame &frame);
+
+    uint8_t getADCCount(void) { return adcCount; }
+    uint8_t getBusCount(void) { return busCount; }
+    AD7689_group_stats getStats(void);
+    void resetStats(void);
+};
+
+#endif
@@ -0,0 +1,61 @@
+// Hardware timer tick source for AD7689Benchmark.
+// The interrupt records the cycle count of the tick and notifies the waiting task; notifications accumulate, so
+// ticks missed while the task was busy are counted by the next wait.
+
+#include "ad7689_timer_ticks.h"
+
+static TaskHandle_t tickTask = NULL;     /*!< Task woken by the timer. */
+static volatile uint32_t tickCycles = 0; /*!< Cycle count of the last timer interrupt. */
+
+static void IRAM_ATTR onTick()
+{
+    tickCycles = ESP.getCycleCount();
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(tickTask, &woken);
+    if (woken)
+        portYIELD_FROM_ISR();
+}
+
+/**
+ * [AD7689TimerTicks::start Starts the timer, ticks wake the calling task.]
+ * @param  period_us Tick period, in µs.
+ * @return           False if another AD7689TimerTicks is running.
+ */
+bool AD7689TimerTicks::start(uint32_t period_us)
+{
+    if (tickTask != NULL)
+        return false;
+
+    tickTask = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    timer->setup();
+    timer->attachInterrupt(onTick);
+    timer->timerPeriodMicroseconds(period_us);
+    timer->enableInterrupt();
+    return true;
+}
+
+/**
+ * [AD7689TimerTicks::wait Blocks the calling task until the next tick.]
+ * @param  timeout_ms  Longest wait, in ms.
+ * @param  tick_cycles Set to the cycle count of the last tick.
+ * @return             Ticks since the previous wait, 0 on timeout.
+ */
+uint32_t AD7689TimerTicks::wait(uint32_t timeout_ms, uint32_t *tick_cycles)
+{
+    uint32_t pending = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    *tick_cycles = tickCycles;
+    return pending;
+}
+
+/**
+ * [AD7689TimerTicks::stop Stops the timer.]
+ */
+void AD7689TimerTicks::stop()
+{
+    timer->disableInterrupt();
+    timer->dettachInterrupt();
+    tickTask = NULL;
+}
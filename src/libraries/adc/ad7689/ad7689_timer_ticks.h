@@ -0,0 +1,27 @@
+#ifndef AD7689_TIMER_TICKS_H
+#define AD7689_TIMER_TICKS_H
+
+#include <Arduino.h>
+#include "ad7689_benchmark.h"
+#include "../../soc/timer/esp_timer.h"
+
+// Tick source for the timer backend of AD7689Benchmark: a hardware timer interrupt notifies the task waiting for the
+// tick. Only one instance can run at a time, the interrupt has no argument to tell them apart.
+
+/**
+ * Hardware timer tick source, on an ESPtimer with a 1 µs tick.
+ */
+class AD7689TimerTicks : public AD7689TickSource
+{
+private:
+    ESPtimer *timer; /*!< Timer raising the interrupt. */
+
+public:
+    AD7689TimerTicks(ESPtimer &hardware_timer) { timer = &hardware_timer; }
+
+    bool start(uint32_t period_us) override;
+    uint32_t wait(uint32_t timeout_ms, uint32_t *tick_cycles) override;
+    void stop(void) override;
+};
+
+#endif
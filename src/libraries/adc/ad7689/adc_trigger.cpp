@@ -0,0 +1,399 @@
+// Event trigger with pre-trigger history for ADC frame streams.
+// Memory is allocated once in begin: the history holds max(pre-trigger frames, TRIGGER_MAX_SLOPE_SPAN) + 1 frames so
+// edge and slope conditions can always look back, and the snapshot holds pre + 1 + post frames.
+
+#include "adc_trigger.h"
+#include <new>
+
+ADCTrigger::ADCTrigger()
+{
+    channels = 0;
+    preFrames = 0;
+    postFrames = 0;
+    frameRate = 0;
+    conditionCount = 0;
+    combine = TRIGGER_ANY;
+    state = TRIGGER_IDLE;
+    history = NULL;
+    historySize = 0;
+    historyHead = 0;
+    historyCount = 0;
+    snapshot = NULL;
+    snapshotFrames = 0;
+    memset(&header, 0, sizeof(header));
+}
+
+ADCTrigger::~ADCTrigger()
+{
+    delete[] history;
+    delete[] snapshot;
+}
+
+/**
+ * [ADCTrigger::begin Allocates the history and snapshot buffers. Conditions on channels still in the frame are kept,
+ * the others are dropped.]
+ * @param  frame_channels      Samples per frame.
+ * @param  pre_trigger_frames  Frames kept before the trigger frame.
+ * @param  post_trigger_frames Frames captured after the trigger frame.
+ * @param  frame_rate          Frames per second, only stored in the snapshot header.
+ * @return                     Error if the buffers can't be allocated.
+ */
+ESP_ERROR ADCTrigger::begin(uint8_t frame_channels, uint16_t pre_trigger_frames, uint16_t post_trigger_frames, uint32_t frame_rate)
+{
+    ESP_ERROR err;
+
+    if (frame_channels == 0 || frame_channels > TOTAL_CHANNELS + 1)
+    {
+        err.on_error = true;
+        err.debug_message = "Invalid number of channels per frame";
+        return err;
+    }
+
+    if ((uint32_t)pre_trigger_frames + post_trigger_frames + 1 > 0xFFFF)
+    {
+        err.on_error = true;
+        err.debug_message = "Snapshot can't be longer than 65535 frames";
+        return err;
+    }
+
+    delete[] history;
+    delete[] snapshot;
+
+    channels = frame_channels;
+    preFrames = pre_trigger_frames;
+
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < conditionCount; i++)
+    {
+        if (conditions[i].channel < channels)
+        {
+            conditions[kept++] = conditions[i];
+        }
+    }
+    conditionCount = kept;
+
+    postFrames = post_trigger_frames;
+    frameRate = frame_rate;
+
+    historySize = ((preFrames > TRIGGER_MAX_SLOPE_SPAN) ? preFrames : TRIGGER_MAX_SLOPE_SPAN) + 1;
+    history = new (std::nothrow) uint16_t[(size_t)historySize * channels];
+    snapshot = new (std::nothrow) uint16_t[((size_t)preFrames + 1 + postFrames) * channels];
+
+    if (!history || !snapshot)
+    {
+        delete[] history;
+        delete[] snapshot;
+        history = NULL;
+        snapshot = NULL;
+        historySize = 0;
+
+        err.on_error = true;
+        err.debug_message = "Not enough memory for trigger buffers";
+        return err;
+    }
+
+    historyHead = 0;
+    historyCount = 0;
+    snapshotFrames = 0;
+    state = TRIGGER_IDLE;
+
+    return err;
+}
+
+/**
+ * [ADCTrigger::addCondition Adds a trigger condition.]
+ * @param  condition The condition. Slope span must be between 1 and TRIGGER_MAX_SLOPE_SPAN.
+ * @return           Error if the condition is invalid or the condition list is full.
+ */
+ESP_ERROR ADCTrigger::addCondition(const ADC_trigger_condition &condition)
+{
+    ESP_ERROR err;
+
+    if (conditionCount >= TRIGGER_MAX_CONDITIONS)
+    {
+        err.on_error = true;
+        err.debug_message = "Maximum number of trigger conditions reached";
+    }
+    else if (condition.channel >= channels)
+    {
+        err.on_error = true;
+        err.debug_message = "Trigger channel " + String(condition.channel) + " is not part of the frame";
+    }
+    else if ((condition.type == TRIGGER_SLOPE_RISING || condition.type == TRIGGER_SLOPE_FALLING) &&
+             (condition.span == 0 || condition.span > TRIGGER_MAX_SLOPE_SPAN))
+    {
+        err.on_error = true;
+        err.debug_message = "Slope span must be between 1 and " + String(TRIGGER_MAX_SLOPE_SPAN);
+    }
+    else
+    {
+        conditions[conditionCount++] = condition;
+    }
+
+    return err;
+}
+
+/**
+ * [ADCTrigger::arm Discards the previous snapshot and waits for the next trigger.]
+ */
+void ADCTrigger::arm()
+{
+    if (!history)
+        return;
+
+    snapshotFrames = 0;
+    state = TRIGGER_ARMED;
+}
+
+/**
+ * [ADCTrigger::sample Sample of a channel in the history.]
+ * @param  channel Channel index within the frame.
+ * @param  age     0 for the latest frame, 1 for the one before, etc.
+ * @return         The sample.
+ */
+uint16_t ADCTrigger::sample(uint8_t channel, uint16_t age)
+{
+    int32_t index = (int32_t)historyHead - 1 - age;
+    if (index < 0)
+        index += historySize;
+
+    return history[index * channels + channel];
+}
+
+/**
+ * [ADCTrigger::evaluate Evaluates a condition on the latest frame in the history.]
+ * @param  condition The condition.
+ * @return           True if the condition is met. Conditions that need older frames are false until they're available.
+ */
+bool ADCTrigger::evaluate(const ADC_trigger_condition &condition)
+{
+    uint16_t value = sample(condition.channel, 0);
+
+    switch (condition.type)
+    {
+    case TRIGGER_LEVEL_ABOVE:
+        return value > condition.threshold;
+
+    case TRIGGER_LEVEL_BELOW:
+        return value < condition.threshold;
+
+    case TRIGGER_RISING_EDGE:
+    {
+        if (historyCount < 2)
+            return false;
+        uint16_t previous = sample(condition.channel, 1);
+        return previous < condition.threshold && value >= condition.threshold;
+    }
+
+    case TRIGGER_FALLING_EDGE:
+    {
+        if (historyCount < 2)
+            return false;
+        uint16_t previous = sample(condition.channel, 1);
+        return previous > condition.threshold && value <= condition.threshold;
+    }
+
+    case TRIGGER_SLOPE_RISING:
+    {
+        if (historyCount <= condition.span)
+            return false;
+        int32_t change = (int32_t)value - sample(condition.channel, condition.span);
+        return change >= condition.threshold;
+    }
+
+    case TRIGGER_SLOPE_FALLING:
+    {
+        if (historyCount <= condition.span)
+            return false;
+        int32_t change = (int32_t)sample(condition.channel, condition.span) - value;
+        return change >= condition.threshold;
+    }
+
+    case TRIGGER_WINDOW_INSIDE:
+        return value >= condition.threshold && value <= condition.upper;
+
+    case TRIGGER_WINDOW_OUTSIDE:
+        return value < condition.threshold || value > condition.upper;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * [ADCTrigger::capture Appends a frame to the snapshot.]
+ * @param frame The frame.
+ */
+void ADCTrigger::capture(const uint16_t *frame)
+{
+    memcpy(&snapshot[(size_t)snapshotFrames * channels], frame, channels * sizeof(uint16_t));
+    snapshotFrames++;
+}
+
+/**
+ * [ADCTrigger::process Feeds one frame to the trigger.]
+ * @param  frame channels samples.
+ * @return       True if this frame completed a snapshot.
+ */
+bool ADCTrigger::process(const uint16_t *frame)
+{
+    if (!history)
+        return false;
+
+    // keep the pre-trigger history
+    memcpy(&history[(size_t)historyHead * channels], frame, channels * sizeof(uint16_t));
+    historyHead = (historyHead + 1 == historySize) ? 0 : historyHead + 1;
+    if (historyCount < historySize)
+        historyCount++;
+
+    if (state == TRIGGER_CAPTURING)
+    {
+        capture(frame);
+        if (snapshotFrames == header.frameCount)
+        {
+            state = TRIGGER_DONE;
+            return true;
+        }
+        return false;
+    }
+
+    if (state != TRIGGER_ARMED || conditionCount == 0)
+        return false;
+
+    bool triggered = (combine == TRIGGER_ALL);
+    uint8_t first_met = 0xFF;
+
+    for (uint8_t i = 0; i < conditionCount; i++)
+    {
+        bool met = evaluate(conditions[i]);
+
+        if (met && first_met == 0xFF)
+            first_met = i;
+
+        if (combine == TRIGGER_ALL && !met)
+        {
+            triggered = false;
+            break;
+        }
+        if (combine == TRIGGER_ANY && met)
+        {
+            triggered = true;
+            break;
+        }
+    }
+
+    if (!triggered)
+        return false;
+
+    // copy the history, oldest first, trigger frame last
+    uint16_t available = (historyCount - 1 < preFrames) ? historyCount - 1 : preFrames;
+    snapshotFrames = 0;
+    for (int32_t age = available; age >= 0; age--)
+    {
+        int32_t index = (int32_t)historyHead - 1 - age;
+        if (index < 0)
+            index += historySize;
+        capture(&history[index * channels]);
+    }
+
+    header.magic = TRIGGER_SNAPSHOT_MAGIC;
+    header.version = TRIGGER_SNAPSHOT_VERSION;
+    header.channels = channels;
+    header.condition = first_met;
+    header.frameCount = available + 1 + postFrames;
+    header.triggerIndex = available;
+    header.triggerTime = micros();
+    header.frameRate = frameRate;
+
+    if (postFrames == 0)
+    {
+        state = TRIGGER_DONE;
+        return true;
+    }
+
+    state = TRIGGER_CAPTURING;
+    return false;
+}
+
+/**
+ * [ADCTrigger::process Feeds a block of frames to the trigger. Frames after a completed snapshot still feed the
+ * pre-trigger history, but can't start a new snapshot until arm is called.]
+ * @param  frames      frame_count frames of channels samples.
+ * @param  frame_count Number of frames.
+ * @return             True if a snapshot was completed within the block.
+ */
+bool ADCTrigger::process(const uint16_t *frames, size_t frame_count)
+{
+    bool completed = false;
+
+    for (size_t f = 0; f < frame_count; f++)
+        completed |= process(&frames[f * channels]);
+
+    return completed;
+}
+
+/**
+ * [ADCTrigger::getSnapshotSize Size of the serialized snapshot.]
+ * @return Size in bytes, 0 if no snapshot is ready.
+ */
+size_t ADCTrigger::getSnapshotSize()
+{
+    if (state != TRIGGER_DONE)
+        return 0;
+
+    return sizeof(ADC_snapshot_header) + (size_t)header.frameCount * channels * sizeof(uint16_t);
+}
+
+/**
+ * [ADCTrigger::readSnapshot Copies part of the serialized snapshot (header + frames), e.g. one BLE MTU at a time.]
+ * @param  offset Offset in the serialized snapshot.
+ * @param  buffer Destination buffer.
+ * @param  length Size of the destination buffer.
+ * @return        Bytes copied, 0 once the end is reached or if no snapshot is ready.
+ */
+size_t ADCTrigger::readSnapshot(size_t offset, uint8_t *buffer, size_t length)
+{
+    size_t total = getSnapshotSize();
+    if (offset >= total)
+        return 0;
+
+    if (length > total - offset)
+        length = total - offset;
+
+    size_t copied = 0;
+    if (offset < sizeof(ADC_snapshot_header))
+    {
+        size_t n = sizeof(ADC_snapshot_header) - offset;
+        if (n > length)
+            n = length;
+        memcpy(buffer, (const uint8_t *)&header + offset, n);
+        copied = n;
+        offset += n;
+    }
+
+    if (copied < length)
+    {
+        const uint8_t *frames = (const uint8_t *)snapshot;
+        memcpy(buffer + copied, frames + (offset - sizeof(ADC_snapshot_header)), length - copied);
+        copied = length;
+    }
+
+    return copied;
+}
+
+/**
+ * [ADCTrigger::writeSnapshot Writes the serialized snapshot to a stream, such as an open eMMC file.]
+ * @param  output Destination.
+ * @return        Bytes written.
+ */
+size_t ADCTrigger::writeSnapshot(Print &output)
+{
+    size_t total = getSnapshotSize();
+    if (total == 0)
+        return 0;
+
+    size_t written = output.write((const uint8_t *)&header, sizeof(ADC_snapshot_header));
+    written += output.write((const uint8_t *)snapshot, total - sizeof(ADC_snapshot_header));
+
+    return written;
+}
@@ -0,0 +1,125 @@
+#ifndef ADC_TRIGGER_H
+#define ADC_TRIGGER_H
+
+#include <Arduino.h>
+#include <utils.h>
+#include "ad7689.h"
+
+// Event trigger for ADC frame streams (one sample per channel per frame, as produced by readChannels / readSequence).
+// Frames are continuously kept in a circular pre-trigger history. When the trigger conditions are met, the history,
+// the trigger frame and a number of post-trigger frames are captured into a snapshot, which can then be serialized
+// in chunks to an eMMC file or over BLE.
+
+#define TRIGGER_MAX_CONDITIONS (8)
+#define TRIGGER_MAX_SLOPE_SPAN (32)
+#define TRIGGER_SNAPSHOT_MAGIC (0x47495254) // "TRIG"
+#define TRIGGER_SNAPSHOT_VERSION (1)
+
+enum TRIGGER_TYPE
+{
+    TRIGGER_LEVEL_ABOVE,    // sample > threshold
+    TRIGGER_LEVEL_BELOW,    // sample < threshold
+    TRIGGER_RISING_EDGE,    // previous sample < threshold <= sample
+    TRIGGER_FALLING_EDGE,   // previous sample > threshold >= sample
+    TRIGGER_SLOPE_RISING,   // sample - sample span frames ago >= threshold
+    TRIGGER_SLOPE_FALLING,  // sample span frames ago - sample >= threshold
+    TRIGGER_WINDOW_INSIDE,  // threshold <= sample <= upper
+    TRIGGER_WINDOW_OUTSIDE, // sample < threshold or sample > upper
+};
+
+enum TRIGGER_COMBINE
+{
+    TRIGGER_ANY, // OR of all conditions
+    TRIGGER_ALL, // AND of all conditions
+};
+
+enum TRIGGER_STATE
+{
+    TRIGGER_IDLE,      // not armed, frames only feed the history
+    TRIGGER_ARMED,     // waiting for the trigger conditions
+    TRIGGER_CAPTURING, // triggered, collecting post-trigger frames
+    TRIGGER_DONE,      // snapshot complete, call arm for the next one
+};
+
+/** A single trigger condition on one channel. */
+struct ADC_trigger_condition
+{
+    uint8_t channel;    /*!< Channel index within the frame. */
+    TRIGGER_TYPE type;  /*!< Condition type. */
+    uint16_t threshold; /*!< Level, edge threshold, minimum slope change in codes or lower window bound. */
+    uint16_t upper;     /*!< Upper window bound. */
+    uint8_t span;       /*!< Number of frames the slope is measured over. */
+};
+
+/** Header of a serialized snapshot, followed by frameCount frames of channels little endian uint16 samples. */
+struct __attribute__((packed)) ADC_snapshot_header
+{
+    uint32_t magic;        /*!< TRIGGER_SNAPSHOT_MAGIC. */
+    uint16_t version;      /*!< TRIGGER_SNAPSHOT_VERSION. */
+    uint8_t channels;      /*!< Samples per frame. */
+    uint8_t condition;     /*!< Index of the first condition that was met. */
+    uint16_t frameCount;   /*!< Number of frames in the snapshot. */
+    uint16_t triggerIndex; /*!< Index of the trigger frame. */
+    uint32_t triggerTime;  /*!< micros() when the trigger frame was processed. */
+    uint32_t frameRate;    /*!< Frames per second, as given to begin. */
+};
+
+/**
+ * Level, edge, slope and window trigger engine with pre-trigger history.
+ */
+class ADCTrigger
+{
+private:
+    uint8_t channels;    /*!< Samples per frame. */
+    uint16_t preFrames;  /*!< Frames kept before the trigger frame. */
+    uint16_t postFrames; /*!< Frames captured after the trigger frame. */
+    uint32_t frameRate;  /*!< Frames per second, stored in the snapshot header. */
+
+    ADC_trigger_condition conditions[TRIGGER_MAX_CONDITIONS]; /*!< Trigger conditions. */
+    uint8_t conditionCount;                                   /*!< Number of conditions. */
+    TRIGGER_COMBINE combine;                                  /*!< How conditions are combined. */
+    TRIGGER_STATE state;                                      /*!< Current state. */
+
+    uint16_t *history;     /*!< Circular history, historySize frames. */
+    uint16_t historySize;  /*!< Capacity of the history, in frames. */
+    uint16_t historyHead;  /*!< Index of the next frame to write. */
+    uint16_t historyCount; /*!< Frames currently in the history. */
+
+    uint16_t *snapshot;         /*!< Captured frames, oldest first. */
+    uint16_t snapshotFrames;    /*!< Frames captured so far. */
+    ADC_snapshot_header header; /*!< Header of the current snapshot. */
+
+    uint16_t sample(uint8_t channel, uint16_t age);
+    bool evaluate(const ADC_trigger_condition &condition);
+    void capture(const uint16_t *frame);
+
+public:
+    ADCTrigger();
+    ~ADCTrigger();
+
+    ESP_ERROR begin(uint8_t frame_channels, uint16_t pre_trigger_frames, uint16_t post_trigger_frames, uint32_t frame_rate = 0);
+    ESP_ERROR addCondition(const ADC_trigger_condition &condition);
+    void clearConditions(void) { conditionCount = 0; }
+    void setCombine(TRIGGER_COMBINE mode) { combine = mode; }
+
+    void arm(void);
+    void disarm(void) { state = TRIGGER_IDLE; }
+    TRIGGER_STATE getState(void) { return state; }
+    bool snapshotReady(void) { return state == TRIGGER_DONE; }
+
+    bool process(const uint16_t *frame);
+    bool process(const uint16_t *frames, size_t frame_count);
+
+    // -- Snapshot access
+    const uint16_t *getSnapshotFrames(void) { return snapshot; }
+    const ADC_snapshot_header &getSnapshotHeader(void) { return header; }
+    size_t getSnapshotSize(void);
+    size_t readSnapshot(size_t offset, uint8_t *buffer, size_t length);
+    size_t writeSnapshot(Print &output);
+
+private:
+    ADCTrigger(const ADCTrigger &) = delete;
+    ADCTrigger &operator=(const ADCTrigger &) = delete;
+};
+
+#endif
@@ -0,0 +1,300 @@
+// Block decimation filters for AD7689 sample streams.
+// Replaces naive averaging in application code: the box-car stage is an accumulate & dump average, the CIC stage adds
+// alias rejection at the same cost per input sample, and the optional half-band FIR cleans up the CIC droop region
+// while decimating by a further 2. Everything runs on integers, floats are only used to report rates and ENOB.
+
+#include "decimation_filter.h"
+
+// Q15 half-band coefficients (11 taps, Hamming windowed sinc, unity DC gain). Odd taps are zero except the centre one.
+static const int32_t HALF_BAND_H0 = 166;
+static const int32_t HALF_BAND_H2 = -1374;
+static const int32_t HALF_BAND_H4 = 9453;
+static const int32_t HALF_BAND_CENTER = 16278;
+
+DecimationFilter::DecimationFilter()
+{
+    filterType = BOXCAR_FILTER;
+    ratio = 1;
+    stageRatio = 1;
+    order = 1;
+    halfBand = false;
+    inputRate = 0;
+    gain = 1;
+    gainShift = 0;
+    reset();
+}
+
+/**
+ * [DecimationFilter::begin Configures the decimator and clears its state.]
+ * @param  type             BOXCAR_FILTER or CIC_FILTER.
+ * @param  decimation_ratio Total decimation ratio, between 2 and 256. Must be even when the half-band stage is enabled.
+ * @param  cic_order        Number of CIC integrator / comb pairs, between 1 and 4. Ignored for box-car.
+ * @param  half_band        True to follow the first stage with a half-band FIR decimating by 2.
+ * @param  input_rate       Input sample rate in samples per second, only used to report the output rate.
+ * @return                  Error if the configuration is not supported.
+ */
+ESP_ERROR DecimationFilter::begin(DECIMATION_FILTER_TYPE type, uint16_t decimation_ratio, uint8_t cic_order, bool half_band, float input_rate)
+{
+    ESP_ERROR err;
+    err.on_error = false;
+
+    if (decimation_ratio < DECIMATION_MIN_RATIO || decimation_ratio > DECIMATION_MAX_RATIO)
+    {
+        err.on_error = true;
+        err.debug_message = "Decimation ratio must be between " + String(DECIMATION_MIN_RATIO) + " and " + String(DECIMATION_MAX_RATIO);
+        return err;
+    }
+
+    if (half_band && (decimation_ratio % 2))
+    {
+        err.on_error = true;
+        err.debug_message = "Decimation ratio must be even when the half-band stage is enabled";
+        return err;
+    }
+
+    if (type == CIC_FILTER && (cic_order < 1 || cic_order > DECIMATION_MAX_CIC_ORDER))
+    {
+        err.on_error = true;
+        err.debug_message = "CIC order must be between 1 and " + String(DECIMATION_MAX_CIC_ORDER);
+        return err;
+    }
+
+    filterType = type;
+    ratio = decimation_ratio;
+    halfBand = half_band;
+    stageRatio = halfBand ? ratio / 2 : ratio;
+    order = (type == CIC_FILTER) ? cic_order : 1;
+    inputRate = input_rate;
+
+    // DC gain of the first stage is R^N, normalized away on every output
+    gain = 1;
+    for (uint8_t i = 0; i < order; i++)
+        gain *= stageRatio;
+
+    gainShift = 0xFF;
+    for (uint8_t shift = 0; shift < 64; shift++)
+    {
+        if (gain == ((uint64_t)1 << shift))
+        {
+            gainShift = shift;
+            break;
+        }
+    }
+
+    reset();
+    return err;
+}
+
+/**
+ * [DecimationFilter::reset Clears integrators, combs and the FIR history. Call when the input stream is interrupted.]
+ */
+void DecimationFilter::reset()
+{
+    phase = 0;
+    halfBandPhase = 0;
+
+    for (uint8_t i = 0; i < DECIMATION_MAX_CIC_ORDER; i++)
+    {
+        integrator[i] = 0;
+        comb[i] = 0;
+    }
+
+    for (uint8_t i = 0; i < HALF_BAND_TAPS; i++)
+        delayLine[i] = 0;
+}
+
+/**
+ * [DecimationFilter::normalize Removes the first stage gain and adds DECIMATION_FRACTION_BITS of fraction.]
+ * @param  value First stage output.
+ * @return       Average input code, times 2^DECIMATION_FRACTION_BITS.
+ */
+int32_t DecimationFilter::normalize(uint64_t value)
+{
+    if (gainShift == 0xFF)
+        return ((value << DECIMATION_FRACTION_BITS) + gain / 2) / gain;
+
+    if (gainShift > DECIMATION_FRACTION_BITS)
+    {
+        uint8_t shift = gainShift - DECIMATION_FRACTION_BITS;
+        return (value + ((uint64_t)1 << (shift - 1))) >> shift;
+    }
+
+    return value << (DECIMATION_FRACTION_BITS - gainShift);
+}
+
+/**
+ * [DecimationFilter::halfBandStep Pushes a sample into the half-band FIR, computing an output every second sample.]
+ * @param  sample  First stage output.
+ * @param  output  Pointer to a variable holding the filtered sample.
+ * @return         True if an output was produced.
+ */
+bool DecimationFilter::halfBandStep(int32_t sample, int32_t *output)
+{
+    memmove(&delayLine[0], &delayLine[1], (HALF_BAND_TAPS - 1) * sizeof(int32_t));
+    delayLine[HALF_BAND_TAPS - 1] = sample;
+
+    halfBandPhase ^= 1;
+    if (halfBandPhase)
+        return false;
+
+    // symmetric taps, zero odd coefficients skipped
+    int64_t acc = (int64_t)HALF_BAND_CENTER * delayLine[5];
+    acc += (int64_t)HALF_BAND_H0 * (delayLine[0] + delayLine[10]);
+    acc += (int64_t)HALF_BAND_H2 * (delayLine[2] + delayLine[8]);
+    acc += (int64_t)HALF_BAND_H4 * (delayLine[4] + delayLine[6]);
+
+    *output = (int32_t)((acc + (1 << 14)) >> 15);
+    return true;
+}
+
+/**
+ * [DecimationFilter::process Filters and decimates a block of samples.]
+ * @param  input  Block of raw ADC codes.
+ * @param  count  Number of input samples.
+ * @param  output Buffer for the decimated samples, at least count / ratio + 1 long.
+ * @param  stride Distance between consecutive input samples, e.g. the frame width of interleaved channels.
+ * @return        Number of samples written to output.
+ */
+size_t DecimationFilter::process(const uint16_t *input, size_t count, int32_t *output, size_t stride)
+{
+    size_t written = 0;
+
+    for (size_t n = 0; n < count; n++)
+    {
+        uint16_t x = input[n * stride];
+        uint64_t v;
+
+        if (filterType == BOXCAR_FILTER)
+        {
+            integrator[0] += x;
+            if (++phase < stageRatio)
+                continue;
+
+            v = integrator[0];
+            integrator[0] = 0;
+        }
+        else
+        {
+            // integrators run at the input rate, wrap-around is harmless
+            integrator[0] += x;
+            for (uint8_t i = 1; i < order; i++)
+                integrator[i] += integrator[i - 1];
+
+            if (++phase < stageRatio)
+                continue;
+
+            // combs run at the decimated rate
+            v = integrator[order - 1];
+            for (uint8_t i = 0; i < order; i++)
+            {
+                uint64_t delayed = comb[i];
+                comb[i] = v;
+                v -= delayed;
+            }
+        }
+        phase = 0;
+
+        int32_t y = normalize(v);
+        if (!halfBand)
+            output[written++] = y;
+        else if (halfBandStep(y, &output[written]))
+            written++;
+    }
+
+    return written;
+}
+
+/**
+ * [DecimationFilter::getENOB Estimates the effective number of bits at the output, assuming white input noise.
+ * Every halving of the bandwidth gains half a bit.]
+ * @param  input_enob Effective number of bits of a single conversion.
+ * @return            Estimated effective number of bits of the decimated samples.
+ */
+float DecimationFilter::getENOB(float input_enob)
+{
+    float enob = input_enob + 0.5 * log2f(ratio);
+    float max_bits = 16 + DECIMATION_FRACTION_BITS;
+    return (enob < max_bits) ? enob : max_bits;
+}
+
+/**
+ * [DecimationStage::configureChannel Configures the decimator of a channel, see DecimationFilter::begin.]
+ */
+ESP_ERROR DecimationStage::configureChannel(uint8_t channel, DECIMATION_FILTER_TYPE type, uint16_t decimation_ratio, uint8_t cic_order, bool half_band, float input_rate)
+{
+    ESP_ERROR err;
+
+    if (channel >= TOTAL_CHANNELS)
+    {
+        err.on_error = true;
+        err.debug_message = "Invalid channel " + String(channel);
+        return err;
+    }
+
+    err = filters[channel].begin(type, decimation_ratio, cic_order, half_band, input_rate);
+    if (!err.on_error)
+        channelMask |= (1 << channel);
+
+    return err;
+}
+
+/**
+ * [DecimationStage::disableChannel Stops decimating a channel.]
+ */
+void DecimationStage::disableChannel(uint8_t channel)
+{
+    if (channel < TOTAL_CHANNELS)
+        channelMask &= ~(1 << channel);
+}
+
+/**
+ * [DecimationStage::reset Clears the state of every channel.]
+ */
+void DecimationStage::reset()
+{
+    for (uint8_t ch = 0; ch < TOTAL_CHANNELS; ch++)
+        filters[ch].reset();
+}
+
+/**
+ * [DecimationStage::process Decimates a block of interleaved frames.]
+ * @param frames       frame_count frames of frame_width samples, channel ch at frames[f * frame_width + ch].
+ * @param frame_count  Number of frames in the block.
+ * @param frame_width  Number of samples per frame.
+ * @param output       Output buffer per channel, NULL for channels that aren't configured.
+ * @param output_count Number of samples written to each output buffer.
+ */
+void DecimationStage::process(const uint16_t *frames, size_t frame_count, uint8_t frame_width, int32_t *output[TOTAL_CHANNELS], size_t output_count[TOTAL_CHANNELS])
+{
+    for (uint8_t ch = 0; ch < TOTAL_CHANNELS; ch++)
+    {
+        output_count[ch] = 0;
+
+        if ((channelMask & (1 << ch)) && ch < frame_width && output[ch])
+            output_count[ch] = filters[ch].process(&frames[ch], frame_count, output[ch], frame_width);
+    }
+}
+
+/**
+ * [DecimationStage::getOutputRate Output rate of a channel.]
+ * @return Samples per second, 0 if the channel isn't configured.
+ */
+float DecimationStage::getOutputRate(uint8_t channel)
+{
+    if (channel >= TOTAL_CHANNELS || !(channelMask & (1 << channel)))
+        return 0;
+
+    return filters[channel].getOutputRate();
+}
+
+/**
+ * [DecimationStage::getENOB Estimated effective number of bits of a channel.]
+ * @return Effective number of bits, 0 if the channel isn't configured.
+ */
+float DecimationStage::getENOB(uint8_t channel, float input_enob)
+{
+    if (channel >= TOTAL_CHANNELS || !(channelMask & (1 << channel)))
+        return 0;
+
+    return filters[channel].getENOB(input_enob);
+}
@@ -0,0 +1,86 @@
+#ifndef DECIMATION_FILTER_H
+#define DECIMATION_FILTER_H
+
+#include <Arduino.h>
+#include <utils.h>
+#include "ad7689.h"
+
+// Block decimation filters for AD7689 sample streams.
+// All arithmetic is integer: CIC integrators/combs wrap around in 64 bits, the half-band FIR uses Q15 coefficients.
+// Output samples are ADC codes with DECIMATION_FRACTION_BITS extra fractional bits, i.e. code * 2^DECIMATION_FRACTION_BITS,
+// so the resolution gained by oversampling isn't thrown away.
+
+#define DECIMATION_MIN_RATIO (2)
+#define DECIMATION_MAX_RATIO (256)
+#define DECIMATION_MAX_CIC_ORDER (4)
+#define DECIMATION_FRACTION_BITS (8)
+#define HALF_BAND_TAPS (11)
+#define AD7689_ENOB (15.1) // effective number of bits of a single conversion, from the 92.5 dB SNR spec
+
+enum DECIMATION_FILTER_TYPE
+{
+    BOXCAR_FILTER, // accumulate & dump, unity weights
+    CIC_FILTER,    // cascaded integrator-comb, sharper alias rejection
+};
+
+/**
+ * A single channel decimator: box-car or CIC, optionally followed by a half-band FIR that decimates by a further 2.
+ */
+class DecimationFilter
+{
+private:
+    DECIMATION_FILTER_TYPE filterType; /*!< Type of the first decimation stage. */
+    uint16_t ratio;                    /*!< Total decimation ratio, half-band included. */
+    uint16_t stageRatio;               /*!< Decimation ratio of the box-car / CIC stage. */
+    uint8_t order;                     /*!< Number of CIC integrator / comb pairs. */
+    bool halfBand;                     /*!< True if the half-band stage is enabled. */
+    float inputRate;                   /*!< Input sample rate in samples per second. */
+
+    uint64_t gain;      /*!< DC gain of the first stage. */
+    uint8_t gainShift;  /*!< log2(gain) if gain is a power of two, 0xFF otherwise. */
+    uint16_t phase;     /*!< Input samples since the last first stage output. */
+    uint64_t integrator[DECIMATION_MAX_CIC_ORDER]; /*!< CIC integrators, or the box-car accumulator. */
+    uint64_t comb[DECIMATION_MAX_CIC_ORDER];       /*!< CIC comb delay elements. */
+
+    int32_t delayLine[HALF_BAND_TAPS]; /*!< Half-band FIR history, oldest first. */
+    uint8_t halfBandPhase;             /*!< Alternates between 0 and 1, outputs are produced on 1. */
+
+    int32_t normalize(uint64_t value);
+    bool halfBandStep(int32_t sample, int32_t *output);
+
+public:
+    DecimationFilter();
+
+    ESP_ERROR begin(DECIMATION_FILTER_TYPE type, uint16_t decimation_ratio, uint8_t cic_order = 3, bool half_band = false, float input_rate = 0);
+    void reset(void);
+    size_t process(const uint16_t *input, size_t count, int32_t *output, size_t stride = 1);
+
+    uint16_t getRatio(void) { return ratio; }
+    float getOutputRate(void) { return inputRate / ratio; }
+    float getENOB(float input_enob = AD7689_ENOB);
+    static uint16_t toCode(int32_t sample) { return (sample + (1 << (DECIMATION_FRACTION_BITS - 1))) >> DECIMATION_FRACTION_BITS; }
+};
+
+/**
+ * Per-channel decimation stage for interleaved frames, such as the ones produced by AD7689::readChannels or readSequence.
+ */
+class DecimationStage
+{
+private:
+    DecimationFilter filters[TOTAL_CHANNELS]; /*!< One decimator per channel. */
+    uint8_t channelMask;                      /*!< Channels with a configured decimator. */
+
+public:
+    DecimationStage() { channelMask = 0; }
+
+    ESP_ERROR configureChannel(uint8_t channel, DECIMATION_FILTER_TYPE type, uint16_t decimation_ratio, uint8_t cic_order = 3, bool half_band = false, float input_rate = 0);
+    void disableChannel(uint8_t channel);
+    void reset(void);
+    void process(const uint16_t *frames, size_t frame_count, uint8_t frame_width, int32_t *output[TOTAL_CHANNELS], size_t output_count[TOTAL_CHANNELS]);
+
+    DecimationFilter &channel(uint8_t channel) { return filters[channel < TOTAL_CHANNELS ? channel : 0]; }
+    float getOutputRate(uint8_t channel);
+    float getENOB(uint8_t channel, float input_enob = AD7689_ENOB);
+};
+
+#endif
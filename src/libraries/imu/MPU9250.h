@@ -5,6 +5,7 @@
 #include <Wire.h>
 
 #include "MPU9250RegisterMap.h"
+#include "MPU9250Transport.h"
 #include "QuaternionFilter.h"
 
 enum class ACCEL_FS_SEL
@@ -79,7 +80,150 @@ struct MPU9250Setting
     ACCEL_DLPF_CFG accel_dlpf_cfg{ACCEL_DLPF_CFG::DLPF_45HZ};
 };
 
-template <typename WireType>
+// Scale factors and sample period of a configuration, usable in constant expressions
+constexpr float mpu9250_acc_resolution(const ACCEL_FS_SEL accel_fs_sel)
+{
+    // 2 g (00), 4 g (01), 8 g (10) and 16 g (11) over 32768 LSB
+    return (float)(2 << (uint8_t)accel_fs_sel) / 32768.f;
+}
+
+constexpr float mpu9250_gyro_resolution(const GYRO_FS_SEL gyro_fs_sel)
+{
+    // 250 dps (00), 500 dps (01), 1000 dps (10) and 2000 dps (11) over 32768 LSB
+    return (float)(250 << (uint8_t)gyro_fs_sel) / 32768.f;
+}
+
+constexpr float mpu9250_mag_resolution(const MAG_OUTPUT_BITS mag_output_bits)
+{
+    // 14 bit (0) or 16 bit (1) resolution, in milliGauss
+    return (mag_output_bits == MAG_OUTPUT_BITS::M14BITS) ? (float)(10. * 4912. / 8190.0) : (float)(10. * 4912. / 32760.0);
+}
+
+// SMPLRT_DIV only applies with the gyro DLPF enabled (1 kHz / (1 + SMPLRT_DIV)), otherwise the gyro runs at 8 kHz
+// (DLPF_250HZ and DLPF_3600HZ) or 32 kHz (Fchoice bypass)
+constexpr float mpu9250_sample_period(const uint8_t gyro_fchoice, const GYRO_DLPF_CFG gyro_dlpf_cfg, const FIFO_SAMPLE_RATE fifo_sample_rate)
+{
+    return (gyro_fchoice != 0x03)                                                                      ? 1.f / 32000.f
+           : (gyro_dlpf_cfg == GYRO_DLPF_CFG::DLPF_250HZ || gyro_dlpf_cfg == GYRO_DLPF_CFG::DLPF_3600HZ) ? 1.f / 8000.f
+                                                                                                       : (1.f + (uint8_t)fifo_sample_rate) / 1000.f;
+}
+
+// Configuration policies of MPU9250_.
+// MPU9250DynamicConfig, the default, uses the MPU9250Setting given to setup() and the filter chosen with selectFilter().
+// MPU9250StaticConfig fixes both at compile time: the scale factors and the sample period become constants, and only
+// the selected filter kernel is built. setup() then ignores the MPU9250Setting it is given, and selectFilter() has no
+// effect. For example:
+//   using ImuConfig = MPU9250StaticConfig<ACCEL_FS_SEL::A4G, GYRO_FS_SEL::G500DPS>;
+//   MPU9250_<TwoWire, MPU9250I2CBus<TwoWire>, ImuConfig> mpu;
+struct MPU9250DynamicConfig
+{
+    static constexpr bool is_static{false};
+
+    static MPU9250Setting setting(const MPU9250Setting &s) { return s; }
+
+    // runtime values, computed by the driver from the setting
+    static float acc_resolution(const float resolution) { return resolution; }
+    static float gyro_resolution(const float resolution) { return resolution; }
+    static float mag_resolution(const float resolution) { return resolution; }
+    static float sample_period(const MPU9250Setting &s) { return mpu9250_sample_period(s.gyro_fchoice, s.gyro_dlpf_cfg, s.fifo_sample_rate); }
+
+    static void update_filter(QuaternionFilter &filter, float an, float ae, float ad, float gn, float ge, float gd, float mn, float me, float md, float *q, const float dt)
+    {
+        if (dt > 0.f)
+            filter.update(an, ae, ad, gn, ge, gd, mn, me, md, q, dt);
+        else
+            filter.update(an, ae, ad, gn, ge, gd, mn, me, md, q);
+    }
+};
+
+template <ACCEL_FS_SEL ACCEL_FS = ACCEL_FS_SEL::A16G, GYRO_FS_SEL GYRO_FS = GYRO_FS_SEL::G2000DPS,
+          MAG_OUTPUT_BITS MAG_BITS = MAG_OUTPUT_BITS::M16BITS, QuatFilterSel FILTER = QuatFilterSel::MADGWICK,
+          FIFO_SAMPLE_RATE SAMPLE_RATE = FIFO_SAMPLE_RATE::SMPL_200HZ, GYRO_DLPF_CFG GYRO_DLPF = GYRO_DLPF_CFG::DLPF_41HZ,
+          ACCEL_DLPF_CFG ACCEL_DLPF = ACCEL_DLPF_CFG::DLPF_45HZ, uint8_t GYRO_FCHOICE = 0x03, uint8_t ACCEL_FCHOICE = 0x01>
+struct MPU9250StaticConfig
+{
+    static constexpr bool is_static{true};
+
+    static MPU9250Setting setting(const MPU9250Setting &)
+    {
+        MPU9250Setting s;
+        s.accel_fs_sel = ACCEL_FS;
+        s.gyro_fs_sel = GYRO_FS;
+        s.mag_output_bits = MAG_BITS;
+        s.fifo_sample_rate = SAMPLE_RATE;
+        s.gyro_fchoice = GYRO_FCHOICE;
+        s.gyro_dlpf_cfg = GYRO_DLPF;
+        s.accel_fchoice = ACCEL_FCHOICE;
+        s.accel_dlpf_cfg = ACCEL_DLPF;
+        return s;
+    }
+
+    static constexpr float acc_resolution(const float) { return mpu9250_acc_resolution(ACCEL_FS); }
+    static constexpr float gyro_resolution(const float) { return mpu9250_gyro_resolution(GYRO_FS); }
+    static constexpr float mag_resolution(const float) { return mpu9250_mag_resolution(MAG_BITS); }
+    static constexpr float sample_period(const MPU9250Setting &) { return mpu9250_sample_period(GYRO_FCHOICE, GYRO_DLPF, SAMPLE_RATE); }
+
+    static void update_filter(QuaternionFilter &filter, float an, float ae, float ad, float gn, float ge, float gd, float mn, float me, float md, float *q, const float dt)
+    {
+        filter.template update_as<FILTER>(an, ae, ad, gn, ge, gd, mn, me, md, q, dt);
+    }
+};
+
+// One sample read from the FIFO, in raw sensor counts
+struct MPU9250FifoSample
+{
+    int16_t acc[3];
+    int16_t temperature;
+    int16_t gyro[3];
+    int16_t mag[3];
+    bool mag_valid;     // false if the magnetometer had no new data for this sample, or overflowed
+    uint32_t index;     // sample number since the stream was started, samples lost to FIFO overflows are not counted
+    uint32_t timestamp; // estimated time the sample was taken, in micros() time
+};
+
+struct MPU9250FifoStats
+{
+    uint32_t samples;    // samples parsed from the FIFO
+    uint32_t bursts;     // FIFO_R_W read transactions
+    uint32_t overflows;  // FIFO overflows, the FIFO is reset and its content dropped each time
+    uint32_t ring_drops; // samples overwritten in the ring before being read
+};
+
+// Sample timestamping. FIFO samples are stamped by a sample clock that runs at the measured sample period and is
+// corrected at each read, against the data ready interrupt if notifyDataReady is called from the INT pin ISR, or else
+// against the read time. update() uses the data ready time directly when there is one.
+struct MPU9250TimingStats
+{
+    uint32_t reads;        // timestamped FIFO reads and update() calls
+    uint32_t data_ready;   // of which anchored on a data ready interrupt
+    uint32_t resyncs;      // FIFO sample clock resets: stream start, overflow, or a residual over 4 periods
+    float period_us;       // sample period measured against micros(), the MPU9250 oscillator is only within a few %
+    float residual_rms_us; // sample clock error at each FIFO read, before correction: the timestamp jitter
+    float residual_max_us;
+    float latency_mean_us; // age of the oldest sample when read (FIFO) or processed (update): batching and scheduling delay
+    float latency_max_us;
+};
+
+enum class MPU9250CalibrationState : uint8_t
+{
+    IDLE,
+    ACC_GYRO, // waiting for / averaging a still period
+    MAG,      // collecting magnetometer samples in all directions
+    DONE,     // results applied
+    FAILED,   // timed out, previous calibration kept
+};
+
+struct MPU9250CalibrationStatus
+{
+    MPU9250CalibrationState state;
+    float progress;     // 0 to 1, of the current step
+    uint32_t samples;   // samples used by the current step
+    float gyro_noise;   // dps, largest gyro standard deviation of the last still check
+    float coverage;     // fraction of the magnetometer directions seen, 24 bins
+    float fit_residual; // RMS relative radius error of the magnetometer ellipsoid fit
+};
+
+template <typename WireType, typename Transport = MPU9250I2CBus<WireType>, typename Config = MPU9250DynamicConfig>
 class MPU9250_
 {
     static constexpr uint8_t MPU9250_DEFAULT_ADDRESS{0x68}; // Device address when ADO = 0
@@ -99,7 +243,7 @@ class MPU9250_
     float acc_bias[3]{0., 0., 0.};  // acc calibration value in ACCEL_FS_SEL: 2g
     float gyro_bias[3]{0., 0., 0.}; // gyro calibration value in GYRO_FS_SEL: 250dps
     float mag_bias_factory[3]{0., 0., 0.};
-    float mag_bias[3]{0., 0., 0.}; // mag calibration value in MAG_OUTPUT_BITS: 16BITS
+    float mag_bias[3]{0., 0., 0.}; // mag calibration value in mG
     float mag_scale[3]{1., 1., 1.};
     float magnetic_declination = -7.51; // Japan, 24th June
 
@@ -125,9 +269,70 @@ class MPU9250_
     bool b_ahrs{true};
     bool b_verbose{false};
 
-    // I2C
-    WireType *wire;
-    uint8_t i2c_err_;
+    // Bus
+    Transport bus;
+
+    // FIFO streaming
+    static constexpr uint16_t FIFO_SIZE{512};                      // bytes
+    static constexpr uint8_t FIFO_MAX_BURST{Transport::MAX_BURST}; // bytes per read transaction
+    static constexpr uint8_t FIFO_ACC_TEMP_GYRO{14};               // bytes per sample, same layout as ACCEL_XOUT_H to GYRO_ZOUT_L
+    static constexpr uint8_t FIFO_MAG{8};                          // AK8963 ST1, XOUT_L to ZOUT_H and ST2, through I2C master slave 0
+    static constexpr size_t FIFO_RING_SIZE{64};                    // samples
+    bool fifo_streaming{false};
+    bool fifo_with_mag{false};
+    uint8_t fifo_packet_size{0};
+    uint8_t fifo_user_ctrl{0};
+    MPU9250FifoSample fifo_ring[FIFO_RING_SIZE];
+    size_t fifo_head{0};  // next sample to read from the ring
+    size_t fifo_count{0}; // samples in the ring
+    uint32_t fifo_index{0};
+    MPU9250FifoStats fifo_stats{0, 0, 0, 0};
+
+    // Sample timestamping
+    static constexpr float CLOCK_PHASE_GAIN{0.1f};  // fraction of the residual corrected at each read
+    static constexpr float CLOCK_PERIOD_GAIN{0.01f}; // fraction of the residual per sample applied to the period
+    static constexpr float CLOCK_RESYNC_PERIODS{4.f}; // larger residuals reset the sample clock
+    static constexpr float MAX_SAMPLE_DT{0.1f};       // s, longer gaps (stream restart, stalls) count as one period
+    volatile uint32_t drdy_time{0};
+    volatile uint32_t drdy_count{0};
+    uint32_t drdy_seen{0};
+    bool sample_clock_valid{false};
+    uint32_t sample_clock{0};     // time of the next FIFO sample, us
+    float sample_clock_frac{0.f}; // and its fraction of us
+    float sample_period_us{0.f};
+    bool last_sample_valid{false};
+    uint32_t last_sample_time{0}; // time of the last sample given to the filter
+    MPU9250TimingStats timing_stats{};
+    double residual_square_sum{0.};
+    double latency_sum{0.};
+    uint32_t residual_count{0};
+
+    // Background calibration
+    static constexpr uint32_t CALIB_TIMEOUT_MS{60000};
+    static constexpr uint16_t CALIB_STILL_MIN_SAMPLES{100};
+    static constexpr uint16_t CALIB_STILL_CHECK_SAMPLES{25}; // motion check interval
+    static constexpr float CALIB_STILL_ACC_G{0.02f};         // largest standard deviation while still
+    static constexpr float CALIB_STILL_GYRO_DPS{1.f};
+    static constexpr uint16_t CALIB_MAG_MIN_SAMPLES{300};
+    static constexpr uint16_t CALIB_MAG_SOLVE_SAMPLES{50}; // fit interval once there are enough samples
+    static constexpr float CALIB_MAG_MIN_COVERAGE{0.75f};
+    static constexpr float CALIB_MAG_MAX_RESIDUAL{0.05f};
+    static constexpr double CALIB_MAG_COUNT_SCALE{1. / 1024.}; // keeps the normal equations well conditioned
+    MPU9250CalibrationStatus calib_status{MPU9250CalibrationState::IDLE, 0.f, 0, 0.f, 0.f, 0.f};
+    bool calib_mag_requested{false};
+    uint32_t calib_start_ms{0};
+    double calib_acc_sum[3], calib_acc_square_sum[3];
+    double calib_gyro_sum[3], calib_gyro_square_sum[3];
+    double calib_normal[6][7]; // normal equations of the ellipsoid fit, right-hand side in the last column
+    int16_t calib_mag_min[3], calib_mag_max[3];
+    uint32_t calib_bins{0};
+    int16_t mag_count_last[3]{0, 0, 0}; // latest fresh magnetometer sample, in counts
+    bool mag_fresh{false};
+
+    // Magnetometer interpolation between fresh FIFO samples
+    float mag_prev[3]{0.f, 0.f, 0.f};
+    uint32_t mag_prev_time{0};
+    bool mag_prev_valid{false};
 
 public:
     static constexpr uint16_t CALIB_GYRO_SENSITIVITY{131};    // LSB/degrees/sec
@@ -144,9 +349,27 @@ public:
             return false;
         }
         mpu_i2c_addr = addr;
-        setting = mpu_setting;
-        wire = &w;
+        setting = Config::setting(mpu_setting);
+        bus.attach(w);
+        return setup_impl();
+    }
+
+    // Setup over SPI, for MPU9250_<SPIClass, MPU9250SPIBus>
+    bool setup(const uint8_t cs_pin, SPIClass &spi, const MPU9250Setting &mpu_setting = MPU9250Setting())
+    {
+        mpu_i2c_addr = MPU9250_DEFAULT_ADDRESS;
+        setting = Config::setting(mpu_setting);
+        bus.attach(spi, cs_pin, mpu_i2c_addr);
+        return setup_impl();
+    }
+
+    // Time spent on the bus, e.g. divide by getFifoStats().samples for the bus time per sample
+    MPU9250BusStats getBusStats() const { return bus.get_stats(); }
+    void resetBusStats() { bus.reset_stats(); }
 
+private:
+    bool setup_impl()
+    {
         if (isConnectedMPU9250())
         {
             initMPU9250();
@@ -174,6 +397,7 @@ public:
         return true;
     }
 
+public:
     void sleep(bool b)
     {
         byte c = read_byte(mpu_i2c_addr, PWR_MGMT_1); // read the value, change sleep bit to match b, write byte back to register
@@ -208,6 +432,36 @@ public:
         calibrate_mag_impl();
     }
 
+    // Background calibration, run on the samples of update() or updateFromFifo(), which keep fusing as usual.
+    // Accel/gyro: keep the device still and flat, on any of its faces, for about a second; gravity is removed from the
+    // vertical axis. Mag: rotate the device in all directions; hard and soft iron are estimated by a streaming least
+    // squares fit of an axis aligned ellipsoid, the correction the driver applies. Results are applied as each step ends.
+    bool startCalibration(const bool acc_gyro = true, const bool mag = true)
+    {
+        if (!has_connected || (!acc_gyro && !mag))
+            return false;
+
+        calib_mag_requested = mag;
+        if (acc_gyro)
+            start_acc_gyro_calibration();
+        else
+            start_mag_calibration();
+        return true;
+    }
+
+    void cancelCalibration()
+    {
+        if (isCalibrating())
+            calib_status.state = MPU9250CalibrationState::IDLE;
+    }
+
+    bool isCalibrating() const
+    {
+        return calib_status.state == MPU9250CalibrationState::ACC_GYRO || calib_status.state == MPU9250CalibrationState::MAG;
+    }
+
+    MPU9250CalibrationStatus getCalibrationStatus() const { return calib_status; }
+
     bool isConnected()
     {
         has_connected = isConnectedMPU9250() && isConnectedAK8963();
@@ -258,6 +512,221 @@ public:
         update_accel_gyro();
         update_mag();
 
+        // with the INT pin wired to notifyDataReady, integrate over the time between samples rather than between calls
+        const uint32_t now = micros();
+        uint32_t sample_time;
+        if (take_data_ready(now, sample_time))
+        {
+            timing_stats.reads++;
+            timing_stats.data_ready++;
+            add_latency(now - sample_time);
+            update_quaternion(sample_dt(sample_time));
+        }
+        else
+        {
+            update_quaternion();
+        }
+        calibration_step();
+
+        if (!b_ahrs)
+        {
+            temperature_count = read_temperature_data();              // Read the adc values
+            temperature = ((float)temperature_count) / 333.87 + 21.0; // Temperature in degrees Centigrade
+        }
+        else
+        {
+            update_rpy(q[0], q[1], q[2], q[3]);
+        }
+        return true;
+    }
+
+    // Streaming mode: accel, temperature, gyro and (optionally) the magnetometer are sampled into the MPU9250 FIFO at
+    // the FIFO_SAMPLE_RATE of the settings, and read many samples per transaction by readFifo.
+    // The magnetometer is read by the MPU9250 internal I2C master, so it can't be accessed directly while streaming.
+    bool beginFifo(const bool with_mag = true)
+    {
+        if (!has_connected)
+            return false;
+
+        // stop the FIFO and the I2C master while reconfiguring
+        write_byte(mpu_i2c_addr, FIFO_EN, 0x00);
+        write_user_ctrl(0x00, false);
+        delay(1);
+
+        fifo_user_ctrl = 0x40; // FIFO_EN
+        // 50 us INT pulse per sample, for notifyDataReady
+        write_byte(mpu_i2c_addr, INT_PIN_CFG, with_mag ? 0x00 : 0x02); // Disable bypass with the magnetometer, so the master owns the aux bus
+        if (with_mag)
+        {
+            write_byte(mpu_i2c_addr, I2C_MST_CTRL, 0x4D);                   // WAIT_FOR_ES: hold data ready until slave data is loaded, 400 kHz
+            write_byte(mpu_i2c_addr, I2C_SLV0_ADDR, 0x80 | AK8963_ADDRESS); // Read from the AK8963
+            write_byte(mpu_i2c_addr, I2C_SLV0_REG, AK8963_ST1);             // starting at ST1
+            write_byte(mpu_i2c_addr, I2C_SLV0_CTRL, 0x80 | FIFO_MAG);       // Enable slave 0, ST1 to ST2
+            fifo_user_ctrl |= 0x20;                                         // I2C_MST_EN
+        }
+
+        write_user_ctrl(fifo_user_ctrl | 0x04, false);              // Enable and reset FIFO
+        write_byte(mpu_i2c_addr, INT_ENABLE, 0x11);                 // Enable FIFO overflow (bit 4) and data ready (bit 0) interrupts
+        // Temperature, gyro x/y/z, accel and slave 0 data go to the FIFO, in register order
+        write_byte(mpu_i2c_addr, FIFO_EN, with_mag ? 0xF9 : 0xF8);
+
+        fifo_with_mag = with_mag;
+        fifo_packet_size = FIFO_ACC_TEMP_GYRO + (with_mag ? FIFO_MAG : 0);
+        fifo_head = 0;
+        fifo_count = 0;
+        fifo_index = 0;
+        fifo_stats = {0, 0, 0, 0};
+        fifo_streaming = true;
+
+        sample_period_us = getFifoSamplePeriod() * 1e6f;
+        sample_clock_valid = false;
+        last_sample_valid = false;
+        mag_prev_valid = false;
+        resetTimingStats();
+        return true;
+    }
+
+    void endFifo()
+    {
+        write_byte(mpu_i2c_addr, FIFO_EN, 0x00);
+        if (fifo_with_mag)
+            write_byte(mpu_i2c_addr, I2C_SLV0_CTRL, 0x00); // Stop slave 0, its ST2 reads would take the AK8963 samples
+        write_user_ctrl(0x00, true);                       // Disable FIFO, and I2C master if the bus allows
+        write_byte(mpu_i2c_addr, INT_PIN_CFG, 0x22);       // Back to bypass, as set by initMPU9250
+        write_byte(mpu_i2c_addr, INT_ENABLE, 0x01);
+        fifo_streaming = false;
+    }
+
+    // Reads every complete sample in the FIFO into the sample ring. Returns the number of samples read.
+    size_t readFifo()
+    {
+        if (!fifo_streaming)
+            return 0;
+
+        uint8_t raw_data[FIFO_MAX_BURST];
+        read_bytes(mpu_i2c_addr, FIFO_COUNTH, 2, &raw_data[0]);
+        const uint32_t read_time = micros();
+        uint16_t count = (((uint16_t)raw_data[0] << 8) | raw_data[1]) & 0x1FFF;
+
+        // The FIFO size is not a multiple of the sample size: once it overflows, the oldest bytes are overwritten and
+        // samples are no longer aligned. Only check for it when the FIFO is close to full, to save a transaction.
+        if (count + fifo_packet_size > FIFO_SIZE)
+        {
+            if ((read_byte(mpu_i2c_addr, INT_STATUS) & 0x10) || (count >= FIFO_SIZE))
+            {
+                write_user_ctrl(fifo_user_ctrl | 0x04, false); // Reset FIFO
+                fifo_stats.overflows++;
+                sample_clock_valid = false;
+                return 0;
+            }
+        }
+
+        const uint8_t burst_samples = FIFO_MAX_BURST / fifo_packet_size;
+        uint16_t samples = count / fifo_packet_size;
+        size_t n_read = 0;
+        if (samples > 0)
+            correct_sample_clock(read_time, samples);
+
+        while (samples > 0)
+        {
+            uint8_t n = (samples > burst_samples) ? burst_samples : samples;
+            read_bytes(mpu_i2c_addr, FIFO_R_W, n * fifo_packet_size, &raw_data[0]);
+            fifo_stats.bursts++;
+
+            for (uint8_t i = 0; i < n; ++i)
+                push_fifo_sample(&raw_data[i * fifo_packet_size]);
+
+            samples -= n;
+            n_read += n;
+        }
+        return n_read;
+    }
+
+    size_t fifoAvailable() const { return fifo_count; }
+
+    // Pops the oldest sample of the ring, in raw counts
+    bool readFifoSample(MPU9250FifoSample &sample)
+    {
+        if (fifo_count == 0)
+            return false;
+
+        sample = fifo_ring[fifo_head];
+        fifo_head = (fifo_head + 1) % FIFO_RING_SIZE;
+        fifo_count--;
+        return true;
+    }
+
+    // Same as update, from the oldest FIFO sample: reads the FIFO if the ring is empty, scales the sample, and runs the
+    // filter over the time between sample timestamps instead of the time between calls. Call until it returns false.
+    bool updateFromFifo()
+    {
+        if (fifo_count == 0 && readFifo() == 0)
+            return false;
+
+        MPU9250FifoSample sample;
+        if (!readFifoSample(sample))
+            return false;
+
+        int16_t raw_acc_gyro_data[7] = {sample.acc[0], sample.acc[1], sample.acc[2], sample.temperature, sample.gyro[0], sample.gyro[1], sample.gyro[2]};
+        scale_accel_gyro(raw_acc_gyro_data);
+        update_fifo_mag(sample);
+
+        update_quaternion(sample_dt(sample.timestamp));
+        calibration_step();
+        if (b_ahrs)
+            update_rpy(q[0], q[1], q[2], q[3]);
+        return true;
+    }
+
+    MPU9250FifoStats getFifoStats() const { return fifo_stats; }
+    bool isFifoStreaming() const { return fifo_streaming; }
+
+    // Call from the ISR of the INT pin (rising edge) with micros(), to timestamp samples at data ready rather than when
+    // they are read
+    void notifyDataReady(const uint32_t t_us)
+    {
+        drdy_time = t_us;
+        drdy_count = drdy_count + 1;
+    }
+
+    // INT pin mode outside FIFO streaming: latched until INT_STATUS is read (as set up), or a 50 us pulse per sample so
+    // that an interrupt driven reader sees an edge for every sample, even when it is late
+    void setDataReadyPulse(const bool pulse)
+    {
+        if (!fifo_streaming)
+            write_byte(mpu_i2c_addr, INT_PIN_CFG, pulse ? 0x02 : 0x22);
+    }
+
+    // Time the sample behind the current accel/gyro/mag/quaternion was taken, in micros() time. Only set when updating
+    // from the FIFO or with notifyDataReady.
+    uint32_t getSampleTime() const { return last_sample_time; }
+
+    MPU9250TimingStats getTimingStats() const
+    {
+        MPU9250TimingStats stats = timing_stats;
+        stats.period_us = (sample_period_us > 0.f) ? sample_period_us : getFifoSamplePeriod() * 1e6f;
+        stats.residual_rms_us = residual_count ? sqrt(residual_square_sum / residual_count) : 0.f;
+        stats.latency_mean_us = stats.reads ? latency_sum / stats.reads : 0.f;
+        return stats;
+    }
+
+    void resetTimingStats()
+    {
+        timing_stats = {};
+        residual_square_sum = 0.;
+        latency_sum = 0.;
+        residual_count = 0;
+    }
+
+    // Sample period of the FIFO in seconds, see mpu9250_sample_period
+    float getFifoSamplePeriod() const
+    {
+        return Config::sample_period(setting);
+    }
+
+private:
+    void update_quaternion(const float dt = 0.f)
+    {
         // Madgwick function needs to be fed North, East, and Down direction like
         // (AN, AE, AD, GN, GE, GD, MN, ME, MD)
         // Accel and Gyro direction is Right-Hand, X-Forward, Z-Up
@@ -283,22 +752,168 @@ public:
         float md = +m[2];
 
         for (size_t i = 0; i < n_filter_iter; ++i)
+            Config::update_filter(quat_filter, an, ae, ad, gn, ge, gd, mn, me, md, q, dt);
+    }
+
+    void push_fifo_sample(const uint8_t *raw_data)
+    {
+        if (fifo_count == FIFO_RING_SIZE)
         {
-            quat_filter.update(an, ae, ad, gn, ge, gd, mn, me, md, q);
+            // ring full, drop the oldest sample
+            fifo_head = (fifo_head + 1) % FIFO_RING_SIZE;
+            fifo_count--;
+            fifo_stats.ring_drops++;
         }
 
-        if (!b_ahrs)
+        MPU9250FifoSample &sample = fifo_ring[(fifo_head + fifo_count) % FIFO_RING_SIZE];
+        sample.acc[0] = ((int16_t)raw_data[0] << 8) | raw_data[1]; // Same big endian layout as the data registers
+        sample.acc[1] = ((int16_t)raw_data[2] << 8) | raw_data[3];
+        sample.acc[2] = ((int16_t)raw_data[4] << 8) | raw_data[5];
+        sample.temperature = ((int16_t)raw_data[6] << 8) | raw_data[7];
+        sample.gyro[0] = ((int16_t)raw_data[8] << 8) | raw_data[9];
+        sample.gyro[1] = ((int16_t)raw_data[10] << 8) | raw_data[11];
+        sample.gyro[2] = ((int16_t)raw_data[12] << 8) | raw_data[13];
+
+        sample.mag_valid = false;
+        if (fifo_with_mag)
         {
-            temperature_count = read_temperature_data();              // Read the adc values
-            temperature = ((float)temperature_count) / 333.87 + 21.0; // Temperature in degrees Centigrade
+            const uint8_t *mag_data = &raw_data[FIFO_ACC_TEMP_GYRO];
+            sample.mag[0] = ((int16_t)mag_data[2] << 8) | mag_data[1]; // AK8963 data is little endian
+            sample.mag[1] = ((int16_t)mag_data[4] << 8) | mag_data[3];
+            sample.mag[2] = ((int16_t)mag_data[6] << 8) | mag_data[5];
+            sample.mag_valid = (mag_data[0] & 0x01) && !(mag_data[7] & 0x08); // ST1 data ready, ST2 no overflow
         }
+
+        sample.index = fifo_index++;
+        sample.timestamp = sample_clock + ((sample_clock_frac >= 0.5f) ? 1 : 0);
+        advance_sample_clock(sample_period_us);
+        fifo_count++;
+        fifo_stats.samples++;
+    }
+
+    // Newest data ready time, if there was an interrupt since the last call
+    bool take_data_ready(const uint32_t now, uint32_t &time)
+    {
+        uint32_t count;
+        do
+        {
+            count = drdy_count;
+            time = drdy_time;
+        } while (count != drdy_count); // the ISR ran in between
+
+        if (count == drdy_seen || (int32_t)(now - time) < 0)
+            return false;
+        drdy_seen = count;
+        return true;
+    }
+
+    // Aligns the sample clock on the newest of the n samples about to be read from the FIFO. Small residuals are
+    // filtered (phase and period), so that read time jitter doesn't reach the timestamps.
+    void correct_sample_clock(const uint32_t read_time, const uint16_t n)
+    {
+        uint32_t anchor;
+        timing_stats.reads++;
+        if (take_data_ready(read_time, anchor))
+            timing_stats.data_ready++;
         else
+            anchor = read_time - (uint32_t)(0.5f * sample_period_us); // the newest sample is up to a period old
+
+        const float span = (n - 1) * sample_period_us;
+        const float residual = (float)(int32_t)(anchor - sample_clock) - sample_clock_frac - span;
+        if (!sample_clock_valid || fabsf(residual) > CLOCK_RESYNC_PERIODS * sample_period_us)
         {
-            update_rpy(q[0], q[1], q[2], q[3]);
+            sample_clock = anchor;
+            sample_clock_frac = 0.f;
+            advance_sample_clock(-span);
+            sample_clock_valid = true;
+            timing_stats.resyncs++;
+        }
+        else
+        {
+            residual_square_sum += residual * residual;
+            residual_count++;
+            if (fabsf(residual) > timing_stats.residual_max_us)
+                timing_stats.residual_max_us = fabsf(residual);
+
+            advance_sample_clock(CLOCK_PHASE_GAIN * residual);
+            const float nominal = getFifoSamplePeriod() * 1e6f;
+            sample_period_us += CLOCK_PERIOD_GAIN * residual / n;
+            sample_period_us = constrain(sample_period_us, 0.9f * nominal, 1.1f * nominal);
+        }
+        add_latency(read_time - sample_clock);
+    }
+
+    void advance_sample_clock(const float us)
+    {
+        const float t = sample_clock_frac + us;
+        const float whole = floorf(t);
+        sample_clock += (int32_t)whole;
+        sample_clock_frac = t - whole;
+    }
+
+    void add_latency(const uint32_t latency)
+    {
+        latency_sum += latency;
+        if (latency > timing_stats.latency_max_us)
+            timing_stats.latency_max_us = latency;
+    }
+
+    // Time since the previous sample given to the filter, in s
+    float sample_dt(const uint32_t time)
+    {
+        float dt = getFifoSamplePeriod();
+        if (last_sample_valid)
+        {
+            const float diff = (float)(int32_t)(time - last_sample_time) * 1e-6f;
+            if (diff > 0.f && diff <= MAX_SAMPLE_DT)
+                dt = diff;
+        }
+        last_sample_time = time;
+        last_sample_valid = true;
+        return dt;
+    }
+
+    // Magnetometer value at the time of a FIFO sample. The AK8963 is much slower than the FIFO: between two fresh
+    // readings, the value is interpolated if the next one is already in the ring, and held otherwise.
+    void update_fifo_mag(const MPU9250FifoSample &sample)
+    {
+        if (!fifo_with_mag)
+            return;
+
+        if (sample.mag_valid)
+        {
+            scale_mag(sample.mag, m);
+            memcpy(mag_count_last, sample.mag, sizeof(mag_count_last));
+            mag_fresh = true;
+            memcpy(mag_prev, m, sizeof(mag_prev));
+            mag_prev_time = sample.timestamp;
+            mag_prev_valid = true;
+            return;
+        }
+        if (!mag_prev_valid)
+            return;
+
+        memcpy(m, mag_prev, sizeof(m));
+        for (size_t i = 0; i < fifo_count; ++i)
+        {
+            const MPU9250FifoSample &next = fifo_ring[(fifo_head + i) % FIFO_RING_SIZE];
+            if (!next.mag_valid)
+                continue;
+
+            const float span = (float)(int32_t)(next.timestamp - mag_prev_time);
+            if (span <= 0.f)
+                break;
+            const float w = (float)(int32_t)(sample.timestamp - mag_prev_time) / span;
+            float mag_next[3];
+            scale_mag(next.mag, mag_next);
+            for (uint8_t k = 0; k < 3; ++k)
+                m[k] = mag_prev[k] + w * (mag_next[k] - mag_prev[k]);
+            break;
         }
-        return true;
     }
 
+public:
+
     float getRoll() const { return rpy[0]; }
     float getPitch() const { return rpy[1]; }
     float getYaw() const { return rpy[2]; }
@@ -378,11 +993,18 @@ public:
     }
     void setMagneticDeclination(const float d) { magnetic_declination = d; }
 
+    // Not used with MPU9250StaticConfig, which fixes the filter
     void selectFilter(QuatFilterSel sel)
     {
         quat_filter.select_filter(sel);
     }
 
+    // Kp and Ki of MAHONY and its variants, with either config. The former driver used 10, 0
+    void setMahonyGains(const float kp, const float ki)
+    {
+        quat_filter.set_mahony_gains(kp, ki);
+    }
+
     void setFilterIterations(const size_t n)
     {
         if (n > 0)
@@ -397,9 +1019,9 @@ public:
 private:
     void initMPU9250()
     {
-        acc_resolution = get_acc_resolution(setting.accel_fs_sel);
-        gyro_resolution = get_gyro_resolution(setting.gyro_fs_sel);
-        mag_resolution = get_mag_resolution(setting.mag_output_bits);
+        acc_resolution = mpu9250_acc_resolution(setting.accel_fs_sel);
+        gyro_resolution = mpu9250_gyro_resolution(setting.gyro_fs_sel);
+        mag_resolution = mpu9250_mag_resolution(setting.mag_output_bits);
 
         // reset device
         write_byte(mpu_i2c_addr, PWR_MGMT_1, 0x80); // Write a one to bit 7 reset bit; toggle reset device
@@ -536,22 +1158,28 @@ public:
     {
         int16_t raw_acc_gyro_data[7];       // used to read all 14 bytes at once from the MPU9250 accel/gyro
         read_accel_gyro(raw_acc_gyro_data); // INT cleared on any read
+        scale_accel_gyro(raw_acc_gyro_data);
+    }
 
+private:
+    void scale_accel_gyro(const int16_t *raw_acc_gyro_data)
+    {
         // Now we'll calculate the accleration value into actual g's
-        a[0] = (float)raw_acc_gyro_data[0] * acc_resolution; // get actual g value, this depends on scale being set
-        a[1] = (float)raw_acc_gyro_data[1] * acc_resolution;
-        a[2] = (float)raw_acc_gyro_data[2] * acc_resolution;
+        const float acc_res = Config::acc_resolution(acc_resolution);
+        a[0] = (float)raw_acc_gyro_data[0] * acc_res; // get actual g value, this depends on scale being set
+        a[1] = (float)raw_acc_gyro_data[1] * acc_res;
+        a[2] = (float)raw_acc_gyro_data[2] * acc_res;
 
         temperature_count = raw_acc_gyro_data[3];                 // Read the adc values
         temperature = ((float)temperature_count) / 333.87 + 21.0; // Temperature in degrees Centigrade
 
         // Calculate the gyro value into actual degrees per second
-        g[0] = (float)raw_acc_gyro_data[4] * gyro_resolution; // get actual gyro value, this depends on scale being set
-        g[1] = (float)raw_acc_gyro_data[5] * gyro_resolution;
-        g[2] = (float)raw_acc_gyro_data[6] * gyro_resolution;
+        const float gyro_res = Config::gyro_resolution(gyro_resolution);
+        g[0] = (float)raw_acc_gyro_data[4] * gyro_res; // get actual gyro value, this depends on scale being set
+        g[1] = (float)raw_acc_gyro_data[5] * gyro_res;
+        g[2] = (float)raw_acc_gyro_data[6] * gyro_res;
     }
 
-private:
     void read_accel_gyro(int16_t *destination)
     {
         uint8_t raw_data[14];                                                // x/y/z accel register data stored here
@@ -573,16 +1201,24 @@ public:
         // Read the x/y/z adc values
         if (read_mag(mag_count))
         {
-            // Calculate the magnetometer values in milliGauss
-            // Include factory calibration per data sheet and user environmental corrections
-            // mag_bias is calcurated in 16BITS
-            float bias_to_current_bits = mag_resolution / get_mag_resolution(MAG_OUTPUT_BITS::M16BITS);
-            m[0] = (float)(mag_count[0] * mag_resolution * mag_bias_factory[0] - mag_bias[0] * bias_to_current_bits) * mag_scale[0]; // get actual magnetometer value, this depends on scale being set
-            m[1] = (float)(mag_count[1] * mag_resolution * mag_bias_factory[1] - mag_bias[1] * bias_to_current_bits) * mag_scale[1];
-            m[2] = (float)(mag_count[2] * mag_resolution * mag_bias_factory[2] - mag_bias[2] * bias_to_current_bits) * mag_scale[2];
+            scale_mag(mag_count, m);
+            memcpy(mag_count_last, mag_count, sizeof(mag_count_last));
+            mag_fresh = true;
         }
     }
 
+private:
+    void scale_mag(const int16_t *mag_count, float *dest)
+    {
+        // Calculate the magnetometer values in milliGauss
+        // Include factory calibration per data sheet and user environmental corrections
+        // mag_bias is in milliGauss, whatever the output bits it was calibrated with
+        const float mag_res = Config::mag_resolution(mag_resolution);
+        dest[0] = (float)(mag_count[0] * mag_res * mag_bias_factory[0] - mag_bias[0]) * mag_scale[0]; // get actual magnetometer value, this depends on scale being set
+        dest[1] = (float)(mag_count[1] * mag_res * mag_bias_factory[1] - mag_bias[1]) * mag_scale[1];
+        dest[2] = (float)(mag_count[2] * mag_res * mag_bias_factory[2] - mag_bias[2]) * mag_scale[2];
+    }
+
 private:
     bool read_mag(int16_t *destination)
     {
@@ -648,8 +1284,8 @@ private:
         write_byte(mpu_i2c_addr, FIFO_EN, 0x00);      // Disable FIFO
         write_byte(mpu_i2c_addr, PWR_MGMT_1, 0x00);   // Turn on internal clock source
         write_byte(mpu_i2c_addr, I2C_MST_CTRL, 0x00); // Disable I2C master
-        write_byte(mpu_i2c_addr, USER_CTRL, 0x00);    // Disable FIFO and I2C master modes
-        write_byte(mpu_i2c_addr, USER_CTRL, 0x0C);    // Reset FIFO and DMP
+        write_user_ctrl(0x00, false);                 // Disable FIFO and I2C master modes
+        write_user_ctrl(0x0C, false);                 // Reset FIFO and DMP
         delay(15);
 
         // Configure MPU6050 gyro and accelerometer for bias calculation
@@ -659,7 +1295,7 @@ private:
         write_byte(mpu_i2c_addr, ACCEL_CONFIG, 0x00); // Set accelerometer full-scale to 2 g, maximum sensitivity
 
         // Configure FIFO to capture accelerometer and gyro data for bias calculation
-        write_byte(mpu_i2c_addr, USER_CTRL, 0x40); // Enable FIFO
+        write_user_ctrl(0x40, false);              // Enable FIFO
         write_byte(mpu_i2c_addr, FIFO_EN, 0x78);   // Enable gyro and accelerometer sensors for FIFO  (max size 512 bytes in MPU-9150)
         delay(40);                                 // accumulate 40 samples in 40 milliseconds = 480 bytes
     }
@@ -865,7 +1501,7 @@ private:
         bias[1] = (mag_max[1] + mag_min[1]) / 2; // get average y mag bias in counts
         bias[2] = (mag_max[2] + mag_min[2]) / 2; // get average z mag bias in counts
 
-        float bias_resolution = get_mag_resolution(MAG_OUTPUT_BITS::M16BITS);
+        float bias_resolution = mpu9250_mag_resolution(MAG_OUTPUT_BITS::M16BITS);
         m_bias[0] = (float)bias[0] * bias_resolution * mag_bias_factory[0]; // save mag biases in G for main program
         m_bias[1] = (float)bias[1] * bias_resolution * mag_bias_factory[1];
         m_bias[2] = (float)bias[2] * bias_resolution * mag_bias_factory[2];
@@ -885,6 +1521,260 @@ private:
         m_scale[2] = avg_rad / ((float)scale[2]);
     }
 
+    // Background calibration
+
+    void start_acc_gyro_calibration()
+    {
+        calib_status = {MPU9250CalibrationState::ACC_GYRO, 0.f, 0, 0.f, 0.f, 0.f};
+        calib_start_ms = millis();
+        reset_still_window();
+    }
+
+    void start_mag_calibration()
+    {
+        calib_status = {MPU9250CalibrationState::MAG, 0.f, 0, 0.f, 0.f, 0.f};
+        calib_start_ms = millis();
+        memset(calib_normal, 0, sizeof(calib_normal));
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            calib_mag_min[i] = 32767;
+            calib_mag_max[i] = -32767;
+        }
+        calib_bins = 0;
+    }
+
+    void reset_still_window()
+    {
+        memset(calib_acc_sum, 0, sizeof(calib_acc_sum));
+        memset(calib_acc_square_sum, 0, sizeof(calib_acc_square_sum));
+        memset(calib_gyro_sum, 0, sizeof(calib_gyro_sum));
+        memset(calib_gyro_square_sum, 0, sizeof(calib_gyro_square_sum));
+        calib_status.samples = 0;
+        calib_status.progress = 0.f;
+    }
+
+    // Called once per sample, after scaling
+    void calibration_step()
+    {
+        if (!isCalibrating())
+            return;
+
+        if (millis() - calib_start_ms > CALIB_TIMEOUT_MS)
+        {
+            calib_status.state = MPU9250CalibrationState::FAILED;
+            return;
+        }
+
+        if (calib_status.state == MPU9250CalibrationState::ACC_GYRO)
+            acc_gyro_calibration_step();
+        else if (mag_fresh)
+            mag_calibration_step(mag_count_last);
+        mag_fresh = false;
+    }
+
+    void acc_gyro_calibration_step()
+    {
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            calib_acc_sum[i] += a[i];
+            calib_acc_square_sum[i] += a[i] * a[i];
+            calib_gyro_sum[i] += g[i];
+            calib_gyro_square_sum[i] += g[i] * g[i];
+        }
+        const uint32_t n = ++calib_status.samples;
+        const uint32_t target = max((uint32_t)CALIB_STILL_MIN_SAMPLES, (uint32_t)(1.f / getFifoSamplePeriod()));
+        if (n % CALIB_STILL_CHECK_SAMPLES && n < target)
+        {
+            calib_status.progress = (float)n / target;
+            return;
+        }
+
+        // any motion restarts the window
+        float acc_deviation = 0.f, gyro_deviation = 0.f;
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            acc_deviation = max(acc_deviation, (float)sqrt(max(0., calib_acc_square_sum[i] / n - sq(calib_acc_sum[i] / n))));
+            gyro_deviation = max(gyro_deviation, (float)sqrt(max(0., calib_gyro_square_sum[i] / n - sq(calib_gyro_sum[i] / n))));
+        }
+        calib_status.gyro_noise = gyro_deviation;
+        if (acc_deviation > CALIB_STILL_ACC_G || gyro_deviation > CALIB_STILL_GYRO_DPS)
+        {
+            reset_still_window();
+            return;
+        }
+        calib_status.progress = (float)n / target;
+        if (n < target)
+            return;
+
+        // bias in the 2 g / 250 dps counts of acc_bias and gyro_bias, on top of the offsets already applied
+        float acc_mean[3], gyro_mean[3];
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            acc_mean[i] = calib_acc_sum[i] / n;
+            gyro_mean[i] = calib_gyro_sum[i] / n;
+        }
+        // gravity is removed from the axis closest to vertical, as calibrate_acc_gyro_impl does with z
+        uint8_t vertical = 0;
+        for (uint8_t i = 1; i < 3; ++i)
+            if (fabs(acc_mean[i]) > fabs(acc_mean[vertical]))
+                vertical = i;
+        acc_mean[vertical] -= (acc_mean[vertical] > 0.f) ? 1.f : -1.f;
+        float acc_residual[3];
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            acc_residual[i] = acc_mean[i] * (float)CALIB_ACCEL_SENSITIVITY;
+            gyro_bias[i] += gyro_mean[i] * (float)CALIB_GYRO_SENSITIVITY;
+        }
+
+        // write_accel_offset subtracts acc_bias from the offset registers as they are now
+        float acc_total[3];
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            acc_total[i] = acc_bias[i] + acc_residual[i];
+            acc_bias[i] = acc_residual[i];
+        }
+        write_accel_offset();
+        memcpy(acc_bias, acc_total, sizeof(acc_bias));
+        write_gyro_offset();
+
+        calib_status.progress = 1.f;
+        if (calib_mag_requested)
+            start_mag_calibration();
+        else
+            calib_status.state = MPU9250CalibrationState::DONE;
+    }
+
+    void mag_calibration_step(const int16_t *count)
+    {
+        // direction coverage: 6 cube faces split in 4 quadrants, around the center of the range seen so far
+        float v[3];
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            calib_mag_min[i] = min(calib_mag_min[i], count[i]);
+            calib_mag_max[i] = max(calib_mag_max[i], count[i]);
+            v[i] = count[i] - 0.5f * (calib_mag_min[i] + calib_mag_max[i]);
+        }
+        uint8_t axis = 0;
+        for (uint8_t i = 1; i < 3; ++i)
+            if (fabs(v[i]) > fabs(v[axis]))
+                axis = i;
+        const uint8_t bin = axis * 8 + (v[axis] < 0.f ? 4 : 0) + (v[(axis + 1) % 3] < 0.f ? 2 : 0) + (v[(axis + 2) % 3] < 0.f ? 1 : 0);
+        calib_bins |= (1UL << bin);
+
+        // normal equations of A x^2 + B y^2 + C z^2 + D x + E y + F z = 1
+        double phi[6];
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            const double x = count[i] * CALIB_MAG_COUNT_SCALE;
+            phi[i] = x * x;
+            phi[i + 3] = x;
+        }
+        for (uint8_t r = 0; r < 6; ++r)
+        {
+            for (uint8_t c = 0; c < 6; ++c)
+                calib_normal[r][c] += phi[r] * phi[c];
+            calib_normal[r][6] += phi[r];
+        }
+
+        const uint32_t n = ++calib_status.samples;
+        calib_status.coverage = (float)__builtin_popcount(calib_bins) / 24.f;
+        calib_status.progress = min((float)n / CALIB_MAG_MIN_SAMPLES, calib_status.coverage / CALIB_MAG_MIN_COVERAGE);
+        if (calib_status.progress > 0.99f)
+            calib_status.progress = 0.99f;
+        if (n < CALIB_MAG_MIN_SAMPLES || n % CALIB_MAG_SOLVE_SAMPLES)
+            return;
+
+        float center[3], radius[3];
+        if (!solve_ellipsoid(n, center, radius))
+            return;
+        if (calib_status.coverage < CALIB_MAG_MIN_COVERAGE || calib_status.fit_residual > CALIB_MAG_MAX_RESIDUAL)
+            return;
+
+        // same units as calibrate_mag_impl, which scale_mag expects: the bias in milliGauss, from counts at the current
+        // output bits, the scale relative to the mean radius
+        const float bias_resolution = Config::mag_resolution(mag_resolution);
+        float mean_radius = 0.f;
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            mag_bias[i] = center[i] * bias_resolution * mag_bias_factory[i];
+            radius[i] *= mag_bias_factory[i];
+            mean_radius += radius[i] / 3.f;
+        }
+        for (uint8_t i = 0; i < 3; ++i)
+            mag_scale[i] = mean_radius / radius[i];
+
+        calib_status.progress = 1.f;
+        calib_status.state = MPU9250CalibrationState::DONE;
+    }
+
+    // Solves the normal equations (Gaussian elimination with partial pivoting) and converts the quadric to an
+    // ellipsoid center and radii, in counts. Also sets the fit residual: RMS relative radius error.
+    bool solve_ellipsoid(const uint32_t n, float *center, float *radius)
+    {
+        double m[6][7];
+        memcpy(m, calib_normal, sizeof(m));
+        for (uint8_t c = 0; c < 6; ++c)
+        {
+            uint8_t pivot = c;
+            for (uint8_t r = c + 1; r < 6; ++r)
+                if (fabs(m[r][c]) > fabs(m[pivot][c]))
+                    pivot = r;
+            if (fabs(m[pivot][c]) < 1e-12)
+                return false;
+            for (uint8_t k = 0; k < 7; ++k)
+            {
+                double tmp = m[c][k];
+                m[c][k] = m[pivot][k];
+                m[pivot][k] = tmp;
+            }
+            for (uint8_t r = c + 1; r < 6; ++r)
+            {
+                const double f = m[r][c] / m[c][c];
+                for (uint8_t k = c; k < 7; ++k)
+                    m[r][k] -= f * m[c][k];
+            }
+        }
+        double p[6];
+        for (int8_t r = 5; r >= 0; --r)
+        {
+            double s = m[r][6];
+            for (uint8_t k = r + 1; k < 6; ++k)
+                s -= m[r][k] * p[k];
+            p[r] = s / m[r][r];
+        }
+
+        // A x^2 + B y^2 + C z^2 all of one sign: positive with the origin inside the ellipsoid, negative with a hard
+        // iron offset larger than the field, where the equation is the ellipsoid's scaled by a negative factor
+        double gain = 1.;
+        double c[3];
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            if (p[i] * p[0] <= 0.)
+                return false;
+            c[i] = -p[i + 3] / (2. * p[i]);
+            gain += p[i] * c[i] * c[i];
+        }
+        if (gain * p[0] <= 0.)
+            return false;
+
+        // sum of squared algebraic residuals: p' M p - 2 p' b + n
+        double square_sum = n;
+        for (uint8_t r = 0; r < 6; ++r)
+        {
+            for (uint8_t k = 0; k < 6; ++k)
+                square_sum += p[r] * calib_normal[r][k] * p[k];
+            square_sum -= 2. * p[r] * calib_normal[r][6];
+        }
+        calib_status.fit_residual = sqrt(max(0., square_sum) / n) / (2. * fabs(gain));
+
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            center[i] = c[i] / CALIB_MAG_COUNT_SCALE;
+            radius[i] = sqrt(gain / p[i]) / CALIB_MAG_COUNT_SCALE;
+        }
+        return true;
+    }
+
     // Accelerometer and gyroscope self test; check calibration wrt factory settings
     bool self_test_impl() // Should return percent deviation from factory trim values, +/- 14 or less deviation is a pass
     {
@@ -1004,110 +1894,30 @@ private:
         return b;
     }
 
-    float get_acc_resolution(const ACCEL_FS_SEL accel_af_sel) const
-    {
-        switch (accel_af_sel)
-        {
-        // Possible accelerometer scales (and their register bit settings) are:
-        // 2 Gs (00), 4 Gs (01), 8 Gs (10), and 16 Gs  (11).
-        // Here's a bit of an algorith to calculate DPS/(ADC tick) based on that 2-bit value:
-        case ACCEL_FS_SEL::A2G:
-            return 2.0 / 32768.0;
-        case ACCEL_FS_SEL::A4G:
-            return 4.0 / 32768.0;
-        case ACCEL_FS_SEL::A8G:
-            return 8.0 / 32768.0;
-        case ACCEL_FS_SEL::A16G:
-            return 16.0 / 32768.0;
-        default:
-            return 0.;
-        }
-    }
-
-    float get_gyro_resolution(const GYRO_FS_SEL gyro_fs_sel) const
-    {
-        switch (gyro_fs_sel)
-        {
-        // Possible gyro scales (and their register bit settings) are:
-        // 250 DPS (00), 500 DPS (01), 1000 DPS (10), and 2000 DPS  (11).
-        // Here's a bit of an algorith to calculate DPS/(ADC tick) based on that 2-bit value:
-        case GYRO_FS_SEL::G250DPS:
-            return 250.0 / 32768.0;
-        case GYRO_FS_SEL::G500DPS:
-            return 500.0 / 32768.0;
-        case GYRO_FS_SEL::G1000DPS:
-            return 1000.0 / 32768.0;
-        case GYRO_FS_SEL::G2000DPS:
-            return 2000.0 / 32768.0;
-        default:
-            return 0.;
-        }
-    }
-
-    float get_mag_resolution(const MAG_OUTPUT_BITS mag_output_bits) const
+    void write_byte(uint8_t address, uint8_t subAddress, uint8_t data)
     {
-        switch (mag_output_bits)
-        {
-        // Possible magnetometer scales (and their register bit settings) are:
-        // 14 bit resolution (0) and 16 bit resolution (1)
-        // Proper scale to return milliGauss
-        case MAG_OUTPUT_BITS::M14BITS:
-            return 10. * 4912. / 8190.0;
-        case MAG_OUTPUT_BITS::M16BITS:
-            return 10. * 4912. / 32760.0;
-        default:
-            return 0.;
-        }
+        bus.write_byte(address, subAddress, data);
     }
 
-    void write_byte(uint8_t address, uint8_t subAddress, uint8_t data)
+    // USER_CTRL goes through the transport, which adds the bits its bus needs (I2C_IF_DIS on SPI). keep_master asks
+    // it to leave the I2C master on if the AK8963 is only reachable through it.
+    void write_user_ctrl(const uint8_t value, const bool keep_master)
     {
-        wire->beginTransmission(address);   // Initialize the Tx buffer
-        wire->write(subAddress);            // Put slave register address in Tx buffer
-        wire->write(data);                  // Put data in Tx buffer
-        i2c_err_ = wire->endTransmission(); // Send the Tx buffer
-        if (i2c_err_)
-            print_i2c_error();
+        write_byte(mpu_i2c_addr, USER_CTRL, bus.user_ctrl(value, keep_master));
     }
 
     uint8_t read_byte(uint8_t address, uint8_t subAddress)
     {
-        uint8_t data = 0;                        // `data` will store the register data
-        wire->beginTransmission(address);        // Initialize the Tx buffer
-        wire->write(subAddress);                 // Put slave register address in Tx buffer
-        i2c_err_ = wire->endTransmission(false); // Send the Tx buffer, but send a restart to keep connection alive
-        if (i2c_err_)
-            print_i2c_error();
-        wire->requestFrom(address, (size_t)1); // Read one byte from slave register address
-        if (wire->available())
-            data = wire->read(); // Fill Rx buffer with result
-        return data;             // Return data read from slave register
+        return bus.read_byte(address, subAddress);
     }
 
     void read_bytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t *dest)
     {
-        wire->beginTransmission(address);        // Initialize the Tx buffer
-        wire->write(subAddress);                 // Put slave register address in Tx buffer
-        i2c_err_ = wire->endTransmission(false); // Send the Tx buffer, but send a restart to keep connection alive
-        if (i2c_err_)
-            print_i2c_error();
-        uint8_t i = 0;
-        wire->requestFrom(address, count); // Read bytes from slave register address
-        while (wire->available())
-        {
-            dest[i++] = wire->read();
-        } // Put read results in the Rx buffer
-    }
-
-    void print_i2c_error()
-    {
-        if (i2c_err_ == 7)
-            return; // to avoid stickbreaker-i2c branch's error code
-        Serial.print("I2C ERROR CODE : ");
-        Serial.println(i2c_err_);
+        bus.read_bytes(address, subAddress, count, dest);
     }
 };
 
 using MPU9250 = MPU9250_<TwoWire>;
+using MPU9250_SPI = MPU9250_<SPIClass, MPU9250SPIBus>;
 
 #endif // MPU9250_H
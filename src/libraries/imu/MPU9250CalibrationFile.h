@@ -0,0 +1,104 @@
+#pragma once
+#ifndef MPU9250CALIBRATIONFILE_H
+#define MPU9250CALIBRATIONFILE_H
+
+#include <FS.h>
+
+#include "MPU9250.h"
+
+// Calibration file of MPU9250_: the accel and gyro biases, the magnetometer bias and scale, with a CRC. Kept out of
+// MPU9250.h, so the driver builds without a file system.
+
+// Calibration file layout, see saveMPU9250Calibration
+struct MPU9250CalibrationRecord
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    float acc_bias[3];
+    float gyro_bias[3];
+    float mag_bias[3];
+    float mag_scale[3];
+    uint32_t crc;
+};
+
+static constexpr uint32_t MPU9250_CALIB_RECORD_MAGIC{0x43393250}; // "P29C"
+static constexpr uint16_t MPU9250_CALIB_RECORD_VERSION{1};
+
+inline uint32_t mpu9250_calibration_crc(const MPU9250CalibrationRecord &record)
+{
+    // CRC-32 of the record up to the crc field
+    const uint8_t *data = (const uint8_t *)&record;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < offsetof(MPU9250CalibrationRecord, crc); ++i)
+    {
+        crc ^= data[i];
+        for (uint8_t b = 0; b < 8; ++b)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+inline bool mpu9250_read_calibration_record(fs::FS &fs, const char *path, MPU9250CalibrationRecord &record)
+{
+    File file = fs.open(path, FILE_READ);
+    if (!file)
+        return false;
+    size_t read = file.read((uint8_t *)&record, sizeof(record));
+    file.close();
+    return read == sizeof(record) && record.magic == MPU9250_CALIB_RECORD_MAGIC &&
+           record.version == MPU9250_CALIB_RECORD_VERSION && record.size == sizeof(record) &&
+           record.crc == mpu9250_calibration_crc(record);
+}
+
+// Binary calibration file, e.g. saveMPU9250Calibration(mpu, SPIFFS)
+template <typename WireType, typename Transport, typename Config>
+bool saveMPU9250Calibration(const MPU9250_<WireType, Transport, Config> &mpu, fs::FS &fs, const char *path = "/mpu9250.cal")
+{
+    MPU9250CalibrationRecord record;
+    record.magic = MPU9250_CALIB_RECORD_MAGIC;
+    record.version = MPU9250_CALIB_RECORD_VERSION;
+    record.size = sizeof(record);
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        record.acc_bias[i] = mpu.getAccBias(i);
+        record.gyro_bias[i] = mpu.getGyroBias(i);
+        record.mag_bias[i] = mpu.getMagBias(i);
+        record.mag_scale[i] = mpu.getMagScale(i);
+    }
+    record.crc = mpu9250_calibration_crc(record);
+
+    // write a copy first, so that a reset while writing leaves the previous file intact
+    String tmp_path = String(path) + ".tmp";
+    File file = fs.open(tmp_path.c_str(), FILE_WRITE);
+    if (!file)
+        return false;
+    size_t written = file.write((const uint8_t *)&record, sizeof(record));
+    file.close();
+    if (written != sizeof(record))
+        return false;
+
+    fs.remove(path);
+    return fs.rename(tmp_path.c_str(), path);
+}
+
+// Applies a file written by saveMPU9250Calibration, after setup()
+template <typename WireType, typename Transport, typename Config>
+bool loadMPU9250Calibration(MPU9250_<WireType, Transport, Config> &mpu, fs::FS &fs, const char *path = "/mpu9250.cal")
+{
+    MPU9250CalibrationRecord record;
+    if (!mpu9250_read_calibration_record(fs, path, record))
+    {
+        String tmp_path = String(path) + ".tmp"; // reset between the removal of the file and the rename
+        if (!mpu9250_read_calibration_record(fs, tmp_path.c_str(), record))
+            return false;
+    }
+
+    mpu.setAccBias(record.acc_bias[0], record.acc_bias[1], record.acc_bias[2]);
+    mpu.setGyroBias(record.gyro_bias[0], record.gyro_bias[1], record.gyro_bias[2]);
+    mpu.setMagBias(record.mag_bias[0], record.mag_bias[1], record.mag_bias[2]);
+    mpu.setMagScale(record.mag_scale[0], record.mag_scale[1], record.mag_scale[2]);
+    return true;
+}
+
+#endif // MPU9250CALIBRATIONFILE_H
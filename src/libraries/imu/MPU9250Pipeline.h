@@ -0,0 +1,346 @@
+#pragma once
+#ifndef MPU9250PIPELINE_H
+#define MPU9250PIPELINE_H
+
+#include <atomic>
+
+#include "MPU9250.h"
+
+// Interrupt driven acquisition for MPU9250_. The INT pin wakes a task pinned to a core, which reads the sensor (or
+// drains the FIFO), runs the fusion and publishes the result to a seqlock protected MPU9250State. Other tasks read the
+// latest state without taking a lock and without touching the bus.
+//
+// The ISR only timestamps the interrupt and notifies the task, so it doesn't call into flash and keeps working while
+// SPIFFS writes disable the cache. While the pipeline runs it owns the MPU9250_: don't call update(), readFifo(), or
+// any other method reaching the bus from other tasks.
+
+// Single writer, many readers. The writer never waits, readers retry while a write is in progress (a few hundred ns).
+template <typename T>
+class MPU9250SeqLock
+{
+    std::atomic<uint32_t> sequence{0}; // odd while a write is in progress
+    T value{};
+
+public:
+    void write(const T &v)
+    {
+        const uint32_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        value = v;
+        std::atomic_thread_fence(std::memory_order_release);
+        sequence.store(s + 2, std::memory_order_relaxed);
+    }
+
+    // Returns false if no consistent copy could be made in max_attempts, which only happens if the writer is
+    // preempted in the middle of a write
+    bool read(T &v, const uint16_t max_attempts = 1000) const
+    {
+        for (uint16_t i = 0; i < max_attempts; ++i)
+        {
+            const uint32_t s = sequence.load(std::memory_order_acquire);
+            if (s & 1)
+                continue;
+            v = value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == s)
+                return true;
+        }
+        return false;
+    }
+
+    // Number of writes so far
+    uint32_t count() const { return sequence.load(std::memory_order_acquire) / 2; }
+};
+
+// Latest fused sample, in the units of the MPU9250_ getters
+struct MPU9250State
+{
+    uint32_t sequence;     // samples published since start(), 0 before the first one
+    uint32_t sample_time;  // time the sample was taken (data ready interrupt, or FIFO sample clock), micros() time
+    uint32_t publish_time; // time the fused result was published, micros() time
+    float acc[3];          // g
+    float gyro[3];         // dps
+    float mag[3];          // mG
+    float lin_acc[3];      // g, gravity removed
+    float q[4];            // w, x, y, z
+    float rpy[3];          // degrees
+};
+
+struct MPU9250PipelineStats
+{
+    uint32_t interrupts;      // data ready interrupts seen by the ISR since start()
+    uint32_t wakeups;         // task wake-ups that read the sensor, on interrupt or on timeout
+    uint32_t timeouts;        // of which on timeout: interrupt missed, or INT pin not connected
+    uint32_t samples;         // samples fused
+    uint32_t missed;          // without the FIFO, interrupts coalesced into one read: samples lost
+    float wake_mean_us;       // interrupt to task running
+    float wake_max_us;
+    float latency_mean_us;    // sample to published orientation, end to end
+    float latency_max_us;
+    uint32_t task_stack_free; // bytes never used by the task
+};
+
+template <typename MPU>
+class MPU9250Pipeline
+{
+    static constexpr uint32_t DEFAULT_STACK{4096};
+    static constexpr uint32_t WAKE_TIMEOUT_MS{100}; // polls the sensor anyway if no interrupt comes
+    static constexpr uint32_t STOP_TIMEOUT_MS{500};
+
+    MPU *mpu{nullptr};
+    int8_t int_pin{-1};
+    bool use_fifo{false};
+    uint8_t fifo_batch{1};
+
+    TaskHandle_t task{nullptr};
+    volatile bool running{false};
+    volatile bool stats_reset_requested{false};
+
+    // written by the ISR
+    volatile uint32_t irq_time{0};
+    volatile uint32_t irq_count{0};
+
+    uint32_t irq_seen{0};
+    uint8_t pending{0};
+    uint32_t wake_count{0};
+    uint32_t publish_count{0};
+    MPU9250SeqLock<MPU9250State> state;
+    MPU9250SeqLock<MPU9250PipelineStats> stats;
+    MPU9250PipelineStats task_stats{};
+    double wake_sum{0.};
+    double latency_sum{0.};
+
+public:
+    MPU9250Pipeline(MPU &m) : mpu(&m) {}
+    ~MPU9250Pipeline() { stop(); }
+
+    // Starts the acquisition task. The INT pin must be wired to an ESP32 GPIO, and the MPU9250_ set up beforehand.
+    // With fifo, streaming is started with beginFifo(with_mag) and the FIFO is drained every batch samples, otherwise
+    // the INT pin is switched to pulses (setDataReadyPulse) and each interrupt reads one sample with update().
+    bool start(const uint8_t pin, const bool fifo = false, const bool with_mag = true, const uint8_t batch = 1,
+               const BaseType_t core = 1, const UBaseType_t priority = 5, const uint32_t stack = DEFAULT_STACK)
+    {
+        // not isConnected(): once set up, the AK8963 is off the I2C bus (no bypass), and its failed probe would mark
+        // the MPU9250_ disconnected
+        if (running || !mpu->isConnectedMPU9250())
+            return false;
+
+        int_pin = pin;
+        use_fifo = fifo;
+        fifo_batch = batch ? batch : 1;
+        if (use_fifo && !mpu->beginFifo(with_mag))
+            return false;
+        if (!use_fifo)
+            mpu->setDataReadyPulse(true);
+
+        irq_count = 0;
+        irq_seen = 0;
+        pending = 0;
+        state.write(MPU9250State{});
+        reset_task_stats();
+
+        running = true;
+        if (xTaskCreatePinnedToCore(task_entry, "MPU9250", stack, this, priority, &task, core) != pdPASS)
+        {
+            running = false;
+            task = nullptr;
+            restore_sensor();
+            return false;
+        }
+
+        pinMode(int_pin, INPUT);
+        attachInterruptArg(digitalPinToInterrupt(int_pin), on_data_ready, this, RISING);
+        return true;
+    }
+
+    // Stops the task and the interrupt, and the FIFO if it was started by start(). Safe to call when not running.
+    // A task still busy after STOP_TIMEOUT_MS is deleted, and the sensor isn't touched.
+    void stop()
+    {
+        if (!running)
+            return;
+
+        detachInterrupt(digitalPinToInterrupt(int_pin));
+        running = false;
+        xTaskNotifyGive(task);
+        const uint32_t start_ms = millis();
+        while (task != nullptr && millis() - start_ms < STOP_TIMEOUT_MS)
+            vTaskDelay(1);
+
+        const TaskHandle_t stuck = task;
+        if (stuck != nullptr)
+        {
+            // most likely in a bus transaction: delete it so it can't outlive the pipeline, and leave the sensor as
+            // it is, the bus state is unknown
+            vTaskDelete(stuck);
+            task = nullptr;
+            return;
+        }
+        restore_sensor();
+    }
+
+    bool isRunning() const { return running; }
+
+    // Copies the latest fused sample, without blocking. Returns false before the first sample.
+    bool read(MPU9250State &s) const
+    {
+        return state.read(s) && s.sequence != 0;
+    }
+
+    MPU9250PipelineStats getStats() const
+    {
+        MPU9250PipelineStats s{};
+        stats.read(s);
+        s.interrupts = irq_count;
+        return s;
+    }
+
+    // Applied by the task at its next wake-up
+    void resetStats() { stats_reset_requested = true; }
+
+private:
+    static void IRAM_ATTR on_data_ready(void *arg)
+    {
+        MPU9250Pipeline *self = static_cast<MPU9250Pipeline *>(arg);
+        self->irq_time = micros();
+        self->irq_count = self->irq_count + 1;
+
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(self->task, &woken);
+        if (woken)
+            portYIELD_FROM_ISR();
+    }
+
+    static void task_entry(void *arg)
+    {
+        MPU9250Pipeline *self = static_cast<MPU9250Pipeline *>(arg);
+        self->run();
+        self->task = nullptr;
+        vTaskDelete(nullptr);
+    }
+
+    void run()
+    {
+        while (running)
+        {
+            const uint32_t notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WAKE_TIMEOUT_MS));
+            if (!running)
+                break;
+
+            const uint32_t wake_time = micros();
+            const uint32_t count = irq_count;
+            const uint32_t time = irq_time;
+            const uint32_t interrupts = count - irq_seen;
+            irq_seen = count;
+
+            if (stats_reset_requested)
+            {
+                stats_reset_requested = false;
+                reset_task_stats();
+            }
+
+            if (notified == 0)
+            {
+                task_stats.timeouts++;
+            }
+            else if (interrupts > 0)
+            {
+                add_wake(wake_time - time);
+                if (use_fifo)
+                {
+                    // batch the bus transactions, the FIFO keeps the samples meanwhile
+                    pending = (pending + interrupts > 0xFF) ? 0xFF : pending + interrupts;
+                    if (pending < fifo_batch)
+                        continue;
+                }
+                else if (interrupts > 1)
+                {
+                    task_stats.missed += interrupts - 1;
+                }
+                mpu->notifyDataReady(time);
+            }
+            pending = 0;
+            task_stats.wakeups++;
+
+            if (use_fifo)
+            {
+                uint32_t n = 0;
+                while (mpu->updateFromFifo())
+                    ++n;
+                if (n > 0)
+                    publish(n, true);
+            }
+            else if (mpu->update())
+            {
+                // without an interrupt, update() had no data ready time to stamp the sample with
+                publish(1, interrupts > 0);
+            }
+
+            task_stats.task_stack_free = uxTaskGetStackHighWaterMark(nullptr) * sizeof(StackType_t);
+            stats.write(task_stats);
+        }
+    }
+
+    void publish(const uint32_t n, const bool timed)
+    {
+        const uint32_t read_time = micros();
+        MPU9250State s;
+        s.sequence = task_stats.samples + n;
+        s.sample_time = timed ? mpu->getSampleTime() : read_time;
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            s.acc[i] = mpu->getAcc(i);
+            s.gyro[i] = mpu->getGyro(i);
+            s.mag[i] = mpu->getMag(i);
+            s.lin_acc[i] = mpu->getLinearAcc(i);
+        }
+        s.q[0] = mpu->getQuaternionW();
+        s.q[1] = mpu->getQuaternionX();
+        s.q[2] = mpu->getQuaternionY();
+        s.q[3] = mpu->getQuaternionZ();
+        s.rpy[0] = mpu->getRoll();
+        s.rpy[1] = mpu->getPitch();
+        s.rpy[2] = mpu->getYaw();
+        s.publish_time = micros();
+        state.write(s);
+
+        task_stats.samples += n;
+        if (!timed)
+            return;
+        // the FIFO sample clock is smoothed, the newest timestamp may be a few us ahead of micros()
+        const float latency = max(0.f, (float)(int32_t)(s.publish_time - s.sample_time));
+        latency_sum += latency;
+        task_stats.latency_mean_us = latency_sum / ++publish_count;
+        if (latency > task_stats.latency_max_us)
+            task_stats.latency_max_us = latency;
+    }
+
+    void add_wake(const uint32_t us)
+    {
+        wake_sum += us;
+        task_stats.wake_mean_us = wake_sum / ++wake_count;
+        if (us > task_stats.wake_max_us)
+            task_stats.wake_max_us = us;
+    }
+
+    void reset_task_stats()
+    {
+        task_stats = {};
+        wake_sum = 0.;
+        latency_sum = 0.;
+        wake_count = 0;
+        publish_count = 0;
+        stats.write(task_stats);
+    }
+
+    void restore_sensor()
+    {
+        if (use_fifo)
+            mpu->endFifo();
+        else
+            mpu->setDataReadyPulse(false);
+    }
+};
+
+#endif // MPU9250PIPELINE_H
@@ -0,0 +1,242 @@
+#pragma once
+#ifndef MPU9250TRANSPORT_H
+#define MPU9250TRANSPORT_H
+
+#include <Wire.h>
+#include <SPI.h>
+
+#include "MPU9250RegisterMap.h"
+
+// Bus policies for MPU9250_. A transport gives register access to the MPU9250 and to the AK8963 magnetometer
+// (selected by address, like on the I2C bus), and keeps track of the time spent on the bus.
+
+struct MPU9250BusStats
+{
+    uint32_t transactions; // register reads and writes
+    uint32_t bytes;        // data bytes transferred, register addresses excluded
+    uint32_t time_us;      // time spent in transactions
+};
+
+// I2C through a Wire compatible WireType. The AK8963 is accessed directly, with the MPU9250 in bypass mode.
+template <typename WireType>
+class MPU9250I2CBus
+{
+    WireType *wire{nullptr};
+    uint8_t i2c_err_{0};
+    MPU9250BusStats stats{0, 0, 0};
+
+public:
+    static constexpr uint8_t MAX_BURST{128}; // bytes per read, size of the Wire buffer
+
+    void attach(WireType &w)
+    {
+        wire = &w;
+    }
+
+    void write_byte(uint8_t address, uint8_t subAddress, uint8_t data)
+    {
+        uint32_t start = micros();
+        wire->beginTransmission(address);   // Initialize the Tx buffer
+        wire->write(subAddress);            // Put slave register address in Tx buffer
+        wire->write(data);                  // Put data in Tx buffer
+        i2c_err_ = wire->endTransmission(); // Send the Tx buffer
+        if (i2c_err_)
+            print_i2c_error();
+        add_transaction(1, start);
+    }
+
+    uint8_t read_byte(uint8_t address, uint8_t subAddress)
+    {
+        uint8_t data = 0; // `data` will store the register data
+        read_bytes(address, subAddress, 1, &data);
+        return data; // Return data read from slave register
+    }
+
+    void read_bytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t *dest)
+    {
+        uint32_t start = micros();
+        wire->beginTransmission(address);        // Initialize the Tx buffer
+        wire->write(subAddress);                 // Put slave register address in Tx buffer
+        i2c_err_ = wire->endTransmission(false); // Send the Tx buffer, but send a restart to keep connection alive
+        if (i2c_err_)
+            print_i2c_error();
+        uint8_t i = 0;
+        wire->requestFrom(address, count); // Read bytes from slave register address
+        while (wire->available() && i < count)
+        {
+            dest[i++] = wire->read();
+        } // Put read results in the Rx buffer
+        add_transaction(count, start);
+    }
+
+    // USER_CTRL value to write for the driver's `value`: nothing to add on I2C
+    uint8_t user_ctrl(const uint8_t value, const bool /*keep_master*/) const { return value; }
+
+    const MPU9250BusStats &get_stats() const { return stats; }
+    void reset_stats() { stats = {0, 0, 0}; }
+
+private:
+    void add_transaction(uint8_t count, uint32_t start)
+    {
+        stats.transactions++;
+        stats.bytes += count;
+        stats.time_us += micros() - start;
+    }
+
+    void print_i2c_error()
+    {
+        if (i2c_err_ == 7)
+            return; // to avoid stickbreaker-i2c branch's error code
+        Serial.print("I2C ERROR CODE : ");
+        Serial.println(i2c_err_);
+    }
+};
+
+// SPI, mode 3. Registers are written and read at 1 MHz, sensor, interrupt status and FIFO registers are read at
+// 20 MHz, as allowed by the datasheet. There is no bypass mode over SPI: the AK8963 is reached through the internal
+// I2C master, one byte at a time with slave 4, so streaming the magnetometer through the FIFO is much faster.
+class MPU9250SPIBus
+{
+    SPIClass *spi{nullptr};
+    uint8_t cs_pin{0};
+    uint8_t mpu_address{0x68}; // address the driver uses for the MPU9250, any other one is an aux device
+    SPISettings register_settings{1000000, MSBFIRST, SPI_MODE3};
+    SPISettings data_settings{20000000, MSBFIRST, SPI_MODE3};
+    MPU9250BusStats stats{0, 0, 0};
+
+    static constexpr uint32_t AUX_TIMEOUT_US{2000}; // a single byte at 400 kHz takes about 50 us
+
+public:
+    static constexpr uint8_t MAX_BURST{255}; // bytes per read, limited by the driver's uint8_t counts
+
+    void attach(SPIClass &s, const uint8_t cs, const uint8_t address)
+    {
+        spi = &s;
+        cs_pin = cs;
+        mpu_address = address;
+        pinMode(cs_pin, OUTPUT);
+        digitalWrite(cs_pin, HIGH);
+    }
+
+    void set_clocks(const uint32_t register_clock, const uint32_t data_clock)
+    {
+        register_settings = SPISettings(register_clock, MSBFIRST, SPI_MODE3);
+        data_settings = SPISettings(data_clock, MSBFIRST, SPI_MODE3);
+    }
+
+    void write_byte(uint8_t address, uint8_t subAddress, uint8_t data)
+    {
+        if (address == mpu_address)
+            write_register(subAddress, data);
+        else
+            aux_transaction(address, subAddress, data, false);
+    }
+
+    uint8_t read_byte(uint8_t address, uint8_t subAddress)
+    {
+        uint8_t data = 0;
+        read_bytes(address, subAddress, 1, &data);
+        return data;
+    }
+
+    void read_bytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t *dest)
+    {
+        if (address == mpu_address)
+        {
+            read_registers(subAddress, count, dest);
+            return;
+        }
+
+        for (uint8_t i = 0; i < count; ++i)
+            dest[i] = aux_transaction(address, subAddress + i, 0, true);
+    }
+
+    // USER_CTRL value to write for the driver's `value`: I2C_IF_DIS always, and I2C_MST_EN when the driver keeps the
+    // AK8963 reachable, since slave 4 is the only way to it
+    uint8_t user_ctrl(const uint8_t value, const bool keep_master) const
+    {
+        return value | 0x10 | (keep_master ? 0x20 : 0x00);
+    }
+
+    const MPU9250BusStats &get_stats() const { return stats; }
+    void reset_stats() { stats = {0, 0, 0}; }
+
+private:
+    static bool is_data_register(const uint8_t reg)
+    {
+        return (reg >= INT_STATUS && reg <= EXT_SENS_DATA_23) || (reg >= FIFO_COUNTH && reg <= FIFO_R_W);
+    }
+
+    void write_register(uint8_t reg, uint8_t data)
+    {
+        uint32_t start = micros();
+        spi->beginTransaction(register_settings);
+        digitalWrite(cs_pin, LOW);
+        spi->transfer(reg & 0x7F);
+        spi->transfer(data);
+        digitalWrite(cs_pin, HIGH);
+        spi->endTransaction();
+        add_transaction(1, start);
+    }
+
+    void read_registers(uint8_t reg, uint8_t count, uint8_t *dest)
+    {
+        uint32_t start = micros();
+        memset(dest, 0, count);
+        spi->beginTransaction(is_data_register(reg) ? data_settings : register_settings);
+        digitalWrite(cs_pin, LOW);
+        spi->transfer(reg | 0x80);
+        spi->transfer(dest, count);
+        digitalWrite(cs_pin, HIGH);
+        spi->endTransaction();
+        add_transaction(count, start);
+    }
+
+    uint8_t read_register(uint8_t reg)
+    {
+        uint8_t data = 0;
+        read_registers(reg, 1, &data);
+        return data;
+    }
+
+    // Single byte access to an aux device through I2C master slave 4
+    uint8_t aux_transaction(uint8_t address, uint8_t reg, uint8_t data, bool read)
+    {
+        // the driver disables the master at times (calibration, end of FIFO streaming)
+        uint8_t user_ctrl = read_register(USER_CTRL);
+        if (!(user_ctrl & 0x20))
+        {
+            write_register(I2C_MST_CTRL, 0x0D);          // 400 kHz
+            write_register(USER_CTRL, user_ctrl | 0x30); // I2C_MST_EN, and I2C_IF_DIS while on SPI
+        }
+
+        write_register(I2C_SLV4_ADDR, read ? (0x80 | address) : address);
+        write_register(I2C_SLV4_REG, reg);
+        if (!read)
+            write_register(I2C_SLV4_DO, data);
+        write_register(I2C_SLV4_CTRL, 0x80); // Start the transfer
+
+        uint32_t start = micros();
+        uint8_t status = 0;
+        while (!(status & 0x40)) // SLV4_DONE
+        {
+            if (micros() - start > AUX_TIMEOUT_US)
+                return 0;
+            status = read_register(I2C_MST_STATUS);
+        }
+
+        if (status & 0x10) // SLV4_NACK
+            return 0;
+
+        return read ? read_register(I2C_SLV4_DI) : 0;
+    }
+
+    void add_transaction(uint8_t count, uint32_t start)
+    {
+        stats.transactions++;
+        stats.bytes += count;
+        stats.time_us += micros() - start;
+    }
+};
+
+#endif // MPU9250TRANSPORT_H
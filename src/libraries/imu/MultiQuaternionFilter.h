@@ -0,0 +1,239 @@
+#pragma once
+#ifndef MULTIQUATERNIONFILTER_H
+#define MULTIQUATERNIONFILTER_H
+
+#include "QuaternionFilter.h"
+
+// Fusion of N IMUs on the same board, mounted with the same orientation (or with samples already rotated to a
+// common frame). Every sensor keeps its own filter state. update() runs the single precision kernel of the selected
+// filter over all sensors in one pass, on a structure of arrays layout so that the loop walks contiguous memory.
+// The N estimates can then be combined into one, for redundancy:
+//
+//     MultiQuaternionFilter<3> fusion;
+//     fusion.set_combine(MultiImuCombine::VOTE, 5.f);
+//     ...
+//     if (mpu0.update()) fusion.set_sample(0, mpu0);
+//     if (mpu1.update()) fusion.set_sample(1, mpu1);
+//     if (mpu2.update()) fusion.set_sample(2, mpu2);
+//     fusion.update(dt);
+//     const float* q = fusion.get_fused_quaternion();
+
+enum class MultiImuCombine {
+    NONE,     // no combined estimate
+    AVERAGE,  // normalised mean of the estimates of all enabled sensors
+    VOTE,     // mean of the estimates close to the one the others agree most with, outliers are left out
+};
+
+template <size_t N>
+class MultiQuaternionFilter {
+    static_assert(N > 0 && N <= 32, "sensors are tracked with 32 bit masks");
+
+    // latest samples, in the frame QuaternionFilter expects (North, East, Down), gyro in rad/s
+    float ax[N], ay[N], az[N];
+    float gx[N], gy[N], gz[N];
+    float mx[N], my[N], mz[N];
+
+    // per sensor filter state
+    float q0[N], q1[N], q2[N], q3[N];
+    float ix[N], iy[N], iz[N];
+
+    uint32_t fresh_mask{0};  // sensors with a new sample since the last update
+    uint32_t enabled_mask{(N == 32) ? 0xFFFFFFFF : ((1UL << N) - 1)};
+    uint32_t outlier_mask{0};  // sensors left out by the last vote
+
+    QuatFilterSel filter_sel{QuatFilterSel::MADGWICK_FAST};
+    float beta = sqrt(3.0f / 4.0f) * PI * (40.0f / 180.0f);  // same defaults as QuaternionFilter
+    float Kp = 30.0;
+    float Ki = 0.0;
+
+    MultiImuCombine combine{MultiImuCombine::AVERAGE};
+    float vote_min_dot{0.f};  // |q1.q2| for the vote threshold, cos(angle / 2)
+    float fused[4]{1.f, 0.f, 0.f, 0.f};
+
+public:
+    MultiQuaternionFilter() {
+        set_combine(combine, 5.f);
+        reset();
+    }
+
+    // Every selection runs the single precision kernels: MADGWICK selects MADGWICK_FAST, MAHONY, MAHONY_FIXED and
+    // MAHONY_MAG select MAHONY_FAST.
+    void select_filter(QuatFilterSel sel) {
+        switch (sel) {
+            case QuatFilterSel::NONE:
+                filter_sel = QuatFilterSel::NONE;
+                break;
+            case QuatFilterSel::MAHONY:
+            case QuatFilterSel::MAHONY_FAST:
+            case QuatFilterSel::MAHONY_FIXED:
+            case QuatFilterSel::MAHONY_MAG:
+                filter_sel = QuatFilterSel::MAHONY_FAST;
+                break;
+            default:
+                filter_sel = QuatFilterSel::MADGWICK_FAST;
+                break;
+        }
+    }
+
+    void set_madgwick_beta(const float b) { beta = b; }
+    void set_mahony_gains(const float kp, const float ki) {
+        Kp = kp;
+        Ki = ki;
+    }
+
+    void set_combine(MultiImuCombine mode, const float vote_threshold_deg = 5.f) {
+        combine = mode;
+        vote_min_dot = cosf(0.5f * vote_threshold_deg * (float)PI / 180.f);
+    }
+
+    // A disabled sensor is neither updated nor combined, e.g. after a bus error
+    void enable(const size_t i, const bool en) {
+        if (i >= N) return;
+        if (en)
+            enabled_mask |= (1UL << i);
+        else
+            enabled_mask &= ~(1UL << i);
+    }
+
+    void reset() {
+        for (size_t i = 0; i < N; ++i) {
+            q0[i] = 1.f;
+            q1[i] = q2[i] = q3[i] = 0.f;
+            ix[i] = iy[i] = iz[i] = 0.f;
+        }
+        fresh_mask = 0;
+        outlier_mask = 0;
+        fused[0] = 1.f;
+        fused[1] = fused[2] = fused[3] = 0.f;
+    }
+
+    // Sample already in the filter frame, gyro in rad/s
+    void set_sample(const size_t i, float an, float ae, float ad, float gn, float ge, float gd, float mn, float me, float md) {
+        if (i >= N) return;
+        ax[i] = an;
+        ay[i] = ae;
+        az[i] = ad;
+        gx[i] = gn;
+        gy[i] = ge;
+        gz[i] = gd;
+        mx[i] = mn;
+        my[i] = me;
+        mz[i] = md;
+        fresh_mask |= (1UL << i);
+    }
+
+    // Latest sample of an MPU9250_, converted as in MPU9250_::update_quaternion
+    template <typename Imu>
+    void set_sample(const size_t i, const Imu& imu) {
+        const float deg_to_rad = (float)PI / 180.f;
+        set_sample(i, -imu.getAccX(), imu.getAccY(), imu.getAccZ(),
+                   imu.getGyroX() * deg_to_rad, -imu.getGyroY() * deg_to_rad, -imu.getGyroZ() * deg_to_rad,
+                   imu.getMagY(), -imu.getMagX(), imu.getMagZ());
+    }
+
+    // Runs the filter of every enabled sensor with a new sample, then combines the estimates
+    void update(const float dt) {
+        const uint32_t mask = fresh_mask & enabled_mask;
+        switch (filter_sel) {
+            case QuatFilterSel::MAHONY_FAST:
+                for (size_t i = 0; i < N; ++i) {
+                    if (!(mask & (1UL << i))) continue;
+                    QuaternionFilter::mahony_step(ax[i], ay[i], az[i], gx[i], gy[i], gz[i],
+                                                  q0[i], q1[i], q2[i], q3[i], ix[i], iy[i], iz[i], Kp, Ki, dt);
+                }
+                break;
+            case QuatFilterSel::NONE:
+                for (size_t i = 0; i < N; ++i) {
+                    if (!(mask & (1UL << i))) continue;
+                    QuaternionFilter::gyro_step(gx[i], gy[i], gz[i], q0[i], q1[i], q2[i], q3[i], dt);
+                }
+                break;
+            default:
+                for (size_t i = 0; i < N; ++i) {
+                    if (!(mask & (1UL << i))) continue;
+                    QuaternionFilter::madgwick_step(ax[i], ay[i], az[i], gx[i], gy[i], gz[i], mx[i], my[i], mz[i],
+                                                    q0[i], q1[i], q2[i], q3[i], beta, dt);
+                }
+                break;
+        }
+        fresh_mask = 0;
+
+        if (combine == MultiImuCombine::AVERAGE)
+            average(enabled_mask, first(enabled_mask));
+        else if (combine == MultiImuCombine::VOTE)
+            vote();
+    }
+
+    void get_quaternion(const size_t i, float* q) const {
+        if (i >= N) return;
+        q[0] = q0[i];
+        q[1] = q1[i];
+        q[2] = q2[i];
+        q[3] = q3[i];
+    }
+
+    const float* get_fused_quaternion() const { return fused; }
+    uint32_t get_outliers() const { return outlier_mask; }
+    uint32_t get_enabled() const { return enabled_mask; }
+
+private:
+    static size_t first(const uint32_t mask) {
+        for (size_t i = 0; i < N; ++i)
+            if (mask & (1UL << i)) return i;
+        return N;
+    }
+
+    float abs_dot(const size_t i, const size_t j) const {
+        return fabsf(q0[i] * q0[j] + q1[i] * q1[j] + q2[i] * q2[j] + q3[i] * q3[j]);
+    }
+
+    // Normalised sum of the selected estimates, each flipped to the hemisphere of the reference one since q and -q
+    // are the same orientation. Close enough to the true mean for estimates a few degrees apart.
+    void average(const uint32_t mask, const size_t reference) {
+        if (reference >= N) return;
+        float sum[4]{0.f, 0.f, 0.f, 0.f};
+        for (size_t i = 0; i < N; ++i) {
+            if (!(mask & (1UL << i))) continue;
+            const float dot = q0[i] * q0[reference] + q1[i] * q1[reference] + q2[i] * q2[reference] + q3[i] * q3[reference];
+            const float sign = (dot < 0.f) ? -1.f : 1.f;
+            sum[0] += sign * q0[i];
+            sum[1] += sign * q1[i];
+            sum[2] += sign * q2[i];
+            sum[3] += sign * q3[i];
+        }
+        const float norm_sq = sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2] + sum[3] * sum[3];
+        if (norm_sq == 0.f) return;
+        const float recipNorm = 1.f / sqrtf(norm_sq);
+        for (int k = 0; k < 4; ++k)
+            fused[k] = sum[k] * recipNorm;
+    }
+
+    // The medoid, the estimate closest to all others, is taken as the majority's opinion. Estimates further than
+    // the vote threshold from it are outliers. With two sensors there is no majority: both are averaged when they
+    // agree, and the fused estimate is held when they don't.
+    void vote() {
+        size_t medoid = N;
+        float best = -1.f;
+        for (size_t i = 0; i < N; ++i) {
+            if (!(enabled_mask & (1UL << i))) continue;
+            float closeness = 0.f;
+            for (size_t j = 0; j < N; ++j)
+                if ((enabled_mask & (1UL << j)) && j != i) closeness += abs_dot(i, j);
+            if (closeness > best) {
+                best = closeness;
+                medoid = i;
+            }
+        }
+        if (medoid == N) return;
+
+        uint32_t agree = 0;
+        for (size_t i = 0; i < N; ++i)
+            if ((enabled_mask & (1UL << i)) && abs_dot(i, medoid) >= vote_min_dot) agree |= (1UL << i);
+        outlier_mask = enabled_mask & ~agree;
+
+        if (outlier_mask && __builtin_popcount(enabled_mask) == 2) return;
+        average(agree, medoid);
+    }
+};
+
+#endif  // MULTIQUATERNIONFILTER_H
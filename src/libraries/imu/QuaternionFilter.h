@@ -2,10 +2,41 @@
 #ifndef QUATERNIONFILTER_H
 #define QUATERNIONFILTER_H
 
+#ifdef ARDUINO
+#include <Arduino.h>
+#else  // host builds, for offline processing and benchmarks
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+inline uint32_t micros() {
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// MADGWICK and MAHONY are the reference implementations, computed partly in double precision.
+// The _FAST variants compute the same filters in single precision only, with a fast reciprocal square root,
+// which is what the ESP32 FPU supports. MAHONY_FIXED is a Q-format integer version of Mahony, for cores without FPU.
+// MAHONY_MAG also feeds the magnetometer back, like the Mahony filter of the former SparkFun based driver (which used
+// set_mahony_gains(10.f, 0.f)): MAHONY and its variants only correct roll and pitch, and leave yaw to the gyro.
 enum class QuatFilterSel {
     NONE,
     MADGWICK,
     MAHONY,
+    MADGWICK_FAST,
+    MAHONY_FAST,
+    MAHONY_FIXED,
+    MAHONY_MAG,
+};
+
+// Integration state of a filter, one per instance so that several sensors can be fused independently
+struct QuatFilterState {
+    float integral[3];          // mahony integral feedback terms, rad/s
+    int32_t integral_fixed[3];  // the same for MAHONY_FIXED, Q20
 };
 
 class QuaternionFilter {
@@ -19,6 +50,8 @@ class QuaternionFilter {
     float Kp = 30.0;
     float Ki = 0.0;
 
+    QuatFilterState state{{0.f, 0.f, 0.f}, {0, 0, 0}};
+
     QuatFilterSel filter_sel{QuatFilterSel::MADGWICK};
     double deltaT{0.};
     uint32_t newTime{0}, oldTime{0};
@@ -28,26 +61,119 @@ public:
         filter_sel = sel;
     }
 
+    // beta and zeta as in Madgwick's paper, zeta is not used by these kernels (no gyro bias drift compensation)
+    void set_madgwick_gains(const float b, const float z) {
+        beta = b;
+        zeta = z;
+    }
+
+    void set_mahony_gains(const float kp, const float ki) {
+        Kp = kp;
+        Ki = ki;
+    }
+
+    float get_madgwick_beta() const { return beta; }
+    float get_madgwick_zeta() const { return zeta; }
+    float get_mahony_kp() const { return Kp; }
+    float get_mahony_ki() const { return Ki; }
+
+    void reset_state() {
+        state = {{0.f, 0.f, 0.f}, {0, 0, 0}};
+    }
+
+    const QuatFilterState& get_state() const {
+        return state;
+    }
+
     void update(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q) {
         newTime = micros();
         deltaT = newTime - oldTime;
         oldTime = newTime;
         deltaT = fabs(deltaT * 0.001 * 0.001);
 
+        filter(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+    }
+
+    // for samples read in bursts (e.g. from the FIFO), where the time between calls is not the sample period
+    void update(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q, double dt) {
+        oldTime = micros();
+        deltaT = dt;
+
+        filter(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+    }
+
+    void filter(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q) {
         switch (filter_sel) {
+            case QuatFilterSel::MADGWICK:
+                filter_as<QuatFilterSel::MADGWICK>(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            case QuatFilterSel::MAHONY:
+                filter_as<QuatFilterSel::MAHONY>(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            case QuatFilterSel::MADGWICK_FAST:
+                filter_as<QuatFilterSel::MADGWICK_FAST>(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            case QuatFilterSel::MAHONY_FAST:
+                filter_as<QuatFilterSel::MAHONY_FAST>(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            case QuatFilterSel::MAHONY_FIXED:
+                filter_as<QuatFilterSel::MAHONY_FIXED>(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            case QuatFilterSel::MAHONY_MAG:
+                filter_as<QuatFilterSel::MAHONY_MAG>(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            default:
+                filter_as<QuatFilterSel::NONE>(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+        }
+    }
+
+    // update() with the filter fixed at compile time instead of by select_filter: only the selected kernel is built.
+    // dt <= 0 measures the time since the previous call.
+    template <QuatFilterSel SEL>
+    void update_as(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q, double dt) {
+        if (dt > 0.) {
+            oldTime = micros();
+            deltaT = dt;
+        } else {
+            newTime = micros();
+            deltaT = newTime - oldTime;
+            oldTime = newTime;
+            deltaT = fabs(deltaT * 0.001 * 0.001);
+        }
+
+        filter_as<SEL>(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+    }
+
+    // The kernel of SEL, on deltaT. filter() and update_as() both go through it, the switch is resolved by the compiler
+    template <QuatFilterSel SEL>
+    void filter_as(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q) {
+        switch (SEL) {
             case QuatFilterSel::MADGWICK:
                 madgwick(ax, ay, az, gx, gy, gz, mx, my, mz, q);
                 break;
             case QuatFilterSel::MAHONY:
                 mahony(ax, ay, az, gx, gy, gz, mx, my, mz, q);
                 break;
+            case QuatFilterSel::MADGWICK_FAST:
+                madgwick_fast(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            case QuatFilterSel::MAHONY_FAST:
+                mahony_fast(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            case QuatFilterSel::MAHONY_FIXED:
+                mahony_fixed(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
+            case QuatFilterSel::MAHONY_MAG:
+                mahony_mag(ax, ay, az, gx, gy, gz, mx, my, mz, q);
+                break;
             default:
                 no_filter(ax, ay, az, gx, gy, gz, mx, my, mz, q);
                 break;
         }
     }
 
-    void no_filter(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q) {
+    void no_filter(float /*ax*/, float /*ay*/, float /*az*/, float gx, float gy, float gz, float /*mx*/, float /*my*/, float /*mz*/, float* q) {
         float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];  // variable for readability
         q[0] += 0.5f * (-q1 * gx - q2 * gy - q3 * gz) * deltaT;
         q[1] += 0.5f * (q0 * gx + q2 * gz - q3 * gy) * deltaT;
@@ -168,12 +294,12 @@ public:
     // float Ki = 0.0;
     // with MPU-9250, angles start oscillating at Kp=40. Ki does not seem to help and is not required.
     // with MPU-6050, some instability observed at Kp=100 Now set to 30.
-    void mahony(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q) {
+    void mahony(float ax, float ay, float az, float gx, float gy, float gz, float /*mx*/, float /*my*/, float /*mz*/, float* q) {
         float recipNorm;
         float vx, vy, vz;
         float ex, ey, ez;  //error terms
         float qa, qb, qc;
-        static float ix = 0.0, iy = 0.0, iz = 0.0;  //integral feedback terms
+        float* integral = state.integral;  //integral feedback terms
         float tmp;
 
         // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
@@ -198,12 +324,12 @@ public:
 
             // Compute and apply to gyro term the integral feedback, if enabled
             if (Ki > 0.0f) {
-                ix += Ki * ex * deltaT;  // integral error scaled by Ki
-                iy += Ki * ey * deltaT;
-                iz += Ki * ez * deltaT;
-                gx += ix;  // apply integral feedback
-                gy += iy;
-                gz += iz;
+                integral[0] += Ki * ex * deltaT;  // integral error scaled by Ki
+                integral[1] += Ki * ey * deltaT;
+                integral[2] += Ki * ez * deltaT;
+                gx += integral[0];  // apply integral feedback
+                gy += integral[1];
+                gz += integral[2];
             }
 
             // Apply proportional feedback to gyro term
@@ -232,6 +358,379 @@ public:
         q[2] = q[2] * recipNorm;
         q[3] = q[3] * recipNorm;
     }
+
+    // Mahony with magnetometer feedback: the error also includes the cross product between the estimated and measured
+    // directions of the magnetic field, after removing its inclination, so that yaw is corrected too
+    void mahony_mag(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q) {
+        float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];  // short name local variable for readability
+        float recipNorm;
+        float hx, hy, bx, bz;
+        float vx, vy, vz, wx, wy, wz;
+        float ex, ey, ez;
+        float qa, qb, qc;
+        float* integral = state.integral;  //integral feedback terms
+
+        // Auxiliary variables to avoid repeated arithmetic
+        float q0q0 = q0 * q0;
+        float q0q1 = q0 * q1;
+        float q0q2 = q0 * q2;
+        float q0q3 = q0 * q3;
+        float q1q1 = q1 * q1;
+        float q1q2 = q1 * q2;
+        float q1q3 = q1 * q3;
+        float q2q2 = q2 * q2;
+        float q2q3 = q2 * q3;
+        float q3q3 = q3 * q3;
+
+        // Normalise accelerometer measurement
+        float a_norm = ax * ax + ay * ay + az * az;
+        if (a_norm == 0.f) return;  // handle NaN
+        recipNorm = 1.f / sqrtf(a_norm);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        // Normalise magnetometer measurement
+        float m_norm = mx * mx + my * my + mz * mz;
+        if (m_norm == 0.f) return;  // handle NaN
+        recipNorm = 1.f / sqrtf(m_norm);
+        mx *= recipNorm;
+        my *= recipNorm;
+        mz *= recipNorm;
+
+        // Reference direction of Earth's magnetic field
+        hx = 2.0f * mx * (0.5f - q2q2 - q3q3) + 2.0f * my * (q1q2 - q0q3) + 2.0f * mz * (q1q3 + q0q2);
+        hy = 2.0f * mx * (q1q2 + q0q3) + 2.0f * my * (0.5f - q1q1 - q3q3) + 2.0f * mz * (q2q3 - q0q1);
+        bx = sqrtf((hx * hx) + (hy * hy));
+        bz = 2.0f * mx * (q1q3 - q0q2) + 2.0f * my * (q2q3 + q0q1) + 2.0f * mz * (0.5f - q1q1 - q2q2);
+
+        // Estimated direction of gravity and magnetic field
+        vx = 2.0f * (q1q3 - q0q2);
+        vy = 2.0f * (q0q1 + q2q3);
+        vz = q0q0 - q1q1 - q2q2 + q3q3;
+        wx = 2.0f * bx * (0.5f - q2q2 - q3q3) + 2.0f * bz * (q1q3 - q0q2);
+        wy = 2.0f * bx * (q1q2 - q0q3) + 2.0f * bz * (q0q1 + q2q3);
+        wz = 2.0f * bx * (q0q2 + q1q3) + 2.0f * bz * (0.5f - q1q1 - q2q2);
+
+        // Error is cross product between estimated direction and measured direction of the reference vectors
+        ex = (ay * vz - az * vy) + (my * wz - mz * wy);
+        ey = (az * vx - ax * vz) + (mz * wx - mx * wz);
+        ez = (ax * vy - ay * vx) + (mx * wy - my * wx);
+
+        // Compute and apply to gyro term the integral feedback, if enabled
+        if (Ki > 0.0f) {
+            integral[0] += Ki * ex * (float)deltaT;  // integral error scaled by Ki
+            integral[1] += Ki * ey * (float)deltaT;
+            integral[2] += Ki * ez * (float)deltaT;
+            gx += integral[0];  // apply integral feedback
+            gy += integral[1];
+            gz += integral[2];
+        }
+
+        // Apply proportional feedback to gyro term
+        gx += Kp * ex;
+        gy += Kp * ey;
+        gz += Kp * ez;
+
+        // Integrate rate of change of quaternion, q cross gyro term
+        const float half_dt = 0.5f * (float)deltaT;
+        qa = q0;
+        qb = q1;
+        qc = q2;
+        q0 += (-qb * gx - qc * gy - q3 * gz) * half_dt;
+        q1 += (qa * gx + qc * gz - q3 * gy) * half_dt;
+        q2 += (qa * gy - qb * gz + q3 * gx) * half_dt;
+        q3 += (qa * gz + qb * gy - qc * gx) * half_dt;
+
+        // renormalise quaternion
+        recipNorm = 1.f / sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+        q[0] = q0 * recipNorm;
+        q[1] = q1 * recipNorm;
+        q[2] = q2 * recipNorm;
+        q[3] = q3 * recipNorm;
+    }
+
+    // Madgwick, single precision only
+    void madgwick_fast(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float* q) {
+        madgwick_step(ax, ay, az, gx, gy, gz, mx, my, mz, q[0], q[1], q[2], q[3], beta, (float)deltaT);
+    }
+
+    // Mahony, single precision only
+    void mahony_fast(float ax, float ay, float az, float gx, float gy, float gz, float /*mx*/, float /*my*/, float /*mz*/, float* q) {
+        mahony_step(ax, ay, az, gx, gy, gz, q[0], q[1], q[2], q[3], state.integral[0], state.integral[1], state.integral[2], Kp, Ki, (float)deltaT);
+    }
+
+    // Single precision kernels on a quaternion passed component by component, so that they can also be run over
+    // structure of arrays layouts (see MultiQuaternionFilter). They are inlined in the calling loop.
+    static inline void madgwick_step(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz,
+                                     float& q0, float& q1, float& q2, float& q3, const float beta, const float dt) {
+        float recipNorm;
+        float s0, s1, s2, s3;
+        float qDot1, qDot2, qDot3, qDot4;
+        float hx, hy;
+        float _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _4bx, _4bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3, q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+
+        // Rate of change of quaternion from gyroscope
+        qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+        qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+        qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+        qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+        // Normalise accelerometer measurement
+        float a_norm = ax * ax + ay * ay + az * az;
+        if (a_norm == 0.f) return;  // handle NaN
+        recipNorm = inv_sqrt(a_norm);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        // Normalise magnetometer measurement
+        float m_norm = mx * mx + my * my + mz * mz;
+        if (m_norm == 0.f) return;  // handle NaN
+        recipNorm = inv_sqrt(m_norm);
+        mx *= recipNorm;
+        my *= recipNorm;
+        mz *= recipNorm;
+
+        // Auxiliary variables to avoid repeated arithmetic
+        _2q0mx = 2.0f * q0 * mx;
+        _2q0my = 2.0f * q0 * my;
+        _2q0mz = 2.0f * q0 * mz;
+        _2q1mx = 2.0f * q1 * mx;
+        _2q0 = 2.0f * q0;
+        _2q1 = 2.0f * q1;
+        _2q2 = 2.0f * q2;
+        _2q3 = 2.0f * q3;
+        _2q0q2 = 2.0f * q0 * q2;
+        _2q2q3 = 2.0f * q2 * q3;
+        q0q0 = q0 * q0;
+        q0q1 = q0 * q1;
+        q0q2 = q0 * q2;
+        q0q3 = q0 * q3;
+        q1q1 = q1 * q1;
+        q1q2 = q1 * q2;
+        q1q3 = q1 * q3;
+        q2q2 = q2 * q2;
+        q2q3 = q2 * q3;
+        q3q3 = q3 * q3;
+
+        // Reference direction of Earth's magnetic field
+        hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+        hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+        _2bx = sqrtf(hx * hx + hy * hy);
+        _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+        _4bx = 2.0f * _2bx;
+        _4bz = 2.0f * _2bz;
+
+        // Gradient decent algorithm corrective step
+        s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay) - _2bz * q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q3 + _2bz * q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+        s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q1 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + _2bz * q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q2 + _2bz * q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q3 - _4bz * q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+        s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q2 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + (-_4bx * q2 - _2bz * q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q1 + _2bz * q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q0 - _4bz * q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+        s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_4bx * q3 + _2bz * q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q0 + _2bz * q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+        recipNorm = inv_sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);  // normalise step magnitude
+        s0 *= recipNorm;
+        s1 *= recipNorm;
+        s2 *= recipNorm;
+        s3 *= recipNorm;
+
+        // Apply feedback step
+        qDot1 -= beta * s0;
+        qDot2 -= beta * s1;
+        qDot3 -= beta * s2;
+        qDot4 -= beta * s3;
+
+        // Integrate rate of change of quaternion to yield quaternion
+        q0 += qDot1 * dt;
+        q1 += qDot2 * dt;
+        q2 += qDot3 * dt;
+        q3 += qDot4 * dt;
+
+        // Normalise quaternion
+        recipNorm = inv_sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+        q0 *= recipNorm;
+        q1 *= recipNorm;
+        q2 *= recipNorm;
+        q3 *= recipNorm;
+    }
+
+    // Gyro integration alone, as no_filter
+    static inline void gyro_step(float gx, float gy, float gz, float& q0, float& q1, float& q2, float& q3, const float dt) {
+        const float half_dt = 0.5f * dt;
+        const float qa = q0, qb = q1, qc = q2, qd = q3;
+        q0 += (-qb * gx - qc * gy - qd * gz) * half_dt;
+        q1 += (qa * gx + qc * gz - qd * gy) * half_dt;
+        q2 += (qa * gy - qb * gz + qd * gx) * half_dt;
+        q3 += (qa * gz + qb * gy - qc * gx) * half_dt;
+        const float recipNorm = inv_sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+        q0 *= recipNorm;
+        q1 *= recipNorm;
+        q2 *= recipNorm;
+        q3 *= recipNorm;
+    }
+
+    // The magnetometer is not used, as in the reference mahony
+    static inline void mahony_step(float ax, float ay, float az, float gx, float gy, float gz,
+                                   float& q0, float& q1, float& q2, float& q3, float& ix, float& iy, float& iz, const float Kp, const float Ki, const float dt) {
+        float recipNorm;
+
+        // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+        float tmp = ax * ax + ay * ay + az * az;
+        if (tmp > 0.f) {
+            recipNorm = inv_sqrt(tmp);
+            ax *= recipNorm;
+            ay *= recipNorm;
+            az *= recipNorm;
+
+            // Estimated direction of gravity in the body frame (factor of two divided out)
+            float vx = q1 * q3 - q0 * q2;
+            float vy = q0 * q1 + q2 * q3;
+            float vz = q0 * q0 - 0.5f + q3 * q3;
+
+            // Error is cross product between estimated and measured direction of gravity in body frame
+            float ex = (ay * vz - az * vy);
+            float ey = (az * vx - ax * vz);
+            float ez = (ax * vy - ay * vx);
+
+            // Compute and apply to gyro term the integral feedback, if enabled
+            if (Ki > 0.f) {
+                ix += Ki * ex * dt;
+                iy += Ki * ey * dt;
+                iz += Ki * ez * dt;
+                gx += ix;
+                gy += iy;
+                gz += iz;
+            }
+
+            // Apply proportional feedback to gyro term
+            gx += Kp * ex;
+            gy += Kp * ey;
+            gz += Kp * ez;
+        }
+
+        // Integrate rate of change of quaternion, q cross gyro term
+        const float half_dt = 0.5f * dt;
+        gx *= half_dt;
+        gy *= half_dt;
+        gz *= half_dt;
+        const float qa = q0, qb = q1, qc = q2, qd = q3;
+        q0 += (-qb * gx - qc * gy - qd * gz);
+        q1 += (qa * gx + qc * gz - qd * gy);
+        q2 += (qa * gy - qb * gz + qd * gx);
+        q3 += (qa * gz + qb * gy - qc * gx);
+
+        // renormalise quaternion
+        recipNorm = inv_sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+        q0 *= recipNorm;
+        q1 *= recipNorm;
+        q2 *= recipNorm;
+        q3 *= recipNorm;
+    }
+
+    // Mahony in fixed point. The quaternion and unit vectors are Q30, angular rates Q20 in rad/s (up to 2048 rad/s),
+    // the accelerometer Q16 (up to 32768, in any unit) and Kp Q16. Products are computed on 64 bits, the only division
+    // is the one in each normalisation. Inputs and output stay float, converted on entry and exit.
+    void mahony_fixed(float ax, float ay, float az, float gx, float gy, float gz, float /*mx*/, float /*my*/, float /*mz*/, float* q) {
+        int32_t qf[4] = {to_fixed(q[0], Q_UNIT), to_fixed(q[1], Q_UNIT), to_fixed(q[2], Q_UNIT), to_fixed(q[3], Q_UNIT)};
+        int32_t w[3] = {to_fixed(gx, Q_RATE), to_fixed(gy, Q_RATE), to_fixed(gz, Q_RATE)};
+        int32_t a[3] = {to_fixed(ax, Q_ACC), to_fixed(ay, Q_ACC), to_fixed(az, Q_ACC)};
+
+        // Compute feedback only if accelerometer measurement valid
+        if (fixed_normalize(a, 3)) {
+            // Estimated direction of gravity in the body frame (factor of two divided out)
+            int32_t vx = fixed_mul(qf[1], qf[3], Q_UNIT) - fixed_mul(qf[0], qf[2], Q_UNIT);
+            int32_t vy = fixed_mul(qf[0], qf[1], Q_UNIT) + fixed_mul(qf[2], qf[3], Q_UNIT);
+            int32_t vz = fixed_mul(qf[0], qf[0], Q_UNIT) - (1 << (Q_UNIT - 1)) + fixed_mul(qf[3], qf[3], Q_UNIT);
+
+            // Error is cross product between estimated and measured direction of gravity in body frame
+            int32_t e[3];
+            e[0] = fixed_mul(a[1], vz, Q_UNIT) - fixed_mul(a[2], vy, Q_UNIT);
+            e[1] = fixed_mul(a[2], vx, Q_UNIT) - fixed_mul(a[0], vz, Q_UNIT);
+            e[2] = fixed_mul(a[0], vy, Q_UNIT) - fixed_mul(a[1], vx, Q_UNIT);
+
+            if (Ki > 0.f) {
+                const int32_t ki_dt = to_fixed(Ki * (float)deltaT, Q_UNIT);
+                for (int i = 0; i < 3; ++i) {
+                    state.integral_fixed[i] += fixed_mul(e[i], ki_dt, 2 * Q_UNIT - Q_RATE);
+                    w[i] += state.integral_fixed[i];
+                }
+            }
+
+            const int32_t kp = to_fixed(Kp, Q_GAIN);
+            for (int i = 0; i < 3; ++i)
+                w[i] += fixed_mul(e[i], kp, Q_UNIT + Q_GAIN - Q_RATE);
+        }
+
+        // Integrate rate of change of quaternion, the half angle increments are Q30
+        const int32_t half_dt = to_fixed(0.5f * (float)deltaT, Q_UNIT);
+        for (int i = 0; i < 3; ++i)
+            w[i] = fixed_mul(w[i], half_dt, Q_RATE);
+        const int32_t q0 = qf[0], q1 = qf[1], q2 = qf[2], q3 = qf[3];
+        qf[0] += -fixed_mul(q1, w[0], Q_UNIT) - fixed_mul(q2, w[1], Q_UNIT) - fixed_mul(q3, w[2], Q_UNIT);
+        qf[1] += fixed_mul(q0, w[0], Q_UNIT) + fixed_mul(q2, w[2], Q_UNIT) - fixed_mul(q3, w[1], Q_UNIT);
+        qf[2] += fixed_mul(q0, w[1], Q_UNIT) - fixed_mul(q1, w[2], Q_UNIT) + fixed_mul(q3, w[0], Q_UNIT);
+        qf[3] += fixed_mul(q0, w[2], Q_UNIT) + fixed_mul(q1, w[1], Q_UNIT) - fixed_mul(q2, w[0], Q_UNIT);
+
+        // renormalise quaternion
+        if (!fixed_normalize(qf, 4)) return;
+        for (int i = 0; i < 4; ++i)
+            q[i] = (float)qf[i] * (1.f / (float)(1L << Q_UNIT));
+    }
+
+private:
+    static constexpr int Q_UNIT{30};
+    static constexpr int Q_RATE{20};
+    static constexpr int Q_ACC{16};
+    static constexpr int Q_GAIN{16};
+
+    // Reciprocal square root: bit level first guess refined by two Newton iterations (relative error below 5e-6)
+    static float inv_sqrt(float x) {
+        float halfx = 0.5f * x;
+        uint32_t i;
+        memcpy(&i, &x, sizeof(i));
+        i = 0x5f375a86 - (i >> 1);
+        float y;
+        memcpy(&y, &i, sizeof(y));
+        y = y * (1.5f - (halfx * y * y));
+        y = y * (1.5f - (halfx * y * y));
+        return y;
+    }
+
+    static int32_t to_fixed(float x, int frac_bits) {
+        return (int32_t)(x * (float)(1L << frac_bits));
+    }
+
+    static int32_t fixed_mul(int32_t a, int32_t b, int shift) {
+        return (int32_t)(((int64_t)a * b) >> shift);
+    }
+
+    // floor(sqrt(x)), bit by bit
+    static uint32_t fixed_sqrt(uint64_t x) {
+        uint64_t r = 0;
+        uint64_t bit = (uint64_t)1 << 62;
+        while (bit > x) bit >>= 2;
+        while (bit) {
+            if (x >= r + bit) {
+                x -= r + bit;
+                r = (r >> 1) + bit;
+            } else {
+                r >>= 1;
+            }
+            bit >>= 2;
+        }
+        return (uint32_t)r;
+    }
+
+    // Scales v to a Q30 unit vector, whatever the Q format of v. False if v is null.
+    static bool fixed_normalize(int32_t* v, int n) {
+        uint64_t sum = 0;
+        for (int i = 0; i < n; ++i)
+            sum += (uint64_t)((int64_t)v[i] * v[i]);
+        if (sum == 0) return false;
+        const uint64_t inv_norm = ((uint64_t)1 << (2 * Q_UNIT + 2)) / fixed_sqrt(sum);  // 2^62 / |v|, |v[i]| * inv_norm <= 2^62
+        for (int i = 0; i < n; ++i)
+            v[i] = (int32_t)(((int64_t)v[i] * (int64_t)inv_norm) >> (Q_UNIT + 2));
+        return true;
+    }
 };
 
 #endif  // QUATERNIONFILTER_H
@@ -0,0 +1,149 @@
+#pragma once
+#ifndef QUATERNIONFILTERBATCH_H
+#define QUATERNIONFILTERBATCH_H
+
+#include "QuaternionFilter.h"
+
+// Offline fusion of recorded IMU samples, to tune the QuaternionFilter parameters on a PC.
+// quat_filter_batch runs one parameter set over a whole recording and writes the quaternion and roll/pitch/yaw of
+// every sample. quat_filter_sweep (host builds only) runs many parameter sets over the same recording, spread over
+// threads, and scores each of them with a user function, e.g. quat_rms_angle_to a reference orientation.
+// Recordings are flat arrays: 3 floats per sample for each sensor, 4 per quaternion, 3 per roll/pitch/yaw.
+
+enum class QuatBatchFrame {
+    MPU9250_AXES,  // as returned by MPU9250_::getAcc/getGyro/getMag: gyro in deg/s, axes mapped as in update_quaternion
+    FILTER_FRAME,  // already in the filter frame (North, East, Down), gyro in rad/s
+};
+
+struct QuatFilterParams {
+    QuatFilterSel filter{QuatFilterSel::MADGWICK};
+    float beta{sqrtf(3.0f / 4.0f) * (float)PI * (40.0f / 180.0f)};  // QuaternionFilter defaults
+    float zeta{0.f};
+    float Kp{30.f};
+    float Ki{0.f};
+    size_t iterations{1};     // as MPU9250_::setFilterIterations
+    float declination{0.f};  // added to the yaw, as MPU9250_::setMagneticDeclination
+};
+
+struct QuatBatchLog {
+    size_t count;
+    const uint64_t* timestamp_us;  // sample times, in us
+    const float* acc;
+    const float* gyro;
+    const float* mag;
+    QuatBatchFrame frame;
+};
+
+// Tait-Bryan angles in degrees, same convention as MPU9250_::update_rpy
+inline void quat_to_rpy(const float* q, const float declination, float* rpy) {
+    const float a12 = 2.0f * (q[1] * q[2] + q[0] * q[3]);
+    const float a22 = q[0] * q[0] + q[1] * q[1] - q[2] * q[2] - q[3] * q[3];
+    const float a31 = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+    const float a32 = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    const float a33 = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+    rpy[0] = atan2f(a31, a33) * 180.0f / (float)PI;
+    rpy[1] = -asinf(a32) * 180.0f / (float)PI;
+    rpy[2] = atan2f(a12, a22) * 180.0f / (float)PI + declination;
+    if (rpy[2] >= +180.f)
+        rpy[2] -= 360.f;
+    else if (rpy[2] < -180.f)
+        rpy[2] += 360.f;
+}
+
+// Runs the filter over the recording. quaternions (4 per sample) and rpy (3 per sample) can each be null.
+// The first sample only sets the start time. Returns false if the recording is empty or a timestamp goes backwards.
+inline bool quat_filter_batch(const QuatBatchLog& log, const QuatFilterParams& params, float* quaternions, float* rpy,
+                              const float* q_init = nullptr) {
+    if (log.count == 0 || !log.timestamp_us || !log.acc || !log.gyro || !log.mag) return false;
+
+    QuaternionFilter filter;
+    filter.select_filter(params.filter);
+    filter.set_madgwick_gains(params.beta, params.zeta);
+    filter.set_mahony_gains(params.Kp, params.Ki);
+
+    float q[4] = {1.f, 0.f, 0.f, 0.f};
+    if (q_init) memcpy(q, q_init, sizeof(q));
+    const float deg_to_rad = (float)PI / 180.f;
+    const size_t iterations = params.iterations ? params.iterations : 1;
+
+    for (size_t i = 0; i < log.count; ++i) {
+        const float* a = &log.acc[i * 3];
+        const float* g = &log.gyro[i * 3];
+        const float* m = &log.mag[i * 3];
+
+        if (i > 0) {
+            if (log.timestamp_us[i] < log.timestamp_us[i - 1]) return false;
+            const double dt = (log.timestamp_us[i] - log.timestamp_us[i - 1]) * 1e-6;
+            for (size_t n = 0; n < iterations; ++n) {
+                if (log.frame == QuatBatchFrame::MPU9250_AXES)
+                    filter.update(-a[0], a[1], a[2], g[0] * deg_to_rad, -g[1] * deg_to_rad, -g[2] * deg_to_rad, m[1], -m[0], m[2], q, dt);
+                else
+                    filter.update(a[0], a[1], a[2], g[0], g[1], g[2], m[0], m[1], m[2], q, dt);
+            }
+        }
+
+        if (quaternions) memcpy(&quaternions[i * 4], q, sizeof(q));
+        if (rpy) quat_to_rpy(q, params.declination, &rpy[i * 3]);
+    }
+    return true;
+}
+
+#ifndef ARDUINO
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Score of a run, from its quaternions and roll/pitch/yaw (count samples). Lower is better by convention.
+using QuatSweepScore = std::function<double(const float* quaternions, const float* rpy, size_t count)>;
+
+// Runs every parameter set over the recording and returns their scores, in the same order.
+// Each worker thread reuses its own output buffers, 28 bytes per sample. threads = 0 uses all cores.
+inline std::vector<double> quat_filter_sweep(const QuatBatchLog& log, const std::vector<QuatFilterParams>& sets,
+                                             const QuatSweepScore& score, unsigned threads = 0) {
+    std::vector<double> scores(sets.size(), NAN);
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > sets.size()) threads = (unsigned)sets.size();
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        std::vector<float> quaternions(log.count * 4), rpy(log.count * 3);
+        for (size_t i = next++; i < sets.size(); i = next++) {
+            if (quat_filter_batch(log, sets[i], quaternions.data(), rpy.data()))
+                scores[i] = score(quaternions.data(), rpy.data(), log.count);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (std::thread& t : pool)
+        t.join();
+    return scores;
+}
+
+// Score: RMS rotation angle, in degrees, between the run and reference quaternions (4 per sample), skipping the
+// first settle samples while the filter converges
+inline QuatSweepScore quat_rms_angle_to(const float* reference, const size_t settle = 0) {
+    return [reference, settle](const float* quaternions, const float*, size_t count) {
+        double square_sum = 0.;
+        size_t n = 0;
+        for (size_t i = settle; i < count; ++i, ++n) {
+            const float* p = &reference[i * 4];
+            const float* q = &quaternions[i * 4];
+            // rotation between p and q: conj(p) * q, angle from the vector and scalar parts
+            const double w = (double)p[0] * q[0] + (double)p[1] * q[1] + (double)p[2] * q[2] + (double)p[3] * q[3];
+            const double x = (double)p[0] * q[1] - (double)p[1] * q[0] - (double)p[2] * q[3] + (double)p[3] * q[2];
+            const double y = (double)p[0] * q[2] + (double)p[1] * q[3] - (double)p[2] * q[0] - (double)p[3] * q[1];
+            const double z = (double)p[0] * q[3] - (double)p[1] * q[2] + (double)p[2] * q[1] - (double)p[3] * q[0];
+            const double angle = 2. * atan2(sqrt(x * x + y * y + z * z), fabs(w)) * 180. / PI;
+            square_sum += angle * angle;
+        }
+        return n ? sqrt(square_sum / n) : NAN;
+    };
+}
+#endif  // ARDUINO
+
+#endif  // QUATERNIONFILTERBATCH_H
@@ -0,0 +1,487 @@
+#pragma once
+#ifndef VIBRATIONSPECTRUM_H
+#define VIBRATIONSPECTRUM_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else // host builds, to validate against a reference FFT
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+// Vibration spectrum of an accelerometer stream, computed on the device so that only a summary has to be sent.
+//
+// Samples of each channel (e.g. accel x, y and z in g) are cut in segments of N samples overlapping by N - hop, Hann
+// windowed after removing their mean, and transformed with a float32 radix-2 real FFT. The power spectra are averaged
+// over report_segments segments (Welch's method) into a one-sided PSD in g^2/Hz, from which a summary is made: the RMS
+// of each channel, its RMS in each frequency band, and its strongest peaks with their interpolated frequency.
+//
+// pack() writes a summary in a few tens of bytes per channel, e.g. 106 bytes for 3 channels, 8 bands and 3 peaks: at
+// one summary per second that replaces a raw stream of several kB/s.
+//
+// Memory is about (2 * CHANNELS + 3) * N floats, 18 kB for N = 512 and 3 channels.
+
+struct VibrationPeak
+{
+    float frequency; // Hz, interpolated between bins
+    float rms;       // g, RMS of the peak (amplitude / sqrt(2) for a sine)
+};
+
+template <size_t N = 512, size_t CHANNELS = 3>
+class VibrationSpectrum
+{
+    static_assert(N >= 16 && N <= 32768 && (N & (N - 1)) == 0, "N must be a power of 2, from 16 to 32768");
+
+public:
+    static constexpr size_t BINS{N / 2 + 1};
+    static constexpr uint8_t MAX_BANDS{8};
+    static constexpr uint8_t MAX_PEAKS{4};
+    static constexpr uint8_t PACKET_VERSION{1};
+
+    struct Summary
+    {
+        uint32_t index;    // summaries made since begin()
+        uint16_t segments; // segments averaged
+        float rms[CHANNELS];
+        float band_rms[CHANNELS][MAX_BANDS];
+        VibrationPeak peaks[CHANNELS][MAX_PEAKS]; // strongest first, frequency 0 if fewer peaks were found
+    };
+
+private:
+    static constexpr size_t M{N / 2}; // size of the complex FFT behind the real one
+    static constexpr float PI_F{3.14159265358979f};
+
+    float sample_rate{0.f};
+    size_t hop{N / 2};
+    uint16_t report_segments{8};
+    uint8_t n_bands{0};
+    bool default_bands{true};
+    uint8_t n_peaks{3};
+    float band_edges[MAX_BANDS + 1];
+
+    // input
+    float ring[CHANNELS][N];
+    size_t ring_pos{0};
+    size_t filled{0};
+    size_t since_segment{0};
+
+    // FFT tables and work area
+    float window[N];
+    float window_power{0.f};  // sum of the squared window
+    float twiddle[M][2];      // e^(-2 pi i k / N), k < N / 2
+    uint16_t bit_reverse[M];
+    float work[M][2];
+
+    // Welch accumulation
+    float psd_sum[CHANNELS][BINS];
+    float last_psd[CHANNELS][BINS]; // one-sided, not scaled
+    uint16_t segments{0};
+    uint32_t summary_index{0};
+    Summary summary;
+    bool summary_ready{false};
+
+public:
+    // hop: samples between segments, N / 2 for 50% overlap. report_segments: segments averaged per summary.
+    void begin(const float sample_rate_hz, const size_t hop_samples = N / 2, const uint16_t segments_per_report = 8)
+    {
+        sample_rate = sample_rate_hz;
+        hop = (hop_samples > 0 && hop_samples <= N) ? hop_samples : N / 2;
+        report_segments = segments_per_report ? segments_per_report : 1;
+
+        window_power = 0.f;
+        for (size_t n = 0; n < N; ++n)
+        {
+            window[n] = 0.5f - 0.5f * cosf(2.f * PI_F * n / N); // periodic Hann
+            window_power += window[n] * window[n];
+        }
+        for (size_t k = 0; k < M; ++k)
+        {
+            twiddle[k][0] = cosf(2.f * PI_F * k / N);
+            twiddle[k][1] = -sinf(2.f * PI_F * k / N);
+        }
+        uint8_t bits = 0;
+        while ((size_t(1) << bits) < M)
+            ++bits;
+        for (size_t i = 0; i < M; ++i)
+        {
+            size_t r = 0;
+            for (uint8_t b = 0; b < bits; ++b)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            bit_reverse[i] = r;
+        }
+
+        if (default_bands)
+            set_default_bands();
+        reset();
+    }
+
+    void reset()
+    {
+        memset(ring, 0, sizeof(ring));
+        memset(psd_sum, 0, sizeof(psd_sum));
+        ring_pos = 0;
+        filled = 0;
+        since_segment = 0;
+        segments = 0;
+        summary_index = 0;
+        summary_ready = false;
+    }
+
+    // Band edges in Hz, increasing, n_edges - 1 bands (at most MAX_BANDS). Bins are assigned by their center frequency.
+    // By default, octaves down from the Nyquist frequency.
+    bool setBands(const float *edges, const uint8_t n_edges)
+    {
+        if (n_edges < 2 || n_edges > MAX_BANDS + 1)
+            return false;
+        for (uint8_t i = 1; i < n_edges; ++i)
+            if (edges[i] <= edges[i - 1])
+                return false;
+        memcpy(band_edges, edges, n_edges * sizeof(float));
+        n_bands = n_edges - 1;
+        default_bands = false;
+        return true;
+    }
+
+    void setPeakCount(const uint8_t n) { n_peaks = (n > MAX_PEAKS) ? MAX_PEAKS : n; }
+
+    // One sample per channel, in g. Returns true when a new summary is available.
+    bool push(const float *sample)
+    {
+        for (size_t c = 0; c < CHANNELS; ++c)
+            ring[c][ring_pos] = sample[c];
+        ring_pos = (ring_pos + 1) % N;
+        if (filled < N)
+            filled++;
+        since_segment++;
+
+        if (filled < N || since_segment < hop)
+            return false;
+        since_segment = 0;
+
+        for (size_t c = 0; c < CHANNELS; ++c)
+            accumulate_segment(c);
+        if (++segments < report_segments)
+            return false;
+
+        make_summary();
+        return true;
+    }
+
+    bool push(const float x, const float y, const float z)
+    {
+        static_assert(CHANNELS == 3, "x, y, z samples need 3 channels");
+        const float sample[3] = {x, y, z};
+        return push(sample);
+    }
+
+    // Accel of an MPU9250_, after update() or updateFromFifo()
+    template <typename MPU>
+    bool push(const MPU &mpu)
+    {
+        return push(mpu.getAccX(), mpu.getAccY(), mpu.getAccZ());
+    }
+
+    bool available() const { return summary_ready; }
+
+    // Latest summary, clears available()
+    const Summary &getSummary()
+    {
+        summary_ready = false;
+        return summary;
+    }
+
+    // Averaged one-sided PSD of the last summary, in g^2/Hz, BINS values
+    void getPsd(const size_t channel, float *psd) const
+    {
+        const float scale = psd_scale(summary.segments);
+        for (size_t k = 0; k < BINS; ++k)
+            psd[k] = last_psd[channel][k] * scale;
+    }
+
+    float binWidth() const { return sample_rate / N; }
+    float bandEdge(const uint8_t i) const { return (i <= n_bands) ? band_edges[i] : 0.f; }
+    uint8_t bandCount() const { return n_bands; }
+
+    // Compact summary, little endian:
+    //   u8 version, u8 channels, u8 bands, u8 peaks, u32 index, u16 segments, u16 N, u32 sample rate in mHz
+    //   per channel: u16 rms, u16 band rms x bands, (u16 frequency in 0.1 Hz, u16 rms) x peaks
+    // RMS values are in 0.01 dB re 1 ug (0 for less), so 1 mg is 6000 and 16 g is 14408.
+    // Returns the number of bytes written, 0 if size is too small.
+    size_t pack(const Summary &s, uint8_t *buffer, const size_t size) const
+    {
+        const size_t needed = packedSize();
+        if (size < needed)
+            return 0;
+
+        uint8_t *p = buffer;
+        *p++ = PACKET_VERSION;
+        *p++ = CHANNELS;
+        *p++ = n_bands;
+        *p++ = n_peaks;
+        p = put_u32(p, s.index);
+        p = put_u16(p, s.segments);
+        p = put_u16(p, N);
+        p = put_u32(p, (uint32_t)lroundf(sample_rate * 1000.f));
+        for (size_t c = 0; c < CHANNELS; ++c)
+        {
+            p = put_u16(p, encode_rms(s.rms[c]));
+            for (uint8_t b = 0; b < n_bands; ++b)
+                p = put_u16(p, encode_rms(s.band_rms[c][b]));
+            for (uint8_t i = 0; i < n_peaks; ++i)
+            {
+                const float f = s.peaks[c][i].frequency * 10.f;
+                p = put_u16(p, (f > 65535.f) ? 65535 : (uint16_t)lroundf(f));
+                p = put_u16(p, encode_rms(s.peaks[c][i].rms));
+            }
+        }
+        return p - buffer;
+    }
+
+    size_t packedSize() const { return 16 + CHANNELS * 2 * (1 + n_bands + 2 * n_peaks); }
+
+    static float decodeRms(const uint16_t v) { return v ? 1e-6f * powf(10.f, v / 2000.f) : 0.f; }
+
+    // FFT of N real samples, for validation: spectrum[k] = X[k] for k <= N / 2, as {re, im}. Call begin() first.
+    void fft(const float *x, float (*spectrum)[2])
+    {
+        for (size_t m = 0; m < M; ++m)
+        {
+            work[m][0] = x[2 * m];
+            work[m][1] = x[2 * m + 1];
+        }
+        real_fft();
+        for (size_t k = 0; k <= M; ++k)
+            split_bin(k, spectrum[k][0], spectrum[k][1]);
+    }
+
+private:
+    void set_default_bands()
+    {
+        // octaves down from the Nyquist frequency, the lowest band starting at the second bin
+        const float nyquist = 0.5f * sample_rate;
+        const float lowest = 1.5f * sample_rate / N;
+        n_bands = 0;
+        float f = nyquist;
+        while (n_bands < MAX_BANDS && f * 0.5f > lowest)
+        {
+            f *= 0.5f;
+            n_bands++;
+        }
+        band_edges[0] = lowest;
+        for (uint8_t b = 1; b <= n_bands; ++b)
+            band_edges[b] = nyquist / (float)(1 << (n_bands - b));
+    }
+
+    void accumulate_segment(const size_t c)
+    {
+        // oldest sample first, mean removed so that gravity doesn't leak into the low bins
+        float mean = 0.f;
+        for (size_t n = 0; n < N; ++n)
+            mean += ring[c][n];
+        mean /= N;
+
+        size_t i = ring_pos;
+        for (size_t m = 0; m < M; ++m)
+        {
+            work[m][0] = (ring[c][i] - mean) * window[2 * m];
+            i = (i + 1) % N;
+            work[m][1] = (ring[c][i] - mean) * window[2 * m + 1];
+            i = (i + 1) % N;
+        }
+        real_fft();
+
+        for (size_t k = 0; k <= M; ++k)
+        {
+            float re, im;
+            split_bin(k, re, im);
+            psd_sum[c][k] += re * re + im * im;
+        }
+    }
+
+    // In place radix-2 decimation in time FFT of work, M complex points
+    void real_fft()
+    {
+        for (size_t i = 0; i < M; ++i)
+        {
+            const size_t r = bit_reverse[i];
+            if (r > i)
+            {
+                float t0 = work[i][0], t1 = work[i][1];
+                work[i][0] = work[r][0];
+                work[i][1] = work[r][1];
+                work[r][0] = t0;
+                work[r][1] = t1;
+            }
+        }
+
+        for (size_t half = 1, stride = M; half < M; half <<= 1, stride >>= 1)
+        {
+            // twiddles of the M point FFT are every other one of the N point table
+            const size_t step = stride; // e^(-2 pi i j / (2 half)) = twiddle[j * N / (2 half)] = twiddle[j * stride]
+            for (size_t start = 0; start < M; start += 2 * half)
+            {
+                for (size_t j = 0; j < half; ++j)
+                {
+                    const float wr = twiddle[j * step][0], wi = twiddle[j * step][1];
+                    float *a = work[start + j];
+                    float *b = work[start + j + half];
+                    const float tr = b[0] * wr - b[1] * wi;
+                    const float ti = b[0] * wi + b[1] * wr;
+                    b[0] = a[0] - tr;
+                    b[1] = a[1] - ti;
+                    a[0] += tr;
+                    a[1] += ti;
+                }
+            }
+        }
+    }
+
+    // Bin k of the N point real FFT, from the M point complex FFT of the even (real) and odd (imaginary) samples
+    void split_bin(const size_t k, float &re, float &im) const
+    {
+        const float *zk = work[k % M];
+        const float *zn = work[(M - k) % M];
+        // even part (Z[k] + conj(Z[M - k])) / 2 and odd part (Z[k] - conj(Z[M - k])) / 2i
+        const float er = 0.5f * (zk[0] + zn[0]);
+        const float ei = 0.5f * (zk[1] - zn[1]);
+        const float orr = 0.5f * (zk[1] + zn[1]);
+        const float oi = -0.5f * (zk[0] - zn[0]);
+        float wr = 1.f, wi = 0.f;
+        if (k < M)
+        {
+            wr = twiddle[k][0];
+            wi = twiddle[k][1];
+        }
+        else
+        {
+            wr = -1.f; // e^(-i pi)
+        }
+        re = er + orr * wr - oi * wi;
+        im = ei + orr * wi + oi * wr;
+    }
+
+    // |X|^2 summed over segments to PSD in g^2/Hz, bins 1 to N / 2 - 1 are doubled by the caller for the one-sided PSD
+    float psd_scale(const uint16_t n_segments) const
+    {
+        return 1.f / (sample_rate * window_power * (n_segments ? n_segments : 1));
+    }
+
+    void make_summary()
+    {
+        const float df = binWidth();
+        const float scale = psd_scale(segments);
+        summary.index = summary_index++;
+        summary.segments = segments;
+
+        for (size_t c = 0; c < CHANNELS; ++c)
+        {
+            // one-sided PSD
+            for (size_t k = 0; k < BINS; ++k)
+                last_psd[c][k] = psd_sum[c][k] * ((k == 0 || k == M) ? 1.f : 2.f);
+            float *psd = last_psd[c];
+
+            double total = 0.;
+            for (size_t k = 1; k < BINS; ++k)
+                total += psd[k];
+            summary.rms[c] = sqrtf(total * scale * df);
+
+            for (uint8_t b = 0; b < MAX_BANDS; ++b)
+            {
+                double sum = 0.;
+                if (b < n_bands)
+                {
+                    for (size_t k = 1; k < BINS; ++k)
+                    {
+                        const float f = k * df;
+                        if (f >= band_edges[b] && (f < band_edges[b + 1] || (b == n_bands - 1 && f <= band_edges[b + 1])))
+                            sum += psd[k];
+                    }
+                }
+                summary.band_rms[c][b] = sqrtf(sum * scale * df);
+            }
+
+            find_peaks(psd, scale, summary.peaks[c]);
+        }
+
+        memset(psd_sum, 0, sizeof(psd_sum));
+        segments = 0;
+        summary_ready = true;
+    }
+
+    // Strongest local maxima between the first and last band edges. The frequency is interpolated with a parabola
+    // through the log power of the 3 bins around the maximum, exact for a Gaussian and within 2% of a bin for Hann.
+    void find_peaks(const float *psd, const float scale, VibrationPeak *peaks) const
+    {
+        const float df = binWidth();
+        size_t first = (size_t)ceilf(band_edges[0] / df);
+        size_t last = (size_t)(band_edges[n_bands] / df);
+        first = (first < 1) ? 1 : first;
+        last = (last > M - 1) ? M - 1 : last;
+
+        size_t found[MAX_PEAKS];
+        uint8_t n = 0;
+        for (size_t k = first; k <= last; ++k)
+        {
+            if (!(psd[k] > psd[k - 1] && psd[k] >= psd[k + 1]))
+                continue;
+
+            // insert by power, strongest first
+            uint8_t pos = n;
+            while (pos > 0 && psd[found[pos - 1]] < psd[k])
+                pos--;
+            if (pos >= n_peaks)
+                continue;
+            for (uint8_t i = (n < n_peaks) ? n : n_peaks - 1; i > pos; --i)
+                found[i] = found[i - 1];
+            found[pos] = k;
+            if (n < n_peaks)
+                n++;
+        }
+
+        for (uint8_t i = 0; i < MAX_PEAKS; ++i)
+        {
+            peaks[i] = {0.f, 0.f};
+            if (i >= n)
+                continue;
+
+            const size_t k = found[i];
+            const float a = logf(psd[k - 1] + 1e-30f);
+            const float b = logf(psd[k] + 1e-30f);
+            const float c = logf(psd[k + 1] + 1e-30f);
+            const float den = a - 2.f * b + c;
+            const float delta = (den < 0.f) ? 0.5f * (a - c) / den : 0.f;
+            peaks[i].frequency = (k + delta) * df;
+
+            // the Hann main lobe spans 2 bins on each side
+            double sum = 0.;
+            for (size_t j = (k > 2) ? k - 2 : 1; j <= k + 2 && j < BINS; ++j)
+                sum += psd[j];
+            peaks[i].rms = sqrtf(sum * scale * df);
+        }
+    }
+
+    static uint16_t encode_rms(const float rms)
+    {
+        if (!(rms > 1e-6f))
+            return 0;
+        const float v = 2000.f * log10f(rms * 1e6f);
+        return (v > 65535.f) ? 65535 : (uint16_t)lroundf(v);
+    }
+
+    static uint8_t *put_u16(uint8_t *p, const uint16_t v)
+    {
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+        return p + 2;
+    }
+
+    static uint8_t *put_u32(uint8_t *p, const uint32_t v)
+    {
+        p = put_u16(p, v & 0xFFFF);
+        return put_u16(p, v >> 16);
+    }
+};
+
+#endif // VIBRATIONSPECTRUM_H
@@ -0,0 +1,251 @@
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_benchmark.cpp
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 9, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*****************************************************       HEADER FILE       *****************************************************/
+#include "emmc_benchmark.h"
+
+//*********************************************       BENCHMARK FUNCTIONS DEFINTIONS       ******************************************/
+EMMC_Benchmark::EMMC_Benchmark()
+{
+    buffer = nullptr;
+    block_size = 0;
+    block_count = 0;
+    random_ops = 0;
+    random_state = 1;
+}
+
+ESP_ERROR EMMC_Benchmark::run(EMMC_Memory &emmc,
+                              size_t block_size,
+                              EMMC_BenchmarkResult &result,
+                              size_t file_size,
+                              uint32_t random_ops)
+{
+    result = {};
+    fs::FS *file_system = emmc.getFileSystem();
+    if (file_system == nullptr)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    if (block_size < sizeof(uint32_t) || block_size % sizeof(uint32_t) != 0 || file_size < 2 * block_size)
+    {
+        return ESP_ERROR(true, "Block size must be a multiple of 4 bytes, with at least 2 blocks in the file");
+    }
+
+    buffer = (uint8_t *)heap_caps_malloc(block_size, MALLOC_CAP_DMA);
+    if (buffer == nullptr)
+    {
+        return ESP_ERROR(true, "Not enough DMA capable memory for the benchmark block");
+    }
+
+    this->block_size = block_size;
+    this->random_ops = random_ops;
+    block_count = file_size / block_size;
+    random_state = 1;
+
+    result.mode = emmc.getConnectionMode();
+    result.bus_width = emmc.getBusWidth();
+    result.frequency_khz = emmc.getBusFrequency();
+    result.block_size = block_size;
+
+    String temp_message;
+    if (!sequentialWrite(*file_system, result))
+    {
+        temp_message = "Sequential write failed";
+    }
+    else if (!sequentialRead(*file_system, result))
+    {
+        temp_message = "Sequential read failed";
+    }
+    else if (!randomWrite(*file_system, result))
+    {
+        temp_message = "Random write failed";
+    }
+    else if (!randomRead(*file_system, result))
+    {
+        temp_message = "Random read failed";
+    }
+    else if (result.errors > 0)
+    {
+        temp_message = String(result.errors) + " blocks read back different from what was written";
+    }
+
+    file_system->remove(EMMC_BENCHMARK_FILE);
+    heap_caps_free(buffer);
+    buffer = nullptr;
+
+    return ESP_ERROR(temp_message.length() > 0, temp_message);
+}
+
+String EMMC_Benchmark::toString(const EMMC_BenchmarkResult &result)
+{
+    String temp_message;
+    temp_message += result.mode == SPI_MODE ? "SPI" : (result.bus_width == MODE_4_BIT ? "SDMMC 4 bit" : "SDMMC 1 bit");
+    temp_message += " ";
+    temp_message += String(result.frequency_khz / 1000.0, 1);
+    temp_message += " MHz, ";
+    temp_message += String((unsigned long)result.block_size);
+    temp_message += " B: seq W ";
+    temp_message += String(result.sequential_write_MBps, 2);
+    temp_message += " R ";
+    temp_message += String(result.sequential_read_MBps, 2);
+    temp_message += " MB/s, rand W ";
+    temp_message += String(result.random_write_iops, 0);
+    temp_message += " R ";
+    temp_message += String(result.random_read_iops, 0);
+    temp_message += " IOPS";
+    return temp_message;
+}
+
+// -- The whole file, block after block, then flushed and closed
+bool EMMC_Benchmark::sequentialWrite(fs::FS &file_system, EMMC_BenchmarkResult &result)
+{
+    uint32_t start = micros();
+    File file = file_system.open(EMMC_BENCHMARK_FILE, FILE_WRITE);
+    if (!file)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < block_count; i++)
+    {
+        fillBlock(i * block_size);
+        uint32_t write_start = micros();
+        if (file.write(buffer, block_size) != block_size)
+        {
+            file.close();
+            return false;
+        }
+        result.max_write_latency_us = max(result.max_write_latency_us, (uint32_t)(micros() - write_start));
+    }
+    file.close();
+
+    uint32_t elapsed = micros() - start;
+    result.sequential_write_MBps = (float)block_count * block_size / max(elapsed, (uint32_t)1);
+    return true;
+}
+
+bool EMMC_Benchmark::sequentialRead(fs::FS &file_system, EMMC_BenchmarkResult &result)
+{
+    uint32_t start = micros();
+    File file = file_system.open(EMMC_BENCHMARK_FILE);
+    if (!file)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < block_count; i++)
+    {
+        if (file.read(buffer, block_size) != block_size)
+        {
+            file.close();
+            return false;
+        }
+        result.errors += !checkBlock(i * block_size);
+    }
+    file.close();
+
+    uint32_t elapsed = micros() - start;
+    result.sequential_read_MBps = (float)block_count * block_size / max(elapsed, (uint32_t)1);
+    return true;
+}
+
+// -- Inside the file, so the clusters are already allocated: the cost of the card, not of the FAT
+bool EMMC_Benchmark::randomWrite(fs::FS &file_system, EMMC_BenchmarkResult &result)
+{
+    uint32_t start = micros();
+    File file = file_system.open(EMMC_BENCHMARK_FILE, "r+");
+    if (!file)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < random_ops; i++)
+    {
+        uint32_t offset = randomBlock() * block_size;
+        fillBlock(offset);
+        uint32_t write_start = micros();
+        if (!file.seek(offset) || file.write(buffer, block_size) != block_size)
+        {
+            file.close();
+            return false;
+        }
+        result.max_write_latency_us = max(result.max_write_latency_us, (uint32_t)(micros() - write_start));
+    }
+    file.close();
+
+    float seconds = max((uint32_t)(micros() - start), (uint32_t)1) / 1e6f;
+    result.random_write_iops = random_ops / seconds;
+    result.random_write_MBps = result.random_write_iops * block_size / 1e6f;
+    return true;
+}
+
+bool EMMC_Benchmark::randomRead(fs::FS &file_system, EMMC_BenchmarkResult &result)
+{
+    uint32_t start = micros();
+    File file = file_system.open(EMMC_BENCHMARK_FILE);
+    if (!file)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < random_ops; i++)
+    {
+        uint32_t offset = randomBlock() * block_size;
+        if (!file.seek(offset) || file.read(buffer, block_size) != block_size)
+        {
+            file.close();
+            return false;
+        }
+        result.errors += !checkBlock(offset);
+    }
+    file.close();
+
+    float seconds = max((uint32_t)(micros() - start), (uint32_t)1) / 1e6f;
+    result.random_read_iops = random_ops / seconds;
+    result.random_read_MBps = result.random_read_iops * block_size / 1e6f;
+    return true;
+}
+
+// -- Each word holds its offset in the file: a block read from the wrong place or torn is caught
+void EMMC_Benchmark::fillBlock(uint32_t offset)
+{
+    uint32_t *words = (uint32_t *)buffer;
+    for (size_t i = 0; i < block_size / sizeof(uint32_t); i++)
+    {
+        words[i] = offset + i * sizeof(uint32_t);
+    }
+}
+
+bool EMMC_Benchmark::checkBlock(uint32_t offset)
+{
+    uint32_t *words = (uint32_t *)buffer;
+    for (size_t i = 0; i < block_size / sizeof(uint32_t); i++)
+    {
+        if (words[i] != offset + i * sizeof(uint32_t))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// -- xorshift32: the same offsets on every run, so results compare across modes
+uint32_t EMMC_Benchmark::randomBlock()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % block_count;
+}
+
+// End.
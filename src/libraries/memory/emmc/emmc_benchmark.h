@@ -0,0 +1,91 @@
+#pragma once
+
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_benchmark.h
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 9, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*********************************************************     READ ME    **********************************************************/
+
+// * Storage benchmark for the card behind an EMMC_Memory, in whatever mode, bus width and clock it was mounted with.
+// *
+// * run() writes a test file of file_size bytes in blocks of block_size, then:
+// *  1. sequential write: the whole file, flushed and closed;
+// *  2. sequential read: the whole file;
+// *  3. random write: random_ops blocks at random block aligned offsets, inside the file (no allocation), flushed;
+// *  4. random read: random_ops blocks at random block aligned offsets.
+// * Every block holds its own offset, so the reads check the data too. Times include the file system: opens, seeks,
+// * flushes. The file is deleted at the end.
+// *
+// * The test file must fit on the card, and a block_size buffer must be available in DMA capable memory.
+
+//*****************************************************     LIBRARY SETTINGS    *****************************************************/
+#define EMMC_BENCHMARK_FILE "/benchmark.bin"
+#define EMMC_BENCHMARK_FILE_SIZE (4UL * 1024 * 1024)
+#define EMMC_BENCHMARK_RANDOM_OPS 500
+
+//*****************************************************        LIBRARIES        *****************************************************/
+#include <Arduino.h>
+#include "FS.h"
+#include <utils.h>
+#include "emmc_memory.h"
+
+//*****************************************************       DATA TYPES        *****************************************************/
+struct EMMC_BenchmarkResult
+{
+    // -- Bus the card was mounted with
+    eMMC_CONNECTION_MODE mode;
+    eMMC_BUS_WIDTH bus_width;
+    uint32_t frequency_khz;
+
+    size_t block_size;
+    float sequential_write_MBps;
+    float sequential_read_MBps;
+    float random_write_MBps;
+    float random_read_MBps;
+    float random_write_iops;
+    float random_read_iops;
+    uint32_t max_write_latency_us; // Slowest block write, sequential or random
+    uint32_t errors;               // Blocks read back different from what was written
+};
+
+//****************************************************      BENCHMARK CLASS     ****************************************************/
+class EMMC_Benchmark
+{
+public:
+    EMMC_Benchmark();
+
+    ESP_ERROR run(EMMC_Memory &emmc,
+                  size_t block_size,
+                  EMMC_BenchmarkResult &result,
+                  size_t file_size = EMMC_BENCHMARK_FILE_SIZE,
+                  uint32_t random_ops = EMMC_BENCHMARK_RANDOM_OPS);
+
+    // -- One line: "SDMMC 4 bit 40 MHz, 4096 B: seq W 9.60 R 12.80 MB/s, rand W 1234 R 2345 IOPS"
+    static String toString(const EMMC_BenchmarkResult &result);
+
+private:
+    bool sequentialWrite(fs::FS &file_system, EMMC_BenchmarkResult &result);
+    bool sequentialRead(fs::FS &file_system, EMMC_BenchmarkResult &result);
+    bool randomWrite(fs::FS &file_system, EMMC_BenchmarkResult &result);
+    bool randomRead(fs::FS &file_system, EMMC_BenchmarkResult &result);
+
+    void fillBlock(uint32_t offset);
+    bool checkBlock(uint32_t offset);
+    uint32_t randomBlock();
+
+    uint8_t *buffer;
+    size_t block_size;
+    uint32_t block_count;
+    uint32_t random_ops;
+    uint32_t random_state;
+};
+
+// End.
@@ -0,0 +1,652 @@
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_compression.cpp
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 9, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*****************************************************       HEADER FILE       *****************************************************/
+#include "emmc_compression.h"
+
+//*****************************************************     ENCODING HELPERS    *****************************************************/
+// -- LZ4 block format limits: the last 5 bytes are literals, and the last match starts 12 bytes before the end
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_SKIP_TRIGGER 6 // Misses before the search starts skipping, 2^6
+
+static uint8_t *putLength(uint8_t *p, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        *p++ = 255;
+    }
+    *p++ = (uint8_t)length;
+    return p;
+}
+
+// -- Adds the extension bytes of a length to length. nullptr if they run past end
+static const uint8_t *getLength(const uint8_t *p, const uint8_t *end, size_t &length)
+{
+    uint8_t byte;
+    do
+    {
+        if (p >= end)
+        {
+            return nullptr;
+        }
+        byte = *p++;
+        length += byte;
+    } while (byte == 255);
+    return p;
+}
+
+// -- Small magnitudes, positive or negative, to small unsigned numbers
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// -- 7 bits per byte, the high bit set on every byte but the last
+static uint8_t *putVarint(uint8_t *p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+// -- nullptr if the varint runs past end
+static const uint8_t *getVarint(const uint8_t *p, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (uint8_t shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+// -- Signed little endian value of 1, 2 or 4 bytes
+static int32_t getValue(const uint8_t *p, uint8_t value_size)
+{
+    switch (value_size)
+    {
+    case 1:
+        return (int8_t)p[0];
+    case 2:
+        return (int16_t)(p[0] | p[1] << 8);
+    default:
+        return (int32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+    }
+}
+
+static void putValue(uint8_t *p, int32_t value, uint8_t value_size)
+{
+    for (uint8_t i = 0; i < value_size; i++)
+    {
+        p[i] = (uint8_t)((uint32_t)value >> (8 * i));
+    }
+}
+
+//************************************************     LZ4 CODEC FUNCTIONS DEFINTIONS      *****************************************/
+size_t EMMC_LZ4Codec::compress(const uint8_t *input, size_t length, uint8_t *output, size_t capacity)
+{
+    const uint8_t *ip = input;
+    const uint8_t *anchor = input; // First literal not written yet
+    const uint8_t *end = input + length;
+    uint8_t *op = output;
+    uint8_t *op_end = output + capacity;
+
+    if (length > LZ4_MATCH_LIMIT)
+    {
+        const uint8_t *match_limit = end - LZ4_MATCH_LIMIT;
+        const uint8_t *match_end = end - LZ4_LAST_LITERALS;
+        uint32_t misses = 0;
+        memset(match_table, 0, sizeof(match_table));
+
+        while (ip <= match_limit)
+        {
+            // -- Look up the last position of these 4 bytes
+            uint32_t sequence, candidate;
+            memcpy(&sequence, ip, sizeof(sequence));
+            uint32_t hash = (sequence * 2654435761U) >> (32 - EMMC_LZ4_HASH_LOG);
+            const uint8_t *ref = input + match_table[hash];
+            match_table[hash] = ip - input;
+            memcpy(&candidate, ref, sizeof(candidate));
+
+            if (ref >= ip || candidate != sequence)
+            {
+                // -- Skip faster through data that does not compress
+                ip += 1 + (misses++ >> LZ4_SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            // -- Extend the match backwards over the pending literals, then forwards
+            while (ip > anchor && ref > input && ip[-1] == ref[-1])
+            {
+                ip--;
+                ref--;
+            }
+            const uint8_t *match = ip + LZ4_MIN_MATCH;
+            const uint8_t *match_ref = ref + LZ4_MIN_MATCH;
+            while (match < match_end && *match == *match_ref)
+            {
+                match++;
+                match_ref++;
+            }
+
+            // -- Sequence: token, literal length, literals, offset, match length
+            size_t literals = ip - anchor;
+            size_t match_length = match - ip - LZ4_MIN_MATCH;
+            if ((size_t)(op_end - op) < 1 + literals / 255 + 1 + literals + 2 + match_length / 255 + 1)
+            {
+                return 0;
+            }
+
+            uint8_t *token = op++;
+            *token = (uint8_t)(min(literals, (size_t)15) << 4 | min(match_length, (size_t)15));
+            if (literals >= 15)
+            {
+                op = putLength(op, literals - 15);
+            }
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            uint16_t offset = ip - ref;
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+            if (match_length >= 15)
+            {
+                op = putLength(op, match_length - 15);
+            }
+
+            ip = match;
+            anchor = ip;
+        }
+    }
+
+    // -- Last sequence: literals only
+    size_t literals = end - anchor;
+    if ((size_t)(op_end - op) < 1 + literals / 255 + 1 + literals)
+    {
+        return 0;
+    }
+    *op++ = (uint8_t)(min(literals, (size_t)15) << 4);
+    if (literals >= 15)
+    {
+        op = putLength(op, literals - 15);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - output;
+}
+
+bool EMMC_LZ4Codec::decode(const uint8_t *input, size_t length, uint8_t *output, size_t raw_length)
+{
+    const uint8_t *ip = input;
+    const uint8_t *end = input + length;
+    uint8_t *op = output;
+    uint8_t *op_end = output + raw_length;
+
+    while (ip < end)
+    {
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !(ip = getLength(ip, end, literals)))
+        {
+            return false;
+        }
+        if (literals > (size_t)(end - ip) || literals > (size_t)(op_end - op))
+        {
+            return false;
+        }
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        // -- The last sequence has no match
+        if (ip == end)
+        {
+            break;
+        }
+
+        if (end - ip < 2)
+        {
+            return false;
+        }
+        size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !(ip = getLength(ip, end, match_length)))
+        {
+            return false;
+        }
+        match_length += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - output) || match_length > (size_t)(op_end - op))
+        {
+            return false;
+        }
+
+        // -- Byte by byte: the match may overlap the bytes it produces
+        const uint8_t *ref = op - offset;
+        for (size_t i = 0; i < match_length; i++)
+        {
+            op[i] = ref[i];
+        }
+        op += match_length;
+    }
+
+    return op == op_end;
+}
+
+//*********************************************     DELTA VARINT CODEC FUNCTIONS DEFINTIONS      ************************************/
+EMMC_DeltaVarintCodec::EMMC_DeltaVarintCodec(uint8_t value_size, uint8_t channels)
+{
+    this->value_size = value_size == 1 || value_size == 4 ? value_size : 2;
+    this->channels = constrain(channels, 1, 64);
+}
+
+// -- Bits 0-1: value size 1, 2 or 4 as 0, 1, 2. Bits 2-7: channels - 1
+uint8_t EMMC_DeltaVarintCodec::getParameter()
+{
+    uint8_t size_code = value_size == 1 ? 0 : (value_size == 2 ? 1 : 2);
+    return (uint8_t)((channels - 1) << 2 | size_code);
+}
+
+size_t EMMC_DeltaVarintCodec::compress(const uint8_t *input, size_t length, uint8_t *output, size_t capacity)
+{
+    int32_t previous[64] = {};
+    size_t count = length / value_size;
+    uint8_t *op = output;
+    uint8_t *op_end = output + capacity;
+    uint8_t channel = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (op_end - op < 10)
+        {
+            return 0;
+        }
+
+        int32_t value = getValue(input + i * value_size, value_size);
+        op = putVarint(op, zigzag((int64_t)value - previous[channel]));
+        previous[channel] = value;
+        channel = channel + 1 == channels ? 0 : channel + 1;
+    }
+
+    // -- A partial value at the end of a flushed block, as it is
+    size_t tail = length - count * value_size;
+    if ((size_t)(op_end - op) < tail)
+    {
+        return 0;
+    }
+    memcpy(op, input + count * value_size, tail);
+    op += tail;
+
+    return op - output;
+}
+
+bool EMMC_DeltaVarintCodec::decode(const uint8_t *input,
+                                   size_t length,
+                                   uint8_t *output,
+                                   size_t raw_length,
+                                   uint8_t parameter)
+{
+    uint8_t value_size = 1 << (parameter & 0x03);
+    uint8_t channels = (parameter >> 2) + 1;
+    if (value_size > 4)
+    {
+        return false;
+    }
+
+    int32_t previous[64] = {};
+    size_t count = raw_length / value_size;
+    size_t tail = raw_length - count * value_size;
+    const uint8_t *ip = input;
+    const uint8_t *end = input + length;
+    uint8_t channel = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t delta;
+        if (!(ip = getVarint(ip, end, delta)))
+        {
+            return false;
+        }
+
+        int32_t value = (int32_t)(previous[channel] + unzigzag(delta));
+        putValue(output + i * value_size, value, value_size);
+        previous[channel] = value;
+        channel = channel + 1 == channels ? 0 : channel + 1;
+    }
+
+    if ((size_t)(end - ip) != tail)
+    {
+        return false;
+    }
+    memcpy(output + count * value_size, ip, tail);
+    return true;
+}
+
+//*********************************************     COMPRESSED WRITER FUNCTIONS DEFINTIONS      *************************************/
+EMMC_CompressedWriter::EMMC_CompressedWriter()
+{
+    output = nullptr;
+    codec = nullptr;
+    compression_block_size = EMMC_COMPRESSION_BLOCK_SIZE;
+    compression_open = false;
+    write_error = false;
+    block_fill = 0;
+    block_callback = nullptr;
+    callback_arg = nullptr;
+    resetStats();
+}
+
+ESP_ERROR EMMC_CompressedWriter::begin(Print &output, EMMC_Codec &codec, size_t block_size)
+{
+    if (compression_open)
+    {
+        return ESP_ERROR(true, "Compressed writer already open");
+    }
+
+    if (block_size == 0 || block_size > EMMC_COMPRESSION_BLOCK_SIZE || block_size % codec.getAlignment() != 0)
+    {
+        return ESP_ERROR(true, "Block size must be a multiple of the codec alignment, up to EMMC_COMPRESSION_BLOCK_SIZE");
+    }
+
+    this->output = &output;
+    this->codec = &codec;
+    compression_block_size = block_size;
+    block_fill = 0;
+    write_error = false;
+    resetStats();
+
+    compression_open = true;
+    return ESP_ERROR();
+}
+
+size_t EMMC_CompressedWriter::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+size_t EMMC_CompressedWriter::write(const uint8_t *data, size_t length)
+{
+    if (!compression_open || write_error)
+    {
+        return 0;
+    }
+
+    size_t done = 0;
+    while (done < length)
+    {
+        size_t n = min(length - done, compression_block_size - block_fill);
+        memcpy(block + block_fill, data + done, n);
+        block_fill += n;
+        done += n;
+
+        if (block_fill == compression_block_size && !writeFrame())
+        {
+            break;
+        }
+    }
+
+    return done;
+}
+
+void EMMC_CompressedWriter::flush()
+{
+    if (!compression_open || write_error)
+    {
+        return;
+    }
+
+    if (block_fill > 0)
+    {
+        writeFrame();
+    }
+    output->flush();
+}
+
+ESP_ERROR EMMC_CompressedWriter::close()
+{
+    if (!compression_open)
+    {
+        return ESP_ERROR(true, "Compressed writer is not open");
+    }
+
+    flush();
+    compression_open = false;
+    output = nullptr;
+
+    return getError();
+}
+
+ESP_ERROR EMMC_CompressedWriter::getError()
+{
+    if (write_error)
+    {
+        return ESP_ERROR(true, "Compressed write operation failed");
+    }
+
+    return ESP_ERROR();
+}
+
+EMMC_CompressionStats EMMC_CompressedWriter::getStats()
+{
+    EMMC_CompressionStats s = stats;
+    if (s.stored_bytes > 0)
+    {
+        s.ratio = (float)s.raw_bytes / s.stored_bytes;
+    }
+    if (s.blocks > 0)
+    {
+        s.mean_compress_us = (float)compress_sum_us / s.blocks;
+    }
+    if (compress_sum_us > 0)
+    {
+        s.compress_MBps = (float)s.raw_bytes / compress_sum_us;
+    }
+    return s;
+}
+
+void EMMC_CompressedWriter::resetStats()
+{
+    stats = {};
+    stats.min_ratio = INFINITY;
+    compress_sum_us = 0;
+}
+
+// -- CRC-32 update, start with 0xFFFFFFFF and invert the result
+uint32_t EMMC_CompressedWriter::crc32(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= bytes[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return crc;
+}
+
+// -- Compress the block into a frame, or store it when it does not get smaller
+bool EMMC_CompressedWriter::writeFrame()
+{
+    EMMC_CompressionFrame header;
+    uint8_t *payload = frame + sizeof(header);
+
+    uint32_t start = micros();
+    size_t stored_length = codec->compress(block, block_fill, payload, block_fill - 1);
+    uint32_t compress_us = micros() - start;
+
+    header.magic = EMMC_COMPRESSION_MAGIC;
+    header.codec = codec->getId();
+    header.parameter = codec->getParameter();
+    if (stored_length == 0 || stored_length >= block_fill)
+    {
+        header.codec = CODEC_STORED;
+        header.parameter = 0;
+        stored_length = block_fill;
+        memcpy(payload, block, block_fill);
+    }
+    header.raw_length = block_fill;
+    header.stored_length = stored_length;
+    header.crc = ~crc32(0xFFFFFFFF, block, block_fill);
+    memcpy(frame, &header, sizeof(header));
+
+    size_t frame_length = sizeof(header) + stored_length;
+    if (output->write(frame, frame_length) != frame_length)
+    {
+        write_error = true;
+        return false;
+    }
+
+    // -- Report the frame
+    EMMC_CompressionBlock info;
+    info.codec = header.codec;
+    info.raw_length = block_fill;
+    info.stored_length = frame_length;
+    info.ratio = (float)block_fill / frame_length;
+    info.compress_us = compress_us;
+
+    stats.blocks++;
+    stats.blocks_stored += header.codec == CODEC_STORED;
+    stats.raw_bytes += block_fill;
+    stats.stored_bytes += frame_length;
+    stats.min_ratio = min(stats.min_ratio, info.ratio);
+    stats.max_compress_us = max(stats.max_compress_us, compress_us);
+    compress_sum_us += compress_us;
+
+    block_fill = 0;
+    if (block_callback)
+    {
+        block_callback(info, callback_arg);
+    }
+    return true;
+}
+
+//*********************************************     COMPRESSED READER FUNCTIONS DEFINTIONS      *************************************/
+EMMC_CompressedReader::EMMC_CompressedReader()
+{
+    source_file = nullptr;
+    frame_position = 0;
+    user_codec = nullptr;
+    block_length = 0;
+    block_read = 0;
+}
+
+ESP_ERROR EMMC_CompressedReader::begin(File &file)
+{
+    if (!file)
+    {
+        return ESP_ERROR(true, "File is not open");
+    }
+
+    source_file = &file;
+    frame_position = file.position();
+    read_error = ESP_ERROR();
+    block_length = 0;
+    block_read = 0;
+    return ESP_ERROR();
+}
+
+size_t EMMC_CompressedReader::readBlock(uint8_t *buffer)
+{
+    EMMC_CompressionFrame header;
+    if (source_file == nullptr || read_error.on_error ||
+        source_file->read((uint8_t *)&header, sizeof(header)) != sizeof(header))
+    {
+        return 0;
+    }
+
+    if (header.magic != EMMC_COMPRESSION_MAGIC || header.raw_length > EMMC_COMPRESSION_BLOCK_SIZE ||
+        header.stored_length > EMMC_COMPRESSION_BLOCK_SIZE)
+    {
+        read_error = ESP_ERROR(true, "Not a compressed frame");
+        return 0;
+    }
+    if (source_file->read(stored, header.stored_length) != header.stored_length)
+    {
+        read_error = ESP_ERROR(true, "Compressed frame cut short");
+        return 0;
+    }
+
+    bool decoded;
+    switch (header.codec)
+    {
+    case CODEC_STORED:
+        decoded = header.stored_length == header.raw_length;
+        memcpy(buffer, stored, header.raw_length);
+        break;
+    case CODEC_LZ4:
+        decoded = EMMC_LZ4Codec::decode(stored, header.stored_length, buffer, header.raw_length);
+        break;
+    case CODEC_DELTA_VARINT:
+        decoded = EMMC_DeltaVarintCodec::decode(stored, header.stored_length, buffer, header.raw_length,
+                                                header.parameter);
+        break;
+    default:
+        decoded = user_codec && user_codec->getId() == header.codec &&
+                  user_codec->decompress(stored, header.stored_length, buffer, header.raw_length, header.parameter);
+        break;
+    }
+
+    if (!decoded || header.crc != ~EMMC_CompressedWriter::crc32(0xFFFFFFFF, buffer, header.raw_length))
+    {
+        read_error = ESP_ERROR(true, "Compressed frame damaged");
+        return 0;
+    }
+
+    frame_position += sizeof(header) + header.stored_length;
+    return header.raw_length;
+}
+
+size_t EMMC_CompressedReader::read(uint8_t *buffer, size_t length)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+        if (block_read == block_length)
+        {
+            block_length = readBlock(block);
+            block_read = 0;
+            if (block_length == 0)
+            {
+                break;
+            }
+        }
+
+        size_t n = min(length - done, block_length - block_read);
+        memcpy(buffer + done, block + block_read, n);
+        block_read += n;
+        done += n;
+    }
+
+    return done;
+}
+
+// End.
@@ -0,0 +1,277 @@
+#pragma once
+
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_compression.h
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 9, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*********************************************************     READ ME    **********************************************************/
+
+// * Compression stage for log writes: fewer bytes to write to the card, and to upload later.
+// *
+// * EMMC_CompressedWriter is a Print placed in front of any other Print: EMMC_StreamWriter, EMMC_LogWriter, a File.
+// * Data is collected in blocks (4 KB by default), and each block is compressed on its own by an EMMC_Codec and
+// * written as one frame: an EMMC_CompressionFrame header followed by the compressed bytes. A block that does not
+// * get smaller is stored as it is, so incompressible data costs the frame header and nothing more. No state is
+// * carried from one block to the next, so EMMC_CompressedReader can start decompressing at any frame.
+// *
+// * Codecs:
+// *  - EMMC_LZ4Codec: LZ4 block format, fast general purpose compression for CAN frames, text, mixed records;
+// *  - EMMC_DeltaVarintCodec: for records of signed 8, 16 or 32 bit channels, e.g. ADC samples. Each value is stored
+// *    as a zigzag varint of its change from the same channel in the previous record, one byte for slow signals.
+// * Other codecs derive from EMMC_Codec and use an id from CODEC_USER up.
+// *
+// * Every buffer is a member of its class, sized by the settings below, so nothing is allocated while logging:
+// * declare the writer and the codec as globals or statics to keep them off the task stack.
+// * Each frame written is reported, with its ratio and compression time, to the callback of setBlockCallback().
+
+//*****************************************************     LIBRARY SETTINGS    *****************************************************/
+#define EMMC_COMPRESSION_BLOCK_SIZE 4096 // Largest block, in bytes. At most 65535
+#define EMMC_COMPRESSION_MAGIC 0x5A43    // "CZ"
+#define EMMC_LZ4_HASH_LOG 12             // 2^12 entry match table, 8 KB
+
+//*****************************************************        LIBRARIES        *****************************************************/
+#include <Arduino.h>
+#include "FS.h"
+#include <utils.h>
+
+//*****************************************************       DATA TYPES        *****************************************************/
+enum EMMC_CODEC_ID : uint8_t
+{
+    CODEC_STORED,        // Block stored as it is
+    CODEC_LZ4,           // EMMC_LZ4Codec
+    CODEC_DELTA_VARINT,  // EMMC_DeltaVarintCodec
+    CODEC_USER = 16,     // First id for other codecs
+};
+
+// -- Frame header, followed by stored_length bytes. Little endian
+struct __attribute__((packed)) EMMC_CompressionFrame
+{
+    uint16_t magic;         // EMMC_COMPRESSION_MAGIC
+    uint8_t codec;          // EMMC_CODEC_ID
+    uint8_t parameter;      // Codec settings the decoder needs, see EMMC_Codec::getParameter()
+    uint16_t raw_length;    // Bytes of the block
+    uint16_t stored_length; // Bytes after this header
+    uint32_t crc;           // CRC-32 of the block as it was written, checked after decompression
+};
+
+// -- One frame, as given to the block callback
+struct EMMC_CompressionBlock
+{
+    uint8_t codec;          // CODEC_STORED when the codec could not make the block smaller
+    uint16_t raw_length;
+    uint32_t stored_length; // Frame header included
+    float ratio;            // raw_length / stored_length
+    uint32_t compress_us;   // Time in the codec
+};
+
+// -- Writer statistics, since begin() or resetStats()
+struct EMMC_CompressionStats
+{
+    uint32_t blocks;
+    uint32_t blocks_stored; // Blocks that did not compress, stored as they are
+    uint64_t raw_bytes;
+    uint64_t stored_bytes;  // Frames, headers included
+    float ratio;            // raw_bytes / stored_bytes
+    float min_ratio;        // Worst block
+    uint32_t max_compress_us;
+    float mean_compress_us;
+    float compress_MBps;    // raw_bytes over the time spent in the codec
+};
+
+typedef void (*EMMC_CompressionCallback)(const EMMC_CompressionBlock &block, void *arg);
+
+//*****************************************************        CODEC CLASSES        *************************************************/
+class EMMC_Codec
+{
+public:
+    virtual ~EMMC_Codec() {}
+
+    virtual uint8_t getId() = 0;
+
+    // -- Stored in each frame, and given back to decompress()
+    virtual uint8_t getParameter()
+    {
+        return 0;
+    }
+
+    // -- Blocks are cut on multiples of this, e.g. the size of a record
+    virtual size_t getAlignment()
+    {
+        return 1;
+    }
+
+    // -- Bytes written to output, 0 if they would not fit in capacity
+    virtual size_t compress(const uint8_t *input, size_t length, uint8_t *output, size_t capacity) = 0;
+
+    // -- False if input is not a valid block of raw_length bytes
+    virtual bool decompress(const uint8_t *input, size_t length, uint8_t *output, size_t raw_length,
+                            uint8_t parameter) = 0;
+};
+
+class EMMC_LZ4Codec : public EMMC_Codec
+{
+public:
+    uint8_t getId() override
+    {
+        return CODEC_LZ4;
+    }
+
+    size_t compress(const uint8_t *input, size_t length, uint8_t *output, size_t capacity) override;
+    bool decompress(const uint8_t *input, size_t length, uint8_t *output, size_t raw_length,
+                    uint8_t /*parameter*/) override
+    {
+        return decode(input, length, output, raw_length);
+    }
+
+    // -- Decompression needs no table, EMMC_CompressedReader calls this
+    static bool decode(const uint8_t *input, size_t length, uint8_t *output, size_t raw_length);
+
+private:
+    uint16_t match_table[1 << EMMC_LZ4_HASH_LOG]; // Last position of each hashed 4 byte sequence
+};
+
+class EMMC_DeltaVarintCodec : public EMMC_Codec
+{
+public:
+    // -- Records of channels values of value_size bytes (1, 2 or 4), at most 64 channels
+    EMMC_DeltaVarintCodec(uint8_t value_size = 2, uint8_t channels = 1);
+
+    uint8_t getId() override
+    {
+        return CODEC_DELTA_VARINT;
+    }
+
+    uint8_t getParameter() override;
+    size_t getAlignment() override
+    {
+        return value_size * channels;
+    }
+
+    size_t compress(const uint8_t *input, size_t length, uint8_t *output, size_t capacity) override;
+    bool decompress(const uint8_t *input, size_t length, uint8_t *output, size_t raw_length,
+                    uint8_t parameter) override
+    {
+        return decode(input, length, output, raw_length, parameter);
+    }
+
+    static bool decode(const uint8_t *input, size_t length, uint8_t *output, size_t raw_length, uint8_t parameter);
+
+private:
+    uint8_t value_size;
+    uint8_t channels;
+};
+
+//**************************************************     COMPRESSED WRITER CLASS    *************************************************/
+class EMMC_CompressedWriter : public Print
+{
+public:
+    EMMC_CompressedWriter();
+
+    // -- Frames go to output. block_size must be a multiple of codec.getAlignment()
+    ESP_ERROR begin(Print &output, EMMC_Codec &codec, size_t block_size = EMMC_COMPRESSION_BLOCK_SIZE);
+
+    // -- Write operations. Return the number of bytes accepted, 0 after a write error
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *data, size_t length) override;
+    using Print::write;
+
+    // -- Write the partially filled block as a shorter frame, then flush the output
+    void flush() override;
+
+    // -- Flush and detach from the output
+    ESP_ERROR close();
+
+    void setBlockCallback(EMMC_CompressionCallback callback, void *arg = nullptr)
+    {
+        block_callback = callback;
+        callback_arg = arg;
+    }
+
+    // -- State Operations
+    bool isOpen()
+    {
+        return compression_open;
+    }
+
+    ESP_ERROR getError();
+    EMMC_CompressionStats getStats();
+    void resetStats();
+
+    static uint32_t crc32(uint32_t crc, const void *data, size_t length);
+
+private:
+    bool writeFrame();
+
+    Print *output;
+    EMMC_Codec *codec;
+    size_t compression_block_size;
+    bool compression_open;
+    bool write_error;
+
+    // -- Block being filled, and the frame it is compressed into
+    uint8_t block[EMMC_COMPRESSION_BLOCK_SIZE];
+    size_t block_fill;
+    uint8_t frame[sizeof(EMMC_CompressionFrame) + EMMC_COMPRESSION_BLOCK_SIZE];
+
+    EMMC_CompressionCallback block_callback;
+    void *callback_arg;
+
+    EMMC_CompressionStats stats;
+    uint64_t compress_sum_us;
+};
+
+//**************************************************     COMPRESSED READER CLASS    *************************************************/
+class EMMC_CompressedReader
+{
+public:
+    EMMC_CompressedReader();
+
+    // -- Read frames from the current position of file. Seek the file to any frame first to start there
+    ESP_ERROR begin(File &file);
+
+    // -- For frames of CODEC_USER codecs
+    void setCodec(EMMC_Codec &codec)
+    {
+        user_codec = &codec;
+    }
+
+    // -- Decompress the next frame into buffer, EMMC_COMPRESSION_BLOCK_SIZE bytes. Returns its length, 0 at the end
+    // -- of the file or on a damaged frame (see getError())
+    size_t readBlock(uint8_t *buffer);
+
+    // -- The decompressed data, across blocks. Returns 0 at the end
+    size_t read(uint8_t *buffer, size_t length);
+
+    ESP_ERROR getError()
+    {
+        return read_error;
+    }
+
+    // -- File position of the next frame
+    uint64_t getFramePosition()
+    {
+        return frame_position;
+    }
+
+private:
+    File *source_file;
+    uint64_t frame_position;
+    ESP_ERROR read_error;
+    EMMC_Codec *user_codec;
+
+    // -- Stored frame, and the block decompressed for read()
+    uint8_t stored[EMMC_COMPRESSION_BLOCK_SIZE];
+    uint8_t block[EMMC_COMPRESSION_BLOCK_SIZE];
+    size_t block_length;
+    size_t block_read;
+};
+
+// End.
@@ -0,0 +1,370 @@
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_directory.cpp
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 9, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*****************************************************       HEADER FILE       *****************************************************/
+#include "emmc_directory.h"
+
+#include <algorithm>
+
+//*********************************************     DIRECTORY ITERATOR FUNCTIONS DEFINTIONS      ************************************/
+EMMC_DirectoryIterator::EMMC_DirectoryIterator()
+{
+    file_system = nullptr;
+    directory_level = 0;
+    max_level = 0;
+}
+
+ESP_ERROR EMMC_DirectoryIterator::begin(fs::FS &file_system, const char *path, uint8_t levels)
+{
+    close();
+    this->file_system = &file_system;
+    max_level = min(levels, (uint8_t)EMMC_DIRECTORY_MAX_LEVELS);
+
+    String dirname = EMMC_MetadataCache::normalize(path);
+    File root = file_system.open(dirname.c_str());
+    if (!root)
+    {
+        return ESP_ERROR(true, "Failed to open directory");
+    }
+    if (!root.isDirectory())
+    {
+        root.close();
+        return ESP_ERROR(true, "Not a Directory");
+    }
+    root.close();
+
+    pending.push_back({dirname, 0});
+    return ESP_ERROR();
+}
+
+bool EMMC_DirectoryIterator::next(EMMC_FileInfo &info)
+{
+    while (directory || openNext())
+    {
+        File file = directory.openNextFile();
+        if (!file)
+        {
+            directory.close();
+            continue;
+        }
+
+        // -- name() is the full path on older cores and the last component on newer ones, keep the last component
+        const char *name = strrchr(file.name(), '/');
+        name = name ? name + 1 : file.name();
+        info.path = directory_path == "/" ? directory_path + name : directory_path + "/" + name;
+        info.is_directory = file.isDirectory();
+        info.size = info.is_directory ? 0 : file.size();
+        info.last_write = file.getLastWrite();
+        info.level = directory_level;
+        file.close();
+
+        if (info.is_directory && directory_level < max_level)
+        {
+            pending.push_back({info.path, (uint8_t)(directory_level + 1)});
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void EMMC_DirectoryIterator::close()
+{
+    if (directory)
+    {
+        directory.close();
+    }
+    pending.clear();
+}
+
+// -- Open the last subdirectory found. False when none is left
+bool EMMC_DirectoryIterator::openNext()
+{
+    while (!pending.empty())
+    {
+        Pending next = pending.back();
+        pending.pop_back();
+
+        directory = file_system->open(next.path.c_str());
+        if (directory && directory.isDirectory())
+        {
+            directory_path = next.path;
+            directory_level = next.level;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//***********************************************     METADATA CACHE FUNCTIONS DEFINTIONS      **************************************/
+EMMC_MetadataCache::EMMC_MetadataCache()
+{
+    cache_valid = false;
+    cache_truncated = false;
+    stats = {};
+}
+
+ESP_ERROR EMMC_MetadataCache::build(fs::FS &file_system)
+{
+    clear();
+    uint32_t start = millis();
+
+    EMMC_DirectoryIterator iterator;
+    ESP_ERROR err = iterator.begin(file_system, "/", EMMC_DIRECTORY_MAX_LEVELS);
+    if (err.on_error)
+    {
+        return err;
+    }
+
+    EMMC_FileInfo info;
+    while (iterator.next(info))
+    {
+        if (entries.size() == EMMC_METADATA_CACHE_MAX_ENTRIES)
+        {
+            iterator.close();
+            clear();
+            return ESP_ERROR(true, "More files than EMMC_METADATA_CACHE_MAX_ENTRIES, metadata cache off");
+        }
+        entries.push_back(info);
+        cache_truncated |= info.is_directory && info.level == EMMC_DIRECTORY_MAX_LEVELS;
+    }
+
+    // -- The walk goes directory by directory, the lookups need path order
+    sortByPath(entries);
+
+    stats.build_ms = millis() - start;
+    cache_valid = true;
+    return ESP_ERROR();
+}
+
+void EMMC_MetadataCache::clear()
+{
+    entries.clear();
+    entries.shrink_to_fit();
+    cache_valid = false;
+    cache_truncated = false;
+}
+
+bool EMMC_MetadataCache::covers(const char *dirname, uint8_t levels)
+{
+    String prefix = directoryPrefix(dirname);
+    return cache_valid && (!cache_truncated || depth(prefix) + levels <= EMMC_DIRECTORY_MAX_LEVELS);
+}
+
+bool EMMC_MetadataCache::get(const char *path, EMMC_FileInfo &info)
+{
+    String key = normalize(path);
+    size_t i = lowerBound(key.c_str());
+    if (!cache_valid || i == entries.size() || entries[i].path != key)
+    {
+        return false;
+    }
+
+    stats.lookups++;
+    info = entries[i];
+    return true;
+}
+
+size_t EMMC_MetadataCache::list(const char *dirname, uint8_t levels, std::vector<EMMC_FileInfo> &entries)
+{
+    return collect(dirname, levels, false, 0, entries);
+}
+
+// -- Files only
+size_t EMMC_MetadataCache::findNewerThan(const char *dirname,
+                                         time_t time,
+                                         uint8_t levels,
+                                         std::vector<EMMC_FileInfo> &files)
+{
+    return collect(dirname, levels, true, time, files);
+}
+
+void EMMC_MetadataCache::update(const char *path, uint64_t size, time_t last_write, bool is_directory)
+{
+    String key = normalize(path);
+    if (!cache_valid || key == "/")
+    {
+        return;
+    }
+
+    // -- Deeper than the cache goes: listings that deep walk the card from now on
+    cache_truncated |= is_directory && depth(key) == EMMC_DIRECTORY_MAX_LEVELS;
+    if (depth(key) > EMMC_DIRECTORY_MAX_LEVELS)
+    {
+        cache_truncated = true;
+        return;
+    }
+
+    size_t i = lowerBound(key.c_str());
+    if (i == entries.size() || entries[i].path != key)
+    {
+        if (entries.size() == EMMC_METADATA_CACHE_MAX_ENTRIES)
+        {
+            clear();
+            return;
+        }
+        entries.insert(entries.begin() + i, EMMC_FileInfo());
+        entries[i].path = key;
+    }
+
+    entries[i].size = size;
+    entries[i].last_write = last_write;
+    entries[i].is_directory = is_directory;
+    entries[i].level = 0;
+    stats.updates++;
+}
+
+void EMMC_MetadataCache::remove(const char *path)
+{
+    String key = normalize(path);
+    String prefix = directoryPrefix(path);
+
+    // -- The entry, then what is under it. Paths like "/logs.old" sort in between, so these are two runs
+    size_t first = lowerBound(key.c_str());
+    if (first < entries.size() && entries[first].path == key)
+    {
+        entries.erase(entries.begin() + first);
+    }
+
+    first = lowerBound(prefix.c_str());
+    size_t last = first;
+    while (last < entries.size() && entries[last].path.startsWith(prefix))
+    {
+        last++;
+    }
+    entries.erase(entries.begin() + first, entries.begin() + last);
+    stats.updates++;
+}
+
+void EMMC_MetadataCache::rename(const char *from, const char *to)
+{
+    if (!cache_valid)
+    {
+        return;
+    }
+
+    String old_key = normalize(from);
+    String old_prefix = directoryPrefix(from);
+    String new_key = normalize(to);
+
+    // -- Take the entry and everything under it out, then put them back under the new path
+    std::vector<EMMC_FileInfo> moved;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].path == old_key || entries[i].path.startsWith(old_prefix))
+        {
+            moved.push_back(entries[i]);
+        }
+    }
+    remove(from);
+    remove(to);
+
+    for (EMMC_FileInfo &entry : moved)
+    {
+        String path = new_key + entry.path.substring(old_key.length());
+        update(path.c_str(), entry.size, entry.last_write, entry.is_directory);
+    }
+}
+
+EMMC_MetadataCacheStats EMMC_MetadataCache::getStats()
+{
+    EMMC_MetadataCacheStats s = stats;
+    s.entries = entries.size();
+    return s;
+}
+
+void EMMC_MetadataCache::sortByPath(std::vector<EMMC_FileInfo> &entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const EMMC_FileInfo &a, const EMMC_FileInfo &b) {
+        return strcmp(a.path.c_str(), b.path.c_str()) < 0;
+    });
+}
+
+String EMMC_MetadataCache::directoryPrefix(const char *dirname)
+{
+    String prefix = normalize(dirname);
+    return prefix == "/" ? prefix : prefix + "/";
+}
+
+String EMMC_MetadataCache::normalize(const char *path)
+{
+    String p = path[0] == '/' ? String(path) : String("/") + path;
+    while (p.length() > 1 && p.endsWith("/"))
+    {
+        p = p.substring(0, p.length() - 1);
+    }
+    return p;
+}
+
+// -- Every path under the prefix is in one run of the sorted entries
+size_t EMMC_MetadataCache::collect(const char *dirname,
+                                   uint8_t levels,
+                                   bool files_only,
+                                   time_t newer_than,
+                                   std::vector<EMMC_FileInfo> &found)
+{
+    found.clear();
+    if (!cache_valid)
+    {
+        return 0;
+    }
+    stats.lookups++;
+
+    String prefix = directoryPrefix(dirname);
+    uint8_t base = depth(prefix);
+
+    for (size_t i = lowerBound(prefix.c_str()); i < entries.size() && entries[i].path.startsWith(prefix); i++)
+    {
+        const EMMC_FileInfo &entry = entries[i];
+        uint8_t level = depth(entry.path) - base;
+        if (level <= levels && (!files_only || (!entry.is_directory && entry.last_write > newer_than)))
+        {
+            found.push_back(entry);
+            found.back().level = level;
+        }
+    }
+
+    return found.size();
+}
+
+// -- First entry not before path
+size_t EMMC_MetadataCache::lowerBound(const char *path)
+{
+    size_t low = 0, high = entries.size();
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (strcmp(entries[middle].path.c_str(), path) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// -- Slashes after the first: 0 for "/logs" and "/", 1 for "/logs/" and "/logs/ride.csv"
+uint8_t EMMC_MetadataCache::depth(const String &path)
+{
+    uint8_t slashes = 0;
+    for (unsigned int i = 1; i < path.length(); i++)
+    {
+        slashes += path[i] == '/';
+    }
+    return slashes;
+}
+
+// End.
@@ -0,0 +1,146 @@
+#pragma once
+
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_directory.h
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 9, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*********************************************************     READ ME    **********************************************************/
+
+// * Directory listings for EMMC_Memory.
+// *
+// * EMMC_DirectoryIterator walks a directory tree, levels deep, one entry per next() call. Only one directory is open
+// * at a time: the subdirectories found are walked after the directory holding them, so the walk never needs more
+// * file handles than the one (SD_MMC opens 5 at most by default).
+// *
+// * Every entry of a FAT directory costs a read of the directory and an open, so walking thousands of log files
+// * takes seconds. EMMC_MetadataCache keeps the path, size and time of last write of every file in RAM, sorted by
+// * path: listing a directory or finding the files written since some time is then a lookup. EMMC_Memory builds it
+// * when the card is mounted (see EMMC_Memory::setMetadataCache) and keeps it up to date on its own writes, renames
+// * and deletes. Files written through a File or a stream writer are picked up with EMMC_Memory::refreshMetadata().
+// *
+// * The cache holds EMMC_METADATA_CACHE_MAX_ENTRIES entries, about 60 bytes each with a short path. A card holding
+// * more turns it off, and listings go back to walking the card. So do listings reaching below
+// * EMMC_DIRECTORY_MAX_LEVELS, if the card has directories that deep.
+
+//*****************************************************     LIBRARY SETTINGS    *****************************************************/
+#define EMMC_DIRECTORY_MAX_LEVELS 8            // Deepest walk, and levels the metadata cache covers
+#define EMMC_METADATA_CACHE_MAX_ENTRIES 4096   // Files and directories
+
+//*****************************************************        LIBRARIES        *****************************************************/
+#include <Arduino.h>
+#include "FS.h"
+#include <utils.h>
+
+#include <vector>
+
+//*****************************************************       DATA TYPES        *****************************************************/
+struct EMMC_FileInfo
+{
+    String path;        // Full path, e.g. "/logs/ride_001.csv"
+    uint64_t size;      // Bytes, 0 for directories
+    time_t last_write;  // As stored by the file system
+    bool is_directory;
+    uint8_t level;      // 0 for entries of the listed directory, 1 for the entries of its subdirectories...
+};
+
+struct EMMC_MetadataCacheStats
+{
+    uint32_t entries;
+    uint32_t build_ms;    // Time the last build() took walking the card
+    uint32_t lookups;     // Listings and queries answered from RAM
+    uint32_t updates;     // Changes made without walking the card
+};
+
+//**************************************************     DIRECTORY ITERATOR CLASS    ************************************************/
+class EMMC_DirectoryIterator
+{
+public:
+    EMMC_DirectoryIterator();
+
+    // -- Walk path and, levels deep, its subdirectories
+    ESP_ERROR begin(fs::FS &file_system, const char *path, uint8_t levels = 0);
+
+    // -- Next entry, false when the walk is over
+    bool next(EMMC_FileInfo &info);
+
+    void close();
+
+private:
+    bool openNext();
+
+    struct Pending
+    {
+        String path;
+        uint8_t level;
+    };
+
+    fs::FS *file_system;
+    File directory;
+    String directory_path;
+    uint8_t directory_level; // Level of the entries of the open directory
+    uint8_t max_level;
+    std::vector<Pending> pending; // Subdirectories found, walked last found first
+};
+
+//***************************************************     METADATA CACHE CLASS    ***************************************************/
+class EMMC_MetadataCache
+{
+public:
+    EMMC_MetadataCache();
+
+    // -- Walk the whole card, EMMC_DIRECTORY_MAX_LEVELS deep
+    ESP_ERROR build(fs::FS &file_system);
+    void clear();
+
+    // -- False before build(), or after the card outgrew the cache
+    bool isValid()
+    {
+        return cache_valid;
+    }
+
+    // -- True if listing dirname levels deep can be answered from the cache
+    bool covers(const char *dirname, uint8_t levels);
+
+    // -- Lookups
+    bool get(const char *path, EMMC_FileInfo &info);
+    size_t list(const char *dirname, uint8_t levels, std::vector<EMMC_FileInfo> &entries);
+    size_t findNewerThan(const char *dirname, time_t time, uint8_t levels, std::vector<EMMC_FileInfo> &files);
+
+    // -- Updates, after the same change was made on the card
+    void update(const char *path, uint64_t size, time_t last_write, bool is_directory = false);
+    void remove(const char *path); // And everything under it
+    void rename(const char *from, const char *to);
+
+    EMMC_MetadataCacheStats getStats();
+
+    // -- The order of list(), for listings walked on the card
+    static void sortByPath(std::vector<EMMC_FileInfo> &entries);
+
+    // -- "/logs/" from "logs", "/logs" or "/logs/"
+    static String directoryPrefix(const char *dirname);
+    static String normalize(const char *path);
+
+private:
+    size_t collect(const char *dirname,
+                   uint8_t levels,
+                   bool files_only,
+                   time_t newer_than,
+                   std::vector<EMMC_FileInfo> &found);
+    size_t lowerBound(const char *path);
+    static uint8_t depth(const String &path);
+
+    std::vector<EMMC_FileInfo> entries; // Sorted by path
+    bool cache_valid;
+    bool cache_truncated; // Some directory is deeper than EMMC_DIRECTORY_MAX_LEVELS, its contents aren't cached
+    EMMC_MetadataCacheStats stats;
+};
+
+// End.
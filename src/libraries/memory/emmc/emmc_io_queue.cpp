@@ -0,0 +1,627 @@
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_io_queue.cpp
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 9, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*****************************************************       HEADER FILE       *****************************************************/
+#include "emmc_io_queue.h"
+
+//*********************************************       IO QUEUE FUNCTIONS DEFINTIONS       *******************************************/
+EMMC_IOQueue::EMMC_IOQueue()
+{
+    emmc = nullptr;
+    io_policy = IO_BUFFER;
+    io_state = IO_STOPPED;
+
+    ring = nullptr;
+    staging = nullptr;
+    ring_size = 0;
+    produced = 0;
+    written = 0;
+    committed = 0;
+    records_pending = 0;
+    ring_mutex = portMUX_INITIALIZER_UNLOCKED;
+
+    file_count = 0;
+    for (uint8_t i = 0; i < EMMC_IO_MAX_FILES; i++)
+    {
+        synced_size[i] = 0;
+        written_size[i] = 0;
+        size_known[i] = false;
+    }
+
+    writer_task = nullptr;
+    task_running = false;
+    stop_requested = false;
+    sync_requested = false;
+    last_sync_ms = 0;
+    removed_ms = 0;
+    last_remount_attempt_ms = 0;
+
+    stats = {};
+}
+
+EMMC_IOQueue::~EMMC_IOQueue()
+{
+    close();
+}
+
+// -- Allocate the ring, open the files and start the writer task
+ESP_ERROR EMMC_IOQueue::begin(EMMC_Memory &emmc,
+                              EMMC_IO_POLICY policy,
+                              size_t buffer_size,
+                              BaseType_t core,
+                              UBaseType_t priority)
+{
+    ESP_ERROR err;
+
+    if (ring != nullptr)
+    {
+        return ESP_ERROR(true, "IO queue is already open");
+    }
+
+    if (emmc.getFileSystem() == nullptr)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    if (file_count == 0)
+    {
+        return ESP_ERROR(true, "Add the files with addFile() before begin()");
+    }
+
+    // A power of two, so that positions in the ring stay right when the byte counts wrap around
+    while (buffer_size & (buffer_size - 1))
+    {
+        buffer_size &= buffer_size - 1;
+    }
+    if (buffer_size < 2 * recordSize(EMMC_IO_MAX_RECORD))
+    {
+        return ESP_ERROR(true, "IO queue buffer must hold at least two records of EMMC_IO_MAX_RECORD bytes");
+    }
+
+    // 1. Ring, and the staging buffer the card is written from
+    ring = (uint8_t *)heap_caps_malloc(buffer_size, MALLOC_CAP_8BIT);
+    staging = (uint8_t *)heap_caps_malloc(EMMC_IO_WRITE_CHUNK, MALLOC_CAP_DMA);
+    if (ring == nullptr || staging == nullptr)
+    {
+        release();
+        return ESP_ERROR(true, "Not enough memory for the IO queue buffers");
+    }
+
+    this->emmc = &emmc;
+    io_policy = policy;
+    ring_size = buffer_size;
+    produced = 0;
+    written = 0;
+    committed = 0;
+    records_pending = 0;
+    resetStats();
+
+    // 2. Files, appended to
+    if (!openFiles())
+    {
+        closeFiles();
+        release();
+        return ESP_ERROR(true, "Failed to open the IO queue files for writting");
+    }
+
+    io_state = IO_RUNNING;
+    last_sync_ms = millis();
+    stop_requested = false;
+    sync_requested = false;
+
+    // 3. Writer task, unless service() is called by the user
+    if (core != EMMC_IO_NO_TASK)
+    {
+        task_running = true;
+        if (xTaskCreatePinnedToCore(taskEntry, "EMMC IO queue", EMMC_IO_TASK_STACK, this, priority, &writer_task, core) != pdPASS)
+        {
+            writer_task = nullptr;
+            task_running = false;
+            io_state = IO_STOPPED;
+            closeFiles();
+            release();
+            return ESP_ERROR(true, "Could not create the IO queue task");
+        }
+    }
+
+    err.debug_message = "IO queue started";
+    return err;
+}
+
+int8_t EMMC_IOQueue::addFile(const char *path)
+{
+    if (ring != nullptr || file_count == EMMC_IO_MAX_FILES)
+    {
+        return -1;
+    }
+
+    file_paths[file_count] = path;
+    size_known[file_count] = false;
+    return file_count++;
+}
+
+// -- Producers. Never waits: the only work is a copy into the ring
+EMMC_IO_STATUS EMMC_IOQueue::write(uint8_t file, const void *data, size_t length)
+{
+    uint32_t start = micros();
+    EMMC_IO_STATUS status = IO_DROPPED;
+
+    portENTER_CRITICAL(&ring_mutex);
+
+    bool valid = ring != nullptr && file < file_count && length > 0 && length <= EMMC_IO_MAX_RECORD;
+    bool suspended = io_state == IO_SUSPENDED;
+
+    if (valid && !(suspended && io_policy == IO_DROP))
+    {
+        // A record doesn't wrap: if it doesn't fit before the end of the ring, pad to the end and start over
+        size_t size = recordSize(length);
+        size_t position = ringPosition(produced);
+        size_t padding = position + size > ring_size ? ring_size - position : 0;
+        bool fits = (uint32_t)(produced + padding + size - committed) <= ring_size; // 32 bit, as the counts wrap
+
+        // Nothing is being written while suspended, the oldest records can go
+        if (!fits && suspended && io_policy == IO_DROP_OLDEST)
+        {
+            fits = dropOldest(padding + size);
+        }
+
+        if (fits)
+        {
+            RecordHeader header;
+            if (padding > 0)
+            {
+                header.length = 0;
+                header.file = PADDING_FILE;
+                header.reserved = 0;
+                memcpy(ring + position, &header, sizeof(header));
+                position = 0;
+            }
+
+            header.length = length;
+            header.file = file;
+            header.reserved = 0;
+            memcpy(ring + position, &header, sizeof(header));
+            memcpy(ring + position + sizeof(header), data, length);
+            produced += padding + size;
+
+            uint32_t depth = produced - committed;
+            stats.records_queued++;
+            stats.max_depth = max(stats.max_depth, depth);
+            status = depth * 100 >= ring_size * EMMC_IO_HIGH_WATER ? IO_SLOW_DOWN : IO_QUEUED;
+            stats.slow_downs += status == IO_SLOW_DOWN;
+        }
+    }
+
+    if (status == IO_DROPPED)
+    {
+        stats.records_dropped++;
+        stats.bytes_dropped += length;
+    }
+    stats.max_write_us = max(stats.max_write_us, (uint32_t)(micros() - start));
+
+    portEXIT_CRITICAL(&ring_mutex);
+    return status;
+}
+
+// -- One round of the writer: watch the card, write, sync when due
+void EMMC_IOQueue::service()
+{
+    if (ring == nullptr)
+    {
+        return;
+    }
+
+    if (io_state == IO_SUSPENDED)
+    {
+        tryRemount();
+        return;
+    }
+
+    if (!emmc->isCardDetected() || !emmc->isInitialized() || !writeRecords())
+    {
+        suspend();
+        return;
+    }
+
+    // Sync on time, when the unsynced records take half the ring, or when asked to once everything is written
+    bool requested = sync_requested && written == produced;
+    bool due = millis() - last_sync_ms >= EMMC_IO_SYNC_INTERVAL_mS || (written - committed) * 2 >= ring_size;
+    if (records_pending > 0 && (due || requested))
+    {
+        if (!syncFiles())
+        {
+            suspend();
+            return;
+        }
+    }
+
+    if (requested)
+    {
+        sync_requested = false;
+    }
+}
+
+ESP_ERROR EMMC_IOQueue::sync(uint32_t timeout_ms)
+{
+    if (ring == nullptr)
+    {
+        return ESP_ERROR(true, "IO queue is not open");
+    }
+
+    uint32_t start = millis();
+    sync_requested = true;
+
+    while (committed != produced || io_state != IO_RUNNING)
+    {
+        if (millis() - start >= timeout_ms)
+        {
+            return ESP_ERROR(true,
+                             io_state == IO_SUSPENDED ? "Card removed, records kept in the IO queue"
+                                                      : "Timed out waiting for the IO queue to sync");
+        }
+
+        if (!task_running)
+        {
+            service();
+        }
+        if (committed != produced || io_state != IO_RUNNING)
+        {
+            vTaskDelay(1);
+        }
+    }
+
+    return ESP_ERROR();
+}
+
+ESP_ERROR EMMC_IOQueue::close()
+{
+    if (ring == nullptr)
+    {
+        return ESP_ERROR(true, "IO queue is not open");
+    }
+
+    ESP_ERROR err;
+    if (io_state == IO_RUNNING)
+    {
+        err = sync();
+    }
+    else
+    {
+        String temp_message;
+        temp_message += "Card removed, ";
+        temp_message += String((unsigned long)(produced - committed));
+        temp_message += " queued bytes lost";
+        err = ESP_ERROR(true, temp_message);
+    }
+
+    // -- The task finishes its round and stops
+    stop_requested = true;
+    while (task_running)
+    {
+        vTaskDelay(1);
+    }
+    writer_task = nullptr;
+
+    closeFiles();
+    io_state = IO_STOPPED;
+    release();
+    return err;
+}
+
+uint8_t EMMC_IOQueue::getFill()
+{
+    if (ring == nullptr)
+    {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&ring_mutex);
+    uint32_t depth = produced - committed;
+    portEXIT_CRITICAL(&ring_mutex);
+    return depth * 100 / ring_size;
+}
+
+EMMC_IOStats EMMC_IOQueue::getStats()
+{
+    portENTER_CRITICAL(&ring_mutex);
+    EMMC_IOStats s = stats;
+    s.depth = produced - committed;
+    portEXIT_CRITICAL(&ring_mutex);
+    return s;
+}
+
+void EMMC_IOQueue::resetStats()
+{
+    portENTER_CRITICAL(&ring_mutex);
+    stats = {};
+    portEXIT_CRITICAL(&ring_mutex);
+}
+
+// -- Writer task
+void EMMC_IOQueue::taskEntry(void *arg)
+{
+    EMMC_IOQueue *queue = static_cast<EMMC_IOQueue *>(arg);
+    queue->run();
+    queue->task_running = false;
+    vTaskDelete(nullptr);
+}
+
+void EMMC_IOQueue::run()
+{
+    while (!stop_requested)
+    {
+        service();
+
+        // Straight on while there's a backlog, otherwise sleep
+        if (io_state != IO_RUNNING || written == produced)
+        {
+            vTaskDelay(EMMC_IO_TASK_PERIOD_mS / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+// -- Up to EMMC_IO_WRITE_BUDGET bytes of records. False if the card refused a write
+bool EMMC_IOQueue::writeRecords()
+{
+    size_t budget = EMMC_IO_WRITE_BUDGET;
+    RecordHeader header;
+
+    while (budget > 0 && written != produced)
+    {
+        // 1. A window of records whose data fits the staging buffer
+        uint32_t end = produced;
+        uint32_t window_end = written;
+        size_t window_data = 0;
+        uint32_t window_records = 0;
+
+        while (window_end != end)
+        {
+            size_t position = ringPosition(window_end);
+            memcpy(&header, ring + position, sizeof(header));
+
+            if (header.file == PADDING_FILE)
+            {
+                window_end += ring_size - position;
+                continue;
+            }
+            if (window_data + header.length > EMMC_IO_WRITE_CHUNK)
+            {
+                break;
+            }
+
+            window_data += header.length;
+            window_records++;
+            window_end += recordSize(header.length);
+        }
+
+        // 2. One write per file, its records in order
+        for (uint8_t i = 0; i < file_count; i++)
+        {
+            size_t length = 0;
+            for (uint32_t next = written; next != window_end;)
+            {
+                size_t position = ringPosition(next);
+                memcpy(&header, ring + position, sizeof(header));
+
+                if (header.file == PADDING_FILE)
+                {
+                    next += ring_size - position;
+                    continue;
+                }
+                if (header.file == i)
+                {
+                    memcpy(staging + length, ring + position + sizeof(header), header.length);
+                    length += header.length;
+                }
+                next += recordSize(header.length);
+            }
+
+            if (length > 0)
+            {
+                if (files[i].write(staging, length) != length)
+                {
+                    return false;
+                }
+                written_size[i] += length;
+            }
+        }
+
+        budget -= min(budget, (size_t)(window_end - written));
+        records_pending += window_records;
+        written = window_end;
+    }
+
+    return true;
+}
+
+// -- Flush every file, then free what was written. FAT only updates a file's size on the card when it's flushed
+bool EMMC_IOQueue::syncFiles()
+{
+    for (uint8_t i = 0; i < file_count; i++)
+    {
+        files[i].flush();
+    }
+
+    // flush() doesn't report errors: a card gone by now may not have taken it
+    if (!emmc->isCardDetected())
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < file_count; i++)
+    {
+        synced_size[i] = written_size[i];
+    }
+
+    portENTER_CRITICAL(&ring_mutex);
+    committed = written;
+    stats.records_written += records_pending;
+    portEXIT_CRITICAL(&ring_mutex);
+
+    records_pending = 0;
+    last_sync_ms = millis();
+    return true;
+}
+
+// -- Open every file at the size of its last sync. The first time, at its current end
+bool EMMC_IOQueue::openFiles()
+{
+    fs::FS *file_system = emmc->getFileSystem();
+    if (file_system == nullptr)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < file_count; i++)
+    {
+        const char *path = file_paths[i].c_str();
+
+        if (!size_known[i])
+        {
+            files[i] = file_system->open(path, FILE_APPEND);
+            if (!files[i])
+            {
+                return false;
+            }
+            synced_size[i] = files[i].size();
+            size_known[i] = true;
+        }
+
+        // After a remount, "r+" so writes go where the last synced record ended. A missing or shorter file (another
+        // card) is written from its end
+        else
+        {
+            files[i] = file_system->exists(path) ? file_system->open(path, "r+") : file_system->open(path, FILE_WRITE);
+            if (!files[i])
+            {
+                return false;
+            }
+            synced_size[i] = min(synced_size[i], (uint64_t)files[i].size());
+            if (!files[i].seek(synced_size[i]))
+            {
+                return false;
+            }
+        }
+
+        written_size[i] = synced_size[i];
+    }
+
+    return true;
+}
+
+void EMMC_IOQueue::closeFiles()
+{
+    for (uint8_t i = 0; i < file_count; i++)
+    {
+        if (files[i])
+        {
+            files[i].close();
+        }
+    }
+}
+
+// -- The card is gone: unmount, and go back to the last sync so those records are written again
+void EMMC_IOQueue::suspend()
+{
+    closeFiles();
+    emmc->end();
+
+    for (uint8_t i = 0; i < file_count; i++)
+    {
+        written_size[i] = synced_size[i];
+    }
+
+    portENTER_CRITICAL(&ring_mutex);
+    written = committed;
+    io_state = IO_SUSPENDED;
+    stats.records_retried += records_pending;
+    stats.removals++;
+    portEXIT_CRITICAL(&ring_mutex);
+
+    records_pending = 0;
+    removed_ms = millis();
+    last_remount_attempt_ms = removed_ms;
+}
+
+void EMMC_IOQueue::tryRemount()
+{
+    if (millis() - last_remount_attempt_ms < EMMC_IO_REMOUNT_INTERVAL_mS)
+    {
+        return;
+    }
+    last_remount_attempt_ms = millis();
+
+    if (!emmc->isCardDetected())
+    {
+        return;
+    }
+
+    if (emmc->remount().on_error || !openFiles())
+    {
+        closeFiles();
+        emmc->end();
+        return;
+    }
+
+    uint32_t remount_ms = millis() - removed_ms;
+
+    portENTER_CRITICAL(&ring_mutex);
+    io_state = IO_RUNNING;
+    stats.remounts++;
+    stats.last_remount_ms = remount_ms;
+    stats.max_remount_ms = max(stats.max_remount_ms, remount_ms);
+    portEXIT_CRITICAL(&ring_mutex);
+
+    last_sync_ms = millis();
+}
+
+// -- Free needed bytes past produced by dropping the oldest records. Only while suspended, inside the critical section
+bool EMMC_IOQueue::dropOldest(size_t needed)
+{
+    while ((uint32_t)(produced + needed - committed) > ring_size && committed != produced)
+    {
+        size_t position = ringPosition(committed);
+        RecordHeader header;
+        memcpy(&header, ring + position, sizeof(header));
+
+        if (header.file == PADDING_FILE)
+        {
+            committed += ring_size - position;
+        }
+        else
+        {
+            committed += recordSize(header.length);
+            stats.records_dropped++;
+            stats.bytes_dropped += header.length;
+        }
+    }
+
+    written = committed;
+    return (uint32_t)(produced + needed - committed) <= ring_size;
+}
+
+void EMMC_IOQueue::release()
+{
+    if (ring != nullptr)
+    {
+        heap_caps_free(ring);
+        ring = nullptr;
+    }
+    if (staging != nullptr)
+    {
+        heap_caps_free(staging);
+        staging = nullptr;
+    }
+    ring_size = 0;
+}
+
+// End.
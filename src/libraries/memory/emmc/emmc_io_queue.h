@@ -0,0 +1,225 @@
+#pragma once
+
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_io_queue.h
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 9, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*********************************************************     READ ME    **********************************************************/
+
+// * Asynchronous, card removal aware writes, for sensor pipelines that must never wait on storage.
+// *
+// * Producers hand records to write() and get an answer at once: IO_QUEUED, IO_SLOW_DOWN (queued, but the queue is
+// * past EMMC_IO_HIGH_WATER percent full) or IO_DROPPED (not queued). The records are kept in one ring buffer of
+// * fixed size and appended to their files by a writer task, which gathers the records of each file into one write
+// * of up to EMMC_IO_WRITE_CHUNK bytes. Memory: the ring plus the staging buffer, allocated by begin().
+// *
+// * Records are released from the ring only once a sync has put them on the card, every EMMC_IO_SYNC_INTERVAL_mS
+// * or sooner when the ring fills up. When the card goes away (detect pin, or a failed write), the queue:
+// *  1. closes its files and unmounts the card (EMMC_Memory::end), so nothing keeps writing to a missing card;
+// *  2. suspends, and treats what producers keep sending according to its EMMC_IO_POLICY;
+// *  3. tries to remount every EMMC_IO_REMOUNT_INTERVAL_mS while the card is detected. Once mounted it reopens the
+// *     files at their last synced size and writes again, from the first record not synced. Records being written
+// *     when the card went are written again whole, nothing is duplicated or torn.
+// *
+// * The queue uses EMMC_Memory::begin again to remount, with the pins and mode of the first begin(). Don't use the
+// * EMMC_Memory file functions on the queue's files while it runs.
+// *
+// * The queue watches the detect pin itself: don't call EMMC_Memory::onDetectPinChange() while it runs.
+// *
+// * Without a task (core = EMMC_IO_NO_TASK), call service() from a loop of your own.
+
+//*****************************************************     LIBRARY SETTINGS    *****************************************************/
+#define EMMC_IO_BUFFER_SIZE 32768        // Ring buffer, in bytes. begin() rounds it down to a power of two
+#define EMMC_IO_MAX_FILES 4              // Files a queue writes to
+#define EMMC_IO_MAX_RECORD 1024          // Longest record, in bytes
+#define EMMC_IO_HIGH_WATER 75            // Fill, in percent, past which write() returns IO_SLOW_DOWN
+#define EMMC_IO_SYNC_INTERVAL_mS 1000    // Longest time between syncs. Data since the last sync is kept in the ring
+#define EMMC_IO_REMOUNT_INTERVAL_mS 500  // Time between remount attempts while the card is away
+#define EMMC_IO_WRITE_CHUNK 4096         // Staging buffer, at least EMMC_IO_MAX_RECORD: records are gathered per file into one write
+#define EMMC_IO_WRITE_BUDGET 16384       // Bytes written per service() call, so card checks are never far apart
+#define EMMC_IO_TASK_STACK 4096          // Writer task stack, in bytes
+#define EMMC_IO_TASK_PERIOD_mS 5         // Writer task sleep when there's nothing to write
+#define EMMC_IO_NO_TASK -1               // begin() core to run service() from your own loop
+
+//*****************************************************        LIBRARIES        *****************************************************/
+#include <Arduino.h>
+#include "FS.h"
+#include <utils.h>
+#include "emmc_memory.h"
+
+//*****************************************************       DATA TYPES        *****************************************************/
+// -- What happens to records while the card is away
+enum EMMC_IO_POLICY
+{
+    IO_BUFFER,      // Keep them while the ring has room, then drop new ones
+    IO_DROP_OLDEST, // Keep them, dropping the oldest records not written yet to make room: the newest data is kept
+    IO_DROP,        // Drop them. What was queued before the removal is still written after the remount
+};
+
+// -- Answer of write()
+enum EMMC_IO_STATUS
+{
+    IO_QUEUED,
+    IO_SLOW_DOWN, // Queued, but the ring is past EMMC_IO_HIGH_WATER: send less, or less often
+    IO_DROPPED,   // Not queued: ring full, card away with IO_DROP, bad file or length, or queue closed
+};
+
+enum EMMC_IO_STATE
+{
+    IO_STOPPED,
+    IO_RUNNING,
+    IO_SUSPENDED, // Card away, waiting to remount
+};
+
+// -- Queue statistics, since begin() or resetStats()
+struct EMMC_IOStats
+{
+    uint32_t depth;            // Bytes in the ring now, records not synced yet included
+    uint32_t max_depth;
+    uint32_t records_queued;
+    uint32_t records_written;  // Synced to the card
+    uint32_t records_dropped;
+    uint64_t bytes_dropped;
+    uint32_t slow_downs;       // IO_SLOW_DOWN answers
+    uint32_t records_retried;  // Written, but not synced when the card went: written again after the remount
+    uint32_t removals;         // Card losses, detected or from failed writes
+    uint32_t remounts;
+    uint32_t last_remount_ms;  // From the loss of the card to writing again
+    uint32_t max_remount_ms;
+    uint32_t max_write_us;     // Longest producer write() call
+};
+
+//*****************************************************      IO QUEUE CLASS     *****************************************************/
+class EMMC_IOQueue
+{
+public:
+    EMMC_IOQueue();
+    ~EMMC_IOQueue();
+
+    // -- Allocate the ring, buffer_size rounded down to a power of two, and start the writer task. The card must be
+    // initialized
+    ESP_ERROR begin(EMMC_Memory &emmc,
+                    EMMC_IO_POLICY policy = IO_BUFFER,
+                    size_t buffer_size = EMMC_IO_BUFFER_SIZE,
+                    BaseType_t core = 0,
+                    UBaseType_t priority = 2);
+
+    // -- A file to append records to, before begin(). Returns its number for write(), -1 if none is left
+    int8_t addFile(const char *path);
+
+    // -- Queue a record. Never blocks
+    EMMC_IO_STATUS write(uint8_t file, const void *data, size_t length);
+    EMMC_IO_STATUS write(uint8_t file, const char *text)
+    {
+        return write(file, text, strlen(text));
+    }
+
+    // -- Work of the writer task: watch the card, write queued records, sync. Only call it with EMMC_IO_NO_TASK
+    void service();
+
+    // -- Wait until everything queued is synced to the card, at most timeout_ms
+    ESP_ERROR sync(uint32_t timeout_ms = 2000);
+
+    // -- Sync if the card is there, stop the task, close the files and free the ring
+    ESP_ERROR close();
+
+    // -- Backpressure
+    uint8_t getFill(); // Percent of the ring in use
+    bool isCongested()
+    {
+        return getFill() >= EMMC_IO_HIGH_WATER;
+    }
+
+    EMMC_IO_STATE getState()
+    {
+        return io_state;
+    }
+
+    void setPolicy(EMMC_IO_POLICY policy)
+    {
+        io_policy = policy;
+    }
+
+    EMMC_IOStats getStats();
+    void resetStats();
+
+private:
+    // -- Record header in the ring, data follows. Records start on 4 byte boundaries
+    struct RecordHeader
+    {
+        uint16_t length;
+        uint8_t file; // PADDING_FILE: skip to the start of the ring
+        uint8_t reserved;
+    };
+
+    static const uint8_t PADDING_FILE = 0xFF;
+
+    static size_t recordSize(size_t length)
+    {
+        return (sizeof(RecordHeader) + length + 3) & ~(size_t)3;
+    }
+
+    // -- Offset in the ring of a byte count. ring_size divides 2^32, so the count may wrap around
+    size_t ringPosition(uint32_t count)
+    {
+        return count & (ring_size - 1);
+    }
+
+    static void taskEntry(void *arg);
+    void run();
+
+    bool writeRecords();
+    bool syncFiles();
+    bool openFiles();
+    void closeFiles();
+    void suspend();
+    void tryRemount();
+    bool dropOldest(size_t needed);
+    void release();
+
+    EMMC_Memory *emmc;
+    EMMC_IO_POLICY io_policy;
+    volatile EMMC_IO_STATE io_state;
+
+    // -- Ring. Byte counts since begin(), modulo 2^32: produced >= written >= committed. Only committed bytes are free
+    // again
+    uint8_t *ring;
+    uint8_t *staging; // EMMC_IO_WRITE_CHUNK bytes, DMA capable
+    size_t ring_size;
+    volatile uint32_t produced;
+    volatile uint32_t written;   // Next record to write to the card
+    volatile uint32_t committed; // Next record not synced yet
+    uint32_t records_pending;    // Written since the last sync
+    portMUX_TYPE ring_mutex;
+
+    // -- Files
+    String file_paths[EMMC_IO_MAX_FILES];
+    File files[EMMC_IO_MAX_FILES];
+    uint64_t synced_size[EMMC_IO_MAX_FILES]; // Size at the last sync, where writes resume after a remount
+    uint64_t written_size[EMMC_IO_MAX_FILES];
+    bool size_known[EMMC_IO_MAX_FILES];
+    uint8_t file_count;
+
+    // -- Task and timing
+    TaskHandle_t writer_task;
+    volatile bool task_running; // Cleared by the task when it stops
+    volatile bool stop_requested;
+    volatile bool sync_requested;
+    uint32_t last_sync_ms;
+    uint32_t removed_ms;
+    uint32_t last_remount_attempt_ms;
+
+    EMMC_IOStats stats;
+
+    friend struct EMMC_IOQueueCheck; // examples/host/io_queue_check.cpp starts the byte counts next to their wrap
+};
+
+// End.
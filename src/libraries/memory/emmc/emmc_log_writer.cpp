@@ -0,0 +1,575 @@
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_log_writer.cpp
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 8, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*****************************************************       HEADER FILE       *****************************************************/
+#include "emmc_log_writer.h"
+
+#define EMMC_LOG_FILE_UPDATE "r+" // Read and write, without truncating
+
+//*******************************************     LOG WRITER FUNCTIONS DEFINTIONS      **********************************************/
+EMMC_LogWriter::EMMC_LogWriter()
+{
+    file_system = nullptr;
+    log_segment_count = 0;
+    log_segment_size = 0;
+    log_segment = 0;
+    log_sequence = 0;
+    log_session = 0;
+
+    block = nullptr;
+    log_block_size = 0;
+    block_fill = 0;
+    block_start = 0;
+
+    log_open = false;
+    write_error = false;
+    memset(header_sector, 0, sizeof(header_sector));
+
+    stats = {};
+    block_latency_sum_us = 0;
+}
+
+EMMC_LogWriter::~EMMC_LogWriter()
+{
+    close();
+}
+
+// -- Pre-allocate or reuse the segments, and start a new session
+ESP_ERROR EMMC_LogWriter::begin(EMMC_Memory &emmc,
+                                const char *directory,
+                                uint8_t segment_count,
+                                uint32_t segment_size,
+                                size_t block_size)
+{
+    fs::FS *emmc_file_system = emmc.getFileSystem();
+    if (emmc_file_system == nullptr)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    return begin(*emmc_file_system, directory, segment_count, segment_size, block_size);
+}
+
+ESP_ERROR EMMC_LogWriter::begin(fs::FS &fs,
+                                const char *directory,
+                                uint8_t segment_count,
+                                uint32_t segment_size,
+                                size_t block_size)
+{
+    ESP_ERROR err;
+
+    if (log_open)
+    {
+        return ESP_ERROR(true, "Log writer is already open");
+    }
+
+    if (segment_count < 2 || segment_count > EMMC_LOG_MAX_SEGMENTS)
+    {
+        return ESP_ERROR(true, "The log needs 2 to EMMC_LOG_MAX_SEGMENTS segments");
+    }
+
+    if (block_size == 0 || block_size % EMMC_SECTOR_SIZE != 0 || segment_size % EMMC_SECTOR_SIZE != 0 ||
+        segment_size < EMMC_LOG_HEADER_SIZE + block_size)
+    {
+        return ESP_ERROR(true, "Block and segment sizes must be multiples of the sector size, with room for a block");
+    }
+
+    file_system = &fs;
+    log_directory = directory;
+    log_segment_count = segment_count;
+    log_segment_size = segment_size;
+    log_block_size = block_size;
+    write_error = false;
+    resetStats();
+
+    if (!file_system->exists(directory) && !file_system->mkdir(directory))
+    {
+        return ESP_ERROR(true, "Could not create the log directory");
+    }
+
+    // 1. Block, DMA capable like the stream writer's. Also used to zero fill segments
+    block = (uint8_t *)heap_caps_malloc(log_block_size, MALLOC_CAP_DMA);
+    if (block == nullptr)
+    {
+        return ESP_ERROR(true, "Not enough DMA capable memory for the log block");
+    }
+
+    // 2. Segments. The new session starts after the newest one, so the previous sessions are overwritten last
+    uint32_t start_ms = millis();
+    uint32_t newest_sequence = 0;
+    uint32_t newest_session = 0;
+    uint8_t newest_segment = 0;
+
+    for (uint8_t i = 0; i < log_segment_count; i++)
+    {
+        EMMC_LogHeader header;
+        if (!prepareSegment(i, header))
+        {
+            heap_caps_free(block);
+            block = nullptr;
+            String temp_message;
+            temp_message += "Could not create log segment \"";
+            temp_message += segmentPath(directory, i);
+            temp_message += "\"";
+            return ESP_ERROR(true, temp_message);
+        }
+
+        if (header.sequence > newest_sequence)
+        {
+            newest_sequence = header.sequence;
+            newest_segment = i;
+        }
+        newest_session = max(newest_session, header.session);
+    }
+    stats.preallocation_ms = millis() - start_ms;
+
+    log_session = newest_session + 1;
+    log_sequence = newest_sequence + 1;
+    log_segment = newest_sequence == 0 ? 0 : (newest_segment + 1) % log_segment_count;
+
+    // 3. First segment of the session
+    if (!openSegment())
+    {
+        heap_caps_free(block);
+        block = nullptr;
+        return ESP_ERROR(true, "Could not open the first log segment");
+    }
+
+    log_open = true;
+    err.debug_message = "Log session ";
+    err.debug_message += String(log_session);
+    err.debug_message += " started";
+    return err;
+}
+
+// -- Write operations
+size_t EMMC_LogWriter::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+size_t EMMC_LogWriter::write(const uint8_t *data, size_t length)
+{
+    if (!log_open || write_error)
+    {
+        return 0;
+    }
+
+    uint32_t start = micros();
+    bool wrote = false;
+    size_t done = 0;
+
+    while (done < length)
+    {
+        size_t capacity = min((size_t)(log_segment_size - block_start), log_block_size);
+        size_t n = min(length - done, capacity - block_fill);
+        memcpy(block + block_fill, data + done, n);
+        block_fill += n;
+        done += n;
+
+        if (block_fill == capacity)
+        {
+            wrote = true;
+            if (!writeBlock() || (block_start == log_segment_size && !rotate()))
+            {
+                break;
+            }
+        }
+    }
+
+    stats.bytes_written += done;
+    if (wrote)
+    {
+        stats.max_write_latency_us = max(stats.max_write_latency_us, (uint32_t)(micros() - start));
+    }
+
+    return done;
+}
+
+// -- Write the buffered data and record the valid extent
+ESP_ERROR EMMC_LogWriter::sync()
+{
+    if (!log_open)
+    {
+        return ESP_ERROR(true, "Log writer is not open");
+    }
+
+    uint32_t start = micros();
+
+    // The block stays in the buffer, and is written again whole once full. Rounded up to whole sectors, what
+    // follows the data is past the extent and ignored
+    if (block_fill > 0 && !write_error)
+    {
+        size_t capacity = min((size_t)(log_segment_size - block_start), log_block_size);
+        size_t length = min((block_fill + EMMC_SECTOR_SIZE - 1) / EMMC_SECTOR_SIZE * EMMC_SECTOR_SIZE, capacity);
+        if (!segment_file.seek(block_start) || segment_file.write(block, length) != length)
+        {
+            write_error = true;
+        }
+    }
+
+    if (!write_error && !writeHeader(block_start - EMMC_LOG_HEADER_SIZE + block_fill))
+    {
+        write_error = true;
+    }
+
+    stats.max_sync_us = max(stats.max_sync_us, (uint32_t)(micros() - start));
+    return getError();
+}
+
+ESP_ERROR EMMC_LogWriter::close()
+{
+    if (!log_open)
+    {
+        return ESP_ERROR(true, "Log writer is not open");
+    }
+
+    ESP_ERROR err = sync();
+
+    segment_file.close();
+    heap_caps_free(block);
+    block = nullptr;
+    log_open = false;
+
+    return err;
+}
+
+ESP_ERROR EMMC_LogWriter::getError()
+{
+    if (write_error)
+    {
+        return ESP_ERROR(true, "Log write operation failed");
+    }
+
+    return ESP_ERROR();
+}
+
+EMMC_LogStats EMMC_LogWriter::getStats()
+{
+    EMMC_LogStats s = stats;
+    if (s.blocks_written > 0)
+    {
+        s.mean_block_latency_us = (float)block_latency_sum_us / s.blocks_written;
+    }
+    return s;
+}
+
+void EMMC_LogWriter::resetStats()
+{
+    uint32_t preallocation_ms = stats.preallocation_ms;
+    stats = {};
+    stats.preallocation_ms = preallocation_ms;
+    block_latency_sum_us = 0;
+}
+
+// -- Segment files
+String EMMC_LogWriter::segmentPath(const char *directory, uint8_t index)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "seg_%03u.log", index);
+
+    String path = directory;
+    if (!path.endsWith("/"))
+    {
+        path += "/";
+    }
+    path += name;
+    return path;
+}
+
+bool EMMC_LogWriter::readHeader(File &file, EMMC_LogHeader &header)
+{
+    return file.seek(0) && file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+           header.magic == EMMC_LOG_MAGIC && header.version == EMMC_LOG_VERSION &&
+           header.header_size == EMMC_LOG_HEADER_SIZE && header.crc == headerCrc(header);
+}
+
+uint32_t EMMC_LogWriter::headerCrc(const EMMC_LogHeader &header)
+{
+    // CRC-32 of the header up to the crc field
+    const uint8_t *data = (const uint8_t *)&header;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < offsetof(EMMC_LogHeader, crc); i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+void EMMC_LogWriter::makeHeader(uint32_t sequence, uint32_t session, uint32_t extent)
+{
+    EMMC_LogHeader header;
+    header.magic = EMMC_LOG_MAGIC;
+    header.version = EMMC_LOG_VERSION;
+    header.header_size = EMMC_LOG_HEADER_SIZE;
+    header.sequence = sequence;
+    header.session = session;
+    header.segment_size = log_segment_size;
+    header.extent = extent;
+    header.crc = headerCrc(header);
+
+    memset(header_sector, 0, sizeof(header_sector));
+    memcpy(header_sector, &header, sizeof(header));
+}
+
+bool EMMC_LogWriter::prepareSegment(uint8_t index, EMMC_LogHeader &header)
+{
+    String path = segmentPath(log_directory.c_str(), index);
+
+    // 1. Reuse a segment of the right size
+    if (file_system->exists(path.c_str()))
+    {
+        File file = file_system->open(path.c_str(), FILE_READ);
+        bool valid = file && file.size() == log_segment_size && readHeader(file, header) &&
+                     header.segment_size == log_segment_size;
+        file.close();
+
+        if (valid)
+        {
+            return true;
+        }
+    }
+
+    // 2. Create it, with the header of a segment never written. Seeking past the end of a file open for writing
+    // makes FAT allocate the clusters without writing them
+    File file = file_system->open(path.c_str(), FILE_WRITE);
+    if (!file)
+    {
+        return false;
+    }
+
+    makeHeader(0, 0, 0);
+    memcpy(&header, header_sector, sizeof(header));
+    bool ok = file.write(header_sector, sizeof(header_sector)) == sizeof(header_sector);
+
+    uint8_t last = 0;
+    if (ok && !(file.seek(log_segment_size - 1) && file.write(&last, 1) == 1 && file.size() == log_segment_size))
+    {
+        // Seeking past the end isn't supported everywhere, fill with zeros instead
+        memset(block, 0, log_block_size);
+        ok = file.seek(file.size());
+        while (ok && file.size() < log_segment_size)
+        {
+            size_t n = min((size_t)(log_segment_size - file.size()), log_block_size);
+            ok = file.write(block, n) == n;
+        }
+    }
+
+    file.close();
+    return ok;
+}
+
+bool EMMC_LogWriter::openSegment()
+{
+    String path = segmentPath(log_directory.c_str(), log_segment);
+    segment_file = file_system->open(path.c_str(), EMMC_LOG_FILE_UPDATE);
+    if (!segment_file)
+    {
+        return false;
+    }
+
+    block_start = EMMC_LOG_HEADER_SIZE;
+    block_fill = 0;
+
+    // The old content of the segment is no longer valid
+    return writeHeader(0);
+}
+
+bool EMMC_LogWriter::writeBlock()
+{
+    uint32_t start = micros();
+
+    if (!segment_file.seek(block_start) || segment_file.write(block, block_fill) != block_fill)
+    {
+        write_error = true;
+        return false;
+    }
+
+    block_start += block_fill;
+    block_fill = 0;
+
+    stats.blocks_written++;
+    block_latency_sum_us += micros() - start;
+    return true;
+}
+
+bool EMMC_LogWriter::writeHeader(uint32_t extent)
+{
+    makeHeader(log_sequence, log_session, extent);
+
+    // Flushed right away, so the header reaches the card before the data that follows it
+    bool ok = segment_file.seek(0) && segment_file.write(header_sector, sizeof(header_sector)) == sizeof(header_sector);
+    segment_file.flush();
+    return ok;
+}
+
+bool EMMC_LogWriter::rotate()
+{
+    uint32_t start = micros();
+
+    bool ok = writeHeader(log_segment_size - EMMC_LOG_HEADER_SIZE);
+    segment_file.close();
+
+    log_segment = (log_segment + 1) % log_segment_count;
+    log_sequence++;
+    ok = ok && openSegment();
+    if (!ok)
+    {
+        write_error = true;
+    }
+
+    stats.rotations++;
+    stats.max_rotation_us = max(stats.max_rotation_us, (uint32_t)(micros() - start));
+    return ok;
+}
+
+//*******************************************     LOG READER FUNCTIONS DEFINTIONS      **********************************************/
+EMMC_LogReader::EMMC_LogReader()
+{
+    file_system = nullptr;
+    valid_count = 0;
+    log_size = 0;
+    next = 0;
+    remaining = 0;
+}
+
+ESP_ERROR EMMC_LogReader::begin(EMMC_Memory &emmc, const char *directory)
+{
+    fs::FS *emmc_file_system = emmc.getFileSystem();
+    if (emmc_file_system == nullptr)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    return begin(*emmc_file_system, directory);
+}
+
+ESP_ERROR EMMC_LogReader::begin(fs::FS &fs, const char *directory)
+{
+    close();
+    file_system = &fs;
+    log_directory = directory;
+    valid_count = 0;
+    log_size = 0;
+    next = 0;
+
+    // Segments are numbered from 0, stop at the first missing one
+    for (uint8_t i = 0; i < EMMC_LOG_MAX_SEGMENTS; i++)
+    {
+        String path = EMMC_LogWriter::segmentPath(directory, i);
+        if (!file_system->exists(path.c_str()))
+        {
+            break;
+        }
+
+        EMMC_LogHeader header;
+        File file = file_system->open(path.c_str(), FILE_READ);
+        bool valid = file && EMMC_LogWriter::readHeader(file, header) && header.sequence != 0 && header.extent > 0 &&
+                     header.extent <= file.size() - EMMC_LOG_HEADER_SIZE;
+        file.close();
+
+        if (!valid)
+        {
+            continue;
+        }
+
+        // Insert ordered by sequence
+        uint8_t position = valid_count;
+        while (position > 0 && headers[position - 1].sequence > header.sequence)
+        {
+            headers[position] = headers[position - 1];
+            order[position] = order[position - 1];
+            position--;
+        }
+        headers[position] = header;
+        order[position] = i;
+        valid_count++;
+        log_size += header.extent;
+    }
+
+    if (valid_count == 0)
+    {
+        return ESP_ERROR(true, "No log data found");
+    }
+
+    return ESP_ERROR();
+}
+
+size_t EMMC_LogReader::read(uint8_t *buffer, size_t length)
+{
+    size_t done = 0;
+
+    while (done < length)
+    {
+        if (remaining == 0 && !openSegment(next))
+        {
+            break;
+        }
+
+        size_t n = segment_file.read(buffer + done, min(length - done, (size_t)remaining));
+        if (n == 0)
+        {
+            remaining = 0;
+            continue;
+        }
+        done += n;
+        remaining -= n;
+    }
+
+    return done;
+}
+
+bool EMMC_LogReader::getHeader(uint8_t index, EMMC_LogHeader &header)
+{
+    if (index >= valid_count)
+    {
+        return false;
+    }
+
+    header = headers[index];
+    return true;
+}
+
+void EMMC_LogReader::close()
+{
+    if (segment_file)
+    {
+        segment_file.close();
+    }
+    remaining = 0;
+}
+
+bool EMMC_LogReader::openSegment(uint8_t position)
+{
+    close();
+    if (position >= valid_count)
+    {
+        return false;
+    }
+
+    String path = EMMC_LogWriter::segmentPath(log_directory.c_str(), order[position]);
+    segment_file = file_system->open(path.c_str(), FILE_READ);
+    next = position + 1;
+    if (!segment_file || !segment_file.seek(EMMC_LOG_HEADER_SIZE))
+    {
+        return openSegment(next);
+    }
+
+    remaining = headers[position].extent;
+    return true;
+}
+
+// End.
@@ -0,0 +1,214 @@
+#pragma once
+
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_log_writer.h
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 8, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*********************************************************     READ ME    **********************************************************/
+
+// * Log file mode with deterministic write latency.
+// *
+// * Growing a file on FAT means extending its cluster chain, and every so often the FAT layer stalls for tens of
+// * milliseconds searching for free clusters and updating both FAT copies. EMMC_LogWriter avoids that on the hot
+// * path: begin() pre-allocates a ring of fixed size segment files in a directory (seg_000.log, seg_001.log, ...),
+// * and data is then only ever written inside them. When a segment is full the writer moves to the next one,
+// * overwriting the oldest data. Files are never grown, truncated or renamed while logging.
+// *
+// * The first sector of each segment holds an EMMC_LogHeader with the segment sequence number and the extent of
+// * valid data. It is updated on sync(), on rotation and on close(), so after a power loss everything up to the
+// * last sync() can be read back with EMMC_LogReader, oldest first. Call sync() periodically, e.g. once a second.
+// *
+// * Data is buffered in one block (32 KB by default) and written in whole blocks, aligned to the sector size.
+// * Existing segments of the right size are reused as they are, so only the first session pays for the allocation.
+
+//*****************************************************     LIBRARY SETTINGS    *****************************************************/
+#define EMMC_LOG_SEGMENT_COUNT 8                   // Segments in the ring
+#define EMMC_LOG_MAX_SEGMENTS 64                   // Largest ring, and segments EMMC_LogReader looks for
+#define EMMC_LOG_SEGMENT_SIZE (8UL * 1024 * 1024) // Bytes per segment, header included, multiple of EMMC_SECTOR_SIZE
+#define EMMC_LOG_BLOCK_SIZE 32768                  // Bytes written at once, multiple of EMMC_SECTOR_SIZE
+#define EMMC_LOG_HEADER_SIZE EMMC_SECTOR_SIZE      // The header takes the first sector, data starts on the second
+#define EMMC_LOG_MAGIC 0x474F4C45                  // "ELOG"
+#define EMMC_LOG_VERSION 1
+
+//*****************************************************        LIBRARIES        *****************************************************/
+#include <Arduino.h>
+#include "FS.h"
+#include <utils.h>
+#include "emmc_memory.h"
+
+//*****************************************************       DATA TYPES        *****************************************************/
+// -- Segment header, at the start of each segment file. Little endian.
+struct __attribute__((packed)) EMMC_LogHeader
+{
+    uint32_t magic;        // EMMC_LOG_MAGIC
+    uint16_t version;      // EMMC_LOG_VERSION
+    uint16_t header_size;  // EMMC_LOG_HEADER_SIZE, data starts here
+    uint32_t sequence;     // Order of the segments, +1 per segment written. 0 for a segment never written
+    uint32_t session;      // +1 per begin(), across power cycles
+    uint32_t segment_size; // Bytes, header included
+    uint32_t extent;       // Bytes of valid data after the header
+    uint32_t crc;          // CRC-32 of the fields above
+};
+
+// -- Writer statistics, since begin() or resetStats()
+struct EMMC_LogStats
+{
+    uint64_t bytes_written;        // Bytes handed to write()
+    uint32_t blocks_written;       // Whole blocks written
+    uint32_t rotations;            // Moves to the next segment
+    uint32_t max_write_latency_us; // Longest write() call, rotations included
+    float mean_block_latency_us;   // Average time to write a block
+    uint32_t max_rotation_us;      // Longest move to the next segment
+    uint32_t max_sync_us;          // Longest sync()
+    uint32_t preallocation_ms;     // Time begin() spent creating segments
+};
+
+//*****************************************************     LOG WRITER CLASS    *****************************************************/
+class EMMC_LogWriter : public Print
+{
+public:
+    EMMC_LogWriter();
+    ~EMMC_LogWriter();
+
+    // -- Pre-allocate or reuse the segments in directory, and start a new session in the segment after the newest one
+    ESP_ERROR begin(EMMC_Memory &emmc,
+                    const char *directory,
+                    uint8_t segment_count = EMMC_LOG_SEGMENT_COUNT,
+                    uint32_t segment_size = EMMC_LOG_SEGMENT_SIZE,
+                    size_t block_size = EMMC_LOG_BLOCK_SIZE);
+
+    ESP_ERROR begin(fs::FS &file_system,
+                    const char *directory,
+                    uint8_t segment_count = EMMC_LOG_SEGMENT_COUNT,
+                    uint32_t segment_size = EMMC_LOG_SEGMENT_SIZE,
+                    size_t block_size = EMMC_LOG_BLOCK_SIZE);
+
+    // -- Write operations. Return the number of bytes accepted, 0 after a write error
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *data, size_t length) override;
+    using Print::write;
+
+    // -- Write the buffered data and record the valid extent in the segment header
+    ESP_ERROR sync();
+    void flush() { sync(); }
+
+    // -- Sync and close the segment, free the block
+    ESP_ERROR close();
+
+    // -- State Operations
+    bool isOpen()
+    {
+        return log_open;
+    }
+
+    ESP_ERROR getError();
+    uint32_t getSession()
+    {
+        return log_session;
+    }
+    uint32_t getSequence()
+    {
+        return log_sequence;
+    }
+    uint8_t getSegment()
+    {
+        return log_segment;
+    }
+
+    EMMC_LogStats getStats();
+    void resetStats();
+
+    // -- Path of a segment file, e.g. "/log/seg_003.log"
+    static String segmentPath(const char *directory, uint8_t index);
+
+    // -- Header helpers, shared with EMMC_LogReader
+    static bool readHeader(File &file, EMMC_LogHeader &header);
+    static uint32_t headerCrc(const EMMC_LogHeader &header);
+
+private:
+    void makeHeader(uint32_t sequence, uint32_t session, uint32_t extent);
+    bool prepareSegment(uint8_t index, EMMC_LogHeader &header);
+    bool openSegment();
+    bool writeBlock();
+    bool writeHeader(uint32_t extent);
+    bool rotate();
+
+    // -- Ring
+    fs::FS *file_system;
+    String log_directory;
+    uint8_t log_segment_count;
+    uint32_t log_segment_size;
+    uint8_t log_segment;
+    uint32_t log_sequence;
+    uint32_t log_session;
+
+    // -- Block being filled, at block_start in the segment
+    uint8_t *block;
+    size_t log_block_size;
+    size_t block_fill;
+    uint32_t block_start;
+
+    // -- File
+    File segment_file;
+    bool log_open;
+    bool write_error;
+    uint8_t header_sector[EMMC_LOG_HEADER_SIZE];
+
+    // -- Statistics
+    EMMC_LogStats stats;
+    uint64_t block_latency_sum_us;
+};
+
+//*****************************************************     LOG READER CLASS    *****************************************************/
+class EMMC_LogReader
+{
+public:
+    EMMC_LogReader();
+
+    // -- Find the valid segments in directory, ordered oldest first
+    ESP_ERROR begin(EMMC_Memory &emmc, const char *directory);
+    ESP_ERROR begin(fs::FS &file_system, const char *directory);
+
+    // -- Read the log data in order, across segments. Returns 0 at the end
+    size_t read(uint8_t *buffer, size_t length);
+
+    // -- Valid data, in bytes
+    uint64_t getSize()
+    {
+        return log_size;
+    }
+
+    uint8_t getSegmentCount()
+    {
+        return valid_count;
+    }
+
+    // -- Header of the index-th valid segment, oldest first
+    bool getHeader(uint8_t index, EMMC_LogHeader &header);
+
+    void close();
+
+private:
+    bool openSegment(uint8_t position);
+
+    fs::FS *file_system;
+    String log_directory;
+    uint8_t order[EMMC_LOG_MAX_SEGMENTS]; // Segment indices, oldest first
+    EMMC_LogHeader headers[EMMC_LOG_MAX_SEGMENTS];
+    uint8_t valid_count;
+    uint64_t log_size;
+
+    uint8_t next;       // Position in order of the next segment to open
+    uint32_t remaining; // Valid bytes left in it
+    File segment_file;
+};
+
+// End.
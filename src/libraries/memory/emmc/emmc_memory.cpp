@@ -32,20 +32,20 @@ ESP_ERROR EMMC_Memory::begin(uint8_t enable_pin,
         emmc_enable_pin = enable_pin;
 
         // Detect if card is inserted
-        if (emmc_detect_pin != -1)
+        if (emmc_detect_pin != (uint8_t)-1)
         {
             pinMode(emmc_detect_pin, INPUT_PULLUP);
             vTaskDelay(25 / portTICK_PERIOD_MS); // This is required of pin will read HIGH. Don't know why, not too important
         }
 
-        if (digitalRead(emmc_detect_pin) == LOW || emmc_detect_pin == -1)
+        if (isCardDetected())
         {
             emmc_detected = true;
             emmc_bus_width = bus_width;
             connection_mode = mode;
 
             // Turn SD card on. Give it sometime to power up
-            if (emmc_enable_pin != -1)
+            if (emmc_enable_pin != (uint8_t)-1)
             {
                 pinMode(emmc_enable_pin, OUTPUT);
                 digitalWrite(emmc_enable_pin, LOW);
@@ -71,8 +71,21 @@ ESP_ERROR EMMC_Memory::begin(uint8_t enable_pin,
                     pinMode(esp_emmc_dat3, INPUT_PULLUP);
                 }
 
-                // Attempt to initialize
-                if (!SD_MMC.begin("/sdcard", mode_1_bit))
+                uint32_t frequency = getBusFrequency();
+                if (frequency > EMMC_SDMMC_HIGH_SPEED_kHZ)
+                {
+                    err.on_error = true;
+                    err.debug_message = "SDMMC frequency above the 40 MHz high speed mode";
+                    break;
+                }
+
+                // Attempt to initialize. Cores before 2.0 have no frequency setting and run at 20 MHz
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 2
+                bool mounted = SD_MMC.begin("/sdcard", mode_1_bit, false, frequency);
+#else
+                bool mounted = SD_MMC.begin("/sdcard", mode_1_bit);
+#endif
+                if (!mounted)
                 {
                     err.on_error = true;
                     err.debug_message = "Card mount failed. Check connections";
@@ -90,9 +103,26 @@ ESP_ERROR EMMC_Memory::begin(uint8_t enable_pin,
 
             break;
             case SPI_MODE:
-            { // TODO: Implement SPI eMMC mode'
-                err.on_error = true;
-                err.debug_message = "SPI Mode hasn't been implemented yet";
+            { // 1 bit bus on its own SPI host. The card's CS is held high until SD.begin talks to it
+                pinMode(spi_cs_pin, OUTPUT);
+                digitalWrite(spi_cs_pin, HIGH);
+                emmc_spi.begin(spi_sck_pin, spi_miso_pin, spi_mosi_pin, spi_cs_pin);
+
+                if (!SD.begin(spi_cs_pin, emmc_spi, getBusFrequency() * 1000, "/sd"))
+                {
+                    emmc_spi.end();
+                    err.on_error = true;
+                    err.debug_message = "Card mount failed. Check connections";
+                }
+                else
+                {
+                    emmc_initialized = true;
+                    file_system = &SD;
+
+                    emmc_memory_size = SD.cardSize() / (1024 * 1024);
+                    emmc_total_memory_space = SD.totalBytes() / (1024 * 1024);
+                    emmc_used_memory_space = SD.usedBytes() / (1024 * 1024);
+                }
             }
 
             break;
@@ -100,6 +130,12 @@ ESP_ERROR EMMC_Memory::begin(uint8_t enable_pin,
             default:
                 break;
             }
+
+            // One walk of the card now, listings from RAM afterwards. Not being able to cache isn't fatal
+            if (emmc_initialized && metadata_cache_enabled)
+            {
+                err.debug_message = metadata_cache.build(*file_system).debug_message;
+            }
         }
 
         // If there's no card inserted
@@ -119,68 +155,192 @@ ESP_ERROR EMMC_Memory::begin(uint8_t enable_pin,
     return err;
 }
 
+// -- Unmount and power the card off. Files opened through the file system must be closed first
+ESP_ERROR EMMC_Memory::end()
+{
+    if (!emmc_initialized)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    if (myFile)
+    {
+        myFile.close();
+    }
+    flush_count = 0;
+
+    if (connection_mode == SPI_MODE)
+    {
+        SD.end();
+        emmc_spi.end();
+    }
+    else
+    {
+        SD_MMC.end();
+    }
+    emmc_initialized = false;
+    metadata_cache.clear();
+
+    // Off until the next begin(), which powers it up from reset
+    if (emmc_enable_pin != (uint8_t)-1)
+    {
+        digitalWrite(emmc_enable_pin, HIGH);
+    }
+
+    return ESP_ERROR();
+}
+
+// -- Mount again with the pins and mode of the last begin(), after a card change or a failed write
+ESP_ERROR EMMC_Memory::remount()
+{
+    if (emmc_initialized)
+    {
+        end();
+    }
+
+    return begin(emmc_enable_pin, emmc_detect_pin, connection_mode, emmc_bus_width);
+}
+
+// -- Clock of the bus: 0 picks the default of the connection mode
+void EMMC_Memory::setBusFrequency(uint32_t frequency_khz)
+{
+    bus_frequency_khz = frequency_khz;
+}
+
+uint32_t EMMC_Memory::getBusFrequency()
+{
+    if (bus_frequency_khz != 0)
+    {
+        return bus_frequency_khz;
+    }
+    return connection_mode == SPI_MODE ? EMMC_SPI_FREQUENCY_kHZ : EMMC_SDMMC_FREQUENCY_kHZ;
+}
+
+void EMMC_Memory::setSPIPins(uint8_t sck, uint8_t miso, uint8_t mosi, uint8_t cs)
+{
+    spi_sck_pin = sck;
+    spi_miso_pin = miso;
+    spi_mosi_pin = mosi;
+    spi_cs_pin = cs;
+}
+
+bool EMMC_Memory::isCardDetected()
+{
+    return emmc_detect_pin == (uint8_t)-1 || digitalRead(emmc_detect_pin) == LOW;
+}
+
 // -- Directory Operations
 ESP_ERROR EMMC_Memory::listDirectory(const char *dirname, uint8_t levels)
 {
-    // TODO: Implement directory list functionality
-    ESP_ERROR err;
-    err.on_error = true;
-    err.debug_message = "List directory functionality has not been implemented yet";
+    std::vector<EMMC_FileInfo> entries;
+    ESP_ERROR err = listDirectory(dirname, levels, entries);
+    if (err.on_error)
+    {
+        return err;
+    }
+
+    String temp_message;
+    temp_message += "Listing directory \"";
+    temp_message += dirname;
+    temp_message += "\"\n";
+
+    for (EMMC_FileInfo &entry : entries)
+    {
+        for (uint8_t level = 0; level <= entry.level; level++)
+        {
+            temp_message += "\t";
+        }
+
+        if (entry.is_directory)
+        {
+            temp_message += "Directory: ";
+            temp_message += entry.path;
+        }
+        else
+        {
+            temp_message += "File: ";
+            temp_message += entry.path;
+            temp_message += " - Size: ";
+            temp_message += String((unsigned long)entry.size);
+            temp_message += " bytes";
+        }
+        temp_message += "\n";
+    }
+
+    err.debug_message = temp_message;
+    return err;
+}
+
+ESP_ERROR EMMC_Memory::listDirectory(const char *dirname, uint8_t levels, std::vector<EMMC_FileInfo> &entries)
+{
+    entries.clear();
+
+    if (!emmc_initialized)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    // From RAM when the cache covers these levels
+    if (metadata_cache.covers(dirname, levels))
+    {
+        EMMC_FileInfo info;
+        String path = EMMC_MetadataCache::normalize(dirname);
+        if (path != "/" && (!metadata_cache.get(dirname, info) || !info.is_directory))
+        {
+            return ESP_ERROR(true, "Failed to open directory");
+        }
+
+        metadata_cache.list(dirname, levels, entries);
+        return ESP_ERROR();
+    }
+
+    // Otherwise walk the card
+    EMMC_DirectoryIterator iterator;
+    ESP_ERROR err = iterator.begin(*file_system, dirname, levels);
+    if (err.on_error)
+    {
+        return err;
+    }
+
+    EMMC_FileInfo info;
+    while (iterator.next(info))
+    {
+        entries.push_back(info);
+    }
+
+    // In path order, as the cache lists them
+    EMMC_MetadataCache::sortByPath(entries);
+    return ESP_ERROR();
+}
+
+ESP_ERROR EMMC_Memory::findFilesNewerThan(const char *dirname,
+                                          time_t time,
+                                          std::vector<EMMC_FileInfo> &files,
+                                          uint8_t levels)
+{
+    if (metadata_cache.covers(dirname, levels))
+    {
+        ESP_ERROR err = listDirectory(dirname, 0, files); // Checks the directory
+        if (!err.on_error)
+        {
+            metadata_cache.findNewerThan(dirname, time, levels, files);
+        }
+        return err;
+    }
+
+    std::vector<EMMC_FileInfo> entries;
+    ESP_ERROR err = listDirectory(dirname, levels, entries);
+
+    files.clear();
+    for (EMMC_FileInfo &entry : entries)
+    {
+        if (!entry.is_directory && entry.last_write > time)
+        {
+            files.push_back(entry);
+        }
+    }
+
     return err;
-    // if (emmc_initialized)
-    // {
-    //     String temp_message;
-    //     temp_message += "Listing directory \"";
-    //     temp_message += dirname;
-    //     temp_message += "\"";
-    //     printDebugMessage(temp_message, READ_WRITE);
-    //     temp_message = "";
-
-    //     File root = this->_file_system->open(dirname);
-    //     if (!root)
-    //     {
-
-    //         printDebugMessage("Failed to open directory", ERR);
-    //         return;
-    //     }
-    //     if (!root.isDirectory())
-    //     {
-    //         printDebugMessage("Not a Directory", ERR);
-    //         return;
-    //     }
-
-    //     File file = root.openNextFile();
-    //     while (file)
-    //     {
-    //         if (file.isDirectory())
-    //         {
-    //             temp_message += "\tDirectory: ";
-    //             temp_message += file.name();
-    //             printDebugMessage(temp_message, READ_WRITE);
-    //             temp_message = "";
-
-    //             if (levels)
-    //             {
-    //                 listDirectory(file.name(), levels - 1);
-    //             }
-    //         }
-    //         else
-    //         {
-    //             temp_message += "\tFile: ";
-    //             temp_message += file.name();
-    //             temp_message += " - Size: ";
-    //             temp_message += file.size();
-    //             temp_message += " bytes";
-    //             printDebugMessage(temp_message, READ_WRITE);
-    //             temp_message = "";
-    //         }
-    //         file = root.openNextFile();
-    //     }
-    // }
-    // else
-    // {
-    //     printDebugMessage("Card has not been initialized", ERR);
-    // }
 }
 
 ESP_ERROR EMMC_Memory::makeDirectory(const char *path)
@@ -194,6 +354,7 @@ ESP_ERROR EMMC_Memory::makeDirectory(const char *path)
     {
         if (file_system->mkdir(path))
         {
+            refreshMetadata(path);
             temp_message += "Directory \"";
             temp_message += path;
             temp_message += "\"";
@@ -226,6 +387,7 @@ ESP_ERROR EMMC_Memory::removeDirectory(const char *path)
     {
         if (file_system->rmdir(path))
         {
+            metadata_cache.remove(path);
             temp_message += "Directory \"";
             temp_message += path;
             temp_message += "\"";
@@ -247,12 +409,13 @@ ESP_ERROR EMMC_Memory::removeDirectory(const char *path)
 }
 
 // -- File Operations
-ESP_ERROR EMMC_Memory::readFile(const char *path)
+ESP_ERROR EMMC_Memory::readFile(const char *path, uint8_t *buffer, size_t length, size_t &bytes_read, size_t offset)
 {
     ESP_ERROR err;
     err.on_error = false;
 
     String temp_message;
+    bytes_read = 0;
 
     if (emmc_initialized)
     {
@@ -267,12 +430,157 @@ ESP_ERROR EMMC_Memory::readFile(const char *path)
             temp_message += "\" for reading";
         }
 
-        // If filed opened correctly
+        // If filed opened correctly, read from offset in as few calls as possible
+        else
+        {
+            if (offset > file.size() || !file.seek(offset))
+            {
+                err.on_error = true;
+                temp_message += "Offset is past the end of the file";
+            }
+            else
+            {
+                size_t expected = min(length, (size_t)(file.size() - offset));
+                size_t n;
+                while (bytes_read < expected && (n = file.read(buffer + bytes_read, expected - bytes_read)) > 0)
+                {
+                    bytes_read += n;
+                }
+
+                if (bytes_read != expected)
+                {
+                    err.on_error = true;
+                    temp_message += "File read operation failed";
+                }
+            }
+
+            file.close();
+        }
+    }
+    else
+    {
+        err.on_error = true;
+        temp_message += "External storage is not inititalized";
+    }
+
+    err.debug_message = temp_message;
+    return err;
+}
+
+ESP_ERROR EMMC_Memory::readFile(const char *path, FileReadCallback callback, size_t chunk_size)
+{
+    // DMA capable, so the driver reads full sectors straight into it
+    uint8_t *buffer = (uint8_t *)heap_caps_malloc(chunk_size, MALLOC_CAP_DMA);
+    if (buffer == nullptr)
+    {
+        return ESP_ERROR(true, "Not enough DMA capable memory for the read buffer");
+    }
+
+    ESP_ERROR err = readFile(path, callback, buffer, chunk_size);
+    heap_caps_free(buffer);
+    return err;
+}
+
+ESP_ERROR EMMC_Memory::readFile(const char *path, FileReadCallback callback, uint8_t *buffer, size_t buffer_size)
+{
+    ESP_ERROR err;
+    err.on_error = false;
+
+    String temp_message;
+
+    if (emmc_initialized)
+    {
+        File file = file_system->open(path);
+
+        // Error opening file
+        if (!file)
+        {
+            err.on_error = true;
+            temp_message += "Failed to open file \"";
+            temp_message += path;
+            temp_message += "\" for reading";
+        }
+
+        // If filed opened correctly, hand the file to the callback one chunk at a time
         else
         {
-            // TODO: Implement serial burst read
+            size_t expected = file.size();
+            size_t total = 0;
+            bool stopped = false;
+            size_t n;
+
+            while (!stopped && (n = file.read(buffer, buffer_size)) > 0)
+            {
+                total += n;
+                stopped = !callback(buffer, n);
+            }
+
+            if (!stopped && total != expected)
+            {
+                err.on_error = true;
+                temp_message += "File read operation failed";
+            }
+
+            file.close();
+        }
+    }
+    else
+    {
+        err.on_error = true;
+        temp_message += "External storage is not inititalized";
+    }
+
+    err.debug_message = temp_message;
+    return err;
+}
+
+ESP_ERROR EMMC_Memory::readFileInto(const char *path, uint8_t *buffer, size_t length, size_t &bytes_read)
+{
+    ESP_ERROR err;
+    err.on_error = false;
+
+    String temp_message;
+    bytes_read = 0;
+
+    if (emmc_initialized)
+    {
+        File file = file_system->open(path);
+
+        // Error opening file
+        if (!file)
+        {
             err.on_error = true;
-            err.debug_message = "Serial file download has not been implemented yet";
+            temp_message += "Failed to open file \"";
+            temp_message += path;
+            temp_message += "\" for reading";
+        }
+
+        // If filed opened correctly, read all of it with a single call
+        else
+        {
+            size_t expected = file.size();
+
+            if (expected > length)
+            {
+                err.on_error = true;
+                temp_message += "File is larger than the buffer";
+            }
+            else
+            {
+                size_t n;
+                while (bytes_read < expected && (n = file.read(buffer + bytes_read, expected - bytes_read)) > 0)
+                {
+                    bytes_read += n;
+                }
+
+                if (bytes_read != expected)
+                {
+                    err.on_error = true;
+                    temp_message += "File read operation failed";
+                }
+            }
+
+            file.close();
         }
     }
     else
@@ -285,7 +593,7 @@ ESP_ERROR EMMC_Memory::readFile(const char *path)
     return err;
 }
 
-ESP_ERROR EMMC_Memory::writeFile(const char *path, char *data, uint16_t length)
+ESP_ERROR EMMC_Memory::writeFile(const char *path, const uint8_t *data, size_t length)
 {
     ESP_ERROR err;
     err.on_error = false;
@@ -308,12 +616,18 @@ ESP_ERROR EMMC_Memory::writeFile(const char *path, char *data, uint16_t length)
         // If filed opened correctly
         else
         {
-            if (myFile.print(data))
+            // write, not print: binary data may contain NUL bytes
+            if (myFile.write(data, length) == length)
             {
                 temp_message += "Appending to file \"";
                 temp_message += path;
                 temp_message += "\" was succesful";
                 myFile.flush();
+
+                if (metadata_cache.isValid())
+                {
+                    metadata_cache.update(path, myFile.size(), myFile.getLastWrite());
+                }
             }
             else
             {
@@ -364,6 +678,12 @@ ESP_ERROR EMMC_Memory::appendFile(const char *path, const char *data)
                 {
                     myFile.flush();
                 }
+
+                // The cache follows every append, flushed or not
+                if (metadata_cache.isValid())
+                {
+                    metadata_cache.update(path, myFile.size(), myFile.getLastWrite());
+                }
             }
             else
             {
@@ -394,6 +714,7 @@ ESP_ERROR EMMC_Memory::renameFile(const char *path1, const char *path2)
 
         if (file_system->rename(path1, path2))
         {
+            metadata_cache.rename(path1, path2);
             temp_message += "Renaming File \"";
             temp_message += path1;
             temp_message += "\" to \"";
@@ -427,6 +748,7 @@ ESP_ERROR EMMC_Memory::deleteFile(const char *path)
 
         if (file_system->remove(path))
         {
+            metadata_cache.remove(path);
             temp_message += "File \"";
             temp_message += path;
             temp_message += "\" has been deleted";
@@ -449,6 +771,42 @@ ESP_ERROR EMMC_Memory::deleteFile(const char *path)
     return err;
 }
 
+// -- Metadata cache
+ESP_ERROR EMMC_Memory::rebuildMetadataCache()
+{
+    if (!emmc_initialized)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    return metadata_cache.build(*file_system);
+}
+
+ESP_ERROR EMMC_Memory::refreshMetadata(const char *path)
+{
+    if (!emmc_initialized)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    if (!metadata_cache.isValid())
+    {
+        return ESP_ERROR();
+    }
+
+    File file = file_system->open(path);
+    if (!file)
+    {
+        metadata_cache.remove(path);
+        return ESP_ERROR();
+    }
+
+    bool is_directory = file.isDirectory();
+    metadata_cache.update(path, is_directory ? 0 : file.size(), file.getLastWrite(), is_directory);
+    file.close();
+    return ESP_ERROR();
+}
+
 ESP_ERROR EMMC_Memory::onDetectPinChange()
 {
     ESP_ERROR err;
@@ -467,12 +825,11 @@ ESP_ERROR EMMC_Memory::onDetectPinChange()
         }
     }
 
-    else if (digitalRead(emmc_detect_pin == HIGH))
+    else if (digitalRead(emmc_detect_pin) == HIGH)
     {
         if (emmc_initialized == true)
         {
-            digitalWrite(emmc_enable_pin, LOW);
-            emmc_initialized = false;
+            end();
             emmc_detected = false;
         }
         else
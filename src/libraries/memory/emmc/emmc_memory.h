@@ -22,9 +22,19 @@
 // * https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/peripherals/sdmmc_host.html
 // * https://github.com/espressif/arduino-esp32/tree/master/libraries/SD_MMC/examples
 // *
+// * Bus: eMMC_MODE uses the SDMMC host, 1 or 4 bits wide, on its fixed pins. SPI_MODE uses the SD library on an SPI
+// * host of its own, by default on the same socket pins (CLK 14, MISO = DAT0 2, MOSI = CMD 15, CS = DAT3 13), see
+// * setSPIPins(). setBusFrequency() sets the clock of either, before begin(). On cores before 2.0 the SDMMC clock
+// * is fixed at 20 MHz.
+// *
 
 //*****************************************************     LIBRARY SETTINGS    *****************************************************/
-#define SD_POWER_UP_DELAY_mS 10 // eMMC IC power up time. This is entirely dependent on the chip you use.
+#define SD_POWER_UP_DELAY_mS 10    // eMMC IC power up time. This is entirely dependent on the chip you use.
+#define EMMC_SDMMC_FREQUENCY_kHZ 20000   // Default SDMMC clock
+#define EMMC_SDMMC_HIGH_SPEED_kHZ 40000  // High speed mode, the fastest of the ESP32 SDMMC host. Needs short traces
+#define EMMC_SPI_FREQUENCY_kHZ 20000     // Default SPI clock
+#define EMMC_SECTOR_SIZE 512       // Card sector size, the unit of aligned writes
+#define EMMC_READ_CHUNK_SIZE 32768 // Chunk size of callback reads, multiple of EMMC_SECTOR_SIZE
 
 //*****************************************************        LIBRARIES        *****************************************************/
 #include <Arduino.h>
@@ -36,6 +46,7 @@
 #include <string>
 #include <vector>
 #include <utils.h>
+#include "emmc_directory.h"
 
 //*****************************************************       DATA TYPES        *****************************************************/
 //  -- Bus type
@@ -60,6 +71,12 @@ public:
     {
         emmc_initialized = false;
         emmc_detected = false;
+        metadata_cache_enabled = false;
+
+        connection_mode = eMMC_MODE;
+        emmc_bus_width = MODE_1_BIT;
+        bus_frequency_khz = 0;
+        setSPIPins(esp32_emmc_clk, esp_emmc_data0, esp32_emmc_cmd, esp_emmc_dat3);
     }
 
     // -- Initialize SD Card
@@ -68,20 +85,70 @@ public:
                     eMMC_CONNECTION_MODE mode = eMMC_MODE,
                     eMMC_BUS_WIDTH bus_width = MODE_1_BIT);
 
+    // -- Bus settings, before begin(). Frequency in kHz, 0 for the default of the mode
+    void setBusFrequency(uint32_t frequency_khz);
+    void setSPIPins(uint8_t sck, uint8_t miso, uint8_t mosi, uint8_t cs);
+
+    uint32_t getBusFrequency();
+
+    eMMC_CONNECTION_MODE getConnectionMode()
+    {
+        return connection_mode;
+    }
+
+    eMMC_BUS_WIDTH getBusWidth()
+    {
+        return emmc_bus_width;
+    }
+
+    // -- Unmount and power the card off, e.g. once it's gone. remount() mounts it again as begin() did
+    ESP_ERROR end();
+    ESP_ERROR remount();
+
     // -- Directory Operations
-    ESP_ERROR listDirectory(const char *dirname, uint8_t levels); // Not implemented yet
+    // Listings are answered from the metadata cache when it is on, and walk the card otherwise, in path order both
+    // ways. See emmc_directory.h
+    ESP_ERROR listDirectory(const char *dirname, uint8_t levels); // One line per entry, in the debug message
+    ESP_ERROR listDirectory(const char *dirname, uint8_t levels, std::vector<EMMC_FileInfo> &entries);
+    ESP_ERROR findFilesNewerThan(const char *dirname,
+                                 time_t time,
+                                 std::vector<EMMC_FileInfo> &files,
+                                 uint8_t levels = EMMC_DIRECTORY_MAX_LEVELS);
     ESP_ERROR makeDirectory(const char *path);
     ESP_ERROR removeDirectory(const char *path);
 
     // File Operations
-    ESP_ERROR readFile(const char *path);
-    ESP_ERROR writeFile(const char *path, char *data, uint16_t length);
+    // Reads are bursts into the caller's buffer: full sectors go straight from the card to a word aligned buffer
+    ESP_ERROR readFile(const char *path, uint8_t *buffer, size_t length, size_t &bytes_read, size_t offset = 0);
+    ESP_ERROR readFile(const char *path, FileReadCallback callback, size_t chunk_size = EMMC_READ_CHUNK_SIZE);
+    ESP_ERROR readFile(const char *path, FileReadCallback callback, uint8_t *buffer, size_t buffer_size);
+    ESP_ERROR readFileInto(const char *path, uint8_t *buffer, size_t length, size_t &bytes_read); // Whole file
+    ESP_ERROR writeFile(const char *path, const uint8_t *data, size_t length);
     ESP_ERROR appendFile(const char *path, const char *data);
     ESP_ERROR renameFile(const char *path1, const char *path2);
     ESP_ERROR deleteFile(const char *path);
 
     ESP_ERROR onDetectPinChange();
 
+    // -- Metadata cache. Call setMetadataCache(true) before begin() to build it when the card is mounted
+    void setMetadataCache(bool enabled)
+    {
+        metadata_cache_enabled = enabled;
+    }
+
+    ESP_ERROR rebuildMetadataCache();
+    ESP_ERROR refreshMetadata(const char *path); // After writing a file through a File or a stream writer
+
+    EMMC_MetadataCacheStats getMetadataCacheStats()
+    {
+        return metadata_cache.getStats();
+    }
+
+    bool isMetadataCached()
+    {
+        return metadata_cache.isValid();
+    }
+
     // -- Card operations
     uint64_t getEMMCsize()
     {
@@ -98,12 +165,20 @@ public:
         return emmc_used_memory_space;
     }
 
+    // File system of the card, nullptr if not initialized. Used by EMMC_StreamWriter
+    fs::FS *getFileSystem()
+    {
+        return emmc_initialized ? file_system : nullptr;
+    }
+
     // -- State Operations
     bool isInitialized()
     {
         return emmc_initialized;
     }
 
+    bool isCardDetected(); // Detect pin LOW, or no detect pin
+
     void setDetected(bool state)
     {
         emmc_detected = state;
@@ -115,6 +190,11 @@ private:
     eMMC_CONNECTION_MODE connection_mode;
     eMMC_BUS_WIDTH emmc_bus_width;
     SPIClass emmc_spi;
+    uint32_t bus_frequency_khz;
+    uint8_t spi_sck_pin;
+    uint8_t spi_miso_pin;
+    uint8_t spi_mosi_pin;
+    uint8_t spi_cs_pin;
     uint8_t emmc_enable_pin;
     uint8_t emmc_detect_pin;
 
@@ -133,6 +213,10 @@ private:
     fs::FS *file_system;
     File myFile;
 
+    // -- Metadata cache
+    bool metadata_cache_enabled;
+    EMMC_MetadataCache metadata_cache;
+
     // -- THESE PINS CANNOT BE CHANGED
     static const byte esp_emmc_data0 = 2;
     static const byte esp_emmc_dat1 = 4;
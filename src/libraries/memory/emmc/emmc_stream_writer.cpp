@@ -0,0 +1,386 @@
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_stream_writer.cpp
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 8, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*****************************************************       HEADER FILE       *****************************************************/
+#include "emmc_stream_writer.h"
+
+//*****************************************     STREAM WRITER FUNCTIONS DEFINTIONS      ********************************************/
+EMMC_StreamWriter::EMMC_StreamWriter()
+{
+    blocks = nullptr;
+    blocks_allocated = 0;
+    stream_block_size = 0;
+    active_block = NO_BLOCK;
+    block_fill = 0;
+    block_capacity = 0;
+    file_offset = 0;
+
+    writer_task = nullptr;
+    free_queue = nullptr;
+    request_queue = nullptr;
+    done_semaphore = nullptr;
+    write_timeout_ms = EMMC_STREAM_WRITE_TIMEOUT_mS;
+
+    stream_open = false;
+    write_error = false;
+
+    stats_mutex = portMUX_INITIALIZER_UNLOCKED;
+    stats = {};
+    first_queued_us = 0;
+    last_written_us = 0;
+    latency_sum_us = 0;
+}
+
+EMMC_StreamWriter::~EMMC_StreamWriter()
+{
+    close();
+}
+
+// -- Open a file and start the writer task
+ESP_ERROR EMMC_StreamWriter::begin(EMMC_Memory &emmc,
+                                   const char *path,
+                                   bool append,
+                                   size_t block_size,
+                                   uint8_t block_count,
+                                   BaseType_t core,
+                                   UBaseType_t priority)
+{
+    ESP_ERROR err;
+
+    if (stream_open)
+    {
+        return ESP_ERROR(true, "Stream writer is already open");
+    }
+
+    fs::FS *file_system = emmc.getFileSystem();
+    if (file_system == nullptr)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    if (block_size == 0 || block_size % EMMC_SECTOR_SIZE != 0 || block_count < 2 || block_count == NO_BLOCK)
+    {
+        return ESP_ERROR(true, "Block size must be a multiple of the sector size, with at least 2 blocks");
+    }
+
+    // 1. Blocks, DMA capable so the driver doesn't bounce them through a sector buffer
+    stream_block_size = block_size;
+    blocks = new uint8_t *[block_count]();
+    for (blocks_allocated = 0; blocks_allocated < block_count; blocks_allocated++)
+    {
+        blocks[blocks_allocated] = (uint8_t *)heap_caps_malloc(block_size, MALLOC_CAP_DMA);
+        if (blocks[blocks_allocated] == nullptr)
+        {
+            release();
+            return ESP_ERROR(true, "Not enough DMA capable memory for the stream blocks");
+        }
+    }
+
+    // 2. Queues. Requests never wait, there are more slots than blocks
+    free_queue = xQueueCreate(block_count, sizeof(uint8_t));
+    request_queue = xQueueCreate(block_count + 1, sizeof(Request));
+    done_semaphore = xSemaphoreCreateBinary();
+    if (free_queue == nullptr || request_queue == nullptr || done_semaphore == nullptr)
+    {
+        release();
+        return ESP_ERROR(true, "Could not create the stream queues");
+    }
+
+    for (uint8_t i = 0; i < block_count; i++)
+    {
+        xQueueSend(free_queue, &i, 0);
+    }
+
+    // 3. File
+    stream_file = file_system->open(path, append ? FILE_APPEND : FILE_WRITE);
+    if (!stream_file)
+    {
+        release();
+        String temp_message;
+        temp_message += "Failed to open file \"";
+        temp_message += path;
+        temp_message += "\" for writting";
+        return ESP_ERROR(true, temp_message);
+    }
+
+    file_offset = append ? stream_file.size() : 0;
+    active_block = NO_BLOCK;
+    block_fill = 0;
+    block_capacity = 0;
+    write_error = false;
+    resetStats();
+
+    // 4. Writer task
+    if (xTaskCreatePinnedToCore(taskEntry, "EMMC stream", EMMC_STREAM_TASK_STACK, this, priority, &writer_task, core) != pdPASS)
+    {
+        writer_task = nullptr;
+        stream_file.close();
+        release();
+        return ESP_ERROR(true, "Could not create the stream writer task");
+    }
+
+    stream_open = true;
+    err.debug_message = "Stream writer started";
+    return err;
+}
+
+// -- Write operations
+size_t EMMC_StreamWriter::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+size_t EMMC_StreamWriter::write(const uint8_t *data, size_t length)
+{
+    if (!stream_open || write_error)
+    {
+        return 0;
+    }
+
+    size_t done = 0;
+    while (done < length)
+    {
+        if (active_block == NO_BLOCK && !acquireBlock())
+        {
+            break;
+        }
+
+        size_t n = min(length - done, block_capacity - block_fill);
+        memcpy(blocks[active_block] + block_fill, data + done, n);
+        block_fill += n;
+        done += n;
+
+        if (block_fill == block_capacity)
+        {
+            submit(COMMAND_WRITE);
+        }
+    }
+
+    if (done < length)
+    {
+        portENTER_CRITICAL(&stats_mutex);
+        stats.dropped_bytes += length - done;
+        portEXIT_CRITICAL(&stats_mutex);
+    }
+
+    return done;
+}
+
+// -- Write the partially filled block and wait until everything is on the card
+ESP_ERROR EMMC_StreamWriter::sync()
+{
+    if (!stream_open)
+    {
+        return ESP_ERROR(true, "Stream writer is not open");
+    }
+
+    submit(COMMAND_SYNC);
+    xSemaphoreTake(done_semaphore, portMAX_DELAY);
+
+    return getError();
+}
+
+ESP_ERROR EMMC_StreamWriter::close()
+{
+    if (!stream_open)
+    {
+        return ESP_ERROR(true, "Stream writer is not open");
+    }
+
+    ESP_ERROR err = sync();
+
+    // The task gives the semaphore right before deleting itself
+    submit(COMMAND_STOP);
+    xSemaphoreTake(done_semaphore, portMAX_DELAY);
+    writer_task = nullptr;
+
+    stream_file.close();
+    stream_open = false;
+    release();
+
+    return err;
+}
+
+ESP_ERROR EMMC_StreamWriter::getError()
+{
+    if (write_error)
+    {
+        return ESP_ERROR(true, "File write operation failed");
+    }
+
+    return ESP_ERROR();
+}
+
+EMMC_StreamStats EMMC_StreamWriter::getStats()
+{
+    portENTER_CRITICAL(&stats_mutex);
+    EMMC_StreamStats s = stats;
+    uint32_t elapsed_us = last_written_us - first_queued_us;
+    uint64_t latency_sum = latency_sum_us;
+    portEXIT_CRITICAL(&stats_mutex);
+
+    if (s.blocks_written > 0)
+    {
+        s.mean_write_latency_us = (float)latency_sum / s.blocks_written;
+        s.write_MBps = latency_sum > 0 ? (float)s.bytes_written / latency_sum : 0;
+        s.sustained_MBps = elapsed_us > 0 ? (float)s.bytes_written / elapsed_us : 0;
+    }
+
+    return s;
+}
+
+void EMMC_StreamWriter::resetStats()
+{
+    portENTER_CRITICAL(&stats_mutex);
+    stats = {};
+    first_queued_us = 0;
+    last_written_us = 0;
+    latency_sum_us = 0;
+    portEXIT_CRITICAL(&stats_mutex);
+}
+
+// -- Producer side
+bool EMMC_StreamWriter::acquireBlock()
+{
+    if (xQueueReceive(free_queue, &active_block, 0) != pdTRUE)
+    {
+        uint32_t start = micros();
+        if (xQueueReceive(free_queue, &active_block, pdMS_TO_TICKS(write_timeout_ms)) != pdTRUE)
+        {
+            active_block = NO_BLOCK;
+            return false;
+        }
+
+        uint32_t stall = micros() - start;
+        portENTER_CRITICAL(&stats_mutex);
+        stats.producer_stalls++;
+        stats.max_stall_us = max(stats.max_stall_us, stall);
+        portEXIT_CRITICAL(&stats_mutex);
+    }
+
+    // End the block on a block_size boundary of the file, also after a sync or when appending
+    block_fill = 0;
+    block_capacity = stream_block_size - file_offset % stream_block_size;
+    return true;
+}
+
+void EMMC_StreamWriter::submit(COMMAND command)
+{
+    Request request;
+    request.block = active_block;
+    request.command = command;
+    request.length = active_block == NO_BLOCK ? 0 : block_fill;
+
+    portENTER_CRITICAL(&stats_mutex);
+    if (request.length > 0 && first_queued_us == 0)
+    {
+        first_queued_us = micros();
+    }
+    portEXIT_CRITICAL(&stats_mutex);
+
+    file_offset += request.length;
+    active_block = NO_BLOCK;
+    block_fill = 0;
+
+    xQueueSend(request_queue, &request, portMAX_DELAY);
+}
+
+void EMMC_StreamWriter::release()
+{
+    if (blocks != nullptr)
+    {
+        for (uint8_t i = 0; i < blocks_allocated; i++)
+        {
+            heap_caps_free(blocks[i]);
+        }
+        delete[] blocks;
+        blocks = nullptr;
+    }
+    blocks_allocated = 0;
+
+    if (free_queue != nullptr)
+    {
+        vQueueDelete(free_queue);
+        free_queue = nullptr;
+    }
+    if (request_queue != nullptr)
+    {
+        vQueueDelete(request_queue);
+        request_queue = nullptr;
+    }
+    if (done_semaphore != nullptr)
+    {
+        vSemaphoreDelete(done_semaphore);
+        done_semaphore = nullptr;
+    }
+}
+
+// -- Writer task
+void EMMC_StreamWriter::taskEntry(void *arg)
+{
+    EMMC_StreamWriter *writer = static_cast<EMMC_StreamWriter *>(arg);
+    writer->run();
+    vTaskDelete(nullptr);
+}
+
+void EMMC_StreamWriter::run()
+{
+    Request request;
+
+    while (true)
+    {
+        xQueueReceive(request_queue, &request, portMAX_DELAY);
+
+        if (request.length > 0)
+        {
+            // After an error the blocks are only recycled, so the producer doesn't stall
+            if (!write_error)
+            {
+                uint32_t start = micros();
+                size_t written = stream_file.write(blocks[request.block], request.length);
+                uint32_t now = micros();
+                uint32_t latency = now - start;
+
+                if (written != request.length)
+                {
+                    write_error = true;
+                }
+
+                portENTER_CRITICAL(&stats_mutex);
+                stats.bytes_written += written;
+                stats.blocks_written++;
+                stats.max_write_latency_us = max(stats.max_write_latency_us, latency);
+                latency_sum_us += latency;
+                last_written_us = now;
+                portEXIT_CRITICAL(&stats_mutex);
+            }
+        }
+
+        if (request.block != NO_BLOCK)
+        {
+            xQueueSend(free_queue, &request.block, portMAX_DELAY);
+        }
+
+        if (request.command == COMMAND_SYNC)
+        {
+            stream_file.flush();
+            xSemaphoreGive(done_semaphore);
+        }
+        else if (request.command == COMMAND_STOP)
+        {
+            xSemaphoreGive(done_semaphore);
+            return;
+        }
+    }
+}
+
+// End.
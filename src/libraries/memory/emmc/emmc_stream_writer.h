@@ -0,0 +1,158 @@
+#pragma once
+
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_stream_writer.h
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 8, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*********************************************************     READ ME    **********************************************************/
+
+// * High throughput streaming writes to a file on the eMMC / SD card.
+// *
+// * Data is copied into large blocks (32 KB by default). A full block is handed to a background task that writes it
+// * with a single call, while the producer fills the next one. Blocks end on block_size boundaries of the file, so
+// * with a block size that is a multiple of the cluster size every write covers whole sectors and clusters, and the
+// * FAT layer hands them straight to the SDMMC driver. The buffers are allocated DMA capable for the same reason:
+// * unaligned or external RAM buffers are copied to the card one sector at a time.
+// *
+// * The writer is a Print, so text records can be written with print / println, and binary data with write.
+// * write() only blocks when every block is waiting to be written, for at most the write timeout.
+// *
+// * Don't use the EMMC_Memory file functions on the same file while a writer has it open.
+
+//*****************************************************     LIBRARY SETTINGS    *****************************************************/
+#define EMMC_STREAM_BLOCK_SIZE 32768      // Bytes per block, multiple of EMMC_SECTOR_SIZE
+#define EMMC_STREAM_BLOCK_COUNT 2         // Blocks, one being filled while the others are written
+#define EMMC_STREAM_TASK_STACK 4096       // Writer task stack, in bytes
+#define EMMC_STREAM_WRITE_TIMEOUT_mS 1000 // Longest time write() waits for a free block
+
+//*****************************************************        LIBRARIES        *****************************************************/
+#include <Arduino.h>
+#include "FS.h"
+#include <utils.h>
+#include "emmc_memory.h"
+
+//*****************************************************       DATA TYPES        *****************************************************/
+// -- Writer statistics, since begin() or resetStats()
+struct EMMC_StreamStats
+{
+    uint64_t bytes_written;        // Bytes written to the file
+    uint32_t blocks_written;       // Number of writes to the file
+    float sustained_MBps;          // Bytes written over the time from the first block queued to the last one written
+    float write_MBps;              // Bytes written over the time spent in the writes
+    uint32_t max_write_latency_us; // Longest single block write
+    float mean_write_latency_us;
+    uint32_t producer_stalls; // write() calls that had to wait for a free block
+    uint32_t max_stall_us;    // Longest of these waits
+    uint32_t dropped_bytes;   // Bytes write() gave up on after the timeout
+};
+
+//*****************************************************   STREAM WRITER CLASS   *****************************************************/
+class EMMC_StreamWriter : public Print
+{
+public:
+    EMMC_StreamWriter();
+    ~EMMC_StreamWriter();
+
+    // -- Open a file and start the writer task
+    ESP_ERROR begin(EMMC_Memory &emmc,
+                    const char *path,
+                    bool append = false,
+                    size_t block_size = EMMC_STREAM_BLOCK_SIZE,
+                    uint8_t block_count = EMMC_STREAM_BLOCK_COUNT,
+                    BaseType_t core = 0,
+                    UBaseType_t priority = 2);
+
+    // -- Write operations. Return the number of bytes accepted, less than length on timeout or after a write error
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *data, size_t length) override;
+    using Print::write;
+
+    // -- Write the partially filled block and wait until everything is on the card
+    ESP_ERROR sync();
+    void flush() { sync(); }
+
+    // -- Sync, stop the task, close the file and free the blocks
+    ESP_ERROR close();
+
+    void setWriteTimeout(uint32_t timeout_ms)
+    {
+        write_timeout_ms = timeout_ms;
+    }
+
+    // -- State Operations
+    bool isOpen()
+    {
+        return stream_open;
+    }
+
+    ESP_ERROR getError();
+    uint64_t getPosition()
+    {
+        return file_offset + block_fill;
+    }
+
+    EMMC_StreamStats getStats();
+    void resetStats();
+
+private:
+    // -- Requests to the writer task
+    enum COMMAND : uint8_t
+    {
+        COMMAND_WRITE,
+        COMMAND_SYNC,
+        COMMAND_STOP,
+    };
+
+    struct Request
+    {
+        uint8_t block;
+        COMMAND command;
+        uint32_t length;
+    };
+
+    static const uint8_t NO_BLOCK = 0xFF;
+
+    static void taskEntry(void *arg);
+    void run();
+    bool acquireBlock();
+    void submit(COMMAND command);
+    void release();
+
+    // -- Blocks
+    uint8_t **blocks;
+    uint8_t blocks_allocated;
+    size_t stream_block_size;
+    uint8_t active_block;
+    size_t block_fill;
+    size_t block_capacity;
+    uint64_t file_offset; // Offset of the active block in the file
+
+    // -- Task
+    TaskHandle_t writer_task;
+    QueueHandle_t free_queue;
+    QueueHandle_t request_queue;
+    SemaphoreHandle_t done_semaphore;
+    uint32_t write_timeout_ms;
+
+    // -- File
+    File stream_file;
+    bool stream_open;
+    volatile bool write_error;
+
+    // -- Statistics, updated by the task
+    portMUX_TYPE stats_mutex;
+    EMMC_StreamStats stats;
+    uint32_t first_queued_us;
+    uint32_t last_written_us;
+    uint64_t latency_sum_us;
+};
+
+// End.
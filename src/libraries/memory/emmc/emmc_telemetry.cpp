@@ -0,0 +1,862 @@
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_telemetry.cpp
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 8, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*****************************************************       HEADER FILE       *****************************************************/
+#include "emmc_telemetry.h"
+
+#include <math.h>
+
+//*****************************************************     ENCODING HELPERS    *****************************************************/
+// -- CRC-32 update, start with 0xFFFFFFFF and invert the result
+static uint32_t telemetryCrc(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= bytes[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return crc;
+}
+
+// -- Small magnitudes, positive or negative, to small unsigned numbers
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// -- 7 bits per byte, the high bit set on every byte but the last
+static uint8_t *putVarint(uint8_t *p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+// -- nullptr if the varint runs past end
+static const uint8_t *getVarint(const uint8_t *p, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (uint8_t shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+//**********************************************     TELEMETRY WRITER FUNCTIONS DEFINTIONS      *************************************/
+EMMC_TelemetryWriter::EMMC_TelemetryWriter()
+{
+    file_system = nullptr;
+    file_offset = 0;
+    telemetry_open = false;
+    write_error = false;
+
+    memset(schema, 0, sizeof(schema));
+    channels = 0;
+    samples_per_block = 0;
+
+    times = nullptr;
+    columns = nullptr;
+    sample_count = 0;
+    encoded = nullptr;
+
+    index_count = 0;
+    block_count = 0;
+    stats = {};
+}
+
+EMMC_TelemetryWriter::~EMMC_TelemetryWriter()
+{
+    close();
+}
+
+EMMC_TelemetryChannel EMMC_TelemetryWriter::channel(const char *name,
+                                                    const char *unit,
+                                                    EMMC_TELEMETRY_TYPE type,
+                                                    float scale,
+                                                    float offset)
+{
+    EMMC_TelemetryChannel channel;
+    memset(&channel, 0, sizeof(channel));
+    strncpy(channel.name, name, sizeof(channel.name) - 1);
+    strncpy(channel.unit, unit, sizeof(channel.unit) - 1);
+    channel.type = type;
+    channel.scale = scale;
+    channel.offset = offset;
+    return channel;
+}
+
+ESP_ERROR EMMC_TelemetryWriter::begin(EMMC_Memory &emmc,
+                                      const char *path,
+                                      const EMMC_TelemetryChannel *channel_schemas,
+                                      uint16_t channel_count,
+                                      uint16_t block_samples)
+{
+    fs::FS *emmc_file_system = emmc.getFileSystem();
+    if (emmc_file_system == nullptr)
+    {
+        return ESP_ERROR(true, "External storage is not inititalized");
+    }
+
+    return begin(*emmc_file_system, path, channel_schemas, channel_count, block_samples);
+}
+
+ESP_ERROR EMMC_TelemetryWriter::begin(fs::FS &fs,
+                                      const char *path,
+                                      const EMMC_TelemetryChannel *channel_schemas,
+                                      uint16_t channel_count,
+                                      uint16_t block_samples)
+{
+    if (telemetry_open)
+    {
+        return ESP_ERROR(true, "Telemetry writer is already open");
+    }
+
+    if (channel_count == 0 || channel_count > EMMC_TELEMETRY_MAX_CHANNELS || block_samples == 0)
+    {
+        return ESP_ERROR(true, "Telemetry needs 1 to EMMC_TELEMETRY_MAX_CHANNELS channels, and samples per block");
+    }
+
+    for (uint16_t c = 0; c < channel_count; c++)
+    {
+        if (channel_schemas[c].type == TELEMETRY_INT32 && channel_schemas[c].scale == 0.f)
+        {
+            return ESP_ERROR(true, "TELEMETRY_INT32 channels need a scale");
+        }
+    }
+
+    file_system = &fs;
+    memcpy(schema, channel_schemas, channel_count * sizeof(EMMC_TelemetryChannel));
+    channels = channel_count;
+    samples_per_block = block_samples;
+
+    // 1. Buffers: the samples of a block, and the block encoded, DMA capable like the stream writer's
+    times = (uint64_t *)heap_caps_malloc(samples_per_block * sizeof(uint64_t), MALLOC_CAP_8BIT);
+    columns = (uint32_t *)heap_caps_malloc(channels * samples_per_block * sizeof(uint32_t), MALLOC_CAP_8BIT);
+    encoded = (uint8_t *)heap_caps_malloc(maxBlockBytes(channels, samples_per_block), MALLOC_CAP_DMA);
+    if (times == nullptr || columns == nullptr || encoded == nullptr)
+    {
+        release();
+        return ESP_ERROR(true, "Not enough memory for the telemetry buffers");
+    }
+
+    // 2. File and header
+    telemetry_file = file_system->open(path, FILE_WRITE);
+    if (!telemetry_file)
+    {
+        release();
+        String temp_message;
+        temp_message += "Failed to open file \"";
+        temp_message += path;
+        temp_message += "\" for writting";
+        return ESP_ERROR(true, temp_message);
+    }
+
+    index_path = String(path) + EMMC_TELEMETRY_INDEX_SUFFIX;
+    if (file_system->exists(index_path.c_str()))
+    {
+        file_system->remove(index_path.c_str());
+    }
+
+    EMMC_TelemetryHeader header;
+    header.magic = EMMC_TELEMETRY_MAGIC;
+    header.version = EMMC_TELEMETRY_VERSION;
+    header.channel_count = channels;
+    header.block_samples = samples_per_block;
+    header.reserved = 0;
+    header.header_size = sizeof(header) + channels * sizeof(EMMC_TelemetryChannel);
+    uint32_t crc = telemetryCrc(0xFFFFFFFF, &header, offsetof(EMMC_TelemetryHeader, crc));
+    header.crc = ~telemetryCrc(crc, schema, channels * sizeof(EMMC_TelemetryChannel));
+
+    if (telemetry_file.write((const uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+        telemetry_file.write((const uint8_t *)schema, channels * sizeof(EMMC_TelemetryChannel)) !=
+            channels * sizeof(EMMC_TelemetryChannel))
+    {
+        telemetry_file.close();
+        release();
+        return ESP_ERROR(true, "File write operation failed");
+    }
+
+    file_offset = header.header_size;
+    sample_count = 0;
+    index_count = 0;
+    block_count = 0;
+    write_error = false;
+    stats = {};
+    stats.bytes_written = file_offset;
+    for (uint16_t c = 0; c < channels; c++)
+    {
+        range_min[c] = INFINITY;
+        range_max[c] = -INFINITY;
+    }
+
+    telemetry_open = true;
+    return ESP_ERROR();
+}
+
+// -- Physical values, TELEMETRY_INT32 channels are quantized
+bool EMMC_TelemetryWriter::addSample(uint64_t time_us, const float *values)
+{
+    if (!startSample(time_us))
+    {
+        return false;
+    }
+
+    for (uint16_t c = 0; c < channels; c++)
+    {
+        uint32_t &raw = columns[c * samples_per_block + sample_count];
+        if (schema[c].type == TELEMETRY_INT32)
+        {
+            double quantized = round((values[c] - schema[c].offset) / schema[c].scale);
+            int32_t value = (int32_t)constrain(quantized, (double)INT32_MIN, (double)INT32_MAX);
+            raw = (uint32_t)value;
+            setRange(c, value * schema[c].scale + schema[c].offset);
+        }
+        else
+        {
+            memcpy(&raw, &values[c], sizeof(raw));
+            setRange(c, values[c]);
+        }
+    }
+
+    sample_count++;
+    return sample_count < samples_per_block || writeBlock();
+}
+
+// -- Raw values, e.g. ADC codes. Converted to float for TELEMETRY_FLOAT32 channels
+bool EMMC_TelemetryWriter::addSample(uint64_t time_us, const int32_t *values)
+{
+    if (!startSample(time_us))
+    {
+        return false;
+    }
+
+    for (uint16_t c = 0; c < channels; c++)
+    {
+        uint32_t &raw = columns[c * samples_per_block + sample_count];
+        if (schema[c].type == TELEMETRY_INT32)
+        {
+            raw = (uint32_t)values[c];
+            setRange(c, values[c] * schema[c].scale + schema[c].offset);
+        }
+        else
+        {
+            float value = (float)values[c];
+            memcpy(&raw, &value, sizeof(raw));
+            setRange(c, value);
+        }
+    }
+
+    sample_count++;
+    return sample_count < samples_per_block || writeBlock();
+}
+
+ESP_ERROR EMMC_TelemetryWriter::flush()
+{
+    if (!telemetry_open)
+    {
+        return ESP_ERROR(true, "Telemetry writer is not open");
+    }
+
+    if (!write_error && writeBlock())
+    {
+        telemetry_file.flush();
+    }
+    return getError();
+}
+
+// -- The index goes after the last block, then the trailer pointing at it
+ESP_ERROR EMMC_TelemetryWriter::close()
+{
+    if (!telemetry_open)
+    {
+        return ESP_ERROR(true, "Telemetry writer is not open");
+    }
+
+    // The last, shorter block first: the index starts after it
+    if (!write_error)
+    {
+        writeBlock();
+    }
+
+    uint64_t index_offset = file_offset;
+    if (!write_error && writeIndex(true))
+    {
+        EMMC_TelemetryTrailer trailer;
+        trailer.magic = EMMC_TELEMETRY_INDEX_MAGIC;
+        trailer.block_count = block_count;
+        trailer.index_offset = index_offset;
+        trailer.crc = ~telemetryCrc(0xFFFFFFFF, &trailer, offsetof(EMMC_TelemetryTrailer, crc));
+
+        if (telemetry_file.write((const uint8_t *)&trailer, sizeof(trailer)) != sizeof(trailer))
+        {
+            write_error = true;
+        }
+        stats.bytes_written += sizeof(trailer);
+    }
+
+    ESP_ERROR err = getError();
+    telemetry_file.close();
+    telemetry_open = false;
+    release();
+    return err;
+}
+
+ESP_ERROR EMMC_TelemetryWriter::getError()
+{
+    if (write_error)
+    {
+        return ESP_ERROR(true, "File write operation failed");
+    }
+
+    return ESP_ERROR();
+}
+
+// -- Worst case: 10 byte time varints, 5 byte value varints
+size_t EMMC_TelemetryWriter::maxBlockBytes(uint16_t channel_count, uint16_t block_samples)
+{
+    return sizeof(EMMC_TelemetryBlockHeader) + (channel_count + 1) * sizeof(uint32_t) + block_samples * 10 +
+           (size_t)channel_count * block_samples * 5 + channel_count * 2 * sizeof(float) +
+           sizeof(EMMC_TelemetryBlockFooter);
+}
+
+bool EMMC_TelemetryWriter::startSample(uint64_t time_us)
+{
+    if (!telemetry_open || write_error)
+    {
+        return false;
+    }
+
+    times[sample_count] = time_us;
+    stats.samples++;
+    stats.raw_bytes += sizeof(uint64_t) + channels * sizeof(uint32_t);
+    return true;
+}
+
+void EMMC_TelemetryWriter::setRange(uint16_t channel, float value)
+{
+    range_min[channel] = min(range_min[channel], value);
+    range_max[channel] = max(range_max[channel], value);
+}
+
+// -- Encode the buffered samples, one column after the other, and write them
+bool EMMC_TelemetryWriter::writeBlock()
+{
+    if (sample_count == 0)
+    {
+        return true;
+    }
+
+    uint32_t start = micros();
+    uint32_t column_bytes[EMMC_TELEMETRY_MAX_CHANNELS + 1];
+    uint8_t *columns_start = encoded + sizeof(EMMC_TelemetryBlockHeader) + (channels + 1) * sizeof(uint32_t);
+    uint8_t *p = columns_start;
+
+    // Time stamps: change of the delta, 0 at a steady rate
+    int64_t previous_delta = 0;
+    for (uint16_t i = 1; i < sample_count; i++)
+    {
+        int64_t delta = (int64_t)(times[i] - times[i - 1]);
+        p = putVarint(p, zigzag(delta - previous_delta));
+        previous_delta = delta;
+    }
+    column_bytes[0] = p - columns_start;
+
+    for (uint16_t c = 0; c < channels; c++)
+    {
+        uint8_t *column_start = p;
+        const uint32_t *column = columns + c * samples_per_block;
+        uint32_t previous = 0;
+
+        for (uint16_t i = 0; i < sample_count; i++)
+        {
+            if (schema[c].type == TELEMETRY_INT32)
+            {
+                p = putVarint(p, zigzag((int64_t)(int32_t)column[i] - (int32_t)previous));
+            }
+            else
+            {
+                p = putVarint(p, column[i] ^ previous);
+            }
+            previous = column[i];
+        }
+        column_bytes[c + 1] = p - column_start;
+    }
+
+    for (uint16_t c = 0; c < channels; c++)
+    {
+        memcpy(p, &range_min[c], sizeof(float));
+        memcpy(p + sizeof(float), &range_max[c], sizeof(float));
+        p += 2 * sizeof(float);
+        range_min[c] = INFINITY;
+        range_max[c] = -INFINITY;
+    }
+
+    EMMC_TelemetryBlockHeader header;
+    header.magic = EMMC_TELEMETRY_BLOCK_MAGIC;
+    header.block_bytes = (p - encoded) + sizeof(EMMC_TelemetryBlockFooter);
+    header.sample_count = sample_count;
+    header.channel_count = channels;
+    memcpy(encoded, &header, sizeof(header));
+    memcpy(encoded + sizeof(header), column_bytes, (channels + 1) * sizeof(uint32_t));
+
+    EMMC_TelemetryBlockFooter footer;
+    footer.first_time_us = times[0];
+    footer.last_time_us = times[sample_count - 1];
+    uint32_t crc = telemetryCrc(0xFFFFFFFF, encoded, p - encoded);
+    footer.crc = ~telemetryCrc(crc, &footer, offsetof(EMMC_TelemetryBlockFooter, crc));
+    memcpy(p, &footer, sizeof(footer));
+
+    uint32_t encoded_at = micros();
+    stats.max_encode_us = max(stats.max_encode_us, encoded_at - start);
+
+    if (telemetry_file.write(encoded, header.block_bytes) != header.block_bytes)
+    {
+        write_error = true;
+        return false;
+    }
+    stats.max_write_us = max(stats.max_write_us, (uint32_t)(micros() - encoded_at));
+
+    EMMC_TelemetryIndexEntry &entry = index[index_count++];
+    entry.offset = file_offset;
+    entry.first_time_us = footer.first_time_us;
+    entry.last_time_us = footer.last_time_us;
+    entry.sample_count = sample_count;
+
+    file_offset += header.block_bytes;
+    stats.bytes_written += header.block_bytes;
+    stats.blocks++;
+    block_count++;
+    sample_count = 0;
+
+    return index_count < EMMC_TELEMETRY_INDEX_BUFFER || writeIndex(false);
+}
+
+// -- While logging, full index buffers go to the side file. On close, the index goes to the end of the file: from the
+// -- side file if there is one, then from RAM
+bool EMMC_TelemetryWriter::writeIndex(bool final)
+{
+    size_t length = index_count * sizeof(EMMC_TelemetryIndexEntry);
+
+    if (!final)
+    {
+        if (!index_file)
+        {
+            index_file = file_system->open(index_path.c_str(), FILE_WRITE);
+        }
+        if (!index_file || index_file.write((const uint8_t *)index, length) != length)
+        {
+            write_error = true;
+            return false;
+        }
+        index_count = 0;
+        return true;
+    }
+
+    if (index_file)
+    {
+        index_file.close();
+        index_file = file_system->open(index_path.c_str(), FILE_READ);
+
+        size_t chunk = maxBlockBytes(channels, samples_per_block);
+        size_t n;
+        while (index_file && (n = index_file.read(encoded, chunk)) > 0)
+        {
+            if (telemetry_file.write(encoded, n) != n)
+            {
+                write_error = true;
+                break;
+            }
+            stats.bytes_written += n;
+        }
+        index_file.close();
+        file_system->remove(index_path.c_str());
+
+        if (write_error)
+        {
+            return false;
+        }
+    }
+
+    if (telemetry_file.write((const uint8_t *)index, length) != length)
+    {
+        write_error = true;
+        return false;
+    }
+    stats.bytes_written += length;
+    index_count = 0;
+    return true;
+}
+
+void EMMC_TelemetryWriter::release()
+{
+    if (index_file)
+    {
+        index_file.close();
+    }
+
+    heap_caps_free(times);
+    heap_caps_free(columns);
+    heap_caps_free(encoded);
+    times = nullptr;
+    columns = nullptr;
+    encoded = nullptr;
+}
+
+//**********************************************     TELEMETRY READER FUNCTIONS DEFINTIONS      *************************************/
+EMMC_TelemetryReader::EMMC_TelemetryReader()
+{
+    source = nullptr;
+    memset(&header, 0, sizeof(header));
+    memset(schema, 0, sizeof(schema));
+    indexed = false;
+    index_offset = 0;
+    block_count = 0;
+    reads = 0;
+}
+
+ESP_ERROR EMMC_TelemetryReader::begin(EMMC_TelemetrySource &telemetry_source)
+{
+    source = &telemetry_source;
+    indexed = false;
+    block_count = 0;
+    scanned.clear();
+    reads = 0;
+
+    if (!readSource(0, &header, sizeof(header)) || header.magic != EMMC_TELEMETRY_MAGIC ||
+        header.version != EMMC_TELEMETRY_VERSION)
+    {
+        return ESP_ERROR(true, "Not a telemetry file");
+    }
+
+    size_t schema_size = header.channel_count * sizeof(EMMC_TelemetryChannel);
+    if (header.channel_count == 0 || header.channel_count > EMMC_TELEMETRY_MAX_CHANNELS ||
+        header.header_size != sizeof(header) + schema_size || !readSource(sizeof(header), schema, schema_size))
+    {
+        return ESP_ERROR(true, "Telemetry header is corrupted");
+    }
+
+    uint32_t crc = telemetryCrc(0xFFFFFFFF, &header, offsetof(EMMC_TelemetryHeader, crc));
+    if (header.crc != ~telemetryCrc(crc, schema, schema_size))
+    {
+        return ESP_ERROR(true, "Telemetry header is corrupted");
+    }
+
+    if (!readIndex() && !scanBlocks())
+    {
+        return ESP_ERROR(true, "Telemetry blocks can't be read");
+    }
+
+    return ESP_ERROR();
+}
+
+bool EMMC_TelemetryReader::getBlockInfo(uint32_t block, EMMC_TelemetryIndexEntry &entry)
+{
+    if (block >= block_count)
+    {
+        return false;
+    }
+
+    if (!indexed)
+    {
+        entry = scanned[block];
+        return true;
+    }
+
+    return readSource(index_offset + (uint64_t)block * sizeof(entry), &entry, sizeof(entry));
+}
+
+uint32_t EMMC_TelemetryReader::findBlock(uint64_t time_us)
+{
+    uint32_t low = 0;
+    uint32_t high = block_count;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        EMMC_TelemetryIndexEntry entry;
+        if (!getBlockInfo(middle, entry))
+        {
+            return block_count;
+        }
+
+        if (entry.last_time_us < time_us)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+bool EMMC_TelemetryReader::getBlockSummary(uint32_t block, float *min, float *max)
+{
+    EMMC_TelemetryIndexEntry entry;
+    EMMC_TelemetryBlockHeader block_header;
+    float ranges[2 * EMMC_TELEMETRY_MAX_CHANNELS];
+    size_t ranges_size = header.channel_count * 2 * sizeof(float);
+
+    if (!getBlockInfo(block, entry) || !readSource(entry.offset, &block_header, sizeof(block_header)) ||
+        !readSource(entry.offset + block_header.block_bytes - sizeof(EMMC_TelemetryBlockFooter) - ranges_size, ranges,
+                    ranges_size))
+    {
+        return false;
+    }
+
+    for (uint16_t c = 0; c < header.channel_count; c++)
+    {
+        min[c] = ranges[2 * c];
+        max[c] = ranges[2 * c + 1];
+    }
+    return true;
+}
+
+bool EMMC_TelemetryReader::readBlock(uint32_t block, uint64_t *times, float *values, uint16_t &sample_count)
+{
+    EMMC_TelemetryIndexEntry entry;
+    sample_count = 0;
+    return getBlockInfo(block, entry) && decodeBlock(entry, times, values, sample_count);
+}
+
+bool EMMC_TelemetryReader::decodeBlock(EMMC_TelemetryIndexEntry &entry,
+                                       uint64_t *times,
+                                       float *values,
+                                       uint16_t &sample_count)
+{
+    if (!loadBlock(entry))
+    {
+        return false;
+    }
+
+    EMMC_TelemetryBlockHeader block_header;
+    uint32_t column_bytes[EMMC_TELEMETRY_MAX_CHANNELS + 1];
+    memcpy(&block_header, block_data.data(), sizeof(block_header));
+    memcpy(column_bytes, block_data.data() + sizeof(block_header), (header.channel_count + 1) * sizeof(uint32_t));
+
+    uint16_t count = block_header.sample_count;
+    if (count == 0 || count > header.block_samples)
+    {
+        return false;
+    }
+
+    // Time stamps
+    const uint8_t *p = block_data.data() + sizeof(block_header) + (header.channel_count + 1) * sizeof(uint32_t);
+    const uint8_t *end = p + column_bytes[0];
+    const uint8_t *block_end = block_data.data() + block_data.size();
+    int64_t delta = 0;
+    uint64_t value;
+
+    times[0] = entry.first_time_us;
+    for (uint16_t i = 1; i < count; i++)
+    {
+        if (end > block_end || (p = getVarint(p, end, value)) == nullptr)
+        {
+            return false;
+        }
+        delta += unzigzag(value);
+        times[i] = times[i - 1] + delta;
+    }
+
+    // Channels
+    for (uint16_t c = 0; c < header.channel_count; c++)
+    {
+        p = end;
+        end = p + column_bytes[c + 1];
+        float *column = values + c * header.block_samples;
+        int64_t previous = 0;
+        uint32_t previous_bits = 0;
+
+        for (uint16_t i = 0; i < count; i++)
+        {
+            if (end > block_end || (p = getVarint(p, end, value)) == nullptr)
+            {
+                return false;
+            }
+
+            if (schema[c].type == TELEMETRY_INT32)
+            {
+                previous += unzigzag(value);
+                column[i] = previous * schema[c].scale + schema[c].offset;
+            }
+            else
+            {
+                previous_bits ^= (uint32_t)value;
+                memcpy(&column[i], &previous_bits, sizeof(float));
+            }
+        }
+    }
+
+    sample_count = count;
+    return true;
+}
+
+uint32_t EMMC_TelemetryReader::exportCSV(Print &output, uint64_t from_us, uint64_t to_us)
+{
+    char text[32];
+    uint32_t rows = 0;
+    std::vector<uint64_t> times(header.block_samples);
+    std::vector<float> values(header.channel_count * header.block_samples);
+
+    output.print("time_us");
+    for (uint16_t c = 0; c < header.channel_count; c++)
+    {
+        snprintf(text, sizeof(text), ",%s", schema[c].name);
+        output.print(text);
+        if (schema[c].unit[0])
+        {
+            snprintf(text, sizeof(text), " [%s]", schema[c].unit);
+            output.print(text);
+        }
+    }
+    output.print("\n");
+
+    uint16_t count;
+    EMMC_TelemetryIndexEntry entry;
+    for (uint32_t block = findBlock(from_us); block < block_count; block++)
+    {
+        if (!getBlockInfo(block, entry) || entry.first_time_us > to_us ||
+            !decodeBlock(entry, times.data(), values.data(), count))
+        {
+            break;
+        }
+
+        for (uint16_t i = 0; i < count; i++)
+        {
+            if (times[i] < from_us || times[i] > to_us)
+            {
+                continue;
+            }
+
+            snprintf(text, sizeof(text), "%llu", (unsigned long long)times[i]);
+            output.print(text);
+            for (uint16_t c = 0; c < header.channel_count; c++)
+            {
+                snprintf(text, sizeof(text), ",%.7g", values[c * header.block_samples + i]);
+                output.print(text);
+            }
+            output.print("\n");
+            rows++;
+        }
+    }
+    return rows;
+}
+
+bool EMMC_TelemetryReader::readSource(uint64_t offset, void *data, size_t length)
+{
+    reads++;
+    return source->read(offset, data, length);
+}
+
+// -- Trailer at the end of the file, pointing at an index that ends right before it
+bool EMMC_TelemetryReader::readIndex()
+{
+    EMMC_TelemetryTrailer trailer;
+    uint64_t size = source->size();
+
+    if (size < header.header_size + sizeof(trailer) || !readSource(size - sizeof(trailer), &trailer, sizeof(trailer)) ||
+        trailer.magic != EMMC_TELEMETRY_INDEX_MAGIC ||
+        trailer.crc != ~telemetryCrc(0xFFFFFFFF, &trailer, offsetof(EMMC_TelemetryTrailer, crc)) ||
+        trailer.index_offset + (uint64_t)trailer.block_count * sizeof(EMMC_TelemetryIndexEntry) + sizeof(trailer) !=
+            size)
+    {
+        return false;
+    }
+
+    index_offset = trailer.index_offset;
+    block_count = trailer.block_count;
+    indexed = true;
+    return true;
+}
+
+// -- No index: walk the blocks, up to the first torn one
+bool EMMC_TelemetryReader::scanBlocks()
+{
+    uint64_t size = source->size();
+    uint64_t offset = header.header_size;
+    EMMC_TelemetryBlockHeader block_header;
+
+    while (offset + sizeof(block_header) <= size && readSource(offset, &block_header, sizeof(block_header)))
+    {
+        if (block_header.magic != EMMC_TELEMETRY_BLOCK_MAGIC ||
+            block_header.channel_count != header.channel_count || offset + block_header.block_bytes > size)
+        {
+            break;
+        }
+
+        EMMC_TelemetryIndexEntry entry;
+        entry.offset = offset;
+        if (!loadBlock(entry))
+        {
+            break;
+        }
+
+        scanned.push_back(entry);
+        block_count = scanned.size();
+        offset += block_header.block_bytes;
+    }
+    return true;
+}
+
+// -- Read the whole block at entry.offset into block_data and check its CRC. Fills the rest of entry
+bool EMMC_TelemetryReader::loadBlock(EMMC_TelemetryIndexEntry &entry)
+{
+    EMMC_TelemetryBlockHeader block_header;
+    size_t minimum = sizeof(block_header) + (header.channel_count + 1) * sizeof(uint32_t) +
+                     header.channel_count * 2 * sizeof(float) + sizeof(EMMC_TelemetryBlockFooter);
+
+    if (!readSource(entry.offset, &block_header, sizeof(block_header)) ||
+        block_header.magic != EMMC_TELEMETRY_BLOCK_MAGIC || block_header.block_bytes < minimum)
+    {
+        return false;
+    }
+
+    block_data.resize(block_header.block_bytes);
+    if (!readSource(entry.offset, block_data.data(), block_data.size()))
+    {
+        return false;
+    }
+
+    EMMC_TelemetryBlockFooter footer;
+    memcpy(&footer, block_data.data() + block_data.size() - sizeof(footer), sizeof(footer));
+    if (footer.crc != ~telemetryCrc(0xFFFFFFFF, block_data.data(), block_data.size() - sizeof(footer.crc)))
+    {
+        return false;
+    }
+
+    entry.first_time_us = footer.first_time_us;
+    entry.last_time_us = footer.last_time_us;
+    entry.sample_count = block_header.sample_count;
+    return true;
+}
+
+// End.
@@ -0,0 +1,324 @@
+#pragma once
+
+/*
+ * Company: ANZE Suspension
+ * File Name: emmc_telemetry.h
+ * Project: ESP32 Utilities EMMC
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 8, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*********************************************************     READ ME    **********************************************************/
+
+// * Binary, column blocked telemetry files. Much smaller than CSV text, and a time window can be pulled out of a
+// * multi GB file with a handful of reads.
+// *
+// * The file starts with an EMMC_TelemetryHeader and the schema of every channel (name, unit, type, scale, offset), so
+// * it describes itself. Samples are then buffered, block_samples at a time, and written as one block per column:
+// *  - time stamps as zigzag varints of the change of their delta, one byte per sample at a steady rate;
+// *  - TELEMETRY_INT32 channels as zigzag varints of the delta from the previous sample. Physical values are stored
+// *    quantized: raw = round((value - offset) / scale);
+// *  - TELEMETRY_FLOAT32 channels losslessly, as varints of the bits XOR the previous sample's bits.
+// * Each block ends with a footer holding the min and max of every channel, its time range and a CRC-32.
+// *
+// * close() appends an index of the blocks (offset and time range of each) and a trailer pointing at it, so a reader
+// * finds the block holding any time with a binary search. The index is kept in RAM EMMC_TELEMETRY_INDEX_BUFFER
+// * entries at a time, and in a side file (path + EMMC_TELEMETRY_INDEX_SUFFIX) beyond that. A file that was never
+// * closed, e.g. after a power loss, has no index: the reader then scans the blocks, and stops at the first torn one.
+// *
+// * EMMC_TelemetryReader reads any EMMC_TelemetrySource: a File on the ESP32, or a file on a PC, see
+// * examples/host/telemetry_export.cpp to export a time range to CSV or to one binary array per channel.
+// * Time stamps must not go backwards.
+
+//*****************************************************     LIBRARY SETTINGS    *****************************************************/
+#define EMMC_TELEMETRY_MAX_CHANNELS 32
+#define EMMC_TELEMETRY_BLOCK_SAMPLES 512 // Samples per block
+#define EMMC_TELEMETRY_INDEX_BUFFER 64   // Index entries kept in RAM before going to the side file
+#define EMMC_TELEMETRY_INDEX_SUFFIX ".idx"
+#define EMMC_TELEMETRY_MAGIC 0x4D4C5445       // "ETLM"
+#define EMMC_TELEMETRY_BLOCK_MAGIC 0x4B4C4245 // "EBLK"
+#define EMMC_TELEMETRY_INDEX_MAGIC 0x58495445 // "ETIX"
+#define EMMC_TELEMETRY_VERSION 1
+
+//*****************************************************        LIBRARIES        *****************************************************/
+#include <Arduino.h>
+#include "FS.h"
+#include <utils.h>
+#include "emmc_memory.h"
+
+#include <vector>
+
+//*****************************************************       DATA TYPES        *****************************************************/
+enum EMMC_TELEMETRY_TYPE : uint8_t
+{
+    TELEMETRY_INT32,   // Quantized: value = raw * scale + offset
+    TELEMETRY_FLOAT32, // Lossless
+};
+
+// -- Channel schema, in the file header. Little endian, like every structure below
+struct __attribute__((packed)) EMMC_TelemetryChannel
+{
+    char name[24]; // Null terminated
+    char unit[8];  // Null terminated
+    uint8_t type;  // EMMC_TELEMETRY_TYPE
+    uint8_t reserved[3];
+    float scale;
+    float offset;
+};
+
+// -- File header, followed by channel_count EMMC_TelemetryChannel
+struct __attribute__((packed)) EMMC_TelemetryHeader
+{
+    uint32_t magic; // EMMC_TELEMETRY_MAGIC
+    uint16_t version;
+    uint16_t channel_count;
+    uint16_t block_samples; // Most samples in a block
+    uint16_t reserved;
+    uint32_t header_size; // This header and the schemas, the first block starts there
+    uint32_t crc;         // CRC-32 of the fields above and the schemas
+};
+
+// -- Block header, followed by uint32_t column sizes (time, then each channel), the columns, a float min and max per
+// -- channel, and the footer
+struct __attribute__((packed)) EMMC_TelemetryBlockHeader
+{
+    uint32_t magic;       // EMMC_TELEMETRY_BLOCK_MAGIC
+    uint32_t block_bytes; // Whole block, footer included
+    uint16_t sample_count;
+    uint16_t channel_count;
+};
+
+struct __attribute__((packed)) EMMC_TelemetryBlockFooter
+{
+    uint64_t first_time_us;
+    uint64_t last_time_us;
+    uint32_t crc; // CRC-32 of the block up to here
+};
+
+// -- Index entry, one per block, in time order
+struct __attribute__((packed)) EMMC_TelemetryIndexEntry
+{
+    uint64_t offset;
+    uint64_t first_time_us;
+    uint64_t last_time_us;
+    uint32_t sample_count;
+};
+
+// -- Last bytes of a closed file
+struct __attribute__((packed)) EMMC_TelemetryTrailer
+{
+    uint32_t magic; // EMMC_TELEMETRY_INDEX_MAGIC
+    uint32_t block_count;
+    uint64_t index_offset;
+    uint32_t crc; // CRC-32 of the fields above
+};
+
+// -- Writer statistics, since begin()
+struct EMMC_TelemetryStats
+{
+    uint64_t samples;
+    uint32_t blocks;
+    uint64_t bytes_written; // Blocks, header, index and trailer
+    uint64_t raw_bytes;     // The same samples as 64 bit time stamps and 32 bit values
+    uint32_t max_encode_us; // Longest block encoding
+    uint32_t max_write_us;  // Longest block write
+};
+
+//**************************************************     TELEMETRY WRITER CLASS    **************************************************/
+class EMMC_TelemetryWriter
+{
+public:
+    EMMC_TelemetryWriter();
+    ~EMMC_TelemetryWriter();
+
+    // -- Schema helper, e.g. channel("fork_travel", "mm", TELEMETRY_INT32, 0.01f)
+    static EMMC_TelemetryChannel channel(const char *name,
+                                         const char *unit,
+                                         EMMC_TELEMETRY_TYPE type = TELEMETRY_FLOAT32,
+                                         float scale = 1.f,
+                                         float offset = 0.f);
+
+    // -- Create the file, replacing any file at path, and write the header
+    ESP_ERROR begin(EMMC_Memory &emmc,
+                    const char *path,
+                    const EMMC_TelemetryChannel *channels,
+                    uint16_t channel_count,
+                    uint16_t block_samples = EMMC_TELEMETRY_BLOCK_SAMPLES);
+
+    ESP_ERROR begin(fs::FS &file_system,
+                    const char *path,
+                    const EMMC_TelemetryChannel *channels,
+                    uint16_t channel_count,
+                    uint16_t block_samples = EMMC_TELEMETRY_BLOCK_SAMPLES);
+
+    // -- One value per channel. Physical values, or raw ones stored as they are in TELEMETRY_INT32 channels. Writes a
+    // -- block when block_samples are buffered. False after a write error
+    bool addSample(uint64_t time_us, const float *values);
+    bool addSample(uint64_t time_us, const int32_t *values);
+
+    // -- Write the samples buffered so far as a shorter block
+    ESP_ERROR flush();
+
+    // -- Flush, write the index and the trailer, free the buffers
+    ESP_ERROR close();
+
+    // -- State Operations
+    bool isOpen()
+    {
+        return telemetry_open;
+    }
+
+    ESP_ERROR getError();
+    EMMC_TelemetryStats getStats()
+    {
+        return stats;
+    }
+
+private:
+    static size_t maxBlockBytes(uint16_t channel_count, uint16_t block_samples);
+
+    bool startSample(uint64_t time_us);
+    void setRange(uint16_t channel, float value);
+    bool writeBlock();
+    bool writeIndex(bool final);
+    void release();
+
+    // -- File
+    fs::FS *file_system;
+    File telemetry_file;
+    File index_file;
+    String index_path;
+    uint64_t file_offset;
+    bool telemetry_open;
+    bool write_error;
+
+    // -- Schema
+    EMMC_TelemetryChannel schema[EMMC_TELEMETRY_MAX_CHANNELS];
+    uint16_t channels;
+    uint16_t samples_per_block;
+
+    // -- Block being filled: time stamps, and raw values or float bits, one column per channel
+    uint64_t *times;
+    uint32_t *columns;
+    uint16_t sample_count;
+    float range_min[EMMC_TELEMETRY_MAX_CHANNELS];
+    float range_max[EMMC_TELEMETRY_MAX_CHANNELS];
+    uint8_t *encoded;
+
+    // -- Index
+    EMMC_TelemetryIndexEntry index[EMMC_TELEMETRY_INDEX_BUFFER];
+    uint16_t index_count;
+    uint32_t block_count;
+
+    EMMC_TelemetryStats stats;
+};
+
+//**************************************************     TELEMETRY READER CLASS    **************************************************/
+// -- Random access to the bytes of a telemetry file
+class EMMC_TelemetrySource
+{
+public:
+    virtual ~EMMC_TelemetrySource() {}
+    virtual uint64_t size() = 0;
+    virtual bool read(uint64_t offset, void *data, size_t length) = 0;
+};
+
+class EMMC_TelemetryFileSource : public EMMC_TelemetrySource
+{
+public:
+    EMMC_TelemetryFileSource(File &file) : source_file(file) {}
+
+    uint64_t size() override
+    {
+        return source_file.size();
+    }
+
+    bool read(uint64_t offset, void *data, size_t length) override
+    {
+        return source_file.seek(offset) && source_file.read((uint8_t *)data, length) == length;
+    }
+
+private:
+    File &source_file;
+};
+
+class EMMC_TelemetryReader
+{
+public:
+    EMMC_TelemetryReader();
+
+    // -- Read the schemas and the index, or scan the blocks if the file was never closed
+    ESP_ERROR begin(EMMC_TelemetrySource &source);
+
+    uint16_t getChannelCount()
+    {
+        return header.channel_count;
+    }
+
+    const EMMC_TelemetryChannel &getChannel(uint16_t channel)
+    {
+        return schema[channel];
+    }
+
+    uint16_t getBlockSamples()
+    {
+        return header.block_samples;
+    }
+
+    uint32_t getBlockCount()
+    {
+        return block_count;
+    }
+
+    // -- False if the index was rebuilt by scanning the blocks
+    bool isIndexed()
+    {
+        return indexed;
+    }
+
+    bool getBlockInfo(uint32_t block, EMMC_TelemetryIndexEntry &entry);
+
+    // -- First block ending at or after time_us, getBlockCount() if none. Binary search on the index
+    uint32_t findBlock(uint64_t time_us);
+
+    // -- Min and max of every channel in a block, from its footer alone
+    bool getBlockSummary(uint32_t block, float *min, float *max);
+
+    // -- Decode a block. values holds getChannelCount() columns of getBlockSamples() physical values
+    bool readBlock(uint32_t block, uint64_t *times, float *values, uint16_t &sample_count);
+
+    // -- Write the samples from_us <= time <= to_us as CSV, with a header line. Returns the rows written
+    uint32_t exportCSV(Print &output, uint64_t from_us = 0, uint64_t to_us = UINT64_MAX);
+
+    // -- Source reads so far, to check the cost of a seek
+    uint32_t getReads()
+    {
+        return reads;
+    }
+
+private:
+    bool readSource(uint64_t offset, void *data, size_t length);
+    bool readIndex();
+    bool scanBlocks();
+    bool loadBlock(EMMC_TelemetryIndexEntry &entry);
+    bool decodeBlock(EMMC_TelemetryIndexEntry &entry, uint64_t *times, float *values, uint16_t &sample_count);
+
+    EMMC_TelemetrySource *source;
+    EMMC_TelemetryHeader header;
+    EMMC_TelemetryChannel schema[EMMC_TELEMETRY_MAX_CHANNELS];
+
+    // -- Index: on the file, or rebuilt in RAM
+    bool indexed;
+    uint64_t index_offset;
+    uint32_t block_count;
+    std::vector<EMMC_TelemetryIndexEntry> scanned;
+
+    std::vector<uint8_t> block_data;
+    uint32_t reads;
+};
+
+// End.
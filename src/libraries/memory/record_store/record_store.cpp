@@ -0,0 +1,694 @@
+/*
+ * Company: ANZE Suspension
+ * File Name: record_store.cpp
+ * Project: ESP32 Utilities Record Store
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 8, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*****************************************************       HEADER FILE       *****************************************************/
+#include "record_store.h"
+
+#define RECORD_STORE_CHUNK_SIZE 64 // Bytes read at once when checking or copying a record
+
+//******************************************     RECORD STORE FUNCTIONS DEFINTIONS      **********************************************/
+RecordStore::RecordStore()
+{
+    flash = nullptr;
+    sector_count = 0;
+    memset(sectors, 0, sizeof(sectors));
+
+    head = NO_SECTOR;
+    head_offset = RECORD_STORE_SECTOR_SIZE;
+    next_sector_sequence = 1;
+    next_record_sequence = 1;
+
+    for (uint16_t key = 0; key < RECORD_STORE_MAX_KEYS; key++)
+    {
+        index[key].address = NO_ADDRESS;
+        index[key].sequence = 0;
+        index[key].length = 0;
+    }
+
+    store_initialized = false;
+    stats = {};
+}
+
+// -- Recover the records from the flash
+ESP_ERROR RecordStore::begin(RecordStoreFlash &record_flash)
+{
+    uint32_t start = micros();
+    uint32_t count = record_flash.size() / RECORD_STORE_SECTOR_SIZE;
+
+    store_initialized = false;
+    stats = {};
+
+    if (count < 3)
+    {
+        return ESP_ERROR(true, "Record store partition is too small, 3 sectors at least");
+    }
+
+    flash = &record_flash;
+    sector_count = min(count, (uint32_t)RECORD_STORE_MAX_SECTORS);
+
+    // -- Without an erased sector power was lost while compacting into the head sector. It only holds copies of
+    // -- records still in the oldest sector, so it is erased and the compaction starts over on the next sector change
+    for (uint8_t pass = 0;; pass++)
+    {
+        if (!recover())
+        {
+            return ESP_ERROR(true, "Couldn't read the record store");
+        }
+
+        if (head == NO_SECTOR)
+        {
+            if (!openSector())
+            {
+                return ESP_ERROR(true, "Couldn't format the record store");
+            }
+            break;
+        }
+
+        if (countErased() > 0)
+        {
+            break;
+        }
+
+        if (pass > 0 || !eraseSector(head))
+        {
+            return ESP_ERROR(true, "Couldn't recover the record store");
+        }
+    }
+
+    store_initialized = true;
+    stats.recovery_us = micros() - start;
+    return ESP_ERROR();
+}
+
+#ifdef ESP_PLATFORM
+ESP_ERROR RecordStore::begin(const char *partition_label)
+{
+    if (!partition.begin(partition_label))
+    {
+        return ESP_ERROR(true, "Couldn't find the record store partition");
+    }
+
+    return begin(partition);
+}
+#endif
+
+// -- Append a record. Skipped if the key already holds the same data
+ESP_ERROR RecordStore::write(uint16_t key, const void *data, uint16_t length)
+{
+    if (!store_initialized)
+    {
+        return ESP_ERROR(true, "Record store is not inititalized");
+    }
+
+    if (key >= RECORD_STORE_MAX_KEYS)
+    {
+        return ESP_ERROR(true, "Record key is out of range");
+    }
+
+    if (length > RECORD_STORE_MAX_LENGTH || (length && data == nullptr))
+    {
+        return ESP_ERROR(true, "Record is too long");
+    }
+
+    uint32_t start = micros();
+
+    if (sameData(key, data, length))
+    {
+        stats.writes_skipped++;
+        return ESP_ERROR();
+    }
+
+    uint32_t size = recordSize(length);
+    uint32_t replaced = contains(key) ? recordSize(index[key].length) : 0;
+    if (getLiveBytes() - replaced + size > getCapacity())
+    {
+        return ESP_ERROR(true, "Record store is full");
+    }
+
+    if (!reserve(size))
+    {
+        return ESP_ERROR(true, "Couldn't make room for the record");
+    }
+
+    RecordStoreRecordHeader header;
+    header.key = key;
+    header.length = length;
+    header.sequence = next_record_sequence++;
+    uint32_t crc = crc32(0xFFFFFFFF, &header, offsetof(RecordStoreRecordHeader, crc));
+    header.crc = ~crc32(crc, data, length);
+
+    // -- Header first: a torn record always fails its CRC
+    uint32_t address = head * RECORD_STORE_SECTOR_SIZE + head_offset;
+    head_offset += size;
+
+    if (!flash->write(address, &header, sizeof(header)) ||
+        (length && !flash->write(address + sizeof(header), data, length)))
+    {
+        // -- Partly programmed, nothing more goes in this sector
+        head_offset = RECORD_STORE_SECTOR_SIZE;
+        return ESP_ERROR(true, "Couldn't write the record");
+    }
+
+    setIndex(header, address);
+    stats.records_written++;
+    stats.bytes_programmed += sizeof(header) + length;
+    stats.max_write_us = max(stats.max_write_us, (uint32_t)(micros() - start));
+    return ESP_ERROR();
+}
+
+// -- Read the latest record of key, up to length bytes
+ESP_ERROR RecordStore::read(uint16_t key, void *data, uint16_t length, uint16_t &bytes_read)
+{
+    bytes_read = 0;
+
+    if (!store_initialized)
+    {
+        return ESP_ERROR(true, "Record store is not inititalized");
+    }
+
+    if (!contains(key))
+    {
+        return ESP_ERROR(true, "Record not found");
+    }
+
+    uint16_t count = min(length, index[key].length);
+    if (count && !flash->read(index[key].address + sizeof(RecordStoreRecordHeader), data, count))
+    {
+        return ESP_ERROR(true, "Couldn't read the record");
+    }
+
+    bytes_read = count;
+    return ESP_ERROR();
+}
+
+bool RecordStore::contains(uint16_t key)
+{
+    return key < RECORD_STORE_MAX_KEYS && index[key].address != NO_ADDRESS;
+}
+
+uint16_t RecordStore::getLength(uint16_t key)
+{
+    return contains(key) ? index[key].length : 0;
+}
+
+uint32_t RecordStore::getSequence(uint16_t key)
+{
+    return contains(key) ? index[key].sequence : 0;
+}
+
+// -- Erase every record
+ESP_ERROR RecordStore::format()
+{
+    if (flash == nullptr)
+    {
+        return ESP_ERROR(true, "Record store is not inititalized");
+    }
+
+    store_initialized = false;
+    for (uint16_t key = 0; key < RECORD_STORE_MAX_KEYS; key++)
+    {
+        index[key].address = NO_ADDRESS;
+    }
+
+    for (uint8_t sector = 0; sector < sector_count; sector++)
+    {
+        if (!eraseSector(sector))
+        {
+            return ESP_ERROR(true, "Couldn't erase the record store");
+        }
+    }
+
+    head = NO_SECTOR;
+    next_sector_sequence = 1;
+    next_record_sequence = 1;
+    if (!openSector())
+    {
+        return ESP_ERROR(true, "Couldn't format the record store");
+    }
+
+    store_initialized = true;
+    return ESP_ERROR();
+}
+
+// -- Compact the oldest sector now, so a later write() doesn't have to
+ESP_ERROR RecordStore::compact()
+{
+    if (!store_initialized)
+    {
+        return ESP_ERROR(true, "Record store is not inititalized");
+    }
+
+    uint8_t oldest = findOldest();
+    if (oldest == NO_SECTOR)
+    {
+        return ESP_ERROR();
+    }
+
+    // -- Not enough room in the head sector: moving to the next one may compact already
+    if (head_offset + sectors[oldest].live > RECORD_STORE_SECTOR_SIZE)
+    {
+        uint32_t compactions = stats.compactions;
+        if (!openSector())
+        {
+            return ESP_ERROR(true, "Couldn't compact the record store");
+        }
+        if (stats.compactions != compactions)
+        {
+            return ESP_ERROR();
+        }
+    }
+
+    if (!compactOldest())
+    {
+        return ESP_ERROR(true, "Couldn't compact the record store");
+    }
+    return ESP_ERROR();
+}
+
+uint32_t RecordStore::getLiveBytes()
+{
+    uint32_t live = 0;
+    for (uint8_t sector = 0; sector < sector_count; sector++)
+    {
+        live += sectors[sector].live;
+    }
+    return live;
+}
+
+// -- One sector is kept erased, and one more worth of room keeps compaction making progress
+uint32_t RecordStore::getCapacity()
+{
+    return sector_count < 3 ? 0 : (sector_count - 2) * (RECORD_STORE_SECTOR_SIZE - sizeof(RecordStoreSectorHeader));
+}
+
+// -- Flash used by a record, header and padding included
+uint32_t RecordStore::recordSize(uint16_t length)
+{
+    return (sizeof(RecordStoreRecordHeader) + length + 3) & ~3UL;
+}
+
+// -- CRC-32 update, start with 0xFFFFFFFF and invert the result
+uint32_t RecordStore::crc32(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= bytes[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return crc;
+}
+
+uint32_t RecordStore::sectorHeaderCrc(const RecordStoreSectorHeader &header)
+{
+    return ~crc32(0xFFFFFFFF, &header, offsetof(RecordStoreSectorHeader, crc));
+}
+
+// -- CRC of a record, its data read from the flash
+uint32_t RecordStore::recordCrc(const RecordStoreRecordHeader &header, uint32_t data_address)
+{
+    uint8_t chunk[RECORD_STORE_CHUNK_SIZE];
+    uint32_t crc = crc32(0xFFFFFFFF, &header, offsetof(RecordStoreRecordHeader, crc));
+
+    for (uint16_t done = 0; done < header.length;)
+    {
+        uint16_t count = min((uint16_t)(header.length - done), (uint16_t)RECORD_STORE_CHUNK_SIZE);
+        if (!flash->read(data_address + done, chunk, count))
+        {
+            return ~header.crc;
+        }
+        crc = crc32(crc, chunk, count);
+        done += count;
+    }
+    return ~crc;
+}
+
+// -- Rebuild the sector table and the index from the flash
+bool RecordStore::recover()
+{
+    uint8_t order[RECORD_STORE_MAX_SECTORS];
+    uint8_t in_use = 0;
+
+    for (uint16_t key = 0; key < RECORD_STORE_MAX_KEYS; key++)
+    {
+        index[key].address = NO_ADDRESS;
+    }
+
+    head = NO_SECTOR;
+    head_offset = RECORD_STORE_SECTOR_SIZE;
+    next_sector_sequence = 1;
+    next_record_sequence = 1;
+    stats.records_recovered = 0;
+    stats.torn_records = 0;
+
+    // -- Sector headers. Sectors neither valid nor erased were being started or erased, and are erased again
+    for (uint8_t sector = 0; sector < sector_count; sector++)
+    {
+        RecordStoreSectorHeader header;
+        if (!flash->read(sector * RECORD_STORE_SECTOR_SIZE, &header, sizeof(header)))
+        {
+            return false;
+        }
+
+        sectors[sector].live = 0;
+        if (header.magic == RECORD_STORE_MAGIC && header.version == RECORD_STORE_VERSION &&
+            header.crc == sectorHeaderCrc(header))
+        {
+            sectors[sector].state = SECTOR_IN_USE;
+            sectors[sector].sequence = header.sequence;
+            next_sector_sequence = max(next_sector_sequence, header.sequence + 1);
+
+            // -- Insert, oldest first
+            uint8_t position = in_use++;
+            for (; position > 0 && sectors[order[position - 1]].sequence > header.sequence; position--)
+            {
+                order[position] = order[position - 1];
+            }
+            order[position] = sector;
+        }
+        else if (isErased(sector))
+        {
+            sectors[sector].state = SECTOR_ERASED;
+        }
+        else
+        {
+            stats.torn_sectors++;
+            if (!eraseSector(sector))
+            {
+                return false;
+            }
+        }
+    }
+
+    // -- Records, oldest sector first. The newest sector is the head
+    for (uint8_t position = 0; position < in_use; position++)
+    {
+        head = order[position];
+        head_offset = scanSector(head);
+    }
+    return true;
+}
+
+// -- Index the valid records of a sector. Returns where the next record goes, the sector size if it is closed
+uint32_t RecordStore::scanSector(uint8_t sector)
+{
+    uint32_t base = sector * RECORD_STORE_SECTOR_SIZE;
+    uint32_t offset = sizeof(RecordStoreSectorHeader);
+
+    while (offset + sizeof(RecordStoreRecordHeader) <= RECORD_STORE_SECTOR_SIZE)
+    {
+        RecordStoreRecordHeader header;
+        if (!flash->read(base + offset, &header, sizeof(header)))
+        {
+            return RECORD_STORE_SECTOR_SIZE;
+        }
+
+        // -- Erased: end of the sector's records
+        const uint8_t *bytes = (const uint8_t *)&header;
+        bool erased = true;
+        for (size_t i = 0; i < sizeof(header) && erased; i++)
+        {
+            erased = bytes[i] == 0xFF;
+        }
+        if (erased)
+        {
+            return offset;
+        }
+
+        // -- Torn by a power loss, its extent can't be trusted
+        uint32_t size = recordSize(header.length);
+        if (header.length > RECORD_STORE_MAX_LENGTH || offset + size > RECORD_STORE_SECTOR_SIZE ||
+            recordCrc(header, base + offset + sizeof(header)) != header.crc)
+        {
+            stats.torn_records++;
+            return RECORD_STORE_SECTOR_SIZE;
+        }
+
+        stats.records_recovered++;
+        next_record_sequence = max(next_record_sequence, header.sequence + 1);
+        setIndex(header, base + offset);
+        offset += size;
+    }
+    return offset;
+}
+
+// -- Point key at the record at address, unless it holds a newer one. Equal sequences are compaction copies
+void RecordStore::setIndex(const RecordStoreRecordHeader &header, uint32_t address)
+{
+    if (header.key >= RECORD_STORE_MAX_KEYS)
+    {
+        return;
+    }
+
+    IndexEntry &entry = index[header.key];
+    if (entry.address != NO_ADDRESS)
+    {
+        if (header.sequence < entry.sequence)
+        {
+            return;
+        }
+        sectors[entry.address / RECORD_STORE_SECTOR_SIZE].live -= recordSize(entry.length);
+    }
+
+    entry.address = address;
+    entry.sequence = header.sequence;
+    entry.length = header.length;
+    sectors[address / RECORD_STORE_SECTOR_SIZE].live += recordSize(header.length);
+}
+
+bool RecordStore::isErased(uint8_t sector)
+{
+    uint8_t chunk[RECORD_STORE_CHUNK_SIZE];
+    uint32_t base = sector * RECORD_STORE_SECTOR_SIZE;
+
+    for (uint32_t offset = 0; offset < RECORD_STORE_SECTOR_SIZE; offset += sizeof(chunk))
+    {
+        if (!flash->read(base + offset, chunk, sizeof(chunk)))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(chunk); i++)
+        {
+            if (chunk[i] != 0xFF)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool RecordStore::eraseSector(uint8_t sector)
+{
+    if (!flash->erase(sector * RECORD_STORE_SECTOR_SIZE, RECORD_STORE_SECTOR_SIZE))
+    {
+        return false;
+    }
+
+    sectors[sector].state = SECTOR_ERASED;
+    sectors[sector].live = 0;
+    stats.sectors_erased++;
+    return true;
+}
+
+// -- Write the header of an erased sector, and make it the head
+bool RecordStore::startSector(uint8_t sector)
+{
+    RecordStoreSectorHeader header;
+    header.magic = RECORD_STORE_MAGIC;
+    header.version = RECORD_STORE_VERSION;
+    header.reserved = 0xFFFF;
+    header.sequence = next_sector_sequence++;
+    header.crc = sectorHeaderCrc(header);
+
+    // -- In use even if the header write fails: it is no longer erased, and will be compacted like any other
+    sectors[sector].state = SECTOR_IN_USE;
+    sectors[sector].sequence = header.sequence;
+    sectors[sector].live = 0;
+    head = sector;
+    head_offset = RECORD_STORE_SECTOR_SIZE;
+
+    if (!flash->write(sector * RECORD_STORE_SECTOR_SIZE, &header, sizeof(header)))
+    {
+        return false;
+    }
+
+    head_offset = sizeof(header);
+    stats.bytes_programmed += sizeof(header);
+    return true;
+}
+
+uint8_t RecordStore::countErased()
+{
+    uint8_t count = 0;
+    for (uint8_t sector = 0; sector < sector_count; sector++)
+    {
+        count += sectors[sector].state == SECTOR_ERASED;
+    }
+    return count;
+}
+
+// -- Next erased sector after the head, so the sectors are used in turn
+uint8_t RecordStore::findErased()
+{
+    uint8_t first = head == NO_SECTOR ? 0 : head + 1;
+    for (uint8_t i = 0; i < sector_count; i++)
+    {
+        uint8_t sector = (first + i) % sector_count;
+        if (sectors[sector].state == SECTOR_ERASED)
+        {
+            return sector;
+        }
+    }
+    return NO_SECTOR;
+}
+
+// -- Sector in use started first, the head excluded
+uint8_t RecordStore::findOldest()
+{
+    uint8_t oldest = NO_SECTOR;
+    for (uint8_t sector = 0; sector < sector_count; sector++)
+    {
+        if (sector != head && sectors[sector].state == SECTOR_IN_USE &&
+            (oldest == NO_SECTOR || sectors[sector].sequence < sectors[oldest].sequence))
+        {
+            oldest = sector;
+        }
+    }
+    return oldest;
+}
+
+// -- Move the head to the next erased sector, and compact if that was the last one
+bool RecordStore::openSector()
+{
+    uint8_t sector = findErased();
+    if (sector == NO_SECTOR || !startSector(sector))
+    {
+        return false;
+    }
+
+    if (countErased() == 0)
+    {
+        return compactOldest();
+    }
+    return true;
+}
+
+// -- Copy the latest records of the oldest sector to the head, then erase it
+bool RecordStore::compactOldest()
+{
+    uint8_t oldest = findOldest();
+    if (oldest == NO_SECTOR)
+    {
+        return false;
+    }
+
+    for (uint16_t key = 0; key < RECORD_STORE_MAX_KEYS; key++)
+    {
+        if (contains(key) && index[key].address / RECORD_STORE_SECTOR_SIZE == oldest && !copyRecord(key))
+        {
+            return false;
+        }
+    }
+
+    if (!eraseSector(oldest))
+    {
+        return false;
+    }
+
+    stats.compactions++;
+    return true;
+}
+
+// -- Copy the latest record of key to the head, sequence number included
+bool RecordStore::copyRecord(uint16_t key)
+{
+    uint8_t chunk[RECORD_STORE_CHUNK_SIZE];
+    uint32_t source = index[key].address;
+    uint32_t size = recordSize(index[key].length);
+
+    RecordStoreRecordHeader header;
+    if (head_offset + size > RECORD_STORE_SECTOR_SIZE || !flash->read(source, &header, sizeof(header)))
+    {
+        return false;
+    }
+
+    uint32_t address = head * RECORD_STORE_SECTOR_SIZE + head_offset;
+    head_offset += size;
+
+    if (!flash->write(address, &header, sizeof(header)))
+    {
+        head_offset = RECORD_STORE_SECTOR_SIZE;
+        return false;
+    }
+
+    for (uint16_t done = 0; done < header.length;)
+    {
+        uint16_t count = min((uint16_t)(header.length - done), (uint16_t)RECORD_STORE_CHUNK_SIZE);
+        if (!flash->read(source + sizeof(header) + done, chunk, count) ||
+            !flash->write(address + sizeof(header) + done, chunk, count))
+        {
+            head_offset = RECORD_STORE_SECTOR_SIZE;
+            return false;
+        }
+        done += count;
+    }
+
+    setIndex(header, address);
+    stats.bytes_programmed += sizeof(header) + header.length;
+    return true;
+}
+
+// -- Make room for size bytes in the head sector. Bounded, in case every record is live
+bool RecordStore::reserve(uint32_t size)
+{
+    for (uint8_t attempt = 0; attempt <= sector_count; attempt++)
+    {
+        if (head != NO_SECTOR && head_offset + size <= RECORD_STORE_SECTOR_SIZE)
+        {
+            return true;
+        }
+
+        if (!openSector())
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+// -- True if the latest record of key holds these bytes already
+bool RecordStore::sameData(uint16_t key, const void *data, uint16_t length)
+{
+    uint8_t chunk[RECORD_STORE_CHUNK_SIZE];
+    if (!contains(key) || index[key].length != length)
+    {
+        return false;
+    }
+
+    uint32_t address = index[key].address + sizeof(RecordStoreRecordHeader);
+    for (uint16_t done = 0; done < length;)
+    {
+        uint16_t count = min((uint16_t)(length - done), (uint16_t)RECORD_STORE_CHUNK_SIZE);
+        if (!flash->read(address + done, chunk, count) || memcmp(chunk, (const uint8_t *)data + done, count) != 0)
+        {
+            return false;
+        }
+        done += count;
+    }
+    return true;
+}
+
+// End.
@@ -0,0 +1,259 @@
+#pragma once
+
+/*
+ * Company: ANZE Suspension
+ * File Name: record_store.h
+ * Project: ESP32 Utilities Record Store
+ * Version: 1.0
+ * Compartible Hardware:
+ * Date Created: September 8, 2021
+ * Last Modified: September 9, 2021
+ *
+ * Copyright 2021, Mateo Segura, All rights reserved.
+ */
+
+//*********************************************************     READ ME    **********************************************************/
+
+// * Crash safe store for small, frequently updated records (odometer, calibration, last known state) on a dedicated
+// * flash partition, instead of rewriting a SPIFFS file on every update.
+// *
+// * The partition is an append-only log. Each record holds a key, a sequence number and a CRC-32, and an update only
+// * writes the new record: O(record), no file system, no whole file rewrite. An in-RAM index keeps the address of the
+// * latest record of each key, so reading it is a single flash read.
+// *
+// * Records are appended to the current sector. When moving to a new sector leaves no erased sector in reserve, the
+// * oldest sector is compacted: its records that are still the latest of their key are copied to the new sector, then
+// * it is erased. Sectors are used in turn, which spreads the erases.
+// *
+// * Power can be lost at any point. begin() scans the partition and recovers the latest valid record of every key: a
+// * torn record fails its CRC and closes its sector, a torn sector header or erase is erased again, and an interrupted
+// * compaction is finished. A write() that returned without error is never lost.
+// *
+// * Add a data partition to the partition table, e.g. "records, data, 0x99, , 0x10000", and call begin("records").
+// * The flash is reached through RecordStoreFlash, so the store can run on a PC on top of a flash emulator (see
+// * examples/host/flash_emulator.h).
+
+//*****************************************************     LIBRARY SETTINGS    *****************************************************/
+#define RECORD_STORE_SECTOR_SIZE 4096 // Flash erase unit
+#define RECORD_STORE_MAX_SECTORS 64   // Largest partition used, in sectors. 3 at least
+#define RECORD_STORE_MAX_KEYS 32      // Keys are 0 to RECORD_STORE_MAX_KEYS - 1
+#define RECORD_STORE_MAX_LENGTH 1024  // Largest record, in bytes
+#define RECORD_STORE_MAGIC 0x53434552 // "RECS"
+#define RECORD_STORE_VERSION 1
+
+//*****************************************************        LIBRARIES        *****************************************************/
+#include <Arduino.h>
+#include <utils.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_partition.h>
+#endif
+
+//*****************************************************       DATA TYPES        *****************************************************/
+// -- Flash access. NOR semantics: write() only clears bits, erase() sets whole sectors to 0xFF
+class RecordStoreFlash
+{
+public:
+    virtual ~RecordStoreFlash() {}
+    virtual uint32_t size() = 0;
+    virtual bool read(uint32_t address, void *data, size_t length) = 0;
+    virtual bool write(uint32_t address, const void *data, size_t length) = 0;
+    virtual bool erase(uint32_t address, size_t length) = 0;
+};
+
+#ifdef ESP_PLATFORM
+// -- A data partition of the SPI flash
+class RecordStorePartition : public RecordStoreFlash
+{
+public:
+    RecordStorePartition()
+    {
+        partition = nullptr;
+    }
+
+    bool begin(const char *label)
+    {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        return partition != nullptr;
+    }
+
+    uint32_t size() override
+    {
+        return partition ? partition->size : 0;
+    }
+
+    bool read(uint32_t address, void *data, size_t length) override
+    {
+        return esp_partition_read(partition, address, data, length) == ESP_OK;
+    }
+
+    bool write(uint32_t address, const void *data, size_t length) override
+    {
+        return esp_partition_write(partition, address, data, length) == ESP_OK;
+    }
+
+    bool erase(uint32_t address, size_t length) override
+    {
+        return esp_partition_erase_range(partition, address, length) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t *partition;
+};
+#endif
+
+// -- Sector header, at the start of every sector in use. Little endian
+struct __attribute__((packed)) RecordStoreSectorHeader
+{
+    uint32_t magic;    // RECORD_STORE_MAGIC
+    uint16_t version;  // RECORD_STORE_VERSION
+    uint16_t reserved; // 0xFFFF
+    uint32_t sequence; // Order the sectors were started in
+    uint32_t crc;      // CRC-32 of the fields above
+};
+
+// -- Record header, followed by length bytes of data, padded with 0xFF to 4 bytes
+struct __attribute__((packed)) RecordStoreRecordHeader
+{
+    uint16_t key;
+    uint16_t length;
+    uint32_t sequence; // Order the records were written in, kept when compaction copies a record
+    uint32_t crc;      // CRC-32 of key, length, sequence and the data
+};
+
+// -- Statistics, since begin()
+struct RecordStoreStats
+{
+    uint32_t records_written;  // By write()
+    uint32_t writes_skipped;   // write() of the value already stored
+    uint32_t bytes_programmed; // Headers and data, compaction copies included
+    uint32_t compactions;
+    uint32_t sectors_erased;
+    uint32_t records_recovered; // Valid records found by begin()
+    uint32_t torn_records;      // Invalid records found by begin(), each one closed its sector
+    uint32_t torn_sectors;      // Sectors begin() found neither valid nor erased, and erased
+    uint32_t recovery_us;       // Time begin() took
+    uint32_t max_write_us;      // Longest write(), compaction included
+};
+
+//*****************************************************    RECORD STORE CLASS   *****************************************************/
+class RecordStore
+{
+public:
+    RecordStore();
+
+    // -- Recover the records from the flash. An empty or foreign partition is formatted
+    ESP_ERROR begin(RecordStoreFlash &flash);
+#ifdef ESP_PLATFORM
+    ESP_ERROR begin(const char *partition_label);
+#endif
+
+    // -- Record Operations
+    ESP_ERROR write(uint16_t key, const void *data, uint16_t length);
+    ESP_ERROR read(uint16_t key, void *data, uint16_t length, uint16_t &bytes_read);
+
+    template <typename T>
+    ESP_ERROR write(uint16_t key, const T &value)
+    {
+        return write(key, &value, sizeof(T));
+    }
+
+    // -- Fails unless the record has exactly the size of T
+    template <typename T>
+    ESP_ERROR read(uint16_t key, T &value)
+    {
+        uint16_t bytes_read;
+        if (getLength(key) != sizeof(T))
+        {
+            return ESP_ERROR(true, "Record size doesn't match");
+        }
+        return read(key, &value, sizeof(T), bytes_read);
+    }
+
+    bool contains(uint16_t key);
+    uint16_t getLength(uint16_t key);
+    uint32_t getSequence(uint16_t key);
+
+    // -- Store Operations
+    ESP_ERROR format();  // Erase every record
+    ESP_ERROR compact(); // Compact the oldest sector now, e.g. while idle
+
+    uint32_t getLiveBytes(); // Flash used by the latest records, headers included
+    uint32_t getCapacity();  // Live bytes the store can hold
+    RecordStoreStats getStats()
+    {
+        return stats;
+    }
+
+    bool isInitialized()
+    {
+        return store_initialized;
+    }
+
+private:
+    // -- Sector states
+    enum SECTOR_STATE : uint8_t
+    {
+        SECTOR_ERASED,
+        SECTOR_IN_USE,
+    };
+
+    struct Sector
+    {
+        SECTOR_STATE state;
+        uint32_t sequence;
+        uint32_t live; // Bytes of records that are the latest of their key
+    };
+
+    struct IndexEntry
+    {
+        uint32_t address; // NO_ADDRESS if the key has no record
+        uint32_t sequence;
+        uint16_t length;
+    };
+
+    static const uint32_t NO_ADDRESS = 0xFFFFFFFF;
+    static const uint8_t NO_SECTOR = 0xFF;
+
+    static uint32_t recordSize(uint16_t length);
+    static uint32_t crc32(uint32_t crc, const void *data, size_t length);
+    static uint32_t sectorHeaderCrc(const RecordStoreSectorHeader &header);
+    uint32_t recordCrc(const RecordStoreRecordHeader &header, uint32_t data_address);
+
+    bool recover();
+    uint32_t scanSector(uint8_t sector);
+    bool isErased(uint8_t sector);
+    bool eraseSector(uint8_t sector);
+    bool startSector(uint8_t sector);
+    void setIndex(const RecordStoreRecordHeader &header, uint32_t address);
+    uint8_t countErased();
+    uint8_t findErased();
+    uint8_t findOldest();
+    bool openSector();
+    bool compactOldest();
+    bool copyRecord(uint16_t key);
+    bool reserve(uint32_t size);
+    bool sameData(uint16_t key, const void *data, uint16_t length);
+
+    // -- Flash
+    RecordStoreFlash *flash;
+#ifdef ESP_PLATFORM
+    RecordStorePartition partition;
+#endif
+    uint8_t sector_count;
+    Sector sectors[RECORD_STORE_MAX_SECTORS];
+
+    // -- Log head
+    uint8_t head;
+    uint32_t head_offset;
+    uint32_t next_sector_sequence;
+    uint32_t next_record_sequence;
+
+    // -- Index
+    IndexEntry index[RECORD_STORE_MAX_KEYS];
+
+    bool store_initialized;
+    RecordStoreStats stats;
+};
+
+// End.
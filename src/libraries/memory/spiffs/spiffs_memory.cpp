@@ -55,16 +55,200 @@ ESP_ERROR SPIFFS_Memory::readFile(const char *path, String &file_content)
             temp_message += "\" for reading";
         }
 
-        // If filed opened correctly
+        // If filed opened correctly, reserve the String once and read in bursts
+        else
+        {
+            char chunk[SPIFFS_STRING_CHUNK_SIZE + 1];
+            size_t n;
+
+            file_content.reserve(file_content.length() + file.size());
+            while ((n = file.read((uint8_t *)chunk, SPIFFS_STRING_CHUNK_SIZE)) > 0)
+            {
+                chunk[n] = '\0';
+                file_content += chunk;
+            }
+
+            file.close();
+        }
+    }
+    else
+    {
+        err.on_error = true;
+        temp_message += "SPIFFS is not inititalized";
+    }
+
+    err.debug_message = temp_message;
+    return err;
+}
+
+ESP_ERROR SPIFFS_Memory::readFile(const char *path, uint8_t *buffer, size_t length, size_t &bytes_read, size_t offset)
+{
+    ESP_ERROR err;
+    err.on_error = false;
+
+    String temp_message;
+    bytes_read = 0;
+
+    if (spiffs_initialized)
+    {
+        File file = file_system->open(path);
+
+        // Error opening file
+        if (!file)
+        {
+            err.on_error = true;
+            temp_message += "Failed to open file \"";
+            temp_message += path;
+            temp_message += "\" for reading";
+        }
+
+        // If filed opened correctly, read from offset in as few calls as possible
+        else
+        {
+            if (offset > file.size() || !file.seek(offset))
+            {
+                err.on_error = true;
+                temp_message += "Offset is past the end of the file";
+            }
+            else
+            {
+                size_t expected = min(length, (size_t)(file.size() - offset));
+                size_t n;
+                while (bytes_read < expected && (n = file.read(buffer + bytes_read, expected - bytes_read)) > 0)
+                {
+                    bytes_read += n;
+                }
+
+                if (bytes_read != expected)
+                {
+                    err.on_error = true;
+                    temp_message += "File read operation failed";
+                }
+            }
+
+            file.close();
+        }
+    }
+    else
+    {
+        err.on_error = true;
+        temp_message += "SPIFFS is not inititalized";
+    }
+
+    err.debug_message = temp_message;
+    return err;
+}
+
+ESP_ERROR SPIFFS_Memory::readFile(const char *path, FileReadCallback callback, size_t chunk_size)
+{
+    uint8_t *buffer = (uint8_t *)malloc(chunk_size);
+    if (buffer == nullptr)
+    {
+        return ESP_ERROR(true, "Not enough memory for the read buffer");
+    }
+
+    ESP_ERROR err = readFile(path, callback, buffer, chunk_size);
+    free(buffer);
+    return err;
+}
+
+ESP_ERROR SPIFFS_Memory::readFile(const char *path, FileReadCallback callback, uint8_t *buffer, size_t buffer_size)
+{
+    ESP_ERROR err;
+    err.on_error = false;
+
+    String temp_message;
+
+    if (spiffs_initialized)
+    {
+        File file = file_system->open(path);
+
+        // Error opening file
+        if (!file)
+        {
+            err.on_error = true;
+            temp_message += "Failed to open file \"";
+            temp_message += path;
+            temp_message += "\" for reading";
+        }
+
+        // If filed opened correctly, hand the file to the callback one chunk at a time
+        else
+        {
+            size_t expected = file.size();
+            size_t total = 0;
+            bool stopped = false;
+            size_t n;
+
+            while (!stopped && (n = file.read(buffer, buffer_size)) > 0)
+            {
+                total += n;
+                stopped = !callback(buffer, n);
+            }
+
+            if (!stopped && total != expected)
+            {
+                err.on_error = true;
+                temp_message += "File read operation failed";
+            }
+
+            file.close();
+        }
+    }
+    else
+    {
+        err.on_error = true;
+        temp_message += "SPIFFS is not inititalized";
+    }
+
+    err.debug_message = temp_message;
+    return err;
+}
+
+ESP_ERROR SPIFFS_Memory::readFileInto(const char *path, uint8_t *buffer, size_t length, size_t &bytes_read)
+{
+    ESP_ERROR err;
+    err.on_error = false;
+
+    String temp_message;
+    bytes_read = 0;
+
+    if (spiffs_initialized)
+    {
+        File file = file_system->open(path);
+
+        // Error opening file
+        if (!file)
+        {
+            err.on_error = true;
+            temp_message += "Failed to open file \"";
+            temp_message += path;
+            temp_message += "\" for reading";
+        }
+
+        // If filed opened correctly, read all of it with a single call
         else
         {
-            //TODO: Implement serial burst read
-            // err.on_error = true;
-            // err.debug_message = "Serial file download has not been implemented yet";
-            // Serial.begin(115200);
-            while (file.available())
+            size_t expected = file.size();
+
+            if (expected > length)
             {
-                file_content += (char)file.read();
+                err.on_error = true;
+                temp_message += "File is larger than the buffer";
+            }
+            else
+            {
+                size_t n;
+                while (bytes_read < expected && (n = file.read(buffer + bytes_read, expected - bytes_read)) > 0)
+                {
+                    bytes_read += n;
+                }
+
+                if (bytes_read != expected)
+                {
+                    err.on_error = true;
+                    temp_message += "File read operation failed";
+                }
             }
 
             file.close();
@@ -242,15 +426,32 @@ ESP_ERROR SPIFFS_Memory::deleteFile(const char *path)
 }
 
 ESP_ERROR SPIFFS_Memory::readJSON(const char *path, JsonDocument &json_document)
+{
+    return readJSON(path, json_document, nullptr);
+}
+
+ESP_ERROR SPIFFS_Memory::readJSON(const char *path, JsonDocument &json_document, JsonDocument &filter)
+{
+    return readJSON(path, json_document, &filter);
+}
+
+// -- Parse straight from the file. If only the temporary file of an interrupted writeJSON exists, it is complete: read
+// -- it and put it in place
+ESP_ERROR SPIFFS_Memory::readJSON(const char *path, JsonDocument &json_document, JsonDocument *filter)
 {
     ESP_ERROR err;
     err.on_error = false;
 
     String temp_message;
+    uint32_t start = micros();
+    uint32_t free_heap = ESP.getFreeHeap();
+    json_stats = {};
 
     if (spiffs_initialized)
     {
-        File file = file_system->open(path);
+        String temp_path = String(path) + SPIFFS_JSON_TEMP_SUFFIX;
+        bool recovering = !file_system->exists(path) && file_system->exists(temp_path.c_str());
+        File file = file_system->open(recovering ? temp_path.c_str() : path);
 
         // Error opening file
         if (!file)
@@ -264,13 +465,35 @@ ESP_ERROR SPIFFS_Memory::readJSON(const char *path, JsonDocument &json_document)
         // If filed opened correctly
         else
         {
-            DeserializationError error = deserializeJson(json_document, file);
+            SPIFFS_BufferedReader reader(file);
+            DeserializationError error;
+            if (filter)
+            {
+                error = deserializeJson(json_document, reader, DeserializationOption::Filter(*filter));
+            }
+            else
+            {
+                error = deserializeJson(json_document, reader);
+            }
+            file.close();
 
             if (error)
             {
                 err.on_error = true;
-                temp_message += "DeserializationError error code: " + String(error.code());
+                temp_message += "DeserializationError error code: " + String(error.c_str());
             }
+            else if (recovering && !file_system->rename(temp_path.c_str(), path))
+            {
+                err.on_error = true;
+                temp_message += "Failed to rename file \"";
+                temp_message += temp_path;
+                temp_message += "\"";
+            }
+
+            json_stats.file_bytes = reader.getBytesRead();
+            json_stats.document_bytes = json_document.memoryUsage();
+            json_stats.buffer_bytes = SPIFFS_JSON_BUFFER_SIZE;
+            json_stats.heap_used_bytes = free_heap - min(free_heap, reader.getLowestFreeHeap());
         }
     }
     else
@@ -279,53 +502,72 @@ ESP_ERROR SPIFFS_Memory::readJSON(const char *path, JsonDocument &json_document)
         temp_message += "SPIFFS is not inititalized";
     }
 
+    json_stats.duration_us = micros() - start;
     err.debug_message = temp_message;
     return err;
 }
 
+// -- Serialize straight into a temporary file, then replace the old one with it
 ESP_ERROR SPIFFS_Memory::writeJSON(const char *path, JsonDocument &json_document)
 {
     ESP_ERROR err;
     err.on_error = false;
 
     String temp_message;
+    uint32_t start = micros();
+    uint32_t free_heap = ESP.getFreeHeap();
+    json_stats = {};
 
     if (spiffs_initialized)
     {
-        File file = file_system->open(path);
+        String temp_path = String(path) + SPIFFS_JSON_TEMP_SUFFIX;
+        File file = file_system->open(temp_path.c_str(), FILE_WRITE);
 
         // Error opening file
         if (!file)
         {
             err.on_error = true;
             temp_message += "Failed to open file \"";
-            temp_message += path;
+            temp_message += temp_path;
             temp_message += "\" for writting";
         }
 
-        // If filed opened correctly then delete it, and rewrite the contents
+        // If filed opened correctly, write it whole before touching the old file
         else
         {
-            String json_string;
-            serializeJson(json_document, json_string);
+            SPIFFS_BufferedWriter writer(file);
+            serializeJson(json_document, writer);
+            writer.flush();
+            bool written = !writer.getWriteError();
+            file.close();
 
-            ESP_ERROR delete_json = deleteFile(path);
+            if (!written)
+            {
+                file_system->remove(temp_path.c_str());
+                err.on_error = true;
+                temp_message += "File write operation failed";
+            }
 
-            if (delete_json.on_error)
+            // SPIFFS doesn't rename over an existing file
+            else if (file_system->exists(path) && !file_system->remove(path))
             {
                 err.on_error = true;
-                err.debug_message = delete_json.debug_message;
+                temp_message += "Failed to delete file \"";
+                temp_message += path;
+                temp_message += "\"";
             }
-            else
+            else if (!file_system->rename(temp_path.c_str(), path))
             {
-                ESP_ERROR write_json = writeFile(path, json_string.c_str());
-
-                if (write_json.on_error)
-                {
-                    err.on_error = true;
-                    err.debug_message = write_json.debug_message;
-                }
+                err.on_error = true;
+                temp_message += "Failed to rename file \"";
+                temp_message += temp_path;
+                temp_message += "\"";
             }
+
+            json_stats.file_bytes = writer.getBytesWritten();
+            json_stats.document_bytes = json_document.memoryUsage();
+            json_stats.buffer_bytes = SPIFFS_JSON_BUFFER_SIZE;
+            json_stats.heap_used_bytes = free_heap - min(free_heap, writer.getLowestFreeHeap());
         }
     }
     else
@@ -334,7 +576,108 @@ ESP_ERROR SPIFFS_Memory::writeJSON(const char *path, JsonDocument &json_document
         temp_message += "SPIFFS is not inititalized";
     }
 
+    json_stats.duration_us = micros() - start;
     err.debug_message = temp_message;
     return err;
 }
+
+//*******************************************     BUFFERED FILE FUNCTIONS DEFINTIONS      *******************************************/
+SPIFFS_BufferedWriter::SPIFFS_BufferedWriter(File &file) : buffered_file(file)
+{
+    buffer_fill = 0;
+    bytes_written = 0;
+    lowest_free_heap = ESP.getFreeHeap();
+}
+
+size_t SPIFFS_BufferedWriter::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+size_t SPIFFS_BufferedWriter::write(const uint8_t *data, size_t length)
+{
+    size_t done = 0;
+    while (done < length && !getWriteError())
+    {
+        size_t count = min(length - done, (size_t)(SPIFFS_JSON_BUFFER_SIZE - buffer_fill));
+        memcpy(buffer + buffer_fill, data + done, count);
+        buffer_fill += count;
+        done += count;
+
+        if (buffer_fill == SPIFFS_JSON_BUFFER_SIZE)
+        {
+            flush();
+        }
+    }
+    return getWriteError() ? 0 : length;
+}
+
+void SPIFFS_BufferedWriter::flush()
+{
+    lowest_free_heap = min(lowest_free_heap, ESP.getFreeHeap());
+    if (buffer_fill && !getWriteError())
+    {
+        if (buffered_file.write(buffer, buffer_fill) != buffer_fill)
+        {
+            setWriteError();
+        }
+        else
+        {
+            bytes_written += buffer_fill;
+        }
+    }
+    buffer_fill = 0;
+}
+
+SPIFFS_BufferedReader::SPIFFS_BufferedReader(File &file) : buffered_file(file)
+{
+    buffer_fill = 0;
+    buffer_position = 0;
+    bytes_read = 0;
+    lowest_free_heap = ESP.getFreeHeap();
+}
+
+int SPIFFS_BufferedReader::available()
+{
+    return (buffer_fill - buffer_position) + buffered_file.available();
+}
+
+int SPIFFS_BufferedReader::read()
+{
+    return refill() ? buffer[buffer_position++] : -1;
+}
+
+int SPIFFS_BufferedReader::peek()
+{
+    return refill() ? buffer[buffer_position] : -1;
+}
+
+size_t SPIFFS_BufferedReader::readBytes(char *data, size_t length)
+{
+    size_t done = 0;
+    while (done < length && refill())
+    {
+        size_t count = min(length - done, buffer_fill - buffer_position);
+        memcpy(data + done, buffer + buffer_position, count);
+        buffer_position += count;
+        done += count;
+    }
+    return done;
+}
+
+// -- True if there is data in the buffer, reading the next burst if needed
+bool SPIFFS_BufferedReader::refill()
+{
+    if (buffer_position < buffer_fill)
+    {
+        return true;
+    }
+
+    lowest_free_heap = min(lowest_free_heap, ESP.getFreeHeap());
+    buffer_fill = buffered_file.read(buffer, SPIFFS_JSON_BUFFER_SIZE);
+    buffer_position = 0;
+    bytes_read += buffer_fill;
+    return buffer_fill > 0;
+}
+
 // End.
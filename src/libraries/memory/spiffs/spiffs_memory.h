@@ -20,10 +20,19 @@
 // *
 // * https://github.com/espressif/arduino-esp32/tree/master/libraries/SPIFFS
 // *
+// * JSON files are streamed: writeJSON serializes straight into the file through a small buffer, and readJSON parses
+// * from the file through another one, so no copy of the text is ever held in RAM. writeJSON writes a temporary file
+// * (path + SPIFFS_JSON_TEMP_SUFFIX) and only replaces the old file once it is complete; if power is lost in between,
+// * readJSON picks up the temporary file. Keep JSON paths short enough for the suffix, SPIFFS allows 31 characters.
+// * Pass a filter document to readJSON to only keep the parts of the file you need, see
+// * https://arduinojson.org/v6/how-to/deserialize-a-very-large-document/
 // *
 
 //*****************************************************     LIBRARY SETTINGS    *****************************************************/
-//None.
+#define SPIFFS_READ_CHUNK_SIZE 4096  // Chunk size of callback reads
+#define SPIFFS_STRING_CHUNK_SIZE 256 // Chunk size of reads into a String, on the stack
+#define SPIFFS_JSON_BUFFER_SIZE 256  // Buffer between ArduinoJson and the file, on the stack. One SPIFFS page
+#define SPIFFS_JSON_TEMP_SUFFIX ".tmp"
 
 //*****************************************************        LIBRARIES        *****************************************************/
 #include <Arduino.h>
@@ -32,6 +41,82 @@
 #include <ArduinoJson.h>
 
 //*****************************************************       DATA TYPES        *****************************************************/
+// -- Statistics of the last readJSON or writeJSON call
+struct SPIFFS_JSONStats
+{
+    size_t file_bytes;        // Bytes read or written
+    size_t document_bytes;    // Memory used in the JsonDocument
+    size_t buffer_bytes;      // Buffer between ArduinoJson and the file
+    uint32_t heap_used_bytes; // Largest drop of the free heap, sampled at every buffer refill or flush
+    uint32_t duration_us;
+};
+
+// -- Buffered Print to a File, ArduinoJson writes one character at a time
+class SPIFFS_BufferedWriter : public Print
+{
+public:
+    SPIFFS_BufferedWriter(File &file);
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *data, size_t length) override;
+    using Print::write;
+    void flush() override;
+
+    size_t getBytesWritten()
+    {
+        return bytes_written;
+    }
+
+    uint32_t getLowestFreeHeap()
+    {
+        return lowest_free_heap;
+    }
+
+private:
+    File &buffered_file;
+    uint8_t buffer[SPIFFS_JSON_BUFFER_SIZE];
+    size_t buffer_fill;
+    size_t bytes_written;
+    uint32_t lowest_free_heap;
+};
+
+// -- Buffered Stream from a File, ArduinoJson reads one character at a time
+class SPIFFS_BufferedReader : public Stream
+{
+public:
+    SPIFFS_BufferedReader(File &file);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char *data, size_t length) override;
+    using Stream::readBytes;
+    size_t write(uint8_t) override
+    {
+        return 0;
+    }
+    void flush() override {}
+
+    size_t getBytesRead()
+    {
+        return bytes_read;
+    }
+
+    uint32_t getLowestFreeHeap()
+    {
+        return lowest_free_heap;
+    }
+
+private:
+    bool refill();
+
+    File &buffered_file;
+    uint8_t buffer[SPIFFS_JSON_BUFFER_SIZE];
+    size_t buffer_fill;
+    size_t buffer_position;
+    size_t bytes_read;
+    uint32_t lowest_free_heap;
+};
 
 //*****************************************************       EMMC CLASS        *****************************************************/
 class SPIFFS_Memory
@@ -41,10 +126,19 @@ public:
     ESP_ERROR begin();
 
     //File Operations
-    ESP_ERROR readFile(const char *path, String &file_content);
+    ESP_ERROR readFile(const char *path, String &file_content); // Text files, appended to file_content
+    ESP_ERROR readFile(const char *path, uint8_t *buffer, size_t length, size_t &bytes_read, size_t offset = 0);
+    ESP_ERROR readFile(const char *path, FileReadCallback callback, size_t chunk_size = SPIFFS_READ_CHUNK_SIZE);
+    ESP_ERROR readFile(const char *path, FileReadCallback callback, uint8_t *buffer, size_t buffer_size);
+    ESP_ERROR readFileInto(const char *path, uint8_t *buffer, size_t length, size_t &bytes_read); // Whole file
 
     ESP_ERROR readJSON(const char *path, JsonDocument &json_document);
-    ESP_ERROR writeJSON(const char *path, JsonDocument &json_document);
+    ESP_ERROR readJSON(const char *path, JsonDocument &json_document, JsonDocument &filter); // Only what filter keeps
+    ESP_ERROR writeJSON(const char *path, JsonDocument &json_document);                     // Replaced atomically
+    SPIFFS_JSONStats getJSONStats()
+    {
+        return json_stats;
+    }
 
     ESP_ERROR writeFile(const char *path, const char *message);
     ESP_ERROR appendFile(const char *path, const char *message);
@@ -63,6 +157,8 @@ public:
     }
 
 private:
+    ESP_ERROR readJSON(const char *path, JsonDocument &json_document, JsonDocument *filter);
+
     // -- Memory Info
     long spiffs_memory_size;
     long spiffs_total_memory_space;
@@ -73,6 +169,9 @@ private:
 
     // -- File system
     fs::FS *file_system;
+
+    // -- JSON
+    SPIFFS_JSONStats json_stats;
 };
 
 // End.
\ No newline at end of file
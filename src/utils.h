@@ -13,6 +13,7 @@
 
 //*****************************************************        LIBRARIES        *****************************************************/
 #include <Arduino.h>
+#include <functional>
 
 //*****************************************************       DATA TYPES        *****************************************************/
 
@@ -35,6 +36,9 @@ public:
     String debug_message;
 };
 
+// -- Chunked file reads (EMMC_Memory, SPIFFS_Memory): called with each chunk read, in order. Return false to stop
+typedef std::function<bool(const uint8_t *data, size_t length)> FileReadCallback;
+
 class DateTime
 {
 public: